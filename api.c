@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "simanalysis.h"
+#include "ast.h"
+#include "canonical.h"
+#include "dependence.h"
+#include "stride.h"
+#include "complexity.h"
+#include "resultcache.h"
+#include "functionindex.h"
+#include "incremental.h"
+#include "parallelparse.h"
+#include "stats.h"
+#include "trace.h"
+#include "simalloc.h"
+#include "simdlexer.h"
+#include "hashcons.h"
+#include "budget.h"
+#include "approximate.h"
+
+struct SimContext {
+    char error[256];
+    unsigned long programsParsed;
+    unsigned long comparisons;
+};
+
+struct SimProgram {
+    char* name;
+    ASTNode* root;
+    uint64_t contentHash;  // Of the source bytes, for the result cache
+    AllocAccount* memory;  // Its parse and its comparisons; NULL unless accounting is on
+};
+
+struct SimHistory {
+    RevisionParser* parser;
+    FunctionPairCache* pairs;
+    AllocAccount* memory;  // Cached chunk trees and every revision parsed through the history
+};
+
+struct SimResult {
+    int score;
+    int degraded;  // The comparison ran out of budget and the score is an estimate
+    int estimated; // Sampled (sim_approximate_set); low and high bound its 95% interval
+    int low, high;
+    MatchTable* table;
+};
+
+static void setError(SimContext* context, const char* format, ...) {
+    if (!context) return;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(context->error, sizeof(context->error), format, args);
+    va_end(args);
+}
+
+int sim_api_version(void) {
+    return SIM_API_VERSION;
+}
+
+SimContext* sim_context_create(void) {
+    SimContext* context = calloc(1, sizeof(SimContext));
+    if (!context) {
+        fprintf(stderr, "Memory allocation failed for analysis context.\n");
+    }
+    return context;
+}
+
+void sim_context_free(SimContext* context) {
+    free(context);
+}
+
+const char* sim_last_error(const SimContext* context) {
+    return context ? context->error : "no context";
+}
+
+// Everything compareASTs would otherwise compute lazily is done here, so a
+// program is never written to again and can be shared between threads
+static SimProgram* wrapProgram(SimContext* context, const char* name, ASTNode* root, uint64_t hash) {
+    if (!root) {
+        setError(context, "parsing failed for %s", name);
+        return NULL;
+    }
+    canonicalizeAST(root);
+    shareExpressions(root);
+    analyzeDependences(root);
+    analyzeCost(root);
+
+    SimProgram* program = calloc(1, sizeof(SimProgram));
+    if (!program || !(program->name = strdup(name))) {
+        setError(context, "out of memory");
+        free(program);
+        freeASTNode(root);
+        return NULL;
+    }
+    program->root = root;
+    program->contentHash = hash;
+    context->programsParsed++;
+    context->error[0] = '\0';
+    return program;
+}
+
+// A parse that failed still closes its account, so its leaks are reported
+static SimProgram* accountFor(SimProgram* program, AllocAccount* memory, AllocAccount* previous) {
+    enterAllocAccount(previous);
+    if (program) program->memory = memory;
+    else closeAllocAccount(memory);
+    return program;
+}
+
+SimProgram* sim_parse_from_buffer(SimContext* context, const char* name, const char* source, size_t length) {
+    if (!context || !source) {
+        setError(context, "invalid arguments");
+        return NULL;
+    }
+    if (!name) name = "buffer";
+    AllocAccount* memory = createAllocAccount(name);
+    AllocAccount* previous = enterAllocAccount(memory);
+    SimProgram* program = wrapProgram(context, name, parseBuffer(name, source, length), contentHash(source, length));
+    return accountFor(program, memory, previous);
+}
+
+SimProgram* sim_parse_file(SimContext* context, const char* path) {
+    if (!context || !path) {
+        setError(context, "invalid arguments");
+        return NULL;
+    }
+    // Read once: the same bytes are parsed and hashed. Large files are parsed on several threads.
+    size_t length = 0;
+    char* source = readSourceFile(path, &length);
+    if (!source) {
+        setError(context, "cannot read %s", path);
+        return NULL;
+    }
+    AllocAccount* memory = createAllocAccount(path);
+    AllocAccount* previous = enterAllocAccount(memory);
+    ASTNode* root = parseBufferParallel(path, source, length, PARALLEL_PARSE_DEFAULT_WORKERS);
+    SimProgram* program = wrapProgram(context, path, root, contentHash(source, length));
+    simFree(source);
+    return accountFor(program, memory, previous);
+}
+
+void sim_program_free(SimProgram* program) {
+    if (!program) return;
+    freeASTNode(program->root);
+    closeAllocAccount(program->memory);
+    free(program->name);
+    free(program);
+}
+
+int sim_program_memory(const SimProgram* program, size_t* live_bytes, size_t* peak_bytes) {
+    if (!program || !program->memory) return 0;
+    allocAccountUsage(program->memory, live_bytes, peak_bytes, NULL);
+    return 1;
+}
+
+const char* sim_program_name(const SimProgram* program) {
+    return program ? program->name : NULL;
+}
+
+static SimResult* compareWith(SimContext* context, const SimProgram* reference, const SimProgram* submission,
+                              FunctionPairCache* pairs) {
+    if (!context || !reference || !submission) {
+        setError(context, "invalid arguments");
+        return NULL;
+    }
+
+    // Comparison memory, the match table included, is charged to the submission
+    AllocAccount* previous = submission->memory ? enterAllocAccount(submission->memory) : currentAllocAccount();
+    SimResult* result = calloc(1, sizeof(SimResult));
+    MatchTable* table = initializeMatchTable();
+    if (!result || !table) {
+        setError(context, "out of memory");
+        free(result);
+        if (table) finalizeMatchTable(table);
+        enterAllocAccount(previous);
+        return NULL;
+    }
+
+    result->table = table;
+    result->score = compareASTsIncremental(reference->root, submission->root, table, pairs);
+    result->degraded = lastPairDegraded();
+    result->estimated = lastPairInterval(&result->low, &result->high);
+    enterAllocAccount(previous);
+    context->comparisons++;
+    context->error[0] = '\0';
+    return result;
+}
+
+SimResult* sim_compare(SimContext* context, const SimProgram* reference, const SimProgram* submission) {
+    return compareWith(context, reference, submission, NULL);
+}
+
+void sim_result_free(SimResult* result) {
+    if (!result) return;
+    finalizeMatchTable(result->table);
+    free(result);
+}
+
+int sim_result_score(const SimResult* result) {
+    return result ? result->score : 0;
+}
+
+int sim_result_degraded(const SimResult* result) {
+    return result ? result->degraded : 0;
+}
+
+int sim_result_interval(const SimResult* result, int* low, int* high) {
+    if (!result || !result->estimated) return 0;
+    if (low) *low = result->low;
+    if (high) *high = result->high;
+    return 1;
+}
+
+int sim_result_match_count(const SimResult* result) {
+    return result ? result->table->count : 0;
+}
+
+int sim_result_match(const SimResult* result, int index, SimMatch* match) {
+    if (!result || !match || index < 0 || index >= result->table->count) return 0;
+
+    MatchEntry* entry = &result->table->entries[index];
+    match->name1 = entry->nodeName1;
+    match->name2 = entry->nodeName2;
+    match->details = entry->details;
+    match->totalScore = entry->totalScore;
+    match->dimensionsMatch = entry->dimensionsMatch;
+    match->initializationMatch = entry->initializationMatch;
+    match->indexMatch = entry->indexMatch;
+    return 1;
+}
+
+SimCache* sim_cache_open(SimContext* context, const char* path, unsigned int max_entries) {
+    if (!context || !path) {
+        setError(context, "invalid arguments");
+        return NULL;
+    }
+    ResultCache* cache = openResultCache(path, max_entries);
+    if (!cache) setError(context, "cannot open result cache %s", path);
+    return (SimCache*)cache;
+}
+
+void sim_cache_close(SimCache* cache) {
+    closeResultCache((ResultCache*)cache);
+}
+
+uint64_t sim_content_hash(const void* bytes, size_t length) {
+    return contentHash(bytes, length);
+}
+
+int sim_cache_lookup(SimCache* cache, uint64_t reference_hash, uint64_t submission_hash, int* score) {
+    return score ? lookupResult((ResultCache*)cache, reference_hash, submission_hash, score) : 0;
+}
+
+void sim_cache_store(SimCache* cache, uint64_t reference_hash, uint64_t submission_hash, int score) {
+    storeResult((ResultCache*)cache, reference_hash, submission_hash, score);
+}
+
+uint64_t sim_program_hash(const SimProgram* program) {
+    return program ? program->contentHash : 0;
+}
+
+int sim_compare_cached(SimContext* context, SimCache* cache, const SimProgram* reference,
+                       const char* name, const char* source, size_t length) {
+    if (!context || !reference || !source) {
+        setError(context, "invalid arguments");
+        return -1;
+    }
+
+    uint64_t submissionHash = contentHash(source, length);
+    int score;
+    if (lookupResult((ResultCache*)cache, reference->contentHash, submissionHash, &score)) return score;
+
+    SimProgram* submission = sim_parse_from_buffer(context, name, source, length);
+    if (!submission) return -1;
+    SimResult* result = sim_compare(context, reference, submission);
+    score = result ? result->score : -1;
+    if (result && !result->degraded && !result->estimated) storeResult((ResultCache*)cache, reference->contentHash, submissionHash, score);
+
+    sim_result_free(result);
+    sim_program_free(submission);
+    return score;
+}
+
+SimHistory* sim_history_create(SimContext* context) {
+    SimHistory* history = calloc(1, sizeof(SimHistory));
+    if (!history || !(history->parser = createRevisionParser()) || !(history->pairs = createFunctionPairCache())) {
+        setError(context, "out of memory");
+        sim_history_free(history);
+        return NULL;
+    }
+    history->memory = createAllocAccount("revision history");
+    return history;
+}
+
+void sim_history_free(SimHistory* history) {
+    if (!history) return;
+    if (history->parser) {
+        fprintf(stderr, "Log: Revision history: %lu chunks reused, %lu parsed, %lu whole-file parses.\n",
+                history->parser->reusedChunks, history->parser->parsedChunks, history->parser->fullParses);
+    }
+    AllocAccount* previous = enterAllocAccount(history->memory);
+    freeRevisionParser(history->parser);
+    enterAllocAccount(previous);
+    closeAllocAccount(history->memory);
+    freeFunctionPairCache(history->pairs);
+    free(history);
+}
+
+SimProgram* sim_parse_revision(SimContext* context, SimHistory* history, const char* name,
+                               const char* source, size_t length) {
+    if (!context || !history || !source) {
+        setError(context, "invalid arguments");
+        return NULL;
+    }
+    if (!name) name = "buffer";
+    AllocAccount* previous = enterAllocAccount(history->memory);
+    SimProgram* program = wrapProgram(context, name, parseRevision(history->parser, name, source, length), contentHash(source, length));
+    enterAllocAccount(previous);
+    return program;
+}
+
+SimResult* sim_compare_revision(SimContext* context, SimHistory* history,
+                                const SimProgram* reference, const SimProgram* submission) {
+    if (!history) {
+        setError(context, "invalid arguments");
+        return NULL;
+    }
+    AllocAccount* previous = enterAllocAccount(history->memory);
+    SimResult* result = compareWith(context, reference, submission, history->pairs);
+    enterAllocAccount(previous);
+    return result;
+}
+
+void sim_stats_enable(void) {
+    enableStats();
+}
+
+char* sim_stats_report(void) {
+    char* report = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&report, &length);
+    if (!output) return NULL;
+    writeStatsJSON(output);
+    if (fclose(output) != 0) {
+        free(report);
+        return NULL;
+    }
+    return report;
+}
+
+void sim_trace_enable(void) {
+    enableTrace();
+}
+
+int sim_trace_write(const char* path) {
+    FILE* output = fopen(path, "w");
+    if (!output) return 0;
+    int written = writeTraceJSON(output);
+    return fclose(output) == 0 && written;
+}
+
+int sim_memory_enable(void) {
+    return enableAllocAccounting();
+}
+
+char* sim_memory_report(void) {
+    char* report = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&report, &length);
+    if (!output) return NULL;
+    writeAllocJSON(output);
+    if (fclose(output) != 0) {
+        free(report);
+        return NULL;
+    }
+    return report;
+}
+
+int sim_scanner_select(const char* name) {
+    return name ? selectScanner(name) : 0;
+}
+
+void sim_share_enable(void) {
+    enableExpressionSharing();
+}
+
+void sim_budget_set(double milliseconds, size_t bytes) {
+    setPairBudget(milliseconds > 0 ? (uint64_t)(milliseconds * 1e6) : 0, bytes);
+}
+
+void sim_approximate_set(double target_error) {
+    setApproximation(target_error);
+}
+
+void sim_print_report(SimContext* context, const SimProgram* reference, const SimProgram* submission) {
+    if (!context || !reference || !submission) {
+        setError(context, "invalid arguments");
+        return;
+    }
+    const char* name1 = reference->name;
+    const char* name2 = submission->name;
+    ASTNode* root1 = reference->root;
+    ASTNode* root2 = submission->root;
+
+    printf("AST for %s:\n", name1);
+    printAST(root1);
+    printf("AST for %s:\n", name2);
+    printAST(root2);
+
+    printf("Array dependences for %s:\n", name1);
+    printDependenceGraph(root1->dependenceGraph);
+    printf("Array dependences for %s:\n", name2);
+    printDependenceGraph(root2->dependenceGraph);
+
+    int similarityScore = compareASTs(root1, root2);
+    context->comparisons++;
+    int low = 0, high = 0;
+    int estimated = lastPairInterval(&low, &high);
+    char note[SCORE_NOTE_SIZE];
+    printf("Total similarity score between %s and %s is: %d%%%s\n", name1, name2, similarityScore,
+           formatScoreNote(note, lastPairDegraded(), estimated, low, high));
+
+    // Stride and footprint differences are reported next to the score
+    LocalityProfile* locality1 = analyzeLocality(root1);
+    LocalityProfile* locality2 = analyzeLocality(root2);
+    printLocalityComparison(name1, locality1, name2, locality2);
+    freeLocalityProfile(locality1);
+    freeLocalityProfile(locality2);
+
+    printCostComparison(name1, root1, name2, root2);
+}
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "approximate.h"
+#include "budget.h"
+#include "simalloc.h"
+
+#define APPROXIMATE_Z 1.96  // Two-sided 95%
+
+// The pairs of one bucket of the first list with one bucket of the second
+typedef struct Stratum {
+    ASTNode** nodes1;   // Ranges of the bucket-sorted lists
+    int count1;
+    ASTNode** nodes2;
+    int count2;
+    int (*scorePair)(ASTNode*, ASTNode*);
+    int64_t size;
+    int64_t drawn;
+    int exact;          // Every pair has been scored once; no sampling error
+    double sum, sumSquares;
+} Stratum;
+
+typedef struct BucketedNode {
+    int bucket;
+    int position;       // Ties keep list order
+    ASTNode* node;
+} BucketedNode;
+
+typedef struct Sampler {
+    Stratum* strata;
+    int count, capacity;
+    int64_t pairs;
+    uint64_t random;
+} Sampler;
+
+static double targetError;
+static __thread int intervalSet, intervalLow, intervalHigh;
+
+void setApproximation(double error) {
+    targetError = error > 0 ? error : 0;
+}
+
+double approximationTarget(void) {
+    return targetError;
+}
+
+void clearPairInterval(void) {
+    intervalSet = 0;
+}
+
+void setPairInterval(int low, int high) {
+    intervalSet = 1;
+    intervalLow = low;
+    intervalHigh = high;
+}
+
+int lastPairInterval(int* low, int* high) {
+    if (intervalSet) {
+        if (low) *low = intervalLow;
+        if (high) *high = intervalHigh;
+    }
+    return intervalSet;
+}
+
+const char* formatScoreNote(char* note, int degraded, int estimated, int low, int high) {
+    if (estimated) {
+        snprintf(note, SCORE_NOTE_SIZE, " (estimate, 95%% interval %d-%d%%%s)", low, high, degraded ? ", degraded" : "");
+    } else {
+        snprintf(note, SCORE_NOTE_SIZE, "%s", degraded ? " (degraded)" : "");
+    }
+    return note;
+}
+
+static unsigned long mixBucketHash(unsigned long h, unsigned long value) {
+    return (h ^ value) * 1099511628211UL;
+}
+
+static unsigned long hashName(const char* name) {
+    unsigned long h = 14695981039346656037UL;
+    for (const char* s = name; s && *s; s++) h = mixBucketHash(h, (unsigned char)*s);
+    return h;
+}
+
+// Index count, and the affine form or identifier of the first index: what scoreAccessPair looks at
+static int accessBucket(const ASTNode* access) {
+    unsigned long h = 0;
+    if (access->indexCount > 0) {
+        if (access->affine && access->affine[0].isAffine) {
+            for (int v = 0; v < AFFINE_MAX_VARS; v++) h = mixBucketHash(h, (unsigned long)access->affine[0].coefficients[v]);
+            h = mixBucketHash(h, (unsigned long)access->affine[0].constant);
+        } else if (access->indices[0] && access->indices[0]->type == NodeType_Identifier) {
+            h = hashName(access->indices[0]->name);
+        }
+    }
+    return access->indexCount * APPROXIMATE_BUCKET_HASHES + (int)(h % APPROXIMATE_BUCKET_HASHES);
+}
+
+static int declarationBucket(const ASTNode* declaration) {
+    return declaration->dimensions * APPROXIMATE_BUCKET_HASHES + (int)(hashName(declaration->name) % APPROXIMATE_BUCKET_HASHES);
+}
+
+static int compareBucketedNodes(const void* a, const void* b) {
+    const BucketedNode* x = a;
+    const BucketedNode* y = b;
+    if (x->bucket != y->bucket) return x->bucket < y->bucket ? -1 : 1;
+    return x->position - y->position;
+}
+
+// Sorts a copy of the list by bucket; bucketOf[i] is the bucket of sorted[i]
+static ASTNode** sortByBucket(ASTNode** nodes, int count, int (*bucket)(const ASTNode*), int** bucketOf) {
+    BucketedNode* keyed = simMalloc(sizeof(BucketedNode) * (count > 0 ? count : 1), Alloc_Scratch);
+    ASTNode** sorted = simMalloc(sizeof(ASTNode*) * (count > 0 ? count : 1), Alloc_Scratch);
+    *bucketOf = simMalloc(sizeof(int) * (count > 0 ? count : 1), Alloc_Scratch);
+    if (!keyed || !sorted || !*bucketOf) {
+        simFree(keyed);
+        simFree(sorted);
+        simFree(*bucketOf);
+        *bucketOf = NULL;
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        keyed[i].bucket = bucket(nodes[i]);
+        keyed[i].position = i;
+        keyed[i].node = nodes[i];
+    }
+    qsort(keyed, count, sizeof(BucketedNode), compareBucketedNodes);
+    for (int i = 0; i < count; i++) {
+        sorted[i] = keyed[i].node;
+        (*bucketOf)[i] = keyed[i].bucket;
+    }
+    simFree(keyed);
+    return sorted;
+}
+
+static int addStratum(Sampler* sampler, ASTNode** nodes1, int count1, ASTNode** nodes2, int count2,
+                      int (*scorePair)(ASTNode*, ASTNode*)) {
+    if (sampler->count == sampler->capacity) {
+        int capacity = sampler->capacity ? sampler->capacity * 2 : 64;
+        Stratum* strata = simRealloc(sampler->strata, sizeof(Stratum) * capacity, Alloc_Scratch);
+        if (!strata) return 0;
+        sampler->strata = strata;
+        sampler->capacity = capacity;
+    }
+    Stratum* stratum = &sampler->strata[sampler->count++];
+    memset(stratum, 0, sizeof(Stratum));
+    stratum->nodes1 = nodes1;
+    stratum->count1 = count1;
+    stratum->nodes2 = nodes2;
+    stratum->count2 = count2;
+    stratum->scorePair = scorePair;
+    stratum->size = (int64_t)count1 * count2;
+    sampler->pairs += stratum->size;
+    return 1;
+}
+
+// One stratum per pair of buckets
+static int addStrata(Sampler* sampler, ASTNode** sorted1, const int* bucket1, int count1,
+                     ASTNode** sorted2, const int* bucket2, int count2, int (*scorePair)(ASTNode*, ASTNode*)) {
+    for (int start1 = 0, end1; start1 < count1; start1 = end1) {
+        for (end1 = start1 + 1; end1 < count1 && bucket1[end1] == bucket1[start1]; end1++) {
+        }
+        for (int start2 = 0, end2; start2 < count2; start2 = end2) {
+            for (end2 = start2 + 1; end2 < count2 && bucket2[end2] == bucket2[start2]; end2++) {
+            }
+            if (!addStratum(sampler, sorted1 + start1, end1 - start1, sorted2 + start2, end2 - start2, scorePair)) return 0;
+        }
+    }
+    return 1;
+}
+
+static uint64_t nextRandom(Sampler* sampler) {
+    sampler->random = sampler->random * 6364136223846793005ULL + 1442695040888963407ULL;
+    return sampler->random >> 11;
+}
+
+static void scoreStratumPair(Stratum* stratum, int64_t pair) {
+    double score = stratum->scorePair(stratum->nodes1[pair / stratum->count2], stratum->nodes2[pair % stratum->count2]);
+    stratum->sum += score;
+    stratum->sumSquares += score * score;
+    stratum->drawn++;
+}
+
+// Draws count more pairs at random, or scores every pair when that is no more work
+static void drawPairs(Sampler* sampler, Stratum* stratum, int64_t count) {
+    if (stratum->exact || count <= 0) return;
+    if (stratum->drawn + count >= stratum->size) {
+        stratum->sum = stratum->sumSquares = 0;
+        stratum->drawn = 0;
+        for (int64_t pair = 0; pair < stratum->size; pair++) scoreStratumPair(stratum, pair);
+        stratum->exact = 1;
+        return;
+    }
+    for (int64_t i = 0; i < count && !budgetExhausted(); i++) {
+        scoreStratumPair(stratum, (int64_t)(nextRandom(sampler) % (uint64_t)stratum->size));
+    }
+}
+
+// Sample variance with one pseudo-pair at each end of the score range added, as in the
+// Agresti-Coull interval: a stratum whose few draws all scored alike keeps a spread that
+// shrinks as it is sampled, rather than none, which would stop Neyman allocation from
+// drawing more of it and narrow the interval below its coverage
+static double stratumVariance(const Stratum* stratum) {
+    if (stratum->exact) return 0;
+    double count = stratum->drawn + 2;
+    double sum = stratum->sum + APPROXIMATE_PAIR_RANGE;
+    double sumSquares = stratum->sumSquares + (double)APPROXIMATE_PAIR_RANGE * APPROXIMATE_PAIR_RANGE;
+    double mean = sum / count;
+    double variance = (sumSquares - count * mean * mean) / (count - 1);
+    return variance > 0 ? variance : 0;
+}
+
+// Stratified mean and the variance of that estimate
+static void summarize(const Sampler* sampler, double* mean, double* variance) {
+    *mean = 0;
+    *variance = 0;
+    for (int h = 0; h < sampler->count; h++) {
+        const Stratum* stratum = &sampler->strata[h];
+        if (stratum->drawn == 0) continue;
+        double weight = (double)stratum->size / sampler->pairs;
+        *mean += weight * stratum->sum / stratum->drawn;
+        if (!stratum->exact) *variance += weight * weight * stratumVariance(stratum) / stratum->drawn;
+    }
+}
+
+// Neyman allocation of the sample size that reaches the target, in at most
+// APPROXIMATE_ROUND_PAIRS more pairs. Returns the number of pairs drawn.
+static int64_t allocateRound(Sampler* sampler, double targetHalfWidth) {
+    double spread = 0;
+    for (int h = 0; h < sampler->count; h++) {
+        const Stratum* stratum = &sampler->strata[h];
+        if (!stratum->exact) spread += (double)stratum->size / sampler->pairs * sqrt(stratumVariance(stratum));
+    }
+    if (spread <= 0) return 0;
+
+    double limit = targetHalfWidth / APPROXIMATE_Z;
+    double needed = spread * spread / (limit * limit);
+    double wanted = 0;
+    for (int h = 0; h < sampler->count; h++) {
+        const Stratum* stratum = &sampler->strata[h];
+        if (stratum->exact) continue;
+        double share = needed * ((double)stratum->size / sampler->pairs * sqrt(stratumVariance(stratum))) / spread;
+        if (share > stratum->drawn) wanted += share - stratum->drawn;
+    }
+    double scale = wanted > APPROXIMATE_ROUND_PAIRS ? APPROXIMATE_ROUND_PAIRS / wanted : 1;
+
+    int64_t drawn = 0;
+    for (int h = 0; h < sampler->count && !budgetRanOut(); h++) {
+        Stratum* stratum = &sampler->strata[h];
+        if (stratum->exact) continue;
+        double share = needed * ((double)stratum->size / sampler->pairs * sqrt(stratumVariance(stratum))) / spread;
+        int64_t extra = (int64_t)ceil((share - stratum->drawn) * scale);
+        if (extra <= 0) continue;
+        int64_t before = stratum->drawn;
+        drawPairs(sampler, stratum, extra);
+        drawn += stratum->drawn - before;
+    }
+    return drawn;
+}
+
+int estimateArrayPairs(ASTNode** declarations1, int declarationCount1, ASTNode** declarations2, int declarationCount2,
+                       ASTNode** accesses1, int accessCount1, ASTNode** accesses2, int accessCount2,
+                       double targetHalfWidth, ArrayEstimate* estimate) {
+    int64_t pairs = (int64_t)declarationCount1 * declarationCount2 + (int64_t)accessCount1 * accessCount2;
+    if (pairs <= APPROXIMATE_EXACT_PAIRS) return 0;
+
+    Sampler sampler = { NULL, 0, 0, 0, 0x9E3779B97F4A7C15ULL };
+    int *declarationBuckets1 = NULL, *declarationBuckets2 = NULL, *accessBuckets1 = NULL, *accessBuckets2 = NULL;
+    ASTNode** sortedDeclarations1 = sortByBucket(declarations1, declarationCount1, declarationBucket, &declarationBuckets1);
+    ASTNode** sortedDeclarations2 = sortByBucket(declarations2, declarationCount2, declarationBucket, &declarationBuckets2);
+    ASTNode** sortedAccesses1 = sortByBucket(accesses1, accessCount1, accessBucket, &accessBuckets1);
+    ASTNode** sortedAccesses2 = sortByBucket(accesses2, accessCount2, accessBucket, &accessBuckets2);
+
+    int built = sortedDeclarations1 && sortedDeclarations2 && sortedAccesses1 && sortedAccesses2 &&
+                addStrata(&sampler, sortedDeclarations1, declarationBuckets1, declarationCount1,
+                          sortedDeclarations2, declarationBuckets2, declarationCount2, scoreDeclarationPair) &&
+                addStrata(&sampler, sortedAccesses1, accessBuckets1, accessCount1,
+                          sortedAccesses2, accessBuckets2, accessCount2, scoreAccessPair);
+    if (!built) {
+        fprintf(stderr, "Memory allocation failed for sampling strata; comparing exactly.\n");
+    } else {
+        for (int h = 0; h < sampler.count; h++) drawPairs(&sampler, &sampler.strata[h], APPROXIMATE_PILOT);
+
+        double mean, variance;
+        summarize(&sampler, &mean, &variance);
+        for (int round = 0; round < APPROXIMATE_ROUNDS && APPROXIMATE_Z * sqrt(variance) > targetHalfWidth; round++) {
+            if (budgetRanOut() || allocateRound(&sampler, targetHalfWidth) == 0) break;
+            summarize(&sampler, &mean, &variance);
+        }
+
+        estimate->mean = mean;
+        estimate->halfWidth = APPROXIMATE_Z * sqrt(variance);
+        estimate->pairs = sampler.pairs;
+        estimate->sampled = 0;
+        for (int h = 0; h < sampler.count; h++) estimate->sampled += sampler.strata[h].drawn;
+        estimate->strata = sampler.count;
+    }
+
+    simFree(sampler.strata);
+    simFree(sortedDeclarations1);
+    simFree(sortedDeclarations2);
+    simFree(sortedAccesses1);
+    simFree(sortedAccesses2);
+    simFree(declarationBuckets1);
+    simFree(declarationBuckets2);
+    simFree(accessBuckets1);
+    simFree(accessBuckets2);
+    return built;
+}
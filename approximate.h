@@ -0,0 +1,61 @@
+#ifndef APPROXIMATE_H
+#define APPROXIMATE_H
+
+#include <stdint.h>
+#include "ast.h"
+
+// Approximate comparison of very large programs. Instead of scoring every declaration
+// and access pair, compareASTs samples them, stratified by signature bucket: a stratum
+// holds the pairs whose two nodes have the same index (or dimension) count and first
+// index (or name) hash on each side, so pairs that score alike are drawn together. A
+// pilot of every stratum gives its spread; further pairs are then allocated to the
+// strata in proportion to size times spread (Neyman allocation) until the 95%
+// confidence interval of the array score is within the target error. Strata smaller
+// than their allocation are scored exactly.
+//
+// Pair loops of up to APPROXIMATE_EXACT_PAIRS pairs are compared exactly, match entries
+// and all, so small programs score as before. Sampled pairs add no match entries.
+
+#define APPROXIMATE_EXACT_PAIRS 4096
+#define APPROXIMATE_PILOT 16          // First pairs drawn from each stratum
+#define APPROXIMATE_PAIR_RANGE 100    // A pair scores 0 to 100, what it adds to totalPossibleScore
+#define APPROXIMATE_ROUNDS 8          // Allocation rounds before settling for a wider interval
+#define APPROXIMATE_ROUND_PAIRS (1 << 20)  // Most pairs drawn in one round
+#define APPROXIMATE_BUCKET_HASHES 8   // First index hashes per index count
+#define APPROXIMATE_DEFAULT_ERROR 2.0 // Percentage points, for --approximate without a value
+
+// Target half-width of the 95% interval of the final score, in percentage points;
+// 0 (the default) compares exactly. Set before any thread compares.
+void setApproximation(double targetError);
+double approximationTarget(void);
+
+// Estimated mean score of all declaration and access pairs, in the units of the exact
+// totalScore / totalPossibleScore * 100, with the half-width of its 95% interval
+typedef struct ArrayEstimate {
+    double mean;
+    double halfWidth;
+    int64_t pairs;
+    int64_t sampled;
+    int strata;
+} ArrayEstimate;
+
+// Samples the pairs of the two declaration lists and of the two access lists until the
+// interval's half-width is at most targetHalfWidth. Returns 0 when there are at most
+// APPROXIMATE_EXACT_PAIRS pairs, or when out of memory: the caller compares exactly.
+int estimateArrayPairs(ASTNode** declarations1, int declarationCount1, ASTNode** declarations2, int declarationCount2,
+                       ASTNode** accesses1, int accessCount1, ASTNode** accesses2, int accessCount2,
+                       double targetHalfWidth, ArrayEstimate* estimate);
+
+// The 95% interval of this thread's last compareASTs score, set only when it was
+// estimated: returns 0 after an exact comparison
+void clearPairInterval(void);
+void setPairInterval(int low, int high);
+int lastPairInterval(int* low, int* high);
+
+#define SCORE_NOTE_SIZE 64
+
+// What follows a score on its report line: " (estimate, 95% interval 40-46%)",
+// " (degraded)", both, or "" for an exact score. Returns note.
+const char* formatScoreNote(char* note, int degraded, int estimated, int low, int high);
+
+#endif
@@ -3,13 +3,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include "functionindex.h"
+#include "dependence.h"
+#include "complexity.h"
+#include "stats.h"
+#include "trace.h"
+#include "simalloc.h"
+#include "hashcons.h"
+#include "budget.h"
+#include "approximate.h"
 
 #define NodeType_Any -1
 
 const int initial_capacity = 10;
 
-ASTNode* globalRoot = NULL;  // Define and initialize globalRoot
-
 const char* getOperationName(int operationCode) {
     switch (operationCode) {
         case OPERATION_ADD: return "ADD";
@@ -29,17 +37,137 @@ int min(int a, int b) {
     return a < b ? a : b;
 }
 
+// The name the user wrote, for reports; canonicalization renames nodes
+static const char* displayName(ASTNode* node) {
+    return node->sourceName ? node->sourceName : node->name;
+}
+
+// Frame buffer of the iterative tree walks, here and in the analysis passes. Nothing
+// recurses per tree level, so deep generated code cannot overflow a worker thread's stack. Each thread keeps its
+// buffer and reuses it, so after the deepest tree seen a walk allocates nothing. A walk
+// only uses the frames above the count it started at, so walks may nest; frames move
+// when the buffer grows, so they are addressed by index across pushes. When the buffer
+// cannot grow, a walk gives up: comparisons score 0 and collections keep what they have.
+#define WALK_STACK_INITIAL 64
+#define WALK_DESCENDED -1  // Returned by a step that pushed a frame instead of scoring
+#define WALK_FAILED -2     // Returned by a step whose frame could not be pushed
+
+static pthread_key_t walkKey;
+static pthread_once_t walkKeyOnce = PTHREAD_ONCE_INIT;
+static __thread WalkStack* threadWalk;
+
+// Plain malloc: the buffer outlives every submission it is used for
+static void freeWalkStack(void* stack) {
+    WalkStack* walk = stack;
+    free(walk->frames);
+    free(walk);
+}
+
+static void createWalkKey(void) {
+    pthread_key_create(&walkKey, freeWalkStack);
+}
+
+// NULL when the stack cannot be allocated; the next call tries again
+WalkStack* threadWalkStack(void) {
+    if (!threadWalk) {
+        pthread_once(&walkKeyOnce, createWalkKey);
+        threadWalk = calloc(1, sizeof(WalkStack));
+        if (!threadWalk) {
+            fprintf(stderr, "Memory allocation failed for the traversal stack.\n");
+            return NULL;
+        }
+        pthread_setspecific(walkKey, threadWalk); // Freed when the thread exits
+    }
+    return threadWalk;
+}
+
+// 0 when the buffer cannot grow; it is left as it was
+int growWalkStack(WalkStack* walk) {
+    int capacity = walk->capacity ? walk->capacity * 2 : WALK_STACK_INITIAL;
+    WalkFrame* frames = realloc(walk->frames, sizeof(WalkFrame) * capacity);
+    if (!frames) {
+        fprintf(stderr, "Memory allocation failed while growing the traversal stack to %d frames.\n", capacity);
+        return 0;
+    }
+    walk->frames = frames;
+    walk->capacity = capacity;
+    return 1;
+}
+
+// Pushes a frame for a node alone; 0 when it could not be pushed
+int pushWalkNode(WalkStack* walk, ASTNode* node) {
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return 0;
+    frame->node1 = node;
+    return 1;
+}
+
+static int sameText(const char* a, const char* b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+// What the structural hash of a node covers, apart from its children and indices
+static int sameNodeFields(const ASTNode* node1, const ASTNode* node2) {
+    if (node1->type != node2->type || node1->childCount != node2->childCount || node1->indexCount != node2->indexCount ||
+        !sameText(node1->name, node2->name) || !sameText(node1->value, node2->value) ||
+        !sameText(node1->dataType, node2->dataType)) {
+        return 0;
+    }
+    int dimensions1 = node1->dimSize ? node1->dimensions : 0;
+    int dimensions2 = node2->dimSize ? node2->dimensions : 0;
+    if (dimensions1 != dimensions2) return 0;
+    for (int i = 0; i < dimensions1; i++) {
+        if (node1->dimSize[i] != node2->dimSize[i]) return 0;
+    }
+    return 1;
+}
+
+// Whether two subtrees are equal in everything their structural hashes cover, so equal
+// hashes can be trusted without a collision passing as a match. 0 when the walk runs
+// out of memory.
+int sameStructure(ASTNode* node1, ASTNode* node2) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return 0;
+    frame->node1 = node1;
+    frame->node2 = node2;
+
+    while (walk->count > base) {
+        WalkFrame pair = walk->frames[--walk->count];
+        if (pair.node1 == pair.node2) continue; // Shared, or both missing
+        if (!pair.node1 || !pair.node2 || !sameNodeFields(pair.node1, pair.node2)) {
+            walk->count = base;
+            return 0;
+        }
+        for (int i = 0; i < pair.node1->childCount + pair.node1->indexCount; i++) {
+            int child = i < pair.node1->childCount;
+            WalkFrame* below = pushWalkFrame(walk);
+            if (!below) {
+                walk->count = base;
+                return 0;
+            }
+            below->node1 = child ? pair.node1->children[i] : pair.node1->indices[i - pair.node1->childCount];
+            below->node2 = child ? pair.node2->children[i] : pair.node2->indices[i - pair.node2->childCount];
+        }
+    }
+    return 1;
+}
+
 ASTNode* createASTNode(NodeType type, char* name) {
     fprintf(stderr, "Attempting to create a new AST Node. Type: %d, Name: %s\n", type, name ? name : "NULL");
 
-    ASTNode* node = malloc(sizeof(ASTNode));
+    AllocTag tag = nodeAllocTag(type);
+    ASTNode* node = simMalloc(sizeof(ASTNode), tag);
     if (!node) {
         fprintf(stderr, "Memory allocation failed for ASTNode.\n");
         return NULL;
     }
+    statsCount(Stat_NodesCreated, 1);
 
     node->type = type;
-    node->name = name ? strdup(name) : NULL;
+    node->name = name ? simStrdup(name, tag) : NULL;
     node->children = NULL;
     node->childCount = 0;
     node->params = NULL;
@@ -59,23 +187,41 @@ ASTNode* createASTNode(NodeType type, char* name) {
     node->initExpr = NULL;
     node->arrayName = NULL;  // Will be set specifically for array accesses
     node->indexExpr = NULL;  // Will be set specifically for array accesses
+    node->capacity = 0;
+    node->left = NULL;
+    node->right = NULL;
+    node->operation = Op_Add;
+    node->initializationExpression = NULL;
+    node->increment = NULL;
+    node->extra = NULL;
+    node->sourceName = NULL;
+    node->structHash = 0;
+    node->canonical = 0;
+    node->shareCount = 0;
+    node->dependenceGraph = NULL;
+    node->costProfile = NULL;
+    node->affine = NULL;
+    node->linearAffine = NULL;
+    node->affineSlots = NULL;
+    node->affineSlotCount = 0;
 
     fprintf(stderr, "Node created successfully. Initial attributes set.\n");
 
     // Initialize children array for specific node types
     if (type == NodeType_Functions || type == NodeType_Statements || type == NodeType_Body || type == NodeType_ParameterList) {
-        node->children = malloc(sizeof(ASTNode*) * 10);
+        node->children = simMalloc(sizeof(ASTNode*) * 10, tag);
         if (!node->children) {
             fprintf(stderr, "Failed to allocate memory for children nodes.\n");
             freeASTNode(node);
             return NULL;
         }
+        node->capacity = 10;
         fprintf(stderr, "Children array initialized with initial capacity.\n");
     }
 
     // Setup for array or array declarations
     if (type == NodeType_Array || type == NodeType_ArrayDeclaration) {
-        node->dimSize = malloc(sizeof(int) * 2); // Assuming 2D arrays at most
+        node->dimSize = simMalloc(sizeof(int) * 2, tag); // Assuming 2D arrays at most
         if (!node->dimSize) {
             fprintf(stderr, "Failed to allocate memory for dimension sizes.\n");
             freeASTNode(node);
@@ -87,10 +233,10 @@ ASTNode* createASTNode(NodeType type, char* name) {
     // Additional setup for array accesses
     // Additional setup for array accesses
 	if (type == NodeType_ArrayAccess) {
-		node->arrayName = strdup(name); // Assuming the name is the array name for simplicity
+		node->arrayName = simStrdup(name, tag); // Assuming the name is the array name for simplicity
     
 		// Allocate memory for index expressions array assuming a maximum of 2 indices for simplicity
-		node->indices = malloc(sizeof(ASTNode*) * 2);
+		node->indices = simMalloc(sizeof(ASTNode*) * 2, tag);
 		if (!node->indices) {
 			fprintf(stderr, "Failed to allocate memory for index expressions.\n");
 			freeASTNode(node);
@@ -103,7 +249,7 @@ ASTNode* createASTNode(NodeType type, char* name) {
 
     // Setup for functions and loops
     if (type == NodeType_FunctionDef || type == NodeType_For || type == NodeType_While) {
-        node->params = malloc(sizeof(ASTNode*) * 5);
+        node->params = simMalloc(sizeof(ASTNode*) * 5, tag);
         node->paramCount = 0;
         if (!node->params) {
             fprintf(stderr, "Failed to allocate memory for parameters.\n");
@@ -119,47 +265,92 @@ ASTNode* createASTNode(NodeType type, char* name) {
 
 
 
+// Out of memory, the subtree that could not be queued is leaked rather than the free abandoned
+static void pushFreedNode(WalkStack* walk, ASTNode* node) {
+    if (!pushWalkNode(walk, node)) fprintf(stderr, "Leaking a subtree: the traversal stack cannot grow.\n");
+}
+
+// Pointer fields own their subtree, except where they point at one of the node's
+// children, as main's body and the Root's Functions container do
+static void pushOwnedField(WalkStack* walk, ASTNode* node, ASTNode* field) {
+    if (!field) return;
+    for (int i = 0; i < node->childCount; i++) {
+        if (node->children[i] == field) return;
+    }
+    pushFreedNode(walk, field);
+}
+
 void freeASTNode(ASTNode* node) {
     if (!node) return;
 
-    // Free simple dynamically allocated memory
-    free(node->name);
-    free(node->dataType);
-    free(node->arrayType);
-
-    // Free the array of children nodes
-    if (node->children) {
-        for (int i = 0; i < node->childCount; i++) {
-            freeASTNode(node->children[i]);  // Recursively free each child
-        }
-        free(node->children);
+    WalkStack* walk = threadWalkStack();
+    if (!walk) {
+        fprintf(stderr, "Leaking a tree: no traversal stack to free it with.\n");
+        return;
     }
+    int base = walk->count;
+    pushFreedNode(walk, node);
+
+    while (walk->count > base) {
+        ASTNode* current = walk->frames[--walk->count].node1;
+
+        // A hash-consed node is freed by the last tree that lets go of it
+        if (current->shareCount && !releaseSharedNode(current)) continue;
+
+        // Free simple dynamically allocated memory
+        simFree(current->name);
+        simFree(current->value);
+        simFree(current->dataType);
+        simFree(current->arrayType);
+        simFree(current->arrayName);
+        simFree(current->sourceName);
+        simFree(current->extra);
+        freeDependenceGraph(current->dependenceGraph);
+        freeCostProfile(current->costProfile);
+        simFree(current->affine);
+        simFree(current->linearAffine);
+        for (int i = 0; i < current->affineSlotCount; i++) {
+            simFree(current->affineSlots[i]);
+        }
+        simFree(current->affineSlots);
+
+        // Subtrees only reachable through a pointer field, checked while the children are still there
+        pushOwnedField(walk, current, current->body);
+        pushOwnedField(walk, current, current->functions);
+        pushOwnedField(walk, current, current->mainFunction);
+        pushOwnedField(walk, current, current->condition);
+        pushOwnedField(walk, current, current->initExpr);
+        pushOwnedField(walk, current, current->indexExpr);
+        pushOwnedField(walk, current, current->initializationExpression);
+        pushOwnedField(walk, current, current->increment);
+        pushOwnedField(walk, current, current->left);
+        pushOwnedField(walk, current, current->right);
+
+        // The children, parameters and index expressions are freed by later turns of the loop
+        for (int i = 0; current->children && i < current->childCount; i++) {
+            if (current->children[i]) pushFreedNode(walk, current->children[i]);
+        }
+        simFree(current->children);
 
-    // Free the parameters if any
-    if (node->params) {
-        for (int i = 0; i < node->paramCount; i++) {
-            freeASTNode(node->params[i]);  // Recursively free each parameter
+        for (int i = 0; current->params && i < current->paramCount; i++) {
+            if (current->params[i]) pushFreedNode(walk, current->params[i]);
         }
-        free(node->params);
-    }
+        simFree(current->params);
 
-    // Free dimension sizes, these are integers and should not be freed individually
-    if (node->dimSize) {
-        free(node->dimSize);  // Only free the pointer to the array of ints
-    }
+        // Dimension sizes are plain integers
+        simFree(current->dimSize);
 
-    // Free indices if they are pointers to ASTNodes, otherwise just free the array
-    if (node->indices) {
-        if (node->type == NodeType_ArrayAccess) {
-            for (int i = 0; i < node->indexCount; i++) {
-                freeASTNode(node->indices[i]);  // Assuming indices are pointers to ASTNodes
+        // Only array accesses own what their indices point to
+        if (current->indices && current->type == NodeType_ArrayAccess) {
+            for (int i = 0; i < current->indexCount; i++) {
+                if (current->indices[i]) pushFreedNode(walk, current->indices[i]);
             }
         }
-        free(node->indices);
-    }
+        simFree(current->indices);
 
-    // Finally, free the node itself
-    free(node);
+        // Finally, free the node itself
+        simFree(current);
+    }
 }
 
 
@@ -168,7 +359,7 @@ int countNodes(ASTNode* root, NodeType type) {
 
     int count = 0;
     int capacity = 100; // Initial stack capacity
-    ASTNode** stack = malloc(capacity * sizeof(ASTNode*));
+    ASTNode** stack = simMalloc(capacity * sizeof(ASTNode*), Alloc_Scratch);
     if (!stack) {
         fprintf(stderr, "Memory allocation failed for stack in countNodes.\n");
         return -1; // Memory allocation failure
@@ -190,10 +381,10 @@ int countNodes(ASTNode* root, NodeType type) {
             if (current->children[i]) {
                 if (top == capacity) { // Check if stack needs expansion
                     capacity *= 2;
-                    ASTNode** newStack = realloc(stack, capacity * sizeof(ASTNode*));
+                    ASTNode** newStack = simRealloc(stack, capacity * sizeof(ASTNode*), Alloc_Scratch);
                     if (!newStack) {
                         fprintf(stderr, "Stack resizing failed in countNodes.\n");
-                        free(stack);
+                        simFree(stack);
                         return -1; // Handle reallocation failure
                     }
                     stack = newStack;
@@ -203,7 +394,7 @@ int countNodes(ASTNode* root, NodeType type) {
         }
     }
 
-    free(stack);
+    simFree(stack);
     return count;
 }
 
@@ -218,7 +409,7 @@ void addASTChild(ASTNode* parent, ASTNode* child) {
     // Initialize children array if it's the first child
     if (parent->children == NULL) {
         int initial_capacity = 10;  // Define an initial capacity if not defined
-        parent->children = malloc(sizeof(ASTNode*) * initial_capacity);
+        parent->children = simMalloc(sizeof(ASTNode*) * initial_capacity, nodeAllocTag(parent->type));
         if (parent->children == NULL) {
             fprintf(stderr, "Memory allocation failed for children array.\n");
             return;
@@ -231,13 +422,14 @@ void addASTChild(ASTNode* parent, ASTNode* child) {
     // Expand the children array if it is full
     if (parent->childCount == parent->capacity) {
         int new_capacity = parent->capacity + 10; // Increase capacity by a fixed increment, say 10
-        ASTNode** new_children = realloc(parent->children, new_capacity * sizeof(ASTNode*));
+        ASTNode** new_children = simRealloc(parent->children, new_capacity * sizeof(ASTNode*), nodeAllocTag(parent->type));
         if (new_children == NULL) {
             fprintf(stderr, "Memory reallocation failed for children array.\n");
             return;
         }
         parent->children = new_children;
         parent->capacity = new_capacity;
+        statsCount(Stat_ChildGrowths, 1);
         fprintf(stderr, "Children array expanded to new capacity of %d.\n", new_capacity);
     }
 
@@ -268,28 +460,273 @@ int isCommutative(const char* opName) {
 
 
 
-ASTNode* deepCloneASTNode(ASTNode* original) {
-    if (!original) return NULL;
-
+// The node's own fields, with room for its indices; deepCloneASTNode clones those and the children
+static ASTNode* cloneNodeFields(ASTNode* original) {
     ASTNode* clone = createASTNode(original->type, original->name);
     if (!clone) return NULL;
 
-    
+    AllocTag tag = nodeAllocTag(original->type);
+    clone->value = original->value ? simStrdup(original->value, tag) : NULL;
+    clone->dataType = original->dataType ? simStrdup(original->dataType, tag) : NULL;
+    clone->sourceName = original->sourceName ? simStrdup(original->sourceName, tag) : NULL;
+    clone->structHash = original->structHash;
+    clone->canonical = original->canonical;
+
+    // Array declarations carry their dimension sizes
+    if (original->dimSize && original->dimensions > 0) {
+        simFree(clone->dimSize);
+        clone->dimSize = simMalloc(sizeof(int) * original->dimensions, tag);
+        if (!clone->dimSize) {
+            fprintf(stderr, "Failed to allocate dimension sizes while cloning %s.\n", original->name);
+            freeASTNode(clone);
+            return NULL;
+        }
+        memcpy(clone->dimSize, original->dimSize, sizeof(int) * original->dimensions);
+    }
+    clone->dimensions = original->dimensions;
+
+    // Array accesses own their index expressions
+    if (original->indices && original->indexCount > 0) {
+        simFree(clone->indices);
+        clone->indices = simMalloc(sizeof(ASTNode*) * original->indexCount, tag);
+        if (!clone->indices) {
+            fprintf(stderr, "Failed to allocate indices while cloning %s.\n", original->name);
+            freeASTNode(clone);
+            return NULL;
+        }
+        clone->indexCount = 0;
+    }
 
+    if (original->affine && original->indexCount > 0) {
+        clone->affine = simMalloc(sizeof(AffineForm) * original->indexCount, tag);
+        if (clone->affine) memcpy(clone->affine, original->affine, sizeof(AffineForm) * original->indexCount);
+    }
+    if (original->linearAffine) {
+        clone->linearAffine = simMalloc(sizeof(AffineForm), tag);
+        if (clone->linearAffine) *clone->linearAffine = *original->linearAffine;
+    }
     return clone;
 }
 
+// Clones one node for the walk of deepCloneASTNode and queues it to have its own
+// indices and children cloned; *failed is set when it cannot be queued
+static ASTNode* cloneQueued(WalkStack* walk, ASTNode* original, int* failed) {
+    ASTNode* clone = original ? cloneNodeFields(original) : NULL;
+    if (clone) {
+        WalkFrame* frame = pushWalkFrame(walk);
+        if (frame) {
+            frame->node1 = original;
+            frame->node2 = clone;
+        } else {
+            *failed = 1;
+        }
+    }
+    return clone;
+}
+
+// Each frame holds an original in node1 and its clone in node2
+ASTNode* deepCloneASTNode(ASTNode* original) {
+    if (!original) return NULL;
+
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return NULL;
+    int base = walk->count;
+    int failed = 0;
+    ASTNode* root = cloneQueued(walk, original, &failed);
+
+    while (walk->count > base && !failed) {
+        WalkFrame pair = walk->frames[--walk->count];
+        ASTNode* from = pair.node1;
+        ASTNode* clone = pair.node2;
+
+        for (int i = 0; from->indices && clone->indices && i < from->indexCount; i++) {
+            clone->indices[clone->indexCount++] = cloneQueued(walk, from->indices[i], &failed);
+        }
+        for (int i = 0; i < from->childCount; i++) {
+            addASTChild(clone, cloneQueued(walk, from->children[i], &failed));
+        }
+    }
+
+    if (failed) {
+        walk->count = base;
+        fprintf(stderr, "Failed to clone %s: the traversal stack cannot grow.\n", original->name ? original->name : "node");
+        freeASTNode(root);
+        return NULL;
+    }
+    return root;
+}
+
+static char* copyString(const char* text, AllocTag tag) {
+    return text ? simStrdup(text, tag) : NULL;
+}
+
+// Every field of the node but its children, parameters, owned indices and pointer fields,
+// which copyASTTree fills in; their arrays start out empty. A shared node is retained instead.
+static ASTNode* copyNodeFields(ASTNode* original) {
+    if (original->shareCount) return retainSharedNode(original); // Read-only, so one more reference will do
+
+    AllocTag tag = nodeAllocTag(original->type);
+    ASTNode* copy = simMalloc(sizeof(ASTNode), tag);
+    if (!copy) {
+        fprintf(stderr, "Memory allocation failed while copying %s.\n", original->name ? original->name : "node");
+        return NULL;
+    }
+    statsCount(Stat_NodesCreated, 1);
+    *copy = *original;
+    copy->name = copyString(original->name, tag);
+    copy->value = copyString(original->value, tag);
+    copy->dataType = copyString(original->dataType, tag);
+    copy->arrayType = copyString(original->arrayType, tag);
+    copy->arrayName = copyString(original->arrayName, tag);
+    copy->sourceName = copyString(original->sourceName, tag);
+    copy->parent = NULL;
+    copy->dependenceGraph = NULL; // Recomputed for the tree it ends up in
+    copy->costProfile = NULL;
+
+    if (original->children) {
+        int capacity = original->capacity > original->childCount ? original->capacity : original->childCount;
+        copy->children = simCalloc(capacity > 0 ? capacity : 1, sizeof(ASTNode*), tag);
+        copy->capacity = capacity;
+    }
+    if (original->params) {
+        copy->params = simCalloc(original->paramCount > 0 ? original->paramCount : 1, sizeof(ASTNode*), tag);
+    }
+    if (original->indices) {
+        copy->indices = simMalloc(sizeof(ASTNode*) * (original->indexCount > 2 ? original->indexCount : 2), tag);
+        for (int i = 0; copy->indices && i < original->indexCount; i++) {
+            copy->indices[i] = original->type == NodeType_ArrayAccess ? NULL : original->indices[i];
+        }
+    }
+    if (original->dimSize) {
+        // The original holds at least one size (createArrayNode) and at most max(dimensions, 2)
+        int used = original->dimensions > 1 ? original->dimensions : 1;
+        copy->dimSize = simCalloc(used > 2 ? used : 2, sizeof(int), tag);
+        if (copy->dimSize) memcpy(copy->dimSize, original->dimSize, sizeof(int) * used);
+    }
+    if (original->affine) {
+        copy->affine = simMalloc(sizeof(AffineForm) * original->indexCount, tag);
+        if (copy->affine) memcpy(copy->affine, original->affine, sizeof(AffineForm) * original->indexCount);
+    }
+    if (original->linearAffine) {
+        copy->linearAffine = simMalloc(sizeof(AffineForm), tag);
+        if (copy->linearAffine) *copy->linearAffine = *original->linearAffine;
+    }
+    if (original->extra) {
+        copy->extra = simMalloc(sizeof(ArrayMetadata), tag);
+        if (copy->extra) *copy->extra = *original->extra;
+    }
+    if (original->affineSlots) {
+        copy->affineSlots = simMalloc(sizeof(char*) * AFFINE_MAX_VARS, Alloc_Slots);
+        for (int i = 0; copy->affineSlots && i < original->affineSlotCount; i++) {
+            copy->affineSlots[i] = simStrdup(original->affineSlots[i], Alloc_Slots);
+        }
+    }
+
+    copy->body = NULL;
+    copy->functions = NULL;
+    copy->mainFunction = NULL;
+    copy->condition = NULL;
+    copy->initExpr = NULL;
+    copy->indexExpr = NULL;
+    copy->initializationExpression = NULL;
+    copy->increment = NULL;
+    copy->left = NULL;
+    copy->right = NULL;
+    return copy;
+}
+
+// Copies one node for the walk of copyASTTree and queues a fresh copy to have the rest
+// filled in; *failed is set when it cannot be queued
+static ASTNode* copyQueued(WalkStack* walk, ASTNode* original, int* failed) {
+    if (!original) return NULL;
+    ASTNode* copy = copyNodeFields(original);
+    if (copy && !original->shareCount) {
+        WalkFrame* frame = pushWalkFrame(walk);
+        if (frame) {
+            frame->node1 = original;
+            frame->node2 = copy;
+        } else {
+            *failed = 1;
+        }
+    }
+    return copy;
+}
+
+// The copy of a pointer field: the copy of the child it refers to, or a copy of its own
+static ASTNode* copyField(WalkStack* walk, ASTNode* original, ASTNode* copy, ASTNode* field, int* failed) {
+    for (int i = 0; field && copy->children && i < original->childCount; i++) {
+        if (original->children[i] == field) return copy->children[i];
+    }
+    return copyQueued(walk, field, failed);
+}
+
+// Exact copy of a finished tree: every field, with aliases such as main's body or
+// the Root's Functions container pointing into the copy. deepCloneASTNode only
+// copies what the grammar actions need and cannot be used for this. Each frame of
+// the walk holds an original in node1 and its copy in node2.
+ASTNode* copyASTTree(ASTNode* original) {
+    if (!original) return NULL;
+
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return NULL;
+    int base = walk->count;
+    int failed = 0;
+    ASTNode* root = copyQueued(walk, original, &failed);
+
+    while (walk->count > base && !failed) {
+        WalkFrame pair = walk->frames[--walk->count];
+        ASTNode* from = pair.node1;
+        ASTNode* copy = pair.node2;
+
+        // Children first, so the pointer fields that alias them find their copies
+        for (int i = 0; copy->children && i < from->childCount; i++) {
+            copy->children[i] = copyQueued(walk, from->children[i], &failed);
+        }
+        for (int i = 0; copy->params && i < from->paramCount; i++) {
+            copy->params[i] = copyQueued(walk, from->params[i], &failed);
+        }
+        for (int i = 0; copy->indices && from->type == NodeType_ArrayAccess && i < from->indexCount; i++) {
+            copy->indices[i] = copyQueued(walk, from->indices[i], &failed);
+        }
+
+        copy->body = copyField(walk, from, copy, from->body, &failed);
+        copy->functions = copyField(walk, from, copy, from->functions, &failed);
+        copy->mainFunction = copyField(walk, from, copy, from->mainFunction, &failed);
+        copy->condition = copyField(walk, from, copy, from->condition, &failed);
+        copy->initExpr = copyField(walk, from, copy, from->initExpr, &failed);
+        copy->indexExpr = copyField(walk, from, copy, from->indexExpr, &failed);
+        copy->initializationExpression = copyField(walk, from, copy, from->initializationExpression, &failed);
+        copy->increment = copyField(walk, from, copy, from->increment, &failed);
+        copy->left = copyField(walk, from, copy, from->left, &failed);
+        copy->right = copyField(walk, from, copy, from->right, &failed);
+    }
+
+    if (failed) {
+        walk->count = base;
+        fprintf(stderr, "Failed to copy %s: the traversal stack cannot grow.\n", original->name ? original->name : "node");
+        freeASTNode(root);
+        return NULL;
+    }
+    return root;
+}
+
+// Takes ownership of paramList and body: the node holds clones of them, and the
+// originals are released once cloned
 ASTNode* createFunctionNode(char* name, ASTNode* paramList, ASTNode* body) {
     ASTNode* node = createASTNode(NodeType_FunctionDef, name);
     if (!node) {
         fprintf(stderr, "Failed to create function node.\n");
+        freeASTNode(paramList);
+        freeASTNode(body);
         return NULL;
     }
 
-    node->children = malloc(sizeof(ASTNode*) * 2); // Allocate space for parameter list and body
+    node->children = simMalloc(sizeof(ASTNode*) * 2, nodeAllocTag(NodeType_FunctionDef)); // Allocate space for parameter list and body
     if (!node->children) {
         fprintf(stderr, "Memory allocation failed for children in function node.\n");
         freeASTNode(node);
+        freeASTNode(paramList);
+        freeASTNode(body);
         return NULL;
     }
 
@@ -297,7 +734,23 @@ ASTNode* createFunctionNode(char* name, ASTNode* paramList, ASTNode* body) {
     ASTNode* clonedParamList = deepCloneASTNode(paramList);
     if (clonedParamList) {
         node->children[0] = clonedParamList;
-        node->paramCount = countNodes(clonedParamList, NodeType_Parameter); // Count only parameter nodes
+        int parameterCount = countNodes(clonedParamList, NodeType_Parameter); // Count only parameter nodes
+        ASTNode** params = simRealloc(node->params, sizeof(ASTNode*) * (parameterCount > 0 ? parameterCount : 1), nodeAllocTag(NodeType_FunctionDef));
+        if (!params) {
+            fprintf(stderr, "Memory allocation failed for parameters in function node.\n");
+            node->childCount = 1; // The cloned parameter list is freed with the node
+            freeASTNode(node);
+            freeASTNode(paramList);
+            freeASTNode(body);
+            return NULL;
+        }
+        node->params = params;
+        node->paramCount = 0;
+        for (int i = 0; i < clonedParamList->childCount && node->paramCount < parameterCount; i++) {
+            if (clonedParamList->children[i]->type == NodeType_Parameter) {
+                node->params[node->paramCount++] = deepCloneASTNode(clonedParamList->children[i]);
+            }
+        }
     } else {
         node->children[0] = NULL;
         node->paramCount = 0;
@@ -308,24 +761,30 @@ ASTNode* createFunctionNode(char* name, ASTNode* paramList, ASTNode* body) {
     node->children[1] = clonedBody;
 
     node->childCount = 2; // Always two children: parameters and body
+    node->capacity = 2;
+    freeASTNode(paramList);
+    freeASTNode(body);
 
     fprintf(stderr, "Function node created: %s with %d parameters and body\n", name, node->paramCount);
     return node;
 }
 
 
+// Takes ownership of params, whose children are cloned into the call
 ASTNode* createFunctionCallNode(char* name, ASTNode* params) {
     ASTNode* node = createASTNode(NodeType_FunctionCall, name);
     if (!node) {
         fprintf(stderr, "Memory allocation failed for function call node.\n");
+        freeASTNode(params);
         return NULL;
     }
 
     if (params) {
-        node->params = malloc(sizeof(ASTNode*) * params->childCount);
+        node->params = simMalloc(sizeof(ASTNode*) * (params->childCount > 0 ? params->childCount : 1), nodeAllocTag(NodeType_FunctionCall));
         if (!node->params) {
             fprintf(stderr, "Memory allocation failed for parameters in function call node.\n");
             freeASTNode(node);
+            freeASTNode(params);
             return NULL;
         }
 
@@ -336,11 +795,14 @@ ASTNode* createFunctionCallNode(char* name, ASTNode* params) {
                 node->params[i] = clonedParam;
             } else {
                 fprintf(stderr, "Failed to clone parameter for function call.\n");
+                node->paramCount = i;
                 freeASTNode(node);
+                freeASTNode(params);
                 return NULL;
             }
         }
         node->paramCount = params->childCount;
+        freeASTNode(params);
     }
 
     fprintf(stderr, "Function call node created: %s with %d parameters\n", name, node->paramCount);
@@ -351,16 +813,20 @@ ASTNode* createFunctionCallNode(char* name, ASTNode* params) {
 
 
 
+// Takes ownership of compoundStatement; main's body is a clone of it
 ASTNode* createMainFunctionNode(char* name, ASTNode* compoundStatement) {
     ASTNode* node = createASTNode(NodeType_MainFunction, name);
     if (!node) {
         fprintf(stderr, "Failed to create main function node.\n");
+        freeASTNode(compoundStatement);
         return NULL;
     }
 
     // Ensure the compound statement is not NULL before attaching
     if (compoundStatement) {
         node->body = deepCloneASTNode(compoundStatement); // Clone to ensure independence
+        addASTChild(node, node->body); // Keep the body reachable for tree walks
+        freeASTNode(compoundStatement);
         fprintf(stderr, "Main function node created: %s with attached body.\n", name);
     } else {
         fprintf(stderr, "No body provided for main function node: %s. Creating an empty body.\n", name);
@@ -382,11 +848,13 @@ int compareArrayDimensions(ASTNode* node1, ASTNode* node2, MatchTable* table) {
         return 0;
     }
 
-    MatchEntry entry = {node1->name, node2->name, 0, 0, 0, 0};
+    MatchEntry entry = {simStrdup(node1->name, Alloc_MatchTable), simStrdup(node2->name, Alloc_MatchTable), 0, 0, 0, 0};
 
     // Check dimensions count
     if (node1->dimensions != node2->dimensions) {
         fprintf(stderr, "Dimension mismatch for arrays %s and %s: %d vs %d\n", node1->name, node2->name, node1->dimensions, node2->dimensions);
+        simFree(entry.nodeName1);
+        simFree(entry.nodeName2);
         return 0; // No match if the dimension counts differ
     }
 
@@ -421,7 +889,7 @@ ASTNode* createParameterNode(char* type) {
 
     // Initialize more attributes if necessary
     // Example: Adding default values or type checks
-    node->dataType = strdup(type);  // Ensure the type is copied and managed independently
+    node->dataType = simStrdup(type, nodeAllocTag(NodeType_Parameter));  // Ensure the type is copied and managed independently
     node->value = NULL;  // Placeholder for default value or further extension
 
     fprintf(stderr, "Parameter node created: Type %s\n", type);
@@ -455,7 +923,7 @@ ASTNode* createForNode(ASTNode* init, ASTNode* cond, ASTNode* incr, ASTNode* bod
     }
 
     // Allocate space for four children: init, condition, increment, and body
-    node->children = malloc(sizeof(ASTNode*) * 4);
+    node->children = simMalloc(sizeof(ASTNode*) * 4, nodeAllocTag(NodeType_For));
     if (!node->children) {
         fprintf(stderr, "Memory allocation failed for children in 'for' node.\n");
         freeASTNode(node);
@@ -471,6 +939,7 @@ ASTNode* createForNode(ASTNode* init, ASTNode* cond, ASTNode* incr, ASTNode* bod
     node->children[2] = incr;
     node->children[3] = body;
     node->childCount = 4;
+    node->capacity = 4;
 
     fprintf(stderr, "'For' node created with init, condition, increment, and body.\n");
     return node;
@@ -478,22 +947,24 @@ ASTNode* createForNode(ASTNode* init, ASTNode* cond, ASTNode* incr, ASTNode* bod
 
 
 ASTNode* createArrayDeclarationNode(char* name, char* type, int* dimSize, int numDimensions, ASTNode* initExpr) {
-    ASTNode* node = malloc(sizeof(ASTNode));
+    AllocTag tag = nodeAllocTag(NodeType_ArrayDeclaration);
+    ASTNode* node = simCalloc(1, sizeof(ASTNode), tag);
     if (!node) {
         fprintf(stderr, "Memory allocation failed for array declaration node.\n");
         return NULL;
     }
-    
+    statsCount(Stat_NodesCreated, 1);
+
     node->type = NodeType_ArrayDeclaration;
-    node->name = strdup(name);
-    node->dataType = strdup(type);
+    node->name = simStrdup(name, tag);
+    node->dataType = simStrdup(type, tag);
     node->dimensions = numDimensions;
-    node->dimSize = malloc(sizeof(int) * numDimensions);
+    node->dimSize = simMalloc(sizeof(int) * numDimensions, tag);
     if (!node->dimSize) {
         fprintf(stderr, "Failed to allocate memory for dimension sizes.\n");
-        free(node->name);
-        free(node->dataType);
-        free(node);
+        simFree(node->name);
+        simFree(node->dataType);
+        simFree(node);
         return NULL;
     }
     for (int i = 0; i < numDimensions; i++) {
@@ -508,7 +979,7 @@ ASTNode* createArrayDeclarationNode(char* name, char* type, int* dimSize, int nu
 
 // Function to initialize the match table with an initial capacity
 void initMatchTable(MatchTable* table, int initialCapacity) {
-    table->entries = (MatchEntry*)malloc(sizeof(MatchEntry) * initialCapacity);
+    table->entries = simMalloc(sizeof(MatchEntry) * initialCapacity, Alloc_MatchTable);
     if (table->entries == NULL) {
         fprintf(stderr, "Failed to allocate memory for match table entries.\n");
         exit(EXIT_FAILURE);
@@ -522,7 +993,7 @@ void addMatchEntry(MatchTable* table, MatchEntry entry) {
     if (table->count >= table->capacity) {
         // Resize the table if necessary
         int newCapacity = table->capacity * 2;
-        MatchEntry* newEntries = (MatchEntry*)realloc(table->entries, sizeof(MatchEntry) * newCapacity);
+        MatchEntry* newEntries = simRealloc(table->entries, sizeof(MatchEntry) * newCapacity, Alloc_MatchTable);
         if (newEntries == NULL) {
             fprintf(stderr, "Failed to reallocate memory for match table entries.\n");
             exit(EXIT_FAILURE);
@@ -532,11 +1003,13 @@ void addMatchEntry(MatchTable* table, MatchEntry entry) {
     }
     table->entries[table->count] = entry;
     table->count++;
+    statsCount(Stat_MatchEntries, 1);
+    statsPeak(Stat_PeakTableCapacity, (uint64_t)table->capacity);
 }
 
 // Function to free the match table
 void freeMatchTable(MatchTable* table) {
-    free(table->entries);
+    simFree(table->entries);
     table->entries = NULL;
     table->count = 0;
     table->capacity = 0;
@@ -558,19 +1031,19 @@ ASTNode* createArrayNode(char* type, char* name, char* size) {
     }
 
     // Duplicate the type for the data type of the node
-    node->dataType = strdup(type);
+    node->dataType = simStrdup(type, nodeAllocTag(NodeType_ArrayDeclaration));
     if (!node->dataType) {
         fprintf(stderr, "Memory allocation failed for array type in %s.\n", name);
         freeASTNode(node);
         return NULL;
     }
 
-    // Initialize dimensions size array and set the first dimension
+    // Initialize dimensions size array and set the first dimension, replacing the one createASTNode made
     node->dimensions = 1;  // This node represents a single dimension array
-    node->dimSize = malloc(sizeof(int) * node->dimensions);  // Allocate memory for one dimension
+    simFree(node->dimSize);
+    node->dimSize = simMalloc(sizeof(int) * node->dimensions, nodeAllocTag(NodeType_ArrayDeclaration));  // Allocate memory for one dimension
     if (!node->dimSize) {
         fprintf(stderr, "Failed to allocate memory for dimension size in %s.\n", name);
-        free(node->dataType);
         freeASTNode(node);
         return NULL;
     }
@@ -596,19 +1069,19 @@ ASTNode* create2DArrayNode(char* type, char* name, char* size1, char* size2) {
         return NULL;
     }
 
-    node->dataType = strdup(type);
+    node->dataType = simStrdup(type, nodeAllocTag(NodeType_ArrayDeclaration));
     if (!node->dataType) {
         fprintf(stderr, "Memory allocation failed for array type in %s.\n", name);
         freeASTNode(node);
         return NULL;
     }
 
-    // Allocate memory for two dimensions
+    // Allocate memory for two dimensions, replacing the array createASTNode made
     node->dimensions = 2;
-    node->dimSize = malloc(sizeof(int) * node->dimensions);
+    simFree(node->dimSize);
+    node->dimSize = simMalloc(sizeof(int) * node->dimensions, nodeAllocTag(NodeType_ArrayDeclaration));
     if (!node->dimSize) {
         fprintf(stderr, "Failed to allocate memory for dimensions in %s.\n", name);
-        free(node->dataType);
         freeASTNode(node);
         return NULL;
     }
@@ -623,27 +1096,29 @@ ASTNode* create2DArrayNode(char* type, char* name, char* size1, char* size2) {
 
 
 
-ASTNode* createArrayAccessNode(char* arrayName, char* dataType, ASTNode** indices, int indexCount) {
+ASTNode* createArrayAccessNode(char* arrayName, char* dataType, ASTNode** indices, int indexCount, AffineSlotTable* slots) {
     if (!arrayName || !dataType || !indices || indexCount < 1) {
         fprintf(stderr, "Invalid parameters for creating an array access node.\n");
         return NULL;
     }
 
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
+    AllocTag tag = nodeAllocTag(NodeType_ArrayAccess);
+    ASTNode* node = simCalloc(1, sizeof(ASTNode), tag);
     if (!node) {
         fprintf(stderr, "Memory allocation failed for array access node.\n");
         return NULL;
     }
+    statsCount(Stat_NodesCreated, 1);
 
     node->type = NodeType_ArrayAccess;
-    node->name = strdup(arrayName);
-    node->dataType = strdup(dataType);
-    node->indices = (ASTNode**)malloc(sizeof(ASTNode*) * indexCount);
+    node->name = simStrdup(arrayName, tag);
+    node->dataType = simStrdup(dataType, tag);
+    node->indices = simMalloc(sizeof(ASTNode*) * indexCount, tag);
     if (!node->indices) {
         fprintf(stderr, "Failed to allocate memory for indices.\n");
-        free(node->name);
-        free(node->dataType);
-        free(node);
+        simFree(node->name);
+        simFree(node->dataType);
+        simFree(node);
         return NULL;
     }
 
@@ -651,66 +1126,200 @@ ASTNode* createArrayAccessNode(char* arrayName, char* dataType, ASTNode** indice
         if (!indices[i]) {
             fprintf(stderr, "Null index expression found.\n");
             while (i-- > 0) {  // Free any already assigned indices to avoid memory leaks
-                free(node->indices[i]);
+                freeASTNode(node->indices[i]);
             }
-            free(node->indices);
-            free(node->name);
-            free(node->dataType);
-            free(node);
+            simFree(node->indices);
+            simFree(node->name);
+            simFree(node->dataType);
+            simFree(node);
             return NULL;
         }
         node->indices[i] = indices[i];  // Assume indices[i] is already a pointer to a valid ASTNode
     }
     node->indexCount = indexCount;
 
+    // Lower each index once into its affine normal form
+    node->affine = simMalloc(sizeof(AffineForm) * indexCount, tag);
+    if (node->affine) {
+        for (int i = 0; i < indexCount; i++) {
+            lowerToAffineForm(indices[i], &node->affine[i], slots);
+        }
+    } else {
+        fprintf(stderr, "Failed to allocate affine forms for %s.\n", arrayName);
+    }
+
     return node;
 }
 
 
 
-int compareASTNodes(ASTNode* node1, ASTNode* node2) {
-    if (!node1 || !node2) {
-        fprintf(stderr, "Comparison failed: One or both nodes are null.\n");
-        return 0; // Return immediately if either node is null.
+void freeAffineSlots(AffineSlotTable* slots) {
+    for (int i = 0; i < slots->count; i++) {
+        simFree(slots->names[i]);
+        slots->names[i] = NULL;
     }
+    slots->count = 0;
+}
 
-    fprintf(stderr, "Comparing nodes of type %d and %d\n", node1->type, node2->type);
+// Hands the slot table of the file just parsed over to its Root node
+void storeAffineSlots(ASTNode* root, AffineSlotTable* slots) {
+    if (!root) return;
+    root->affineSlots = simMalloc(sizeof(char*) * AFFINE_MAX_VARS, Alloc_Slots);
+    if (!root->affineSlots) {
+        fprintf(stderr, "Failed to allocate affine slot table.\n");
+        freeAffineSlots(slots);
+        return;
+    }
+    for (int i = 0; i < slots->count; i++) {
+        root->affineSlots[i] = slots->names[i];
+        slots->names[i] = NULL;
+    }
+    root->affineSlotCount = slots->count;
+    slots->count = 0;
+}
 
-    int score = 0;
+int affineSlotOf(ASTNode* root, const char* name) {
+    if (!root || !name) return -1;
+    for (int i = 0; i < root->affineSlotCount; i++) {
+        if (strcmp(root->affineSlots[i], name) == 0) return i;
+    }
+    return -1;
+}
 
-    // Check for type matching and provide a high initial score for matching types.
-    if (node1->type == node2->type) {
-        fprintf(stderr, "Node types match. Initial score set to 30.\n");
-        score += 30; // Types match, allocate base score.
+// Slot of name in the table, added on first use; -1 once the table is full
+int affineSlotFor(AffineSlotTable* slots, const char* name) {
+    for (int i = 0; i < slots->count; i++) {
+        if (strcmp(slots->names[i], name) == 0) return i;
+    }
+    if (slots->count == AFFINE_MAX_VARS) {
+        fprintf(stderr, "Affine slot table full, %s is treated as non-affine.\n", name);
+        return -1;
+    }
+    slots->names[slots->count] = simStrdup(name, Alloc_Slots);
+    return slots->count++;
+}
+
+static int isNumericConstant(ASTNode* node, int* value) {
+    if (!node || node->type != NodeType_Constant || !node->name || !node->name[0]) return 0;
+    for (const char* p = node->name; *p; p++) {
+        if (*p < '0' || *p > '9') return 0;
+    }
+    *value = atoi(node->name);
+    return 1;
+}
+
+static int pushScaledTerm(WalkStack* walk, ASTNode* term, int scale) {
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return 0;
+    frame->node1 = term;
+    frame->score = scale;
+    return 1;
+}
 
-        if (node1->name && node2->name && strcmp(node1->name, node2->name) == 0) {
-            fprintf(stderr, "Node names match (%s). Adding 20 to score.\n", node1->name);
-            score += 20; // Increase score for matching names.
+// Each frame holds a term still to be added in node1 and the factor it is scaled by in
+// score. Terms are added left to right, the order slots are handed out in.
+static int accumulateAffine(ASTNode* expr, int scale, AffineForm* form, AffineSlotTable* slots) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
+    int affine = pushScaledTerm(walk, expr, scale);
+
+    while (affine && walk->count > base) {
+        WalkFrame term = walk->frames[--walk->count];
+        ASTNode* node = term.node1;
+        if (!node) {
+            affine = 0;
+            break;
         }
 
-        if (node1->value && node2->value && strcmp(node1->value, node2->value) == 0) {
-            fprintf(stderr, "Node values match (%s). Adding 10 to score.\n", node1->value);
-            score += 10; // Values match, increase score.
+        int value;
+        if (isNumericConstant(node, &value)) {
+            form->constant += term.score * value;
+            continue;
         }
 
-        if (node1->dataType && node2->dataType && strcmp(node1->dataType, node2->dataType) == 0) {
-            fprintf(stderr, "Node data types match (%s). Adding 10 to score.\n", node1->dataType);
-            score += 10; // Data types match, further increase score.
+        if (node->type == NodeType_Identifier) {
+            int slot = affineSlotFor(slots, node->name);
+            if (slot < 0) affine = 0;
+            else form->coefficients[slot] += term.score;
+            continue;
         }
 
-        int childScoreSum = 0;
-        for (int i = 0; i < min(node1->childCount, node2->childCount); i++) {
-            int childScore = compareASTNodes(node1->children[i], node2->children[i]);
-            fprintf(stderr, "Child %d score: %d\n", i + 1, childScore);
-            childScoreSum += childScore; // Sum child scores.
+        affine = 0;
+        if (node->type == NodeType_Expression && node->childCount == 2 && node->name) {
+            if (strcmp(node->name, "+") == 0) {
+                affine = pushScaledTerm(walk, node->children[1], term.score) && pushScaledTerm(walk, node->children[0], term.score);
+            } else if (strcmp(node->name, "-") == 0) {
+                affine = pushScaledTerm(walk, node->children[1], -term.score) && pushScaledTerm(walk, node->children[0], term.score);
+            } else if (strcmp(node->name, "*") == 0) {
+                if (isNumericConstant(node->children[0], &value)) affine = pushScaledTerm(walk, node->children[1], term.score * value);
+                else if (isNumericConstant(node->children[1], &value)) affine = pushScaledTerm(walk, node->children[0], term.score * value);
+            }
         }
+    }
+
+    walk->count = base;
+    return affine;
+}
+
+// Lowers an index expression into a dense coefficient vector over the slot variables
+int lowerToAffineForm(ASTNode* expr, AffineForm* form, AffineSlotTable* slots) {
+    memset(form, 0, sizeof(AffineForm));
+    form->isAffine = slots && accumulateAffine(expr, 1, form, slots);
+    if (!form->isAffine) {
+        memset(form->coefficients, 0, sizeof(form->coefficients));
+        form->constant = 0;
+    }
+    return form->isAffine;
+}
 
-        if (node1->childCount > 0 && node2->childCount > 0) {
-            score += (childScoreSum / min(node1->childCount, node2->childCount)); // Average child scores.
+// Fixed-width, branch-free comparison; the loop vectorizes
+int affineFormsEqual(const AffineForm* a, const AffineForm* b) {
+    int difference = (a->constant ^ b->constant) | (a->isAffine ^ b->isAffine) | !a->isAffine;
+    for (int i = 0; i < AFFINE_MAX_VARS; i++) {
+        difference |= a->coefficients[i] ^ b->coefficients[i];
+    }
+    return difference == 0;
+}
+
+// Row-major flattening of an access against its declaration: m[i][j] in int m[R][C] becomes i*C + j
+void linearizeArrayAccess(ASTNode* access, ASTNode* declaration) {
+    if (!access || access->type != NodeType_ArrayAccess || !access->affine) return;
+
+    AffineForm linear;
+    memset(&linear, 0, sizeof(AffineForm));
+
+    if (access->indexCount == 1) {
+        linear = access->affine[0];
+    } else if (access->indexCount == 2 && declaration && declaration->dimensions == 2 && declaration->dimSize) {
+        int rowLength = declaration->dimSize[1];
+        const AffineForm* row = &access->affine[0];
+        const AffineForm* column = &access->affine[1];
+        linear.isAffine = row->isAffine && column->isAffine;
+        if (linear.isAffine) {
+            for (int i = 0; i < AFFINE_MAX_VARS; i++) {
+                linear.coefficients[i] = row->coefficients[i] * rowLength + column->coefficients[i];
+            }
+            linear.constant = row->constant * rowLength + column->constant;
         }
     } else {
-        fprintf(stderr, "Node types do not match. Minimal score of 5 allocated.\n");
-        score += 5; // Minimal score for non-matching types to recognize effort.
+        return; // Cannot flatten without the row length
+    }
+
+    if (!access->linearAffine) {
+        access->linearAffine = simMalloc(sizeof(AffineForm), nodeAllocTag(NodeType_ArrayAccess));
+        if (!access->linearAffine) {
+            fprintf(stderr, "Failed to allocate flattened affine form for %s.\n", access->name);
+            return;
+        }
+    }
+    *access->linearAffine = linear;
+}
+
+// Last step of compareASTNodes for one pair: average in the child scores and normalize
+static int finishNodeComparison(ASTNode* node1, ASTNode* node2, int score, int childScoreSum) {
+    if (node1->type == node2->type && node1->childCount > 0 && node2->childCount > 0) {
+        score += (childScoreSum / min(node1->childCount, node2->childCount)); // Average child scores.
     }
 
     fprintf(stderr, "Total score before normalization: %d\n", score);
@@ -720,6 +1329,104 @@ int compareASTNodes(ASTNode* node1, ASTNode* node2) {
     return normalizedScore;
 }
 
+// Scores what can be scored of a pair before its children. Returns the score, or
+// WALK_DESCENDED after pushing a frame when the children still have to be compared.
+static int startNodeComparison(WalkStack* walk, ASTNode* node1, ASTNode* node2) {
+    if (!node1 || !node2) {
+        fprintf(stderr, "Comparison failed: One or both nodes are null.\n");
+        return 0; // Return immediately if either node is null.
+    }
+
+    fprintf(stderr, "Comparing nodes of type %d and %d\n", node1->type, node2->type);
+
+    int score = 0;
+
+    // Check for type matching and provide a high initial score for matching types.
+    if (node1->type != node2->type) {
+        fprintf(stderr, "Node types do not match. Minimal score of 5 allocated.\n");
+        score += 5; // Minimal score for non-matching types to recognize effort.
+        return finishNodeComparison(node1, node2, score, 0);
+    }
+
+    fprintf(stderr, "Node types match. Initial score set to 30.\n");
+    score += 30; // Types match, allocate base score.
+
+    if (node1->name && node2->name && strcmp(node1->name, node2->name) == 0) {
+        fprintf(stderr, "Node names match (%s). Adding 20 to score.\n", node1->name);
+        score += 20; // Increase score for matching names.
+    }
+
+    if (node1->value && node2->value && strcmp(node1->value, node2->value) == 0) {
+        fprintf(stderr, "Node values match (%s). Adding 10 to score.\n", node1->value);
+        score += 10; // Values match, increase score.
+    }
+
+    if (node1->dataType && node2->dataType && strcmp(node1->dataType, node2->dataType) == 0) {
+        fprintf(stderr, "Node data types match (%s). Adding 10 to score.\n", node1->dataType);
+        score += 10; // Data types match, further increase score.
+    }
+
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return WALK_FAILED;
+    frame->node1 = node1;
+    frame->node2 = node2;
+    frame->score = score;
+    return WALK_DESCENDED;
+}
+
+int compareASTNodes(ASTNode* node1, ASTNode* node2) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
+    int result = startNodeComparison(walk, node1, node2);
+    if (result == WALK_FAILED) return 0;
+
+    // The frame's counters are kept in locals and only stored when descending
+    while (walk->count > base) {
+        WalkFrame* frame = &walk->frames[walk->count - 1];
+        ASTNode* parent1 = frame->node1;
+        ASTNode* parent2 = frame->node2;
+        int next = frame->next;
+        int childScoreSum = frame->sum;
+        if (frame->pending) { // The child comparison it was waiting for has finished
+            fprintf(stderr, "Child %d score: %d\n", next, result);
+            childScoreSum += result; // Sum child scores.
+        }
+
+        // Children scored without a frame of their own are summed right away
+        int descended = 0;
+        while (!descended && next < min(parent1->childCount, parent2->childCount)) {
+            if (budgetExhausted()) { // The caller discards the score
+                walk->count = base;
+                return 0;
+            }
+            result = startNodeComparison(walk, parent1->children[next], parent2->children[next]);
+            if (result == WALK_FAILED) {
+                walk->count = base;
+                return 0;
+            }
+            next++;
+            descended = result == WALK_DESCENDED;
+            if (!descended) {
+                fprintf(stderr, "Child %d score: %d\n", next, result);
+                childScoreSum += result;
+            }
+        }
+        if (descended) {
+            frame = &walk->frames[walk->count - 2]; // The push may have moved it
+            frame->next = next;
+            frame->sum = childScoreSum;
+            frame->pending = 1;
+            continue;
+        }
+
+        result = finishNodeComparison(parent1, parent2, frame->score, childScoreSum);
+        walk->count--;
+    }
+
+    return result;
+}
+
 
 
 
@@ -758,10 +1465,18 @@ void printAST(ASTNode* root) {
         return;
     }
 
-    void printASTNode(ASTNode* node, int level) {
-        if (!node) return; // Guard against null node references.
+    printf("Printing AST:\n");
 
-        for (int i = 0; i < level; i++) printf("  "); // Indent based on the depth level.
+    // Pre-order from the root at level 0; children are pushed last one first to print in order
+    WalkStack* walk = threadWalkStack();
+    if (!walk || !pushWalkNode(walk, root)) return;
+    int base = walk->count - 1;
+
+    while (walk->count > base) {
+        WalkFrame frame = walk->frames[--walk->count];
+        ASTNode* node = frame.node1;
+
+        for (int i = 0; i < frame.level; i++) printf("  "); // Indent based on the depth level.
 
         printf("Node Type: %d, Name: %s", node->type, node->name ? node->name : "Unnamed");
 
@@ -784,16 +1499,21 @@ void printAST(ASTNode* root) {
 
         if (node->childCount > 0) {
             printf(", Children: %d\n", node->childCount);
-            for (int i = 0; i < node->childCount; i++) {
-                printASTNode(node->children[i], level + 1); // Recursive call to print children.
+            for (int i = node->childCount - 1; i >= 0; i--) {
+                if (!node->children[i]) continue; // Guard against null node references.
+                WalkFrame* child = pushWalkFrame(walk);
+                if (!child) {
+                    printf("(AST truncated: out of memory)\n");
+                    walk->count = base;
+                    return;
+                }
+                child->node1 = node->children[i];
+                child->level = frame.level + 1;
             }
         } else {
             printf("\n");
         }
     }
-
-    printf("Printing AST:\n");
-    printASTNode(root, 0); // Start from the root at level 0.
 }
 
 
@@ -852,7 +1572,7 @@ int countNodesOfType(ASTNode* root, NodeType type) {
 
     int count = 0;
     int capacity = 100; // Initial stack capacity
-    ASTNode** stack = malloc(capacity * sizeof(ASTNode*));
+    ASTNode** stack = simMalloc(capacity * sizeof(ASTNode*), Alloc_Scratch);
     if (!stack) {
         fprintf(stderr, "Memory allocation failed for stack in countNodesOfType.\n");
         return -1; // Memory allocation failure
@@ -874,10 +1594,10 @@ int countNodesOfType(ASTNode* root, NodeType type) {
             if (current->children[i]) {
                 if (top == capacity) { // Check if stack needs expansion
                     capacity *= 2;
-                    ASTNode** newStack = realloc(stack, capacity * sizeof(ASTNode*));
+                    ASTNode** newStack = simRealloc(stack, capacity * sizeof(ASTNode*), Alloc_Scratch);
                     if (!newStack) {
                         fprintf(stderr, "Stack resizing failed in countNodesOfType.\n");
-                        free(stack);
+                        simFree(stack);
                         return -1; // Handle reallocation failure
                     }
                     stack = newStack;
@@ -887,17 +1607,58 @@ int countNodesOfType(ASTNode* root, NodeType type) {
         }
     }
 
-    free(stack);
+    simFree(stack);
     return count;
 }
 
 
-int compareExpressions(ASTNode *expr1, ASTNode *expr2) {
+// How compareExpressions combines the scores of the operand pairs of two compound expressions
+typedef enum OperandMode {
+    Operands_None,     // Nothing to compare below the node
+    Operands_Ordered,  // Canonical commutative: left with left, right with right
+    Operands_Commuted, // Commutative: the better of both pairings
+    Operands_Weighted  // Same operator: left counts 0.6, right 0.4
+} OperandMode;
+
+static int operandPairCount(int mode) {
+    return mode == Operands_Commuted ? 4 : mode == Operands_None ? 0 : 2;
+}
+
+// Last step of compareExpressions for one pair, once its operand pairs are scored
+static int finishExpressionComparison(int mode, int score, const int* results) {
+    if (mode == Operands_Ordered) {
+        score += results[0] + results[1];
+        fprintf(stderr, "Ordered canonical score: %d\n", score);
+    } else if (mode == Operands_Commuted) {
+        int normalOrder = results[0] + results[1];
+        int reverseOrder = results[2] + results[3];
+        score += max(normalOrder, reverseOrder);
+        fprintf(stderr, "Commuted score: %d\n", score);
+    } else if (mode == Operands_Weighted) {
+        score += results[0] * 0.6 + results[1] * 0.4;
+    }
+
+    // Normalize and cap the score
+    score = (score > 100) ? 100 : score;
+    fprintf(stderr, "Normalized score for expressions: %d\n", score);
+
+    return score;
+}
+
+// Scores a pair as far as it can without its operands. Returns the score, or
+// WALK_DESCENDED after pushing a frame when operand pairs still have to be compared.
+static int startExpressionComparison(WalkStack* walk, ASTNode* expr1, ASTNode* expr2) {
     if (!expr1 || !expr2) {
         fprintf(stderr, "Error: One of the expression nodes is null.\n");
         return 0; // Early exit if any expression is null.
     }
 
+    // The same hash-consed subtree on both sides: it is canonical, so this is the canonical match below
+    if (expr1 == expr2 && expr1->shareCount) {
+        fprintf(stderr, "Shared expression, skipping detailed comparison.\n");
+        return 100;
+    }
+
     int score = 0;
 
     // Check for type matching and handle different expression types with specific logic.
@@ -906,6 +1667,14 @@ int compareExpressions(ASTNode *expr1, ASTNode *expr2) {
         return 0; // Exit if expression types don't match.
     }
 
+    // Canonicalized subtrees with the same structural hash are identical, once a
+    // collision is ruled out
+    int bothCanonical = expr1->canonical && expr2->canonical;
+    if (bothCanonical && expr1->structHash == expr2->structHash && sameStructure(expr1, expr2)) {
+        fprintf(stderr, "Canonical forms match, skipping detailed comparison.\n");
+        return 100;
+    }
+
     // Constants or identifiers comparison
     if (expr1->type == NodeType_Constant || expr1->type == NodeType_Identifier) {
         if (strcmp(expr1->name, expr2->name) == 0) {
@@ -926,46 +1695,100 @@ int compareExpressions(ASTNode *expr1, ASTNode *expr2) {
     }
 
     // Detailed comparison for binary and unary expressions
+    int mode = Operands_None;
     if (expr1->type == NodeType_Expression && expr1->children && expr2->children) {
         fprintf(stderr, "Comparing compound expressions.\n");
-        // Handle commutative operations where the order of operands doesn't matter
-        if (isCommutative(expr1->name) && strcmp(expr1->name, expr2->name) == 0) {
-            int normalOrder = compareExpressions(expr1->children[0], expr2->children[0]) +
-                              compareExpressions(expr1->children[1], expr2->children[1]);
-            int reverseOrder = compareExpressions(expr1->children[0], expr2->children[1]) +
-                               compareExpressions(expr1->children[1], expr2->children[0]);
-            score += max(normalOrder, reverseOrder);
-            fprintf(stderr, "Commuted score: %d\n", score);
-        } else if (strcmp(expr1->name, expr2->name) == 0) {
-            score += compareExpressions(expr1->children[0], expr2->children[0]) * 0.6 +
-                     compareExpressions(expr1->children[1], expr2->children[1]) * 0.4;
+        // Handle commutative operations where the order of operands doesn't matter.
+        // Canonical operands are already sorted, so the plain order is enough there.
+        int sameOperator = strcmp(expr1->name, expr2->name) == 0;
+        if (isCommutative(expr1->name) && sameOperator) {
+            mode = bothCanonical ? Operands_Ordered : Operands_Commuted;
+        } else if (sameOperator) {
+            mode = Operands_Weighted;
         }
     }
 
-    // Normalize and cap the score
-    score = (score > 100) ? 100 : score;
-    fprintf(stderr, "Normalized score for expressions: %d\n", score);
+    if (mode == Operands_None) {
+        return finishExpressionComparison(mode, score, NULL);
+    }
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return WALK_FAILED;
+    frame->node1 = expr1;
+    frame->node2 = expr2;
+    frame->mode = mode;
+    frame->score = score;
+    return WALK_DESCENDED;
+}
 
-    return score;
+int compareExpressions(ASTNode *expr1, ASTNode *expr2) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
+    int result = startExpressionComparison(walk, expr1, expr2);
+    if (result == WALK_FAILED) return 0;
+
+    // Operand pairs in order: left-left, right-right, then left-right and right-left
+    while (walk->count > base) {
+        WalkFrame* frame = &walk->frames[walk->count - 1];
+        if (frame->pending) { // The operand pair it was waiting for has been scored
+            frame->results[frame->next - 1] = result;
+            frame->pending = 0;
+        }
+
+        // Operand pairs scored without a frame of their own are stored right away
+        int descended = 0;
+        while (!descended && frame->next < operandPairCount(frame->mode)) {
+            int pair = frame->next++;
+            ASTNode* operand1 = frame->node1->children[pair & 1];
+            ASTNode* operand2 = frame->node2->children[pair == 1 || pair == 2];
+            result = startExpressionComparison(walk, operand1, operand2);
+            if (result == WALK_FAILED) {
+                walk->count = base;
+                return 0;
+            }
+            descended = result == WALK_DESCENDED;
+            if (!descended) {
+                frame = &walk->frames[walk->count - 1]; // A nested sameStructure walk may have moved it
+                frame->results[pair] = result;
+            }
+        }
+        if (descended) {
+            walk->frames[walk->count - 2].pending = 1; // The push may have moved the frame
+            continue;
+        }
+
+        result = finishExpressionComparison(frame->mode, frame->score, frame->results);
+        walk->count--;
+    }
+
+    return result;
 }
 
 
 
 
-int compareExpressionsDeep(ASTNode* expr1, ASTNode* expr2) {
+// Scores a pair as far as it can without its children. Returns the score, or
+// WALK_DESCENDED after pushing a frame when the children still have to be compared.
+static int startDeepComparison(WalkStack* walk, ASTNode* expr1, ASTNode* expr2) {
     if (!expr1 || !expr2) return 0; // Null checks
 
+    // Shared (hash-consed) subtrees compare by identity, and identical canonical ones need no walk
+    if ((expr1 == expr2 && expr1->shareCount) ||
+        (expr1->canonical && expr2->canonical && expr1->structHash == expr2->structHash && sameStructure(expr1, expr2))) {
+        return 100;
+    }
+
     // Basic type and name comparison
     if (expr1->type != expr2->type || strcmp(expr1->name, expr2->name) != 0)
         return 0;
 
-    // Recursively compare children nodes if both expressions have children
+    // Children are compared if both expressions have them
     if (expr1->children && expr2->children) {
-        int score = 0;
-        for (int i = 0; i < min(expr1->childCount, expr2->childCount); i++) {
-            score += compareExpressionsDeep(expr1->children[i], expr2->children[i]);
-        }
-        return score / max(1, min(expr1->childCount, expr2->childCount)); // Normalize score by number of children
+        WalkFrame* frame = pushWalkFrame(walk);
+        if (!frame) return WALK_FAILED;
+        frame->node1 = expr1;
+        frame->node2 = expr2;
+        return WALK_DESCENDED;
     }
 
     // If no children, compare values directly (if applicable)
@@ -976,6 +1799,49 @@ int compareExpressionsDeep(ASTNode* expr1, ASTNode* expr2) {
     return 100; // If reached here, expressions matched at all checked levels
 }
 
+int compareExpressionsDeep(ASTNode* expr1, ASTNode* expr2) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
+    int result = startDeepComparison(walk, expr1, expr2);
+    if (result == WALK_FAILED) return 0;
+
+    // The frame's counters are kept in locals and only stored when descending
+    while (walk->count > base) {
+        WalkFrame* frame = &walk->frames[walk->count - 1];
+        ASTNode* node1 = frame->node1;
+        ASTNode* node2 = frame->node2;
+        int next = frame->next;
+        int sum = frame->sum + (frame->pending ? result : 0);
+        int compared = min(node1->childCount, node2->childCount);
+
+        // Children scored without a frame of their own are summed right away
+        int descended = 0;
+        while (!descended && next < compared) {
+            result = startDeepComparison(walk, node1->children[next], node2->children[next]);
+            if (result == WALK_FAILED) {
+                walk->count = base;
+                return 0;
+            }
+            next++;
+            descended = result == WALK_DESCENDED;
+            if (!descended) sum += result;
+        }
+        if (descended) {
+            frame = &walk->frames[walk->count - 2]; // The push may have moved it
+            frame->next = next;
+            frame->sum = sum;
+            frame->pending = 1;
+            continue;
+        }
+
+        result = sum / max(1, compared); // Normalize score by number of children
+        walk->count--;
+    }
+
+    return result;
+}
+
 int compareArrayNodes(ASTNode* node1, ASTNode* node2, MatchTable* matchTable) {
     if (!node1 || !node2) {
         fprintf(stderr, "Error: One or both array nodes are null.\n");
@@ -1042,7 +1908,7 @@ int compareArrayInitializations(ASTNode* node1, ASTNode* node2, MatchTable* tabl
     }
 
     // Initialize the entry for the match table with the relevant node names
-    MatchEntry entry = {node1->name, node2->name, 0, 0, 0, 0};
+    MatchEntry entry = {simStrdup(node1->name, Alloc_MatchTable), simStrdup(node2->name, Alloc_MatchTable), 0, 0, 0, 0};
 
     // Compare initialization expressions if both nodes have an initialization
     if (node1->initExpr && node2->initExpr) {
@@ -1095,34 +1961,48 @@ int compareArrayIndices(ASTNode* node1, ASTNode* node2, MatchTable* table) {
     }
 
     // Update the match table with the index comparison score
-    updateMatchTable(table, node1->name, node2->name, 0, 0, totalScore); // Update only the index match score
+    updateMatchTable(table, displayName(node1), displayName(node2), 0, 0, totalScore); // Update only the index match score
 
     return totalScore;
 }
 
 void traverseAndCollect(ASTNode* node, NodeType type, ASTNode*** collectedNodes, int* count, int* capacity) {
-    if (!node) return;
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return;
+    int base = walk->count;
+    if (node && !pushWalkNode(walk, node)) return;
 
-    fprintf(stderr, "Visiting node %s of type %d.\n", node->name, node->type);
+    // Pre-order; children are pushed last one first so they are collected in source order
+    while (walk->count > base) {
+        ASTNode* current = walk->frames[--walk->count].node1;
 
-    if (node->type == type) {
-        if (*count >= *capacity) {
-            // Increase capacity
-            int oldCapacity = *capacity;
-            *capacity *= 2;
-            *collectedNodes = realloc(*collectedNodes, (*capacity) * sizeof(ASTNode*));
-            if (!*collectedNodes) {
-                fprintf(stderr, "Memory allocation failed during array resizing from %d to %d.\n", oldCapacity, *capacity);
-                return;
+        fprintf(stderr, "Visiting node %s of type %d.\n", current->name, current->type);
+
+        if (current->type == type) {
+            if (*count >= *capacity) {
+                // Increase capacity
+                int oldCapacity = *capacity;
+                *capacity *= 2;
+                ASTNode** grown = simRealloc(*collectedNodes, (*capacity) * sizeof(ASTNode*), Alloc_Scratch);
+                if (!grown) {
+                    fprintf(stderr, "Memory allocation failed during array resizing from %d to %d.\n", oldCapacity, *capacity);
+                    *capacity = oldCapacity;
+                    walk->count = base;
+                    return;
+                }
+                *collectedNodes = grown;
             }
+            (*collectedNodes)[*count] = current;
+            fprintf(stderr, "Collected node %s of type %d at index %d.\n", current->name, current->type, *count);
+            (*count)++;
         }
-        (*collectedNodes)[*count] = node;
-        fprintf(stderr, "Collected node %s of type %d at index %d.\n", node->name, node->type, *count);
-        (*count)++;
-    }
 
-    for (int i = 0; i < node->childCount; i++) {
-        traverseAndCollect(node->children[i], type, collectedNodes, count, capacity);
+        for (int i = current->childCount - 1; i >= 0; i--) {
+            if (current->children[i] && !pushWalkNode(walk, current->children[i])) {
+                walk->count = base; // What was collected so far is kept
+                return;
+            }
+        }
     }
 }
 
@@ -1135,8 +2015,9 @@ ASTNode** collectNodesOfType(ASTNode* root, NodeType type, int* count) {
         return NULL;
     }
 
+    // Released by the caller with simFree
     int capacity = 10; // Start with some capacity
-    ASTNode** collectedNodes = malloc(capacity * sizeof(ASTNode*));
+    ASTNode** collectedNodes = simMalloc(capacity * sizeof(ASTNode*), Alloc_Scratch);
     if (!collectedNodes) {
         fprintf(stderr, "Memory allocation failed for node collection.\n");
         *count = 0;
@@ -1144,11 +2025,13 @@ ASTNode** collectNodesOfType(ASTNode* root, NodeType type, int* count) {
     }
 
     *count = 0; // Initialize count
+    uint64_t started = statsPhaseStart();
     traverseAndCollect(root, type, &collectedNodes, count, &capacity);
+    statsPhaseEnd(Phase_Collect, started);
 
     if (*count == 0) {
         fprintf(stderr, "No nodes of specified type (%d) found.\n", type);
-        free(collectedNodes);
+        simFree(collectedNodes);
         return NULL;
     }
 
@@ -1160,12 +2043,12 @@ ASTNode** collectNodesOfType(ASTNode* root, NodeType type, int* count) {
 
 
 MatchTable* initializeMatchTable() {
-    MatchTable* table = malloc(sizeof(MatchTable));
+    MatchTable* table = simMalloc(sizeof(MatchTable), Alloc_MatchTable);
     if (!table) {
         fprintf(stderr, "Memory allocation failed for MatchTable\n");
         return NULL;
     }
-    table->entries = malloc(sizeof(MatchEntry) * 10); // Initial capacity
+    table->entries = simMalloc(sizeof(MatchEntry) * 10, Alloc_MatchTable); // Initial capacity
     table->count = 0;
     table->capacity = 10;
     return table;
@@ -1176,21 +2059,23 @@ void updateMatchTable(MatchTable* table, const char* name1, const char* name2, i
     if (table->count >= table->capacity) {
         // Resize the table if necessary
         table->capacity *= 2;
-        table->entries = realloc(table->entries, sizeof(MatchEntry) * table->capacity);
+        table->entries = simRealloc(table->entries, sizeof(MatchEntry) * table->capacity, Alloc_MatchTable);
         if (!table->entries) {
             fprintf(stderr, "Failed to reallocate memory for MatchTable entries\n");
             return;
         }
     }
     MatchEntry entry = {
-        .nodeName1 = strdup(name1),
-        .nodeName2 = strdup(name2),
+        .nodeName1 = simStrdup(name1, Alloc_MatchTable),
+        .nodeName2 = simStrdup(name2, Alloc_MatchTable),
         .dimensionsMatch = dimMatch,
         .initializationMatch = initMatch,
         .indexMatch = indexMatch,
         .totalScore = dimMatch + initMatch + indexMatch
     };
     table->entries[table->count++] = entry;
+    statsCount(Stat_MatchEntries, 1);
+    statsPeak(Stat_PeakTableCapacity, (uint64_t)table->capacity);
 }
 
 // Retrieve a MatchEntry from the MatchTable
@@ -1207,29 +2092,77 @@ MatchEntry* getMatchEntry(MatchTable* table, const char* name1, const char* name
 // Clean up and finalize the MatchTable
 void finalizeMatchTable(MatchTable* table) {
     for (int i = 0; i < table->count; i++) {
-        free(table->entries[i].nodeName1);
-        free(table->entries[i].nodeName2);
+        simFree(table->entries[i].nodeName1);
+        simFree(table->entries[i].nodeName2);
     }
-    free(table->entries);
-    free(table);
+    simFree(table->entries);
+    simFree(table);
 }
 
 
-int compareExpressionPatterns(ASTNode* expr1, ASTNode* expr2) {
-    if (!expr1 || !expr2) return 0; // Handle NULL expressions
+// The pair scores of the array comparisons, shared by compareArrayDeclarations and
+// compareArrayAccesses and by the sampled pairs, which skip the log lines and match entry
 
+// Type and name of a declaration pair
+static int declarationMatchScore(ASTNode* decl1, ASTNode* decl2) {
     int score = 0;
+    if (strcmp(decl1->dataType, decl2->dataType) == 0) score += 20;
+    if (strcmp(decl1->name, decl2->name) == 0) score += 30;
+    return score;
+}
+
+// Dimension count and the sizes of each dimension
+static int dimensionsMatchScore(ASTNode* decl1, ASTNode* decl2) {
+    if (decl1->dimensions != decl2->dimensions) return 0;
+    int score = 20;
+    for (int i = 0; i < decl1->dimensions; i++) {
+        if (decl1->dimSize[i] == decl2->dimSize[i]) score += 10;
+    }
+    return score;
+}
+
+int scoreDeclarationPair(ASTNode* decl1, ASTNode* decl2) {
+    return declarationMatchScore(decl1, decl2) + dimensionsMatchScore(decl1, decl2);
+}
+
+// Indices are only compared as patterns when both are the same identifier
+static int indexPatternScore(ASTNode* expr1, ASTNode* expr2) {
+    if (!expr1 || !expr2 || expr1->type != NodeType_Identifier || expr2->type != NodeType_Identifier) return 0;
+    return strcmp(expr1->name, expr2->name) == 0 ? 20 : 0;
+}
+
+// Index i of two accesses with as many indices: affine normal forms first, expression patterns as the fallback
+static int indexPairScore(ASTNode* access1, ASTNode* access2, int i) {
+    if (access1->affine && access2->affine && affineFormsEqual(&access1->affine[i], &access2->affine[i])) return 20;
+    return indexPatternScore(access1->indices[i], access2->indices[i]);
+}
+
+// m[i][j] against a flattened m[i*C+j]
+static int flattenedIndicesMatch(ASTNode* access1, ASTNode* access2) {
+    return access1->linearAffine && access2->linearAffine && affineFormsEqual(access1->linearAffine, access2->linearAffine);
+}
+
+int scoreAccessPair(ASTNode* access1, ASTNode* access2) {
+    if (access1->indexCount == access2->indexCount) {
+        int score = 0;
+        for (int i = 0; i < access1->indexCount; i++) score += indexPairScore(access1, access2, i);
+        return score;
+    }
+    if (flattenedIndicesMatch(access1, access2)) return 20 * max(access1->indexCount, access2->indexCount);
+    return 0;
+}
+
+int compareExpressionPatterns(ASTNode* expr1, ASTNode* expr2) {
+    if (!expr1 || !expr2) return 0; // Handle NULL expressions
 
     // Compare only identifiers, which are used as indices in the array access
-    if (expr1->type == NodeType_Identifier && expr2->type == NodeType_Identifier) {
-        if (strcmp(expr1->name, expr2->name) == 0) {
-            score += 20; // Exact match of identifiers
-            fprintf(stderr, "Matching indices (%s), score: 20\n", expr1->name);
-        } else {
-            fprintf(stderr, "Indices do not match: %s vs %s\n", expr1->name, expr2->name);
-        }
-    } else {
+    int score = indexPatternScore(expr1, expr2);
+    if (expr1->type != NodeType_Identifier || expr2->type != NodeType_Identifier) {
         fprintf(stderr, "Non-identifier nodes detected, comparison not applicable for indices.\n");
+    } else if (score) {
+        fprintf(stderr, "Matching indices (%s), score: %d\n", expr1->name, score);
+    } else {
+        fprintf(stderr, "Indices do not match: %s vs %s\n", expr1->name, expr2->name);
     }
 
     return score;
@@ -1244,8 +2177,8 @@ int compareArrayDeclarations(ASTNode* decl1, ASTNode* decl2, MatchTable* table)
     }
 
     MatchEntry entry = {
-        .nodeName1 = decl1->name,
-        .nodeName2 = decl2->name,
+        .nodeName1 = simStrdup(displayName(decl1), Alloc_MatchTable),
+        .nodeName2 = simStrdup(displayName(decl2), Alloc_MatchTable),
         .dimensionsMatch = 0,
         .initializationMatch = 0,
         .declarationMatch = 0,
@@ -1253,38 +2186,16 @@ int compareArrayDeclarations(ASTNode* decl1, ASTNode* decl2, MatchTable* table)
         .details = "Detailed comparison of array declarations"
     };
 
-    // Compare data types
-    if (strcmp(decl1->dataType, decl2->dataType) == 0) {
-        fprintf(stderr, "Data types match: %s\n", decl1->dataType);
-        entry.declarationMatch = 20; // Base score for matching data types
-    }
+    // Data types and names, then the dimension count and sizes
+    entry.declarationMatch = declarationMatchScore(decl1, decl2);
+    entry.dimensionsMatch = dimensionsMatchScore(decl1, decl2);
 
-    // Compare names
-    if (strcmp(decl1->name, decl2->name) == 0) {
-        fprintf(stderr, "Names match: %s\n", decl1->name);
-        entry.declarationMatch += 30; // Additional score for matching names
-    }
-
-    // Compare dimensions
-    if (decl1->dimensions == decl2->dimensions) {
-        fprintf(stderr, "Dimensions count match: %d dimensions\n", decl1->dimensions);
-        entry.dimensionsMatch = 20; // Base score for matching dimension count
-        for (int i = 0; i < decl1->dimensions; i++) {
-            if (decl1->dimSize[i] == decl2->dimSize[i]) {
-                entry.dimensionsMatch += 10; // Additional points for each exact matching dimension size
-            } else {
-                fprintf(stderr, "Mismatch in dimension %d sizes: %d vs %d\n", i + 1, decl1->dimSize[i], decl2->dimSize[i]);
-            }
-        }
-    }
-
-    
     // Calculate total score
     entry.totalScore = entry.declarationMatch + entry.dimensionsMatch + entry.initializationMatch;
 
     // Log the comparison details
     fprintf(stderr, "Array declaration comparison for %s and %s:\n", decl1->name, decl2->name);
-    fprintf(stderr, "Declaration Score: %d, Dimensions Score: %d",
+    fprintf(stderr, "Declaration Score: %d, Dimensions Score: %d, Total: %d\n",
             entry.declarationMatch, entry.dimensionsMatch, entry.totalScore);
 
     // Add the match entry to the match table
@@ -1303,27 +2214,25 @@ int compareArrayAccesses(ASTNode* access1, ASTNode* access2, MatchTable* table)
     fprintf(stderr, "Starting comparison between array accesses.\n");
 
     MatchEntry entry = {
-        .nodeName1 = access1->name,
-        .nodeName2 = access2->name,
+        .nodeName1 = simStrdup(displayName(access1), Alloc_MatchTable),
+        .nodeName2 = simStrdup(displayName(access2), Alloc_MatchTable),
         .indexMatch = 0,
         .initializationMatch = 0,
         .totalScore = 0,
         .details = "Detailed comparison of array accesses"
     };
 
-    // Compare indices
-    if (access1->indexCount == access2->indexCount) {
-        for (int i = 0; i < access1->indexCount; i++) {
-            int indexScore = compareExpressionPatterns(access1->indices[i], access2->indices[i]);
-            entry.indexMatch += indexScore;
-            
-        }
-    } else {
+    if (access1->indexCount != access2->indexCount && !flattenedIndicesMatch(access1, access2)) {
         fprintf(stderr, "Mismatch in the number of indices.\n");
+        simFree(entry.nodeName1);
+        simFree(entry.nodeName2);
         return 0;  // Index count mismatch might be critical enough to stop further comparison.
     }
 
-    
+    entry.indexMatch = scoreAccessPair(access1, access2);
+    if (access1->indexCount != access2->indexCount) {
+        fprintf(stderr, "Flattened indices have the same affine form, score: %d\n", entry.indexMatch);
+    }
 
     entry.totalScore = entry.indexMatch;
 
@@ -1347,17 +2256,33 @@ int evaluateComplexityBonus(ASTNode* node1, ASTNode* node2, int baseScore) {
     return bonus;
 }
 
-// Helper function to compute depth of an AST
+// Helper function to compute depth of an AST: the number of nodes with children on
+// its longest downward path, so a node at level L that has children makes it L + 1
 int computeASTDepth(ASTNode* node) {
-    if (!node || node->childCount == 0) return 0;
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
     int maxDepth = 0;
-    for (int i = 0; i < node->childCount; i++) {
-        int childDepth = computeASTDepth(node->children[i]);
-        if (childDepth > maxDepth) {
-            maxDepth = childDepth;
+    if (node && !pushWalkNode(walk, node)) return 0;
+
+    while (walk->count > base) {
+        WalkFrame frame = walk->frames[--walk->count];
+        if (frame.node1->childCount == 0) continue;
+        if (frame.level + 1 > maxDepth) {
+            maxDepth = frame.level + 1;
+        }
+        for (int i = 0; i < frame.node1->childCount; i++) {
+            if (!frame.node1->children[i]) continue;
+            WalkFrame* child = pushWalkFrame(walk);
+            if (!child) {
+                walk->count = base;
+                return maxDepth;
+            }
+            child->node1 = frame.node1->children[i];
+            child->level = frame.level + 1;
         }
     }
-    return 1 + maxDepth;
+    return maxDepth;
 }
 
 // Helper function to find the 'else' branch in if-else structures
@@ -1424,8 +2349,8 @@ int compareArrayUsages(ASTNode* usage1, ASTNode* usage2, MatchTable* table) {
 
     // Correct initialization of the match entry with proper memory handling
     MatchEntry entry = {
-        .nodeName1 = strdup(usage1->name),
-        .nodeName2 = strdup(usage2->name),
+        .nodeName1 = simStrdup(displayName(usage1), Alloc_MatchTable),
+        .nodeName2 = simStrdup(displayName(usage2), Alloc_MatchTable),
         .dimensionsMatch = 0,
         .initializationMatch = 0,
         .indexMatch = 0,
@@ -1438,41 +2363,216 @@ int compareArrayUsages(ASTNode* usage1, ASTNode* usage2, MatchTable* table) {
 }
 
 
+// Pairs of nodes1 x nodes2 are compared row by row; once the budget runs out, the
+// pairs from done on are estimated from a fixed pseudo-random sample of them
+static void estimateRemainingPairs(ASTNode** nodes1, int count1, ASTNode** nodes2, int count2, int64_t done,
+                                   int (*scorePair)(ASTNode*, ASTNode*), const char* kind,
+                                   int64_t* totalScore, int64_t* totalPossibleScore) {
+    int64_t remaining = (int64_t)count1 * count2 - done;
+    if (remaining <= 0) return;
+
+    int64_t samples = remaining < BUDGET_SAMPLE_PAIRS ? remaining : BUDGET_SAMPLE_PAIRS;
+    int64_t sampledScore = 0;
+    uint64_t position = 0x9E3779B97F4A7C15ULL;
+    for (int64_t s = 0; s < samples; s++) {
+        // An exhaustive walk when everything left fits in the sample
+        int64_t pair = done + s;
+        if (samples < remaining) {
+            position = position * 6364136223846793005ULL + 1442695040888963407ULL;
+            pair = done + (int64_t)((position >> 11) % (uint64_t)remaining);
+        }
+        sampledScore += scorePair(nodes1[pair / count2], nodes2[pair % count2]);
+    }
+
+    *totalScore += sampledScore * remaining / samples;
+    *totalPossibleScore += 100 * remaining;
+    fprintf(stderr, "Log: Estimated %lld remaining %s pairs from a sample of %lld.\n",
+            (long long)remaining, kind, (long long)samples);
+}
+
 // Example function assuming each matching comparison contributes its score directly to the total score
 // without individual normalization before the final percentage calculation.
 int compareASTs(ASTNode *root1, ASTNode *root2) {
-    if (!root1 || !root2) {
-        fprintf(stderr, "Comparison failed: One of the roots is null.\n");
+    MatchTable* matchTable = initializeMatchTable();
+    if (!matchTable) {
+        fprintf(stderr, "Failed to initialize match table.\n");
         return 0;
     }
 
-    fprintf(stderr, "Comparing node types: %d vs %d\n", root1->type, root2->type);
+    int similarity = compareASTsWithTable(root1, root2, matchTable);
+    finalizeMatchTable(matchTable);
+    return similarity;
+}
 
-    MatchTable* matchTable = initializeMatchTable();
-    if (!matchTable) {
-        fprintf(stderr, "Failed to initialize match table.\n");
+// Same as compareASTs, but leaves the match entries in the caller's table
+int compareASTsWithTable(ASTNode *root1, ASTNode *root2, MatchTable* matchTable) {
+    return compareASTsIncremental(root1, root2, matchTable, NULL);
+}
+
+static int scoreProgramPair(ASTNode *root1, ASTNode *root2, MatchTable* matchTable, struct FunctionPairCache* pairCache);
+
+// compareASTsWithTable for revisions of one submission: function pair scores are reused
+// through pairCache for every function body that is unchanged since an earlier revision
+int compareASTsIncremental(ASTNode *root1, ASTNode *root2, MatchTable* matchTable, struct FunctionPairCache* pairCache) {
+    uint64_t traced = traceSpanStart();
+    uint64_t started = statsPhaseStart();
+    clearPairInterval();
+    beginPairBudget();
+    int similarity = scoreProgramPair(root1, root2, matchTable, pairCache);
+    if (endPairBudget()) {
+        fprintf(stderr, "Log: The score of %s and %s is an estimate; the comparison ran out of budget.\n",
+                root1 && root1->name ? root1->name : "Unnamed", root2 && root2->name ? root2->name : "Unnamed");
+    }
+    statsPhaseEnd(Phase_Compare, started);
+    traceSpanEnd("compare", "compare", traced, root1 ? root1->name : NULL, root2 ? root2->name : NULL);
+    statsCount(Stat_ProgramPairs, 1);
+    return similarity;
+}
+
+// Every declaration pair, scored into the match table
+static void compareDeclarationPairs(ASTNode** allDeclarations1, int numberOfDeclarations1, ASTNode** allDeclarations2,
+                                    int numberOfDeclarations2, MatchTable* matchTable,
+                                    int64_t* totalScore, int64_t* totalPossibleScore) {
+    uint64_t traced = traceSpanStart();
+    uint64_t started = statsPhaseStart();
+    int64_t compared = 0;
+    for (int i = 0; i < numberOfDeclarations1 && !budgetRanOut(); i++) {
+        for (int j = 0; j < numberOfDeclarations2 && !budgetExhausted(); j++) {
+            fprintf(stderr, "\nComparing array declarations: %s and %s\n", allDeclarations1[i]->name, allDeclarations2[j]->name);
+            int score = compareArrayDeclarations(allDeclarations1[i], allDeclarations2[j], matchTable);
+            fprintf(stderr, "\nScore for this comparison: %d\n\n", score);
+            *totalScore += score;
+            *totalPossibleScore += 100;
+            compared++;
+        }
+    }
+    if (budgetRanOut()) {
+        estimateRemainingPairs(allDeclarations1, numberOfDeclarations1, allDeclarations2, numberOfDeclarations2,
+                               compared, scoreDeclarationPair, "declaration", totalScore, totalPossibleScore);
+    }
+    statsPhaseEnd(Phase_ArrayPairs, started);
+    traceSpanEnd("declarations", "compare", traced, NULL, NULL);
+    statsCount(Stat_DeclarationPairs, (uint64_t)compared);
+}
+
+// Every access pair, scored into the match table
+static void compareAccessPairs(ASTNode** allAccesses1, int numberOfAccesses1, ASTNode** allAccesses2,
+                               int numberOfAccesses2, MatchTable* matchTable,
+                               int64_t* totalScore, int64_t* totalPossibleScore) {
+    uint64_t traced = traceSpanStart();
+    uint64_t started = statsPhaseStart();
+    int64_t compared = 0;
+    for (int i = 0; i < numberOfAccesses1 && !budgetRanOut(); i++) {
+        for (int j = 0; j < numberOfAccesses2 && !budgetExhausted(); j++) {
+            fprintf(stderr, "\nComparing array accesses: %s and %s\n", allAccesses1[i]->name, allAccesses2[j]->name);
+            int score = compareArrayAccesses(allAccesses1[i], allAccesses2[j], matchTable);
+            
+            *totalScore += score;
+            *totalPossibleScore += 100;
+            compared++;
+        }
+    }
+    if (budgetRanOut()) {
+        estimateRemainingPairs(allAccesses1, numberOfAccesses1, allAccesses2, numberOfAccesses2,
+                               compared, scoreAccessPair, "access", totalScore, totalPossibleScore);
+    }
+    statsPhaseEnd(Phase_ArrayPairs, started);
+    traceSpanEnd("accesses", "compare", traced, NULL, NULL);
+    statsCount(Stat_AccessPairs, (uint64_t)compared);
+}
+
+// Weighted blend of the available components (-1 when missing): arrays and dependences
+// weigh twice as much as functions and cost. arraySimilarity is the mean pair score in
+// percent. Returns -1 when no component is available.
+static int blendComponents(int arraySimilarity, int functionScore, int dependenceScore, int costScore) {
+    int weightedScore = 0, totalWeight = 0;
+
+    if (arraySimilarity >= 0) {
+        int adjusted_similarity = (arraySimilarity * 2) > 100 ? 100 : (arraySimilarity * 2);
+        weightedScore += adjusted_similarity * 2;
+        totalWeight += 2;
+    }
+    if (functionScore >= 0) {
+        weightedScore += functionScore;
+        totalWeight += 1;
+    }
+    if (dependenceScore >= 0) {
+        weightedScore += dependenceScore * 2;
+        totalWeight += 2;
+    }
+    if (costScore >= 0) {
+        weightedScore += costScore;
+        totalWeight += 1;
+    }
+    return totalWeight > 0 ? weightedScore / totalWeight : -1;
+}
+
+// Samples the array pairs for an interval of +-target on the final score; 0 when the
+// pair loops are small enough to compare exactly
+static int estimateArraySimilarity(ASTNode** allDeclarations1, int numberOfDeclarations1, ASTNode** allDeclarations2,
+                                   int numberOfDeclarations2, ASTNode** allAccesses1, int numberOfAccesses1,
+                                   ASTNode** allAccesses2, int numberOfAccesses2,
+                                   int functionScore, int dependenceScore, int costScore, int* similarity) {
+    // The array part moves the final score by 4 / totalWeight points per point
+    int totalWeight = 2 + (functionScore >= 0) + 2 * (dependenceScore >= 0) + (costScore >= 0);
+    double target = approximationTarget() * totalWeight / 4.0;
+
+    ArrayEstimate estimate;
+    uint64_t traced = traceSpanStart();
+    uint64_t started = statsPhaseStart();
+    int sampled = estimateArrayPairs(allDeclarations1, numberOfDeclarations1, allDeclarations2, numberOfDeclarations2,
+                                     allAccesses1, numberOfAccesses1, allAccesses2, numberOfAccesses2, target, &estimate);
+    statsPhaseEnd(Phase_ArrayPairs, started);
+    traceSpanEnd("sampled pairs", "compare", traced, NULL, NULL);
+    if (!sampled) return 0;
+    statsCount(Stat_SampledPairs, (uint64_t)estimate.sampled);
+
+    fprintf(stderr, "Log: Estimated array similarity %.1f%% +- %.1f from %lld of %lld pairs in %d strata.\n",
+            estimate.mean, estimate.halfWidth, (long long)estimate.sampled, (long long)estimate.pairs, estimate.strata);
+    int low = (int)floor(estimate.mean - estimate.halfWidth);
+    int high = (int)ceil(estimate.mean + estimate.halfWidth);
+    *similarity = blendComponents((int)floor(estimate.mean), functionScore, dependenceScore, costScore);
+    setPairInterval(blendComponents(low > 0 ? low : 0, functionScore, dependenceScore, costScore),
+                    blendComponents(high, functionScore, dependenceScore, costScore));
+    return 1;
+}
+
+static int scoreProgramPair(ASTNode *root1, ASTNode *root2, MatchTable* matchTable, struct FunctionPairCache* pairCache) {
+    if (!root1 || !root2 || !matchTable) {
+        fprintf(stderr, "Comparison failed: One of the roots is null.\n");
         return 0;
     }
 
-    int totalScore = 0, totalPossibleScore = 0;
+    fprintf(stderr, "Comparing node types: %d vs %d\n", root1->type, root2->type);
+
+    int64_t totalScore = 0, totalPossibleScore = 0;
 
     // Collect and compare array declarations
     int numberOfDeclarations1 = 0, numberOfDeclarations2 = 0;
     ASTNode** allDeclarations1 = collectNodesOfType(root1, NodeType_ArrayDeclaration, &numberOfDeclarations1);
     ASTNode** allDeclarations2 = collectNodesOfType(root2, NodeType_ArrayDeclaration, &numberOfDeclarations2);
+    int declarationsCollected = allDeclarations1 && allDeclarations2;
+
+    // In approximate mode, programs with more array pairs than are worth comparing exactly
+    // have them sampled last, once the target error on the array part can be derived from
+    // the other components. Smaller ones are compared as before, in the same order. A
+    // program without declarations (no array was found) still counts its access pairs.
+    int approximate = 0;
+    if (approximationTarget() > 0) {
+        int64_t accesses1 = max(0, countNodes(root1, NodeType_ArrayAccess));
+        int64_t accesses2 = max(0, countNodes(root2, NodeType_ArrayAccess));
+        int64_t pairs = (int64_t)numberOfDeclarations1 * numberOfDeclarations2 + accesses1 * accesses2;
+        approximate = pairs > APPROXIMATE_EXACT_PAIRS;
+    }
 
-    if (!allDeclarations1 || !allDeclarations2) {
+
+    if (!declarationsCollected) {
         fprintf(stderr, "Failed to collect nodes for comparison.\n");
     } else {
         fprintf(stderr, "Found %d array declarations in first AST, %d in second AST.\n", numberOfDeclarations1, numberOfDeclarations2);
-        for (int i = 0; i < numberOfDeclarations1; i++) {
-            for (int j = 0; j < numberOfDeclarations2; j++) {
-                fprintf(stderr, "\nComparing array declarations: %s and %s\n", allDeclarations1[i]->name, allDeclarations2[j]->name);
-                int score = compareArrayDeclarations(allDeclarations1[i], allDeclarations2[j], matchTable);
-                fprintf(stderr, "\nScore for this comparison: %d\n\n", score);
-                totalScore += score;
-                totalPossibleScore += 100;
-            }
+        if (!approximate) {
+            compareDeclarationPairs(allDeclarations1, numberOfDeclarations1, allDeclarations2, numberOfDeclarations2,
+                                    matchTable, &totalScore, &totalPossibleScore);
         }
     }
 
@@ -1480,53 +2580,102 @@ int compareASTs(ASTNode *root1, ASTNode *root2) {
     int numberOfAccesses1 = 0, numberOfAccesses2 = 0;
     ASTNode** allAccesses1 = collectNodesOfType(root1, NodeType_ArrayAccess, &numberOfAccesses1);
     ASTNode** allAccesses2 = collectNodesOfType(root2, NodeType_ArrayAccess, &numberOfAccesses2);
+    int accessesCollected = allAccesses1 && allAccesses2;
 
-    if (!allAccesses1 || !allAccesses2) {
+    if (!accessesCollected) {
         fprintf(stderr, "Failed to collect array access nodes for comparison.\n");
     } else {
         fprintf(stderr, "Found %d array accesses in first AST, %d in second AST.\n", numberOfAccesses1, numberOfAccesses2);
-        for (int i = 0; i < numberOfAccesses1; i++) {
-            for (int j = 0; j < numberOfAccesses2; j++) {
-                fprintf(stderr, "\nComparing array accesses: %s and %s\n", allAccesses1[i]->name, allAccesses2[j]->name);
-                int score = compareArrayAccesses(allAccesses1[i], allAccesses2[j], matchTable);
-                
-                totalScore += score;
-                totalPossibleScore += 100;
-            }
+        if (!approximate) {
+            compareAccessPairs(allAccesses1, numberOfAccesses1, allAccesses2, numberOfAccesses2,
+                               matchTable, &totalScore, &totalPossibleScore);
+        }
+    }
+
+    // Match user-defined functions (and main) through the signature index
+    uint64_t started = statsPhaseStart();
+    int functionScore = compareFunctionSetsCached(root1, root2, matchTable, pairCache);
+    statsPhaseEnd(Phase_Functions, started);
+    if (functionScore >= 0) {
+        fprintf(stderr, "\nFunction similarity: %d%%\n", functionScore);
+    }
+
+    // Compare the precomputed array dependence graphs
+    DependenceGraph* graph1 = analyzeDependences(root1);
+    DependenceGraph* graph2 = analyzeDependences(root2);
+    started = statsPhaseStart();
+    int dependenceScore = compareDependenceGraphs(graph1, graph2);
+    statsPhaseEnd(Phase_DependenceCompare, started);
+    if (dependenceScore >= 0) {
+        fprintf(stderr, "\nDependence similarity: %d%%\n", dependenceScore);
+    }
+
+    // Compare the estimated asymptotic cost of the loop nests
+    int costScore = compareNestedLoops(root1, root2);
+    if (costScore >= 0) {
+        fprintf(stderr, "\nCost profile similarity: %d%%\n", costScore);
+    }
+
+    int similarity = -1;
+    int estimated = approximate && accessesCollected &&
+                    estimateArraySimilarity(allDeclarations1, numberOfDeclarations1, allDeclarations2, numberOfDeclarations2,
+                                            allAccesses1, numberOfAccesses1, allAccesses2, numberOfAccesses2,
+                                            functionScore, dependenceScore, costScore, &similarity);
+    if (approximate && !estimated) { // No accesses, or out of memory for the strata
+        if (declarationsCollected) {
+            compareDeclarationPairs(allDeclarations1, numberOfDeclarations1, allDeclarations2, numberOfDeclarations2,
+                                    matchTable, &totalScore, &totalPossibleScore);
+        }
+        if (accessesCollected) {
+            compareAccessPairs(allAccesses1, numberOfAccesses1, allAccesses2, numberOfAccesses2,
+                               matchTable, &totalScore, &totalPossibleScore);
         }
     }
 
     // Clean up
-    free(allDeclarations1);
-    free(allDeclarations2);
-    free(allAccesses1);
-    free(allAccesses2);
+    simFree(allDeclarations1);
+    simFree(allDeclarations2);
+    simFree(allAccesses1);
+    simFree(allAccesses2);
 
     // Normalize the total score to a percentage if there was at least one comparable element
-    if (totalPossibleScore > 0) {
-    int base_similarity = (totalScore * 100) / totalPossibleScore;
-    int adjusted_similarity = (base_similarity * 2) > 100 ? 100 : (base_similarity * 2);
-    fprintf(stderr, "\nCalculated similarity: %d%%\n", adjusted_similarity);
-    finalizeMatchTable(matchTable);
-    return adjusted_similarity;
-}
+    if (!estimated) {
+        int base_similarity = totalPossibleScore > 0 ? (int)((totalScore * 100) / totalPossibleScore) : -1;
+        similarity = blendComponents(base_similarity, functionScore, dependenceScore, costScore);
+    }
 
+    if (similarity >= 0) {
+        fprintf(stderr, "\nCalculated similarity: %d%%\n", similarity);
+        return similarity;
+    }
 
     fprintf(stderr, "No comparable elements found, returning 0.\n");
-    finalizeMatchTable(matchTable);
     return 0;
 }
 
-
-
-
-
-
-
-
-
-
-
-
-
-
+// Reads a whole file into memory (not NUL-terminated); used where sources are hashed or sent as bytes.
+// Release with simFree.
+char* readSourceFile(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror("File opening error");
+        return NULL;
+    }
+    size_t capacity = 4096, used = 0;
+    char* data = simMalloc(capacity, Alloc_Scratch);
+    while (data) {
+        used += fread(data + used, 1, capacity - used, file);
+        if (used < capacity) break;
+        capacity *= 2;
+        char* grown = simRealloc(data, capacity, Alloc_Scratch);
+        if (!grown) {
+            simFree(data);
+            data = NULL;
+        } else {
+            data = grown;
+        }
+    }
+    fclose(file);
+    *length = used;
+    return data;
+}
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #define OPERATION_ADD 1
 #define OPERATION_SUBTRACT 2
@@ -49,6 +50,22 @@ typedef enum NodeType {
 	NodeType_Constant // Constants like numbers
 } NodeType;
 
+#define AFFINE_MAX_VARS 8  // Variable slots in an affine index form
+
+// Affine normal form of an index expression: sum(coefficients[s] * variable in slot s) + constant.
+// Slots are assigned per parse by first appearance in an index expression.
+typedef struct AffineForm {
+    int coefficients[AFFINE_MAX_VARS];
+    int constant;
+    int isAffine;  // 0 when the expression is not affine in the slot variables
+} AffineForm;
+
+// Variable names of the affine slots of one parse, in slot order
+typedef struct AffineSlotTable {
+    char* names[AFFINE_MAX_VARS];
+    int count;
+} AffineSlotTable;
+
 typedef struct ArrayMetadata {
     int dimensions[2];  // Supports 2D arrays 
 } ArrayMetadata;
@@ -87,8 +104,67 @@ typedef struct ASTNode {
 	struct ASTNode** indices;
     // Other necessary fields
 	struct ArrayMetadata* extra;
+
+    // Canonical form, filled in by canonicalizeAST()
+    char* sourceName;          // Name as written in the source, before alpha-renaming
+    unsigned long structHash;  // Structural hash of the subtree
+    int canonical;             // Non-zero once the subtree has been canonicalized
+    int shareCount;            // References to a hash-consed node (see hashcons.c), 0 for nodes of one tree
+
+    // Root only: precomputed dependence graph and loop cost profile (see dependence.c and complexity.c)
+    struct DependenceGraph* dependenceGraph;
+    struct CostProfile* costProfile;
+
+    // Array access only: affine form of each index, and of the row-major flattened index
+    AffineForm* affine;
+    AffineForm* linearAffine;
+
+    // Root only: variable names of the affine slots, in slot order
+    char** affineSlots;
+    int affineSlotCount;
 } ASTNode;
 
+// One pending node of an iterative tree walk (see threadWalkStack in ast.c). Comparisons
+// use every field; other walks document at the walk which fields they use and how.
+typedef struct WalkFrame {
+    struct ASTNode* node1;
+    struct ASTNode* node2; // The other tree, in comparisons; the copy, in copies
+    int next;          // Next child (or operand pair) to visit
+    int level;         // Depth below the node the walk started at
+    int pending;       // A child comparison was started and its score is due
+    int mode;          // How compareExpressions combines the operand pairs
+    int score;         // Score of the node itself
+    int sum;           // Sum of the child scores
+    int results[4];    // Scores of the operand pairs
+} WalkFrame;
+
+typedef struct WalkStack {
+    WalkFrame* frames;
+    int count;
+    int capacity;
+} WalkStack;
+
+// The calling thread's walk stack, NULL when it cannot be allocated. A walk uses only the
+// frames above the count it started at and re-reads them by index after every push.
+WalkStack* threadWalkStack(void);
+int growWalkStack(WalkStack* walk); // 0 when the buffer cannot grow
+int pushWalkNode(WalkStack* walk, struct ASTNode* node); // 0 when it could not be pushed
+
+// A frame on top of the stack with everything but the operand results zeroed; those
+// are only read once written. NULL when the stack is full and cannot grow.
+static inline WalkFrame* pushWalkFrame(WalkStack* walk) {
+    if (__builtin_expect(walk->count == walk->capacity, 0) && !growWalkStack(walk)) return NULL;
+    WalkFrame* frame = &walk->frames[walk->count++];
+    frame->node1 = NULL;
+    frame->node2 = NULL;
+    frame->next = 0;
+    frame->level = 0;
+    frame->pending = 0;
+    frame->mode = 0;
+    frame->score = 0;
+    frame->sum = 0;
+    return frame;
+}
 
 
 
@@ -131,6 +207,8 @@ void printAST(ASTNode* node);
 int countParams(ASTNode* paramList);
 void freeASTNode(ASTNode* node);
 const char* getOperationName(int operationCode);
+int max(int a, int b);
+int min(int a, int b);
 
 void addASTChild(ASTNode* parent, ASTNode* child);
 int isFunctionDefinition(ASTNode* node);
@@ -167,13 +245,22 @@ MatchEntry* getMatchEntry(MatchTable* table, const char* name1, const char* name
 void finalizeMatchTable(MatchTable* table);
 int basicSemanticMatch(ASTNode* node1, ASTNode* node2);
 int compareASTs(ASTNode *root1, ASTNode *root2);
+int compareASTsWithTable(ASTNode *root1, ASTNode *root2, MatchTable* matchTable);
+struct FunctionPairCache;
+int compareASTsIncremental(ASTNode *root1, ASTNode *root2, MatchTable* matchTable, struct FunctionPairCache* pairCache);
 int compareNestedLoops(ASTNode* body1, ASTNode* body2);
 int countNodeType(ASTNode* node, NodeType type);
 int compareArrayAccesses(ASTNode* access1, ASTNode* access2, MatchTable* table);
+// The pair scores compareArrayDeclarations and compareArrayAccesses log and record in the
+// match table; sampled pairs use them alone
+int scoreDeclarationPair(ASTNode* decl1, ASTNode* decl2);
+int scoreAccessPair(ASTNode* access1, ASTNode* access2);
 int compareMultidimensionalArrays(ASTNode* node1, ASTNode* node2);
 int compareControlStatements(ASTNode* stmt1, ASTNode* stmt2);
 int compareMainFunctions(ASTNode* main1, ASTNode* main2);
 int compareExpressionsDeep(ASTNode* expr1, ASTNode* expr2);
+// Whether two subtrees are equal in everything their structural hashes cover
+int sameStructure(ASTNode* node1, ASTNode* node2);
 int isDefaultInitialized(ASTNode* node);
 
 int compareArrayUsages(ASTNode* usage1, ASTNode* usage2, MatchTable* table);
@@ -192,12 +279,37 @@ int countNodesOfType(ASTNode* root, NodeType type);
 ASTNode** collectNodesOfType(ASTNode* root, NodeType type, int* count);
 void collectNodes(ASTNode* root, ASTNode** array, int* index);
 int compareSingleASTNode(ASTNode* node1, ASTNode* node2);
-ASTNode* createArrayAccessNode(char* arrayName, char* dataType, ASTNode** indices, int indexCount);
+ASTNode* createArrayAccessNode(char* arrayName, char* dataType, ASTNode** indices, int indexCount, AffineSlotTable* slots);
 ASTNode* findElseBranch(ASTNode* node);
 
 int computeASTDepth(ASTNode* node);
 ASTNode* createArrayDeclarationNode(char* name, char* type, int* dimSize, int numDimensions, ASTNode* initExpr);
 ASTNode* deepCloneASTNode(ASTNode* original);
+ASTNode* copyASTTree(ASTNode* original);
+
+char* readSourceFile(const char* path, size_t* length);
+
+// Parser entry points (parser.y). Reentrant: every call has its own scanner and ParseState.
+ASTNode* parse(const char* filename);
+ASTNode* parseBuffer(const char* name, const char* source, size_t length);
+uint64_t tokenStreamHash(const char* source, size_t length);
+
+// Incremental parsing for input that arrives in pieces (sockets, archive streams).
+// Bytes may be fed in chunks of any size; each chunk is scanned and parsed up to its
+// last safe boundary right away, so parsing overlaps with reading.
+typedef struct StreamParser StreamParser;
+StreamParser* createStreamParser(const char* name);
+int feedStreamParser(StreamParser* parser, const char* bytes, size_t length); // 0 once parsing has failed
+ASTNode* finishStreamParser(StreamParser* parser);                             // Root, or NULL on failure
+void freeStreamParser(StreamParser* parser);
+
+void freeAffineSlots(AffineSlotTable* slots);
+int affineSlotFor(AffineSlotTable* slots, const char* name);
+void storeAffineSlots(ASTNode* root, AffineSlotTable* slots);
+int affineSlotOf(ASTNode* root, const char* name);
+int lowerToAffineForm(ASTNode* expr, AffineForm* form, AffineSlotTable* slots);
+int affineFormsEqual(const AffineForm* a, const AffineForm* b);
+void linearizeArrayAccess(ASTNode* access, ASTNode* declaration);
 int compareArrayNodes(ASTNode* node1, ASTNode* node2, MatchTable* matchTable);
 
 
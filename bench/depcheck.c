@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "canonical.h"
+#include "dependence.h"
+
+// Fixed-input check of the dependence tests. Each case is a small program with one loop
+// nest whose edges (kind, access indices, direction and distance per common level) are
+// known by hand; the GCD and Banerjee tests, the distance vectors and the handling of
+// levels beyond the enumerated ones must produce exactly those edges, in any order.
+// Accesses are numbered in collection order: the right-hand side of an assignment first.
+
+#define DEPCHECK_MAX_EDGES 8
+#define DEPCHECK_EDGE_TEXT 96
+
+typedef struct DependenceCase {
+    const char* name;
+    const char* source;
+    const char* edges[DEPCHECK_MAX_EDGES]; // "kind source->sink (directions) (distances)"
+} DependenceCase;
+
+static const DependenceCase cases[] = {
+    {"flow carried by the loop",
+     "int a[100];\n"
+     "int main() {\n"
+     "    for (int i = 0; i < 10; i++) {\n"
+     "        a[i + 1] = a[i];\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     {"flow 1->0 (<) (1)"}},
+    {"anti carried by the loop",
+     "int a[100];\n"
+     "int main() {\n"
+     "    for (int i = 0; i < 10; i++) {\n"
+     "        a[i] = a[i + 1];\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     {"anti 0->1 (<) (1)"}},
+    {"GCD test: even writes, odd reads",
+     "int a[100];\n"
+     "int main() {\n"
+     "    for (int i = 0; i < 10; i++) {\n"
+     "        a[2 * i] = a[2 * i + 1];\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     {NULL}},
+    {"Banerjee test: reads past every write",
+     "int a[100];\n"
+     "int main() {\n"
+     "    for (int i = 0; i < 10; i++) {\n"
+     "        a[i] = a[i + 20];\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     {NULL}},
+    {"two levels, opposite directions",
+     "int m[20][20];\n"
+     "int main() {\n"
+     "    for (int i = 1; i < 10; i++) {\n"
+     "        for (int j = 0; j < 9; j++) {\n"
+     "            m[i][j] = m[i - 1][j + 1];\n"
+     "        }\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     {"flow 1->0 (<,>) (1,-1)"}},
+    {"carried only beyond the enumerated levels",
+     "int a[1000000];\n"
+     "int main() {\n"
+     "    for (int i = 0; i < 4; i++) {\n"
+     "        for (int j = 0; j < 4; j++) {\n"
+     "            for (int k = 0; k < 4; k++) {\n"
+     "                for (int l = 0; l < 4; l++) {\n"
+     "                    for (int m = 0; m < 9; m++) {\n"
+     "                        a[100000 * i + 10000 * j + 1000 * k + 100 * l + m + 1] = a[100000 * i + 10000 * j + 1000 * k + 100 * l + m];\n"
+     "                    }\n"
+     "                }\n"
+     "            }\n"
+     "        }\n"
+     "    }\n"
+     "    return 0;\n"
+     "}\n",
+     {"anti 0->1 (=,=,=,=,*) (?,?,?,?,?)", "flow 1->0 (=,=,=,=,*) (?,?,?,?,?)",
+      "output 1->1 (=,=,=,=,*) (?,?,?,?,?)"}},
+};
+
+static const char* kindText(DependenceKind kind) {
+    switch (kind) {
+        case Dependence_Flow: return "flow";
+        case Dependence_Anti: return "anti";
+        case Dependence_Output: return "output";
+        default: return "unknown";
+    }
+}
+
+static void formatEdge(const DependenceEdge* edge, char* text) {
+    int length = snprintf(text, DEPCHECK_EDGE_TEXT, "%s %d->%d (", kindText(edge->kind), edge->source, edge->sink);
+    for (int k = 0; k < edge->levels; k++) {
+        length += snprintf(text + length, DEPCHECK_EDGE_TEXT - length, "%s%c", k ? "," : "", edge->direction[k]);
+    }
+    length += snprintf(text + length, DEPCHECK_EDGE_TEXT - length, ") (");
+    for (int k = 0; k < edge->levels; k++) {
+        if (edge->distanceKnown[k]) {
+            length += snprintf(text + length, DEPCHECK_EDGE_TEXT - length, "%s%ld", k ? "," : "", edge->distance[k]);
+        } else {
+            length += snprintf(text + length, DEPCHECK_EDGE_TEXT - length, "%s?", k ? "," : "");
+        }
+    }
+    snprintf(text + length, DEPCHECK_EDGE_TEXT - length, ")");
+}
+
+// Returns the number of mismatches between the nest's edges and the expected ones
+static int checkCase(const DependenceCase* test) {
+    ASTNode* root = parseBuffer(test->name, test->source, strlen(test->source));
+    if (!root) {
+        printf("FAIL %s: does not parse\n", test->name);
+        return 1;
+    }
+    canonicalizeAST(root);
+    DependenceGraph* graph = analyzeDependences(root);
+    if (!graph || graph->nestCount != 1) {
+        printf("FAIL %s: expected one loop nest, found %d\n", test->name, graph ? graph->nestCount : 0);
+        freeASTNode(root);
+        return 1;
+    }
+
+    LoopNest* nest = &graph->nests[0];
+    int expected = 0;
+    while (expected < DEPCHECK_MAX_EDGES && test->edges[expected]) expected++;
+    int found[DEPCHECK_MAX_EDGES] = {0};
+    int failures = 0;
+
+    for (int e = 0; e < nest->edgeCount; e++) {
+        char text[DEPCHECK_EDGE_TEXT];
+        formatEdge(&nest->edges[e], text);
+        int match = -1;
+        for (int x = 0; x < expected && match < 0; x++) {
+            if (!found[x] && strcmp(test->edges[x], text) == 0) match = x;
+        }
+        if (match < 0) {
+            printf("FAIL %s: unexpected edge %s\n", test->name, text);
+            failures++;
+        } else {
+            found[match] = 1;
+        }
+    }
+    for (int x = 0; x < expected; x++) {
+        if (!found[x]) {
+            printf("FAIL %s: missing edge %s\n", test->name, test->edges[x]);
+            failures++;
+        }
+    }
+    if (!failures) printf("ok   %s\n", test->name);
+
+    freeASTNode(root);
+    return failures;
+}
+
+int main(void) {
+    int failures = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        failures += checkCase(&cases[c]);
+    }
+    printf("%d mismatches\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ast.h"
+#include "simalloc.h"
+
+// Microbenchmarks of the comparison kernels on fixed ASTs built with the create*Node
+// builders. Every kernel is warmed up, then timed over a number of samples; a sample
+// runs the kernel in a batch sized so that one sample takes at least MICRO_SAMPLE_NS.
+// Results are written as JSON and can be checked against an earlier run.
+
+#define MICRO_DEFAULT_WARMUP 5
+#define MICRO_DEFAULT_SAMPLES 30
+#define MICRO_SAMPLE_NS 2000000.0   // Minimum duration of one sample
+#define MICRO_DEFAULT_THRESHOLD 10.0 // Percent slower than the baseline median that counts as a regression
+
+typedef struct Fixture {
+    ASTNode* left;
+    ASTNode* right;
+    ASTNode* tree;
+    MatchTable* table;
+    AffineSlotTable slots;
+} Fixture;
+
+typedef struct Kernel {
+    const char* name;
+    void (*setup)(Fixture* fixture);
+    int (*run)(Fixture* fixture);     // One operation; the result feeds a sink so it is not optimized away
+    void (*reset)(Fixture* fixture);  // Between samples, outside the timed region; may be NULL
+} Kernel;
+
+typedef struct Summary {
+    long batch;
+    double min, median, mean, stddev, p95; // ns per operation
+} Summary;
+
+/* ---- Fixtures ---- */
+
+static char* numberName(char* buffer, size_t size, const char* prefix, int n) {
+    snprintf(buffer, size, "%s%d", prefix, n);
+    return buffer;
+}
+
+// Balanced binary expression tree over operators[], leaves named by position
+static ASTNode* buildExpression(int depth, const char* const* operators, int operatorCount, int* leaf) {
+    char name[32];
+    if (depth == 0) {
+        int n = (*leaf)++;
+        return createASTNode(n % 3 == 0 ? NodeType_Constant : NodeType_Identifier,
+                             n % 3 == 0 ? numberName(name, sizeof(name), "", n) : numberName(name, sizeof(name), "v", n % 7));
+    }
+    ASTNode* node = createASTNode(NodeType_Expression, (char*)operators[depth % operatorCount]);
+    addASTChild(node, buildExpression(depth - 1, operators, operatorCount, leaf));
+    addASTChild(node, buildExpression(depth - 1, operators, operatorCount, leaf));
+    return node;
+}
+
+// Left-deep chain a0 + a1 + ... ; mirrored puts the chain on the right
+static ASTNode* buildChain(int length, int mirrored) {
+    char name[32];
+    ASTNode* chain = createASTNode(NodeType_Identifier, numberName(name, sizeof(name), "a", 0));
+    for (int i = 1; i < length; i++) {
+        ASTNode* node = createASTNode(NodeType_Expression, "+");
+        ASTNode* operand = createASTNode(NodeType_Identifier, numberName(name, sizeof(name), "a", i));
+        addASTChild(node, mirrored ? operand : chain);
+        addASTChild(node, mirrored ? chain : operand);
+        chain = node;
+    }
+    return chain;
+}
+
+static ASTNode* buildAccess(Fixture* fixture, const char* array, const char* row, const char* column, int offset) {
+    char constant[16];
+    ASTNode* rowIndex = createASTNode(NodeType_Expression, "+");
+    addASTChild(rowIndex, createASTNode(NodeType_Identifier, (char*)row));
+    addASTChild(rowIndex, createASTNode(NodeType_Constant, numberName(constant, sizeof(constant), "", offset)));
+    ASTNode* indices[2] = { rowIndex, createASTNode(NodeType_Identifier, (char*)column) };
+    return createArrayAccessNode((char*)array, "int", indices, 2, &fixture->slots);
+}
+
+// A function-sized tree: nested for loops with array assignments, as the parser builds them
+static ASTNode* buildLoopNest(Fixture* fixture, int loops, int statements) {
+    static const char* const operators[] = { "+", "*", "-" };
+    ASTNode* body = createASTNode(NodeType_Body, "Body");
+    for (int l = 0; l < loops; l++) {
+        ASTNode* statementList = createASTNode(NodeType_Statements, "Statements");
+        for (int s = 0; s < statements; s++) {
+            int leaf = s;
+            ASTNode* assign = createASTNode(NodeType_Assignment, "=");
+            addASTChild(assign, buildAccess(fixture, "m", "i", "j", s));
+            addASTChild(assign, buildExpression(3, operators, 3, &leaf));
+            addASTChild(statementList, assign);
+        }
+        ASTNode* init = createASTNode(NodeType_Assignment, "=");
+        addASTChild(init, createASTNode(NodeType_Identifier, "i"));
+        addASTChild(init, createASTNode(NodeType_Constant, "0"));
+        ASTNode* condition = createASTNode(NodeType_Expression, "<");
+        addASTChild(condition, createASTNode(NodeType_Identifier, "i"));
+        addASTChild(condition, createASTNode(NodeType_Constant, "64"));
+        ASTNode* increment = createASTNode(NodeType_Expression, "++");
+        addASTChild(increment, createASTNode(NodeType_Identifier, "i"));
+        ASTNode* loopBody = createASTNode(NodeType_Body, "Body");
+        addASTChild(loopBody, statementList);
+        addASTChild(body, createForNode(init, condition, increment, loopBody));
+    }
+    return body;
+}
+
+static void setupDeclarations(Fixture* fixture) {
+    int sizes1[2] = { 64, 128 }, sizes2[2] = { 64, 96 };
+    fixture->left = createArrayDeclarationNode("matrix", "int", sizes1, 2, NULL);
+    fixture->right = createArrayDeclarationNode("matrix", "int", sizes2, 2, NULL);
+    fixture->table = initializeMatchTable();
+}
+
+static void setupAccesses(Fixture* fixture) {
+    fixture->left = buildAccess(fixture, "m", "i", "j", 1);
+    fixture->right = buildAccess(fixture, "m", "i", "j", 1);
+    fixture->table = initializeMatchTable();
+}
+
+static void setupExpressions(Fixture* fixture) {
+    static const char* const operators[] = { "+", "-", "*", "/" };
+    int leaf = 0;
+    fixture->left = buildExpression(8, operators, 4, &leaf);
+    leaf = 1;
+    fixture->right = buildExpression(8, operators, 4, &leaf);
+}
+
+static void setupCommutativeChain(Fixture* fixture) {
+    fixture->left = buildChain(64, 0);
+    fixture->right = buildChain(64, 1);
+}
+
+// Every level tries both operand orders, so this grows as 4^depth
+static void setupCommutativeTree(Fixture* fixture) {
+    static const char* const operators[] = { "+", "*" };
+    int leaf = 0;
+    fixture->left = buildExpression(6, operators, 2, &leaf);
+    leaf = 0;
+    fixture->right = buildExpression(6, operators, 2, &leaf);
+}
+
+static void setupDeep(Fixture* fixture) {
+    static const char* const operators[] = { "+", "-", "*" };
+    int leaf = 0;
+    fixture->left = buildExpression(10, operators, 3, &leaf);
+    leaf = 0;
+    fixture->right = buildExpression(10, operators, 3, &leaf);
+}
+
+static void setupLoopNests(Fixture* fixture) {
+    fixture->left = buildLoopNest(fixture, 8, 6);
+    fixture->right = buildLoopNest(fixture, 8, 6);
+}
+
+static void setupTree(Fixture* fixture) {
+    fixture->tree = buildLoopNest(fixture, 32, 8);
+}
+
+static void setupChildren(Fixture* fixture) {
+    char name[32];
+    fixture->tree = createASTNode(NodeType_Statements, "Statements");
+    fixture->left = createASTNode(NodeType_Statements, "Statements");
+    for (int i = 0; i < 256; i++) {
+        addASTChild(fixture->left, createASTNode(NodeType_Identifier, numberName(name, sizeof(name), "c", i)));
+    }
+}
+
+static void setupMatchTable(Fixture* fixture) {
+    char name1[32], name2[32];
+    fixture->table = initializeMatchTable();
+    for (int i = 0; i < 1000; i++) {
+        updateMatchTable(fixture->table, numberName(name1, sizeof(name1), "a", i), numberName(name2, sizeof(name2), "b", i), 1, 1, 1);
+    }
+}
+
+/* ---- Operations ---- */
+
+static int runDeclarations(Fixture* fixture) {
+    return compareArrayDeclarations(fixture->left, fixture->right, fixture->table);
+}
+
+static int runAccesses(Fixture* fixture) {
+    return compareArrayAccesses(fixture->left, fixture->right, fixture->table);
+}
+
+static int runExpressions(Fixture* fixture) {
+    return compareExpressions(fixture->left, fixture->right);
+}
+
+static int runDeep(Fixture* fixture) {
+    return compareExpressionsDeep(fixture->left, fixture->right);
+}
+
+static int runNodes(Fixture* fixture) {
+    return compareASTNodes(fixture->left, fixture->right);
+}
+
+static int runCollect(Fixture* fixture) {
+    int count = 0, capacity = 16;
+    ASTNode** nodes = simMalloc(sizeof(ASTNode*) * capacity, Alloc_Scratch);
+    traverseAndCollect(fixture->tree, NodeType_ArrayAccess, &nodes, &count, &capacity);
+    simFree(nodes);
+    return count;
+}
+
+// Appends 256 children to an empty node; the children array is dropped afterwards
+static int runAddChildren(Fixture* fixture) {
+    ASTNode* parent = fixture->tree;
+    for (int i = 0; i < fixture->left->childCount; i++) addASTChild(parent, fixture->left->children[i]);
+    int count = parent->childCount;
+    simFree(parent->children);
+    parent->children = NULL;
+    parent->childCount = 0;
+    parent->capacity = 0;
+    return count;
+}
+
+// Lookups at the front, middle and end of the table, and a miss
+static int runMatchEntry(Fixture* fixture) {
+    int found = 0;
+    found += getMatchEntry(fixture->table, "a3", "b3") != NULL;
+    found += getMatchEntry(fixture->table, "a500", "b500") != NULL;
+    found += getMatchEntry(fixture->table, "a999", "b999") != NULL;
+    found += getMatchEntry(fixture->table, "a999", "b0") != NULL;
+    return found;
+}
+
+// The comparison kernels add an entry per call; start each sample from an empty table
+static void resetTable(Fixture* fixture) {
+    finalizeMatchTable(fixture->table);
+    fixture->table = initializeMatchTable();
+}
+
+static const Kernel kernels[] = {
+    { "compareArrayDeclarations", setupDeclarations, runDeclarations, resetTable },
+    { "compareArrayAccesses", setupAccesses, runAccesses, resetTable },
+    { "compareExpressions/balanced", setupExpressions, runExpressions, NULL },
+    { "compareExpressions/commutative-chain", setupCommutativeChain, runExpressions, NULL },
+    { "compareExpressions/commutative-tree", setupCommutativeTree, runExpressions, NULL },
+    { "compareExpressionsDeep", setupDeep, runDeep, NULL },
+    { "compareASTNodes", setupLoopNests, runNodes, NULL },
+    { "traverseAndCollect", setupTree, runCollect, NULL },
+    { "addASTChild", setupChildren, runAddChildren, NULL },
+    { "getMatchEntry", setupMatchTable, runMatchEntry, NULL },
+};
+
+/* ---- Harness ---- */
+
+static volatile long sink;
+
+static double nowNs(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static double timeBatch(const Kernel* kernel, Fixture* fixture, long batch) {
+    if (kernel->reset) kernel->reset(fixture);
+    long result = 0;
+    double start = nowNs();
+    for (long i = 0; i < batch; i++) result += kernel->run(fixture);
+    double elapsed = nowNs() - start;
+    sink += result;
+    return elapsed;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void measure(const Kernel* kernel, Fixture* fixture, int warmup, int samples, Summary* summary) {
+    // Grow the batch until one sample is long enough to time reliably
+    long batch = 1;
+    while (batch < (1L << 30) && timeBatch(kernel, fixture, batch) < MICRO_SAMPLE_NS) batch *= 2;
+    for (int i = 0; i < warmup; i++) timeBatch(kernel, fixture, batch);
+
+    double* perOperation = malloc(sizeof(double) * samples);
+    if (!perOperation) {
+        fprintf(stderr, "Memory allocation failed for benchmark samples.\n");
+        exit(EXIT_FAILURE);
+    }
+    double sum = 0;
+    for (int i = 0; i < samples; i++) {
+        perOperation[i] = timeBatch(kernel, fixture, batch) / batch;
+        sum += perOperation[i];
+    }
+    qsort(perOperation, samples, sizeof(double), compareDoubles);
+
+    summary->batch = batch;
+    summary->min = perOperation[0];
+    summary->median = samples % 2 ? perOperation[samples / 2] : (perOperation[samples / 2 - 1] + perOperation[samples / 2]) / 2;
+    summary->mean = sum / samples;
+    double squares = 0;
+    for (int i = 0; i < samples; i++) squares += (perOperation[i] - summary->mean) * (perOperation[i] - summary->mean);
+    summary->stddev = samples > 1 ? sqrt(squares / (samples - 1)) : 0;
+    summary->p95 = perOperation[(int)ceil(samples * 0.95) - 1];
+    free(perOperation);
+}
+
+// Median of the named kernel in an earlier JSON report, or -1 when it is not there
+static double baselineMedian(const char* json, const char* name) {
+    char key[256];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char* entry = strstr(json, key);
+    if (!entry) return -1;
+    const char* median = strstr(entry, "\"median_ns\":");
+    const char* next = strstr(entry + 1, "\"name\":");
+    if (!median || (next && median > next)) return -1;
+    return strtod(median + strlen("\"median_ns\":"), NULL);
+}
+
+static char* readWholeFile(const char* path) {
+    size_t length = 0;
+    char* data = readSourceFile(path, &length);
+    if (!data) return NULL;
+    char* text = simRealloc(data, length + 1, Alloc_Scratch);
+    if (!text) {
+        simFree(data);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [--warmup N] [--samples N] [--filter text] [--output file.json]\n", program);
+    fprintf(stderr, "       %*s [--baseline old.json [--threshold percent]]\n", (int)strlen(program), "");
+}
+
+int main(int argc, char** argv) {
+    int warmup = MICRO_DEFAULT_WARMUP, samples = MICRO_DEFAULT_SAMPLES;
+    const char *filter = NULL, *outputPath = NULL, *baselinePath = NULL;
+    double threshold = MICRO_DEFAULT_THRESHOLD;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--warmup") == 0) warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--samples") == 0) samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--filter") == 0) filter = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0) outputPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0) baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0) threshold = atof(argv[++i]);
+        else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (samples < 1 || warmup < 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char* baseline = NULL;
+    if (baselinePath && !(baseline = readWholeFile(baselinePath))) return EXIT_FAILURE;
+    FILE* output = outputPath ? fopen(outputPath, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (!output) {
+        perror(outputPath ? outputPath : "stdout");
+        return EXIT_FAILURE;
+    }
+
+    // The kernels log every step to stderr; keep the terminal for the summary lines
+    FILE* console = fdopen(dup(STDERR_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (!console || null < 0) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    close(null);
+
+    fprintf(output, "{\n  \"harness\": \"simmicro\",\n  \"warmup\": %d,\n  \"samples\": %d,\n", warmup, samples);
+    if (baseline) fprintf(output, "  \"threshold_pct\": %.1f,\n", threshold);
+    fprintf(output, "  \"results\": [");
+
+    int regressions = 0, written = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        const Kernel* kernel = &kernels[k];
+        if (filter && !strstr(kernel->name, filter)) continue;
+
+        Fixture fixture;
+        memset(&fixture, 0, sizeof(Fixture));
+        kernel->setup(&fixture);
+        Summary summary;
+        measure(kernel, &fixture, warmup, samples, &summary);
+
+        fprintf(output, "%s\n    { \"name\": \"%s\", \"batch\": %ld, \"min_ns\": %.1f, \"median_ns\": %.1f, "
+                "\"mean_ns\": %.1f, \"stddev_ns\": %.1f, \"p95_ns\": %.1f",
+                written++ ? "," : "", kernel->name, summary.batch, summary.min, summary.median,
+                summary.mean, summary.stddev, summary.p95);
+        fprintf(console, "%-40s median %12.1f ns  p95 %12.1f ns  (+/- %.1f)", kernel->name,
+                summary.median, summary.p95, summary.stddev);
+
+        double old = baseline ? baselineMedian(baseline, kernel->name) : -1;
+        if (old > 0) {
+            double change = (summary.median - old) * 100.0 / old;
+            int regressed = change > threshold;
+            regressions += regressed;
+            fprintf(output, ", \"baseline_median_ns\": %.1f, \"change_pct\": %.1f, \"regression\": %s",
+                    old, change, regressed ? "true" : "false");
+            fprintf(console, "  %+.1f%%%s", change, regressed ? "  REGRESSION" : "");
+        }
+        fprintf(output, " }");
+        fprintf(console, "\n");
+        fflush(console);
+
+        freeASTNode(fixture.left);
+        freeASTNode(fixture.right);
+        freeASTNode(fixture.tree);
+        if (fixture.table) finalizeMatchTable(fixture.table);
+        freeAffineSlots(&fixture.slots);
+    }
+    fprintf(output, "\n  ]\n}\n");
+    fclose(output);
+
+    if (baseline) {
+        fprintf(console, "%d regression(s) beyond %.1f%% against %s.\n", regressions, threshold, baselinePath);
+        simFree(baseline);
+    }
+    fclose(console);
+    return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
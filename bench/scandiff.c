@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ast.h"
+#include "simalloc.h"
+#include "simdlexer.h"
+#include "y.tab.h"
+#include "workload.h"
+
+// Differential test of the two scanner backends. Every input is scanned by the flex
+// scanner and by the simd scanner with each kernel the CPU supports; the token ids,
+// semantic values, line numbers, token trace and error messages must be identical.
+// The corpus is the files given, generated programs, and random token soup that leans
+// on the lexer's quirks (lone and grouped newlines, unterminated strings and comments,
+// extern/typedef/void lines, stray bytes) with runs long enough for the vector loops.
+
+#define SCANDIFF_DEFAULT_PROGRAMS 8
+#define SCANDIFF_DEFAULT_SOUPS 2000
+
+// Reentrant scanner interface generated by flex (lexer.l)
+int yylex(YYSTYPE* yylval_param, yyscan_t scanner);
+int yylex_init(yyscan_t* scanner);
+int yylex_destroy(yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
+void yyset_lineno(int lineNumber, yyscan_t scanner);
+struct yy_buffer_state* yy_scan_bytes(const char* bytes, int length, yyscan_t scanner);
+
+typedef struct Token {
+    int id;
+    int line;     // After the token
+    char* value;  // For IDENTIFIER, NUMBER and STRING_LITERAL
+} Token;
+
+typedef struct Scan {
+    Token* tokens;
+    int count, capacity;
+    char* trace;   // What the scanner printed to stdout and stderr
+    size_t traceLength;
+} Scan;
+
+static int addToken(Scan* scan, int id, int line, YYSTYPE* value) {
+    if (scan->count == scan->capacity) {
+        int capacity = scan->capacity ? scan->capacity * 2 : 256;
+        Token* grown = realloc(scan->tokens, sizeof(Token) * capacity);
+        if (!grown) return 0;
+        scan->tokens = grown;
+        scan->capacity = capacity;
+    }
+    Token* token = &scan->tokens[scan->count++];
+    token->id = id;
+    token->line = line;
+    token->value = NULL;
+    if (id == IDENTIFIER || id == NUMBER || id == STRING_LITERAL) {
+        token->value = strdup(value->sval);
+        simFree(value->sval);
+    }
+    return 1;
+}
+
+static void freeScan(Scan* scan) {
+    for (int i = 0; i < scan->count; i++) free(scan->tokens[i].value);
+    free(scan->tokens);
+    free(scan->trace);
+}
+
+// Scans with stdout and stderr sent to a temporary file, which becomes the trace
+static int scanInput(ScannerBackend backend, const char* source, size_t length, Scan* scan) {
+    memset(scan, 0, sizeof(Scan));
+    FILE* capture = tmpfile();
+    if (!capture) return 0;
+    fflush(stdout);
+    fflush(stderr);
+    int savedOut = dup(STDOUT_FILENO), savedErr = dup(STDERR_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    dup2(fileno(capture), STDERR_FILENO);
+
+    int ok = 1;
+    YYSTYPE value;
+    int id;
+    if (backend == Scanner_Flex) {
+        yyscan_t scanner;
+        if (yylex_init(&scanner) != 0 || !yy_scan_bytes(source, (int)length, scanner)) {
+            ok = 0;
+        } else {
+            yyset_lineno(1, scanner);
+            while (ok && (id = yylex(&value, scanner)) != 0) ok = addToken(scan, id, yyget_lineno(scanner), &value);
+            yylex_destroy(scanner);
+        }
+    } else {
+        SimdLexer* lexer = createSimdLexer();
+        if (!lexer) {
+            ok = 0;
+        } else {
+            simdLexBytes(lexer, source, length);
+            while (ok && (id = simdLex(lexer, &value)) != 0) ok = addToken(scan, id, simdLexLine(lexer), &value);
+            freeSimdLexer(lexer);
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(savedOut, STDOUT_FILENO);
+    dup2(savedErr, STDERR_FILENO);
+    close(savedOut);
+    close(savedErr);
+
+    // Written through the duplicated descriptors, so read back with pread
+    off_t size = lseek(fileno(capture), 0, SEEK_END);
+    if (ok && size >= 0 && (scan->trace = malloc((size_t)size + 1)) != NULL) {
+        scan->traceLength = (size_t)pread(fileno(capture), scan->trace, (size_t)size, 0);
+    } else {
+        ok = 0;
+    }
+    fclose(capture);
+    return ok;
+}
+
+// Prints the first difference; 1 when the scans agree
+static int compareScans(const char* name, const char* kernel, const Scan* flex, const Scan* simd) {
+    int count = flex->count < simd->count ? flex->count : simd->count;
+    for (int i = 0; i < count; i++) {
+        const Token* a = &flex->tokens[i];
+        const Token* b = &simd->tokens[i];
+        int sameValue = (!a->value && !b->value) || (a->value && b->value && strcmp(a->value, b->value) == 0);
+        if (a->id != b->id || a->line != b->line || !sameValue) {
+            fprintf(stderr, "%s (%s): token %d differs: flex %d '%s' line %d, simd %d '%s' line %d\n", name, kernel, i,
+                    a->id, a->value ? a->value : "", a->line, b->id, b->value ? b->value : "", b->line);
+            return 0;
+        }
+    }
+    if (flex->count != simd->count) {
+        fprintf(stderr, "%s (%s): flex returned %d tokens, simd %d\n", name, kernel, flex->count, simd->count);
+        return 0;
+    }
+    if (flex->traceLength != simd->traceLength || memcmp(flex->trace, simd->trace, flex->traceLength) != 0) {
+        size_t at = 0;
+        while (at < flex->traceLength && at < simd->traceLength && flex->trace[at] == simd->trace[at]) at++;
+        fprintf(stderr, "%s (%s): printed output differs at byte %zu\n", name, kernel, at);
+        return 0;
+    }
+    return 1;
+}
+
+static const char* kernelNames[] = { "scalar", "sse2", "avx2" };
+
+// 1 when every kernel agrees with flex
+static int checkInput(const char* name, const char* source, size_t length, long* tokens) {
+    Scan flex;
+    if (!scanInput(Scanner_Flex, source, length, &flex)) {
+        fprintf(stderr, "%s: flex scan failed\n", name);
+        freeScan(&flex);
+        return 0;
+    }
+    *tokens += flex.count;
+    int agree = 1;
+    for (size_t k = 0; k < sizeof(kernelNames) / sizeof(kernelNames[0]); k++) {
+        if (!selectSimdKernel(kernelNames[k])) continue;
+        Scan simd;
+        if (!scanInput(Scanner_Simd, source, length, &simd)) {
+            fprintf(stderr, "%s (%s): simd scan failed\n", name, kernelNames[k]);
+            agree = 0;
+        } else if (!compareScans(name, kernelNames[k], &flex, &simd)) {
+            agree = 0;
+        }
+        freeScan(&simd);
+    }
+    freeScan(&flex);
+    return agree;
+}
+
+/* ---- Random token soup ---- */
+
+static unsigned nextRandom(unsigned long long* state) {
+    *state ^= *state << 13; // xorshift64
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (unsigned)(*state >> 32);
+}
+
+static const char* const soupPieces[] = {
+    "int", "return", "main", "if", "else", "while", "printf", "for", "void", "integer", "mainly", "_x1",
+    "extern int x;", "extern\tint y", "extern;", "typedef int t;", "typedef", "void f(void);", "void g(int a)",
+    "void\n", "voidx ;", "0", "42", "007", "12ab", "+", "++", "+++", "-", "--", "*", "/", "=", "==", "===", ";",
+    "(", ")", "{", "}", ",", "[", "]", "<", "<=", "<<", "<<=", ">", ">=", ">>", "!", "!=", "&", "&&", "|", "||",
+    "^", "%", "\"text\"", "\"a\\\"b\"", "\"esc\\\\\"", "\"open", "\"line\\\nbreak\"", "\"two\nlines\"", "\"\"",
+    "// comment", "//", "/* block */", "/**/", "/***/", "/*/ x */", "/* open", "/* a\nb */", "*/", "#include <x>",
+    "#", " ", "  ", "\t", "\n", "\n\n", " \n", "\n ", "\t\n\t", "\r", "@", "$", "`", "\\", "'", "?", ":", ".",
+    "~", "\x80", "\xff", "\x01"
+};
+
+// Repeats a byte or word so runs cross 16 and 32 byte blocks
+static size_t appendRun(char* buffer, size_t at, size_t capacity, const char* unit, int times) {
+    size_t unitLength = strlen(unit);
+    for (int t = 0; t < times && at + unitLength < capacity; t++) {
+        memcpy(buffer + at, unit, unitLength);
+        at += unitLength;
+    }
+    return at;
+}
+
+static char* makeSoup(unsigned long long* state, size_t* length) {
+    size_t capacity = 4096 + nextRandom(state) % 4096;
+    char* buffer = malloc(capacity);
+    if (!buffer) return NULL;
+    size_t at = 0;
+    int pieces = 1 + (int)(nextRandom(state) % 300);
+    for (int p = 0; p < pieces && at + 64 < capacity; p++) {
+        unsigned choice = nextRandom(state) % 100;
+        if (choice < 80) {
+            const char* piece = soupPieces[nextRandom(state) % (sizeof(soupPieces) / sizeof(soupPieces[0]))];
+            at = appendRun(buffer, at, capacity, piece, 1);
+        } else if (choice < 85) {
+            at = appendRun(buffer, at, capacity, " ", 1 + (int)(nextRandom(state) % 70));
+        } else if (choice < 88) {
+            at = appendRun(buffer, at, capacity, "\n", 1 + (int)(nextRandom(state) % 40));
+        } else if (choice < 92) {
+            at = appendRun(buffer, at, capacity, "a", 1 + (int)(nextRandom(state) % 70));
+        } else if (choice < 95) {
+            at = appendRun(buffer, at, capacity, "9", 1 + (int)(nextRandom(state) % 70));
+        } else if (choice < 97) {
+            at = appendRun(buffer, at, capacity, "/* ", 1);
+            at = appendRun(buffer, at, capacity, "x*", (int)(nextRandom(state) % 40));
+            if (nextRandom(state) % 4) at = appendRun(buffer, at, capacity, "*/", 1);
+        } else {
+            buffer[at++] = (char)(nextRandom(state) & 0xFF);
+        }
+    }
+    *length = at;
+    return buffer;
+}
+
+static char* readFile(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    size_t capacity = 65536, size = 0;
+    char* data = malloc(capacity);
+    size_t count;
+    while (data && (count = fread(data + size, 1, capacity - size, file)) > 0) {
+        size += count;
+        if (size == capacity) {
+            char* grown = realloc(data, capacity *= 2);
+            if (!grown) free(data);
+            data = grown;
+        }
+    }
+    fclose(file);
+    *length = size;
+    return data;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [--programs N] [--soups N] [--seed N] [file.c]...\n", program);
+}
+
+int main(int argc, char** argv) {
+    int programs = SCANDIFF_DEFAULT_PROGRAMS, soups = SCANDIFF_DEFAULT_SOUPS;
+    unsigned long long seed = 0x5CA9D1FFULL;
+    int firstFile = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--programs") == 0 && i + 1 < argc) {
+            programs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--soups") == 0 && i + 1 < argc) {
+            soups = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            firstFile = i;
+            break;
+        }
+    }
+    if (seed == 0) seed = 1; // xorshift never leaves 0
+
+    int inputs = 0, failures = 0;
+    long tokens = 0;
+    for (int i = firstFile; i < argc; i++, inputs++) {
+        size_t length;
+        char* source = readFile(argv[i], &length);
+        if (!source) {
+            perror(argv[i]);
+            failures++;
+            continue;
+        }
+        if (!checkInput(argv[i], source, length, &tokens)) failures++;
+        free(source);
+    }
+
+    WorkloadOptions options;
+    defaultWorkloadOptions(&options);
+    for (int p = 0; p < programs; p++, inputs++) {
+        char name[64];
+        snprintf(name, sizeof(name), "generated program %d", p);
+        options.functions = 1 + p * 4;
+        options.seed = (unsigned)(seed + p);
+        size_t length;
+        char* source = generateProgram(&options, (unsigned)p, &length);
+        if (!source || !checkInput(name, source, length, &tokens)) failures++;
+        free(source);
+    }
+
+    unsigned long long state = seed;
+    for (int s = 0; s < soups; s++, inputs++) {
+        char name[64];
+        snprintf(name, sizeof(name), "soup %d", s);
+        size_t length;
+        char* source = makeSoup(&state, &length);
+        if (!source || !checkInput(name, source, length, &tokens)) failures++;
+        free(source);
+    }
+
+    printf("%d inputs, %ld tokens, %d differing; simd kernels checked:", inputs, tokens, failures);
+    for (size_t k = 0; k < sizeof(kernelNames) / sizeof(kernelNames[0]); k++) {
+        if (selectSimdKernel(kernelNames[k])) printf(" %s", kernelNames[k]);
+    }
+    printf("\n");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
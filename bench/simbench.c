@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "ast.h"
+#include "canonical.h"
+#include "dependence.h"
+#include "simdlexer.h"
+#include "workload.h"
+
+// End-to-end benchmark: for each program size, a cohort of generated programs (a base
+// and its mutants) is lexed, parsed, analyzed and compared against the base. Each size
+// runs in its own process, so the peak RSS reported is that of the size alone.
+
+#define BENCH_DEFAULT_FILES 32
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double rate(double amount, double seconds) {
+    return seconds > 0 ? amount / seconds : 0.0;
+}
+
+static long countTreeNodes(ASTNode* node) {
+    if (!node) return 0;
+    long count = 1;
+    for (int i = 0; i < node->childCount; i++) count += countTreeNodes(node->children[i]);
+    return count;
+}
+
+// The parser and lexer trace every step; that output goes to /dev/null unless asked for
+static void silence(void) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null < 0) return;
+    fflush(stdout);
+    fflush(stderr);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    close(null);
+}
+
+static int runSize(const WorkloadOptions* options, int files, FILE* report, int verbose) {
+    char** sources = calloc(files, sizeof(char*));
+    size_t* lengths = calloc(files, sizeof(size_t));
+    ASTNode** roots = calloc(files, sizeof(ASTNode*));
+    if (!sources || !lengths || !roots) return 0;
+
+    size_t bytes = 0;
+    for (int f = 0; f < files; f++) {
+        if (!(sources[f] = generateProgram(options, (unsigned)f, &lengths[f]))) return 0;
+        bytes += lengths[f];
+    }
+    if (!verbose) silence();
+
+    double start = now();
+    uint64_t sink = 0;
+    for (int f = 0; f < files; f++) sink ^= tokenStreamHash(sources[f], lengths[f]);
+    double lexSeconds = now() - start;
+
+    start = now();
+    long nodes = 0;
+    int failures = 0;
+    for (int f = 0; f < files; f++) {
+        roots[f] = parseBuffer("bench", sources[f], lengths[f]);
+        if (roots[f]) nodes += countTreeNodes(roots[f]);
+        else failures++;
+    }
+    double parseSeconds = now() - start;
+
+    start = now();
+    for (int f = 0; f < files; f++) {
+        if (!roots[f]) continue;
+        canonicalizeAST(roots[f]);
+        analyzeDependences(roots[f]);
+    }
+    double analyzeSeconds = now() - start;
+
+    start = now();
+    int pairs = 0;
+    long scoreSum = 0;
+    for (int f = 1; f < files; f++) {
+        if (!roots[0] || !roots[f]) continue;
+        scoreSum += compareASTs(roots[0], roots[f]);
+        pairs++;
+    }
+    double compareSeconds = now() - start;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(report, "%9d %6d %10zu %9.1f %9.2f %9.1f %11.0f %9.1f %9.1f %8ld %6ld %4d\n",
+            options->functions, files, bytes,
+            rate(files, lexSeconds), rate(bytes / 1e6, lexSeconds),
+            rate(files - failures, parseSeconds), rate(nodes, parseSeconds),
+            rate(files - failures, analyzeSeconds), rate(pairs, compareSeconds),
+            usage.ru_maxrss, pairs ? scoreSum / pairs : 0L, failures);
+    fflush(report);
+    (void)sink;
+
+    for (int f = 0; f < files; f++) {
+        freeASTNode(roots[f]);
+        free(sources[f]);
+    }
+    free(roots);
+    free(sources);
+    free(lengths);
+    return failures == 0;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [--sizes n,n,...] [--files N] [--scanner flex|simd] [--verbose] [knob=value]...\n", program);
+    fprintf(stderr, "Sizes are functions per program; knobs as for simgen.\n");
+}
+
+int main(int argc, char** argv) {
+    WorkloadOptions options;
+    defaultWorkloadOptions(&options);
+    const char* sizes = "5,20,80";
+    int files = BENCH_DEFAULT_FILES, verbose = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sizes = argv[++i];
+        } else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) {
+            files = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scanner") == 0 && i + 1 < argc) {
+            if (!selectScanner(argv[++i])) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (!setWorkloadOption(&options, argv[i])) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (files < 2) {
+        fprintf(stderr, "At least 2 files are needed for a comparison.\n");
+        return EXIT_FAILURE;
+    }
+
+    // The report goes to a copy of stdout, which survives silence() in the children
+    FILE* report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report) {
+        perror("report");
+        return EXIT_FAILURE;
+    }
+    fprintf(report, "# depth=%d accesses=%d exprdepth=%d arrays1d=%d arrays2d=%d mutation=%.2f seed=%u scanner=%s\n",
+            options.loopDepth, options.accessesPerLoop, options.exprDepth, options.arrays1d, options.arrays2d,
+            options.mutationRate, options.seed, scannerName());
+    fprintf(report, "%9s %6s %10s %9s %9s %9s %11s %9s %9s %8s %6s %4s\n", "functions", "files", "bytes",
+            "lex f/s", "lex MB/s", "parse f/s", "nodes/s", "anlyz f/s", "pairs/s", "rss KB", "score", "fail");
+    fflush(report);
+
+    int status = EXIT_SUCCESS;
+    for (const char* p = sizes; *p;) {
+        char* end;
+        long size = strtol(p, &end, 10);
+        if (end == p || size < 0) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        options.functions = (int)size;
+        fflush(NULL);
+        pid_t child = fork();
+        if (child == 0) _exit(runSize(&options, files, report, verbose) ? EXIT_SUCCESS : EXIT_FAILURE);
+        int childStatus = 0;
+        if (child < 0 || waitpid(child, &childStatus, 0) < 0 || !WIFEXITED(childStatus) ||
+            WEXITSTATUS(childStatus) != EXIT_SUCCESS) {
+            fprintf(stderr, "Benchmark for %ld functions failed.\n", size);
+            status = EXIT_FAILURE;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    fclose(report);
+    return status;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "workload.h"
+
+// Writes synthetic programs: one variant to stdout, or a base program and its
+// mutants into a directory (sub0000.c is the base)
+static void printUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [knob=value]... [variant]\n", program);
+    fprintf(stderr, "       %s -o <dir> -n <count> [knob=value]...\n", program);
+    fprintf(stderr, "Knobs: functions arrays1d arrays2d depth accesses exprdepth mutation seed\n");
+}
+
+static int writeVariant(const WorkloadOptions* options, unsigned variant, const char* path) {
+    size_t length;
+    char* source = generateProgram(options, variant, &length);
+    if (!source) {
+        fprintf(stderr, "Memory allocation failed for generated program.\n");
+        return 0;
+    }
+    FILE* file = path ? fopen(path, "w") : stdout;
+    if (!file) {
+        perror(path);
+        free(source);
+        return 0;
+    }
+    int ok = fwrite(source, 1, length, file) == length;
+    if (path) ok = fclose(file) == 0 && ok;
+    free(source);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    WorkloadOptions options;
+    defaultWorkloadOptions(&options);
+    const char* directory = NULL;
+    long count = 1, variant = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = strtol(argv[++i], NULL, 10);
+        } else if (strchr(argv[i], '=')) {
+            if (!setWorkloadOption(&options, argv[i])) {
+                fprintf(stderr, "Bad knob setting: %s\n", argv[i]);
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (!directory && argv[i][0] >= '0' && argv[i][0] <= '9') {
+            variant = strtol(argv[i], NULL, 10);
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!directory) return writeVariant(&options, (unsigned)variant, NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (count <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (long v = 0; v < count; v++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/sub%04ld.c", directory, v);
+        if (!writeVariant(&options, (unsigned)v, path)) return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Log: Wrote %ld programs to %s.\n", count, directory);
+    return EXIT_SUCCESS;
+}
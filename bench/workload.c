@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "workload.h"
+
+typedef struct Output {
+    char* data;
+    size_t length, capacity;
+    int failed;
+} Output;
+
+// Two independent streams: the skeleton draws from one, the mutations from the other,
+// so every variant of a seed has the same skeleton whatever it mutates
+typedef struct Generator {
+    const WorkloadOptions* options;
+    Output out;
+    unsigned long long skeleton;
+    unsigned long long mutation;
+    int mutating;
+} Generator;
+
+static unsigned nextRandom(unsigned long long* state) {
+    *state ^= *state << 13; // xorshift64
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (unsigned)(*state >> 32);
+}
+
+static int pick(Generator* g, int n) {
+    return n > 0 ? (int)(nextRandom(&g->skeleton) % (unsigned)n) : 0;
+}
+
+static int mutate(Generator* g) {
+    if (!g->mutating) return 0;
+    return nextRandom(&g->mutation) < (unsigned)(g->options->mutationRate * 4294967295.0);
+}
+
+static void emit(Generator* g, const char* format, ...) {
+    Output* out = &g->out;
+    if (out->failed) return;
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int needed = vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+        va_end(args);
+        if (needed < 0) {
+            out->failed = 1;
+            return;
+        }
+        if (out->length + (size_t)needed < out->capacity) {
+            out->length += (size_t)needed;
+            return;
+        }
+        size_t capacity = out->capacity * 2 + (size_t)needed;
+        char* grown = realloc(out->data, capacity);
+        if (!grown) {
+            out->failed = 1;
+            return;
+        }
+        out->data = grown;
+        out->capacity = capacity;
+    }
+}
+
+// Mutations that remove or replace generated text rewind to a mark instead of skipping
+// the generation, which would leave the skeleton stream out of step
+static size_t mark(Generator* g) {
+    return g->out.length;
+}
+
+static void rewindTo(Generator* g, size_t position) {
+    if (g->out.failed) return;
+    g->out.length = position;
+    g->out.data[position] = '\0';
+}
+
+static void indent(Generator* g, int level) {
+    emit(g, "%*s", level * 4, "");
+}
+
+static const char* loopNames[2][4] = { { "i", "j", "k", "l" }, { "p", "q", "r", "s" } };
+
+// Loop variable of nest level; a mutated function uses the other name set
+static void emitLoopVariable(Generator* g, int level, int renamed) {
+    emit(g, "%s%d", loopNames[renamed][level % 4], level / 4);
+}
+
+// Index expression over the loop variables in scope: v, v + c, v * c + w
+static void emitIndex(Generator* g, int depth, int renamed) {
+    int shape = pick(g, 3), level = pick(g, depth), other = pick(g, depth), constant = 1 + pick(g, 4);
+    if (mutate(g)) shape = (shape + 1) % 3;
+    if (mutate(g)) constant++;
+    emitLoopVariable(g, level, renamed);
+    if (shape == 1) {
+        emit(g, " + %d", constant);
+    } else if (shape == 2) {
+        emit(g, " * %d + ", constant);
+        emitLoopVariable(g, other, renamed);
+    }
+}
+
+static void emitArrayAccess(Generator* g, int depth, int renamed, int function) {
+    const WorkloadOptions* o = g->options;
+    int choices = o->arrays1d + o->arrays2d + 2, choice = pick(g, choices);
+    if (choice < o->arrays1d) {
+        emit(g, "g%d[", choice);
+        emitIndex(g, depth, renamed);
+        emit(g, "]");
+    } else if (choice < o->arrays1d + o->arrays2d) {
+        emit(g, "m%d[", choice - o->arrays1d);
+        emitIndex(g, depth, renamed);
+        emit(g, "][");
+        emitIndex(g, depth, renamed);
+        emit(g, "]");
+    } else {
+        emit(g, choice == choices - 1 ? "x[" : "t%d[", function);
+        emitIndex(g, depth, renamed);
+        emit(g, "]");
+    }
+}
+
+static void emitExpression(Generator* g, int exprDepth, int depth, int renamed, int function) {
+    static const char* operators[] = { "+", "-", "*", "+" };
+    if (exprDepth <= 0) {
+        int leaf = pick(g, 3), constant = 1 + pick(g, 9);
+        size_t start = mark(g);
+        if (leaf == 0) emitArrayAccess(g, depth, renamed, function);
+        else if (leaf == 1) emitLoopVariable(g, pick(g, depth), renamed);
+        else emit(g, "%d", constant);
+        if (mutate(g)) {
+            rewindTo(g, start);
+            emit(g, "%u", nextRandom(&g->mutation) % 100);
+        }
+        return;
+    }
+    int op = pick(g, 4);
+    if (mutate(g)) op = (op + 1) % 4;
+    emit(g, "(");
+    emitExpression(g, exprDepth - 1, depth, renamed, function);
+    emit(g, " %s ", operators[op]);
+    emitExpression(g, exprDepth - 1, depth, renamed, function);
+    emit(g, ")");
+}
+
+static void emitAssignment(Generator* g, int level, int depth, int renamed, int function) {
+    indent(g, level);
+    emitArrayAccess(g, depth, renamed, function);
+    emit(g, " = ");
+    emitExpression(g, g->options->exprDepth, depth, renamed, function);
+    emit(g, ";\n");
+}
+
+static void emitLoopNest(Generator* g, int level, int depth, int renamed, int function) {
+    const WorkloadOptions* o = g->options;
+    if (level == depth) {
+        int guarded = pick(g, 4) == 0;
+        if (guarded) {
+            indent(g, level + 1);
+            emit(g, "if (");
+            emitLoopVariable(g, pick(g, depth), renamed);
+            emit(g, " < n) {\n");
+        }
+        for (int a = 0; a < o->accessesPerLoop; a++) {
+            size_t start = mark(g);
+            emitAssignment(g, level + 1 + guarded, depth, renamed, function);
+            // Keep the first statement, an empty block does not parse
+            if (mutate(g) && a > 0) {
+                rewindTo(g, start);
+            } else if (mutate(g) && !g->out.failed) {
+                // Copied out first: emit may move the buffer
+                char* statement = strndup(g->out.data + start, mark(g) - start);
+                if (statement) emit(g, "%s", statement);
+                else g->out.failed = 1;
+                free(statement);
+            }
+        }
+        if (guarded) {
+            indent(g, level + 1);
+            emit(g, "}\n");
+        }
+        return;
+    }
+    int bound = 8 + pick(g, 56), start = pick(g, 2);
+    if (mutate(g)) bound += 1;
+    indent(g, level + 1);
+    emit(g, "for (int ");
+    emitLoopVariable(g, level, renamed);
+    emit(g, " = %d; ", start);
+    emitLoopVariable(g, level, renamed);
+    emit(g, " < %d; ", bound);
+    emitLoopVariable(g, level, renamed);
+    emit(g, "++) {\n");
+    emitLoopNest(g, level + 1, depth, renamed, function);
+    indent(g, level + 1);
+    emit(g, "}\n");
+}
+
+char* generateProgram(const WorkloadOptions* options, unsigned variant, size_t* length) {
+    Generator g;
+    memset(&g, 0, sizeof(Generator));
+    g.options = options;
+    g.skeleton = 0x9E3779B97F4A7C15ULL ^ ((unsigned long long)options->seed * 0xD1B54A32D192ED03ULL);
+    g.mutation = 0xBF58476D1CE4E5B9ULL ^ ((unsigned long long)variant * 0x94D049BB133111EBULL) ^ options->seed;
+    if (!g.skeleton) g.skeleton = 1;
+    if (!g.mutation) g.mutation = 1;
+    g.mutating = variant != 0;
+    g.out.capacity = 4096;
+    g.out.data = malloc(g.out.capacity);
+    if (!g.out.data) return NULL;
+    g.out.data[0] = '\0';
+
+    emit(&g, "// Generated workload: seed %u, variant %u\n", options->seed, variant);
+    for (int a = 0; a < options->arrays1d; a++) emit(&g, "int g%d[%d];\n", a, 64 + 64 * pick(&g, 16));
+    for (int a = 0; a < options->arrays2d; a++) emit(&g, "int m%d[%d][%d];\n", a, 8 + 8 * pick(&g, 8), 8 + 8 * pick(&g, 8));
+
+    int depth = options->loopDepth > 0 ? options->loopDepth : 1;
+    for (int f = 0; f < options->functions; f++) {
+        int renamed = mutate(&g);
+        emit(&g, "\nint f%d(int x[], int n) {\n", f);
+        emit(&g, "    int t%d[%d];\n", f, 64 + 64 * pick(&g, 8));
+        emitLoopNest(&g, 0, depth, renamed, f);
+        emit(&g, "    return t%d[n - 1];\n}\n", f);
+    }
+
+    emit(&g, "\nint main() {\n    int b[16];\n");
+    emit(&g, "    for (int i0 = 0; i0 < 16; i0++) {\n        b[i0] = i0 * %d;\n    }\n", 1 + pick(&g, 7));
+    emit(&g, "    return 0;\n}\n");
+
+    if (g.out.failed) {
+        free(g.out.data);
+        return NULL;
+    }
+    if (length) *length = g.out.length;
+    return g.out.data;
+}
+
+void defaultWorkloadOptions(WorkloadOptions* options) {
+    options->functions = 20;
+    options->arrays1d = 4;
+    options->arrays2d = 2;
+    options->loopDepth = 2;
+    options->accessesPerLoop = 3;
+    options->exprDepth = 2;
+    options->mutationRate = 0.1;
+    options->seed = 1;
+}
+
+int setWorkloadOption(WorkloadOptions* options, const char* setting) {
+    const char* equals = strchr(setting, '=');
+    if (!equals) return 0;
+    size_t keyLength = (size_t)(equals - setting);
+    const char* value = equals + 1;
+    char* end;
+
+    if (keyLength == 8 && strncmp(setting, "mutation", 8) == 0) {
+        double rate = strtod(value, &end);
+        if (*end || rate < 0 || rate > 1) return 0;
+        options->mutationRate = rate;
+        return 1;
+    }
+
+    long number = strtol(value, &end, 10);
+    if (*end || !*value || number < 0 || number > 1000000) return 0;
+    struct { const char* key; int* field; } knobs[] = {
+        { "functions", &options->functions }, { "arrays1d", &options->arrays1d },
+        { "arrays2d", &options->arrays2d },   { "depth", &options->loopDepth },
+        { "accesses", &options->accessesPerLoop }, { "exprdepth", &options->exprDepth },
+    };
+    for (size_t i = 0; i < sizeof(knobs) / sizeof(knobs[0]); i++) {
+        if (strlen(knobs[i].key) == keyLength && strncmp(setting, knobs[i].key, keyLength) == 0) {
+            *knobs[i].field = (int)number;
+            return 1;
+        }
+    }
+    if (keyLength == 4 && strncmp(setting, "seed", 4) == 0) {
+        options->seed = (unsigned)number;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stddef.h>
+
+// Knobs of a synthetic program. Every generated program is in the subset parser.y accepts.
+typedef struct WorkloadOptions {
+    int functions;        // Functions besides main
+    int arrays1d;         // Global 1D array declarations
+    int arrays2d;         // Global 2D array declarations
+    int loopDepth;        // Nesting depth of the loop nest in each function
+    int accessesPerLoop;  // Array assignments in each innermost loop body
+    int exprDepth;        // Depth of the right-hand side expression trees
+    double mutationRate;  // Probability that a mutation point of the base program is changed
+    unsigned seed;        // Seed of the base program
+} WorkloadOptions;
+
+void defaultWorkloadOptions(WorkloadOptions* options);
+
+// Generates a program. Variant 0 is the base program of options->seed; variant v > 0
+// has the same skeleton with each mutation point (operators, constants, index
+// expressions, loop variable names, statements) changed with probability mutationRate.
+// Returns a malloc'd, NUL-terminated source, or NULL on allocation failure.
+char* generateProgram(const WorkloadOptions* options, unsigned variant, size_t* length);
+
+// Parses "name=value" knob settings (functions, arrays1d, arrays2d, depth, accesses,
+// exprdepth, mutation, seed). Returns 0 for an unknown knob or a bad value.
+int setWorkloadOption(WorkloadOptions* options, const char* setting);
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include "budget.h"
+#include "stats.h"
+#include "simalloc.h"
+
+typedef struct PairBudgetState {
+    int active;
+    int ranOut;
+    int lastDegraded;
+    unsigned int probes;
+    uint64_t started;
+    size_t allocatedAtStart;
+    int64_t liveAtStart;
+} PairBudgetState;
+
+int budgetEnabled = 0;
+
+static uint64_t timeLimit;
+static size_t memoryLimit;
+static int countLiveBytes;  // Otherwise every byte allocated counts, freed or not
+static __thread PairBudgetState state;
+
+void setPairBudget(uint64_t nanoseconds, size_t bytes) {
+    timeLimit = nanoseconds;
+    memoryLimit = bytes;
+    budgetEnabled = nanoseconds > 0 || bytes > 0;
+    countLiveBytes = bytes > 0 && enableLiveByteTracking();
+    if (bytes > 0 && !countLiveBytes) {
+        fprintf(stderr, "Log: Memory budget set after the first allocation; it counts bytes allocated, not bytes in use.\n");
+    }
+}
+
+// Bytes the comparison holds now that it did not at the start, by the best measure available
+static size_t memoryUsed(void) {
+    if (!countLiveBytes) return simThreadAllocated() - state.allocatedAtStart;
+    int64_t grown = simThreadLive() - state.liveAtStart;
+    return grown > 0 ? (size_t)grown : 0;
+}
+
+void beginPairBudget(void) {
+    state.active = budgetEnabled;
+    state.ranOut = 0;
+    state.probes = 0;
+    if (!state.active) return;
+    state.started = statsClock();
+    state.allocatedAtStart = simThreadAllocated();
+    state.liveAtStart = simThreadLive();
+}
+
+int endPairBudget(void) {
+    state.lastDegraded = state.active && state.ranOut;
+    state.active = 0;
+    state.ranOut = 0;
+    if (state.lastDegraded) statsCount(Stat_DegradedPairs, 1);
+    return state.lastDegraded;
+}
+
+int lastPairDegraded(void) {
+    return state.lastDegraded;
+}
+
+int budgetProbe(void) {
+    if (!state.active) return 0;
+    if (state.ranOut) return 1;
+    if ((++state.probes & (BUDGET_PROBE_INTERVAL - 1)) != 0) return 0;
+
+    uint64_t elapsed = statsClock() - state.started;
+    size_t used = memoryUsed();
+    if ((timeLimit && elapsed >= timeLimit) || (memoryLimit && used >= memoryLimit)) {
+        state.ranOut = 1;
+        fprintf(stderr, "Log: Comparison budget ran out after %.1f ms with %zu bytes %s.\n", elapsed / 1e6, used,
+                countLiveBytes ? "in use" : "allocated");
+    }
+    return state.ranOut;
+}
+
+int budgetRanOut(void) {
+    return state.active && state.ranOut;
+}
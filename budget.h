@@ -0,0 +1,46 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-pair resource governor. With a budget set, one program comparison may run for at
+// most that much wall time and hold at most that many more bytes than at its start
+// (allocated through simalloc on its own thread and not yet freed). Once either runs
+// out the exact comparison stops where it is and finishes with cheaper tiers: the
+// declaration and access pairs not yet compared are estimated from an evenly spread
+// sample, and function pairs not yet compared are scored by the similarity of their
+// feature vectors. The score is then marked degraded, and is never stored in a result
+// cache.
+//
+// Probes are amortized, so a budget can be overrun by a few dozen node visits. The
+// dependence and cost components are linear and always computed exactly.
+
+#define BUDGET_PROBE_INTERVAL 64   // Probes between two clock reads; a power of two
+#define BUDGET_SAMPLE_PAIRS 256    // Remaining pairs scored per pair loop once the budget is out
+
+extern int budgetEnabled;
+
+// 0 means no limit. Set before any thread compares. A memory limit turns on live byte
+// tracking, which only works before the first allocation; set later, it counts every
+// byte allocated instead.
+void setPairBudget(uint64_t nanoseconds, size_t bytes);
+
+// Brackets one program comparison on the calling thread. endPairBudget returns 1 when
+// the budget ran out, i.e. the score is an estimate.
+void beginPairBudget(void);
+int endPairBudget(void);
+// What endPairBudget returned for this thread's last comparison
+int lastPairDegraded(void);
+
+int budgetProbe(void);
+// Whether the budget had already run out; never reads the clock
+int budgetRanOut(void);
+
+// Amortized check for loops and tree walks. Outside a comparison, or without a budget,
+// it is always 0.
+static inline int budgetExhausted(void) {
+    return __builtin_expect(budgetEnabled, 0) ? budgetProbe() : 0;
+}
+
+#endif
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "canonical.h"
+#include "stats.h"
+#include "simalloc.h"
+
+#define RENAME_TABLE_INITIAL 64
+#define CANONICAL_STACK_INITIAL 64
+
+// Open-addressing map from source names to canonical names, numbered prefix0, prefix1, ...
+typedef struct RenameTable {
+    char** from;
+    char** to;
+    int count;
+    int capacity;
+    const char* prefix;
+} RenameTable;
+
+// Explicit stack of the passes below, so deep generated code cannot overflow a worker
+// thread's stack. Frames are addressed by index, since they move when it grows.
+typedef struct CanonicalFrame {
+    ASTNode* node;
+    int next;  // Next index expression or child to visit, in the post-order passes
+} CanonicalFrame;
+
+typedef struct CanonicalStack {
+    CanonicalFrame* frames;
+    int count;
+    int capacity;
+} CanonicalStack;
+
+// 0 when the stack cannot grow; the pass then stops where it is
+static int pushCanonicalFrame(CanonicalStack* stack, ASTNode* node) {
+    if (stack->count == stack->capacity) {
+        int capacity = stack->capacity ? stack->capacity * 2 : CANONICAL_STACK_INITIAL;
+        CanonicalFrame* frames = simRealloc(stack->frames, sizeof(CanonicalFrame) * capacity, Alloc_Scratch);
+        if (!frames) {
+            fprintf(stderr, "Memory allocation failed while growing the canonicalization stack to %d frames.\n", capacity);
+            return 0;
+        }
+        stack->frames = frames;
+        stack->capacity = capacity;
+    }
+    stack->frames[stack->count].node = node;
+    stack->frames[stack->count].next = 0;
+    stack->count++;
+    return 1;
+}
+
+static unsigned long hashString(unsigned long h, const char* s) {
+    // FNV-1a
+    if (!s) return h ^ 0x5bd1e995UL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static unsigned long hashCombine(unsigned long h, unsigned long v) {
+    return h ^ (v + 0x9e3779b97f4a7c15UL + (h << 6) + (h >> 2));
+}
+
+// 0 when out of memory; the table is then empty and renames nothing
+static int initRenameTable(RenameTable* table, const char* prefix) {
+    table->capacity = RENAME_TABLE_INITIAL;
+    table->count = 0;
+    table->prefix = prefix;
+    table->from = simCalloc(table->capacity, sizeof(char*), Alloc_Scratch);
+    table->to = simCalloc(table->capacity, sizeof(char*), Alloc_Scratch);
+    if (!table->from || !table->to) {
+        fprintf(stderr, "Memory allocation failed for rename table.\n");
+        simFree(table->from);
+        simFree(table->to);
+        table->from = table->to = NULL;
+        table->capacity = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static void freeRenameTable(RenameTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        simFree(table->from[i]);
+        simFree(table->to[i]);
+    }
+    simFree(table->from);
+    simFree(table->to);
+}
+
+// Starts the numbering over, for the next function's locals
+static void resetRenameTable(RenameTable* table) {
+    freeRenameTable(table);
+    initRenameTable(table, table->prefix);
+}
+
+static int findRenameSlot(char** keys, int capacity, const char* name) {
+    int slot = (int)(hashString(14695981039346656037UL, name) & (unsigned long)(capacity - 1));
+    while (keys[slot] && strcmp(keys[slot], name) != 0) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+// 0 when out of memory; the table is left as it was
+static int growRenameTable(RenameTable* table) {
+    int newCapacity = table->capacity * 2;
+    char** newFrom = simCalloc(newCapacity, sizeof(char*), Alloc_Scratch);
+    char** newTo = simCalloc(newCapacity, sizeof(char*), Alloc_Scratch);
+    if (!newFrom || !newTo) {
+        fprintf(stderr, "Memory allocation failed while growing rename table.\n");
+        simFree(newFrom);
+        simFree(newTo);
+        return 0;
+    }
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->from[i]) {
+            int slot = findRenameSlot(newFrom, newCapacity, table->from[i]);
+            newFrom[slot] = table->from[i];
+            newTo[slot] = table->to[i];
+        }
+    }
+    simFree(table->from);
+    simFree(table->to);
+    table->from = newFrom;
+    table->to = newTo;
+    table->capacity = newCapacity;
+    return 1;
+}
+
+// The canonical name already given to a source name, or NULL
+static const char* findRename(const RenameTable* table, const char* name) {
+    if (!table->capacity) return NULL;
+    int slot = findRenameSlot(table->from, table->capacity, name);
+    return table->from[slot] ? table->to[slot] : NULL;
+}
+
+// Returns the canonical name for a source name, assigning the next one on first use;
+// NULL when out of memory
+static const char* canonicalNameFor(RenameTable* table, const char* name) {
+    const char* known = findRename(table, name);
+    if (known) return known;
+
+    if (!table->capacity || ((table->count + 1) * 2 > table->capacity && !growRenameTable(table))) return NULL;
+    int slot = findRenameSlot(table->from, table->capacity, name);
+
+    char canonicalName[32];
+    snprintf(canonicalName, sizeof(canonicalName), "%s%d", table->prefix, table->count);
+    char* from = simStrdup(name, Alloc_Scratch);
+    char* to = simStrdup(canonicalName, Alloc_Scratch);
+    if (!from || !to) {
+        simFree(from);
+        simFree(to);
+        return NULL;
+    }
+    table->from[slot] = from;
+    table->to[slot] = to;
+    table->count++;
+    return to;
+}
+
+static int isIdentifierNamed(ASTNode* node, const char* name) {
+    return node && node->type == NodeType_Identifier && node->name && name && strcmp(node->name, name) == 0;
+}
+
+static int isConstantOne(ASTNode* node) {
+    return node && node->type == NodeType_Constant && node->name && strcmp(node->name, "1") == 0;
+}
+
+static int isRelational(const char* op) {
+    static const char* relationalOps[] = {"<", ">", "<=", ">=", "!=", "==", NULL};
+    if (!op) return 0;
+    for (int i = 0; relationalOps[i]; i++) {
+        if (strcmp(op, relationalOps[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// +1 / -1 when the statement is var = var + 1, var = 1 + var or var = var - 1, otherwise 0
+static int unitStepOf(ASTNode* stmt, const char* var) {
+    if (!stmt || stmt->type != NodeType_Assignment || stmt->childCount != 2) return 0;
+    if (!isIdentifierNamed(stmt->children[0], var)) return 0;
+
+    ASTNode* rhs = stmt->children[1];
+    if (!rhs || rhs->type != NodeType_Expression || rhs->childCount != 2) return 0;
+
+    if (strcmp(rhs->name, "+") == 0) {
+        if (isIdentifierNamed(rhs->children[0], var) && isConstantOne(rhs->children[1])) return 1;
+        if (isConstantOne(rhs->children[0]) && isIdentifierNamed(rhs->children[1], var)) return 1;
+    } else if (strcmp(rhs->name, "-") == 0) {
+        if (isIdentifierNamed(rhs->children[0], var) && isConstantOne(rhs->children[1])) return -1;
+    }
+    return 0;
+}
+
+// Loop variable tested by a relational condition such as i < n or n > i: the identifier
+// operand that stepStatement steps by one, otherwise the first identifier operand
+static const char* loopVariableOf(ASTNode* cond, ASTNode* stepStatement) {
+    if (!cond || cond->type != NodeType_Expression || cond->childCount != 2 || !isRelational(cond->name)) {
+        return NULL;
+    }
+    const char* first = NULL;
+    for (int i = 0; i < 2; i++) {
+        ASTNode* operand = cond->children[i];
+        if (operand->type != NodeType_Identifier) continue;
+        if (unitStepOf(stepStatement, operand->name)) return operand->name;
+        if (!first) first = operand->name;
+    }
+    return first;
+}
+
+static ASTNode* createStepNode(const char* var, int step) {
+    ASTNode* stepNode = createASTNode(NodeType_Expression, step > 0 ? "++" : "--");
+    if (!stepNode) return NULL;
+    addASTChild(stepNode, createASTNode(NodeType_Identifier, (char*)var));
+    return stepNode;
+}
+
+// Writes n > i as i < n so the loop variable is always on the left
+static void normalizeLoopCondition(ASTNode* cond, const char* var) {
+    if (!cond || cond->type != NodeType_Expression || cond->childCount != 2 || !isRelational(cond->name)) return;
+    if (isIdentifierNamed(cond->children[0], var) || !isIdentifierNamed(cond->children[1], var)) return;
+
+    const char* flipped = cond->name;
+    if (strcmp(cond->name, "<") == 0) flipped = ">";
+    else if (strcmp(cond->name, ">") == 0) flipped = "<";
+    else if (strcmp(cond->name, "<=") == 0) flipped = ">=";
+    else if (strcmp(cond->name, ">=") == 0) flipped = "<=";
+
+    char* newName = simStrdup(flipped, nodeAllocTag(cond->type));
+    simFree(cond->name);
+    cond->name = newName;
+
+    ASTNode* tmp = cond->children[0];
+    cond->children[0] = cond->children[1];
+    cond->children[1] = tmp;
+}
+
+static void removeChildAt(ASTNode* parent, int index) {
+    for (int i = index; i < parent->childCount - 1; i++) {
+        parent->children[i] = parent->children[i + 1];
+    }
+    parent->childCount--;
+}
+
+// for (init; cond; v = v + 1) is rewritten with v++ as its increment
+static void normalizeForNode(ASTNode* forNode) {
+    if (forNode->childCount != 4) return;
+
+    ASTNode* init = forNode->children[0];
+    ASTNode* incr = forNode->children[2];
+    const char* var = NULL;
+
+    if (init && init->type == NodeType_Assignment && init->childCount > 0 && init->children[0]->type == NodeType_Identifier) {
+        var = init->children[0]->name;
+    } else {
+        var = loopVariableOf(forNode->children[1], incr);
+    }
+    if (!var) return;
+
+    normalizeLoopCondition(forNode->children[1], var);
+
+    int step = unitStepOf(incr, var);
+    if (step) {
+        ASTNode* stepNode = createStepNode(var, step);
+        if (stepNode) {
+            forNode->children[2] = stepNode;
+            freeASTNode(incr);
+        }
+    }
+}
+
+// Rewrites statements[index] when it is `while (v REL e) { ...; v = v +/- 1; }`.
+// An assignment to v right before the loop is hoisted into the for initialization.
+// Returns the index of the loop after the rewrite.
+static int normalizeWhileAt(ASTNode* statements, int index) {
+    ASTNode* whileNode = statements->children[index];
+    if (whileNode->childCount != 2) return index;
+
+    ASTNode* condWrapper = whileNode->children[0];
+    ASTNode* bodyWrapper = whileNode->children[1];
+    if (condWrapper->childCount != 1 || bodyWrapper->childCount != 1) return index;
+
+    ASTNode* cond = condWrapper->children[0];
+    ASTNode* body = bodyWrapper->children[0];
+    if (!body || body->type != NodeType_Body || body->childCount != 1) return index;
+
+    ASTNode* bodyStatements = body->children[0];
+    if (bodyStatements->type != NodeType_Statements || bodyStatements->childCount == 0) return index;
+
+    ASTNode* last = bodyStatements->children[bodyStatements->childCount - 1];
+    const char* var = loopVariableOf(cond, last);
+    if (!var) return index;
+    int step = unitStepOf(last, var);
+    if (!step) return index;
+
+    ASTNode* incr = createStepNode(var, step);
+    if (!incr) return index;
+
+    ASTNode* init = NULL;
+    if (index > 0) {
+        ASTNode* previous = statements->children[index - 1];
+        if (previous->type == NodeType_Assignment && previous->childCount == 2 && isIdentifierNamed(previous->children[0], var)) {
+            init = previous;
+            removeChildAt(statements, index - 1);
+            index--;
+        }
+    }
+
+    fprintf(stderr, "Log: Normalizing while loop over %s into a for loop.\n", var);
+
+    // Detach the reused parts before the while wrapper is released
+    bodyStatements->childCount--;
+    condWrapper->childCount = 0;
+    bodyWrapper->childCount = 0;
+    freeASTNode(last);
+
+    ASTNode* forNode = createForNode(init, cond, incr, body);
+    if (!forNode) return index;
+
+    normalizeLoopCondition(cond, var);
+    statements->children[index] = forNode;
+    freeASTNode(whileNode);
+    return index;
+}
+
+// Post-order: a node is normalized after all its children
+static void normalizeLoops(ASTNode* root, CanonicalStack* stack) {
+    stack->count = 0;
+    if (!root || !pushCanonicalFrame(stack, root)) return;
+
+    while (stack->count > 0) {
+        CanonicalFrame* frame = &stack->frames[stack->count - 1];
+        ASTNode* node = frame->node;
+        if (frame->next < node->childCount) {
+            ASTNode* child = node->children[frame->next++];
+            if (child && !pushCanonicalFrame(stack, child)) return;
+            continue;
+        }
+        stack->count--;
+
+        if (node->type == NodeType_For) {
+            normalizeForNode(node);
+        }
+
+        if (node->type == NodeType_Statements) {
+            for (int i = 0; i < node->childCount; i++) {
+                if (node->children[i]->type == NodeType_While) {
+                    i = normalizeWhileAt(node, i);
+                }
+            }
+        }
+    }
+}
+
+// Names first seen outside any function are globals (g0, g1, ...) everywhere; the others
+// are numbered per function (v0, v1, ...), so a local renamed in one function does not
+// shift the names of every function after it
+static void renameNode(ASTNode* node, RenameTable* globals, RenameTable* locals, int inFunction) {
+    if (!node->name || node->sourceName) return;
+
+    const char* canonicalName = findRename(globals, node->name);
+    if (!canonicalName) canonicalName = canonicalNameFor(inFunction ? locals : globals, node->name);
+    char* copy = canonicalName ? simStrdup(canonicalName, nodeAllocTag(node->type)) : NULL;
+    if (!copy) return; // Out of memory: the node keeps its source name
+    node->sourceName = node->name;
+    node->name = copy;
+}
+
+// Pre-order walk in source order so names are numbered by first use: an access's
+// index expressions, then the children. Both are pushed last one first. A function's
+// subtree is every frame popped from above the index it was popped from.
+static void alphaRename(ASTNode* root, RenameTable* globals, RenameTable* locals, CanonicalStack* stack) {
+    stack->count = 0;
+    if (!root || !pushCanonicalFrame(stack, root)) return;
+
+    int functionBase = -1;
+    while (stack->count > 0) {
+        ASTNode* node = stack->frames[--stack->count].node;
+        if (functionBase >= 0 && stack->count < functionBase) functionBase = -1;
+        if (functionBase < 0 && (node->type == NodeType_FunctionDef || node->type == NodeType_MainFunction)) {
+            functionBase = stack->count;
+            resetRenameTable(locals);
+        }
+
+        if (node->type == NodeType_Identifier || node->type == NodeType_ArrayDeclaration || node->type == NodeType_ArrayAccess) {
+            renameNode(node, globals, locals, functionBase >= 0);
+        }
+
+        for (int i = node->childCount - 1; i >= 0; i--) {
+            if (node->children[i] && !pushCanonicalFrame(stack, node->children[i])) return;
+        }
+
+        if (node->type == NodeType_ArrayAccess) {
+            for (int i = node->indexCount - 1; i >= 0; i--) {
+                if (node->indices[i] && !pushCanonicalFrame(stack, node->indices[i])) return;
+            }
+        }
+    }
+}
+
+// Gives every array access the row-major flattened affine form of its index,
+// using the declaration of the same (canonical) name for the row length
+static void bindArrayAccesses(ASTNode* root) {
+    int declarationCount = 0, accessCount = 0;
+    ASTNode** declarations = collectNodesOfType(root, NodeType_ArrayDeclaration, &declarationCount);
+    ASTNode** accesses = collectNodesOfType(root, NodeType_ArrayAccess, &accessCount);
+
+    for (int i = 0; i < accessCount; i++) {
+        ASTNode* declaration = NULL;
+        for (int j = 0; j < declarationCount && !declaration; j++) {
+            if (strcmp(declarations[j]->name, accesses[i]->name) == 0) declaration = declarations[j];
+        }
+        linearizeArrayAccess(accesses[i], declaration);
+    }
+
+    simFree(declarations);
+    simFree(accesses);
+}
+
+// Hashes a node whose index expressions and children are already hashed
+static void hashNode(ASTNode* node, int sortCommutative) {
+    unsigned long h = hashCombine(14695981039346656037UL, (unsigned long)node->type);
+    h = hashString(h, node->name);
+    h = hashString(h, node->value);
+    h = hashString(h, node->dataType);
+
+    for (int i = 0; i < node->dimensions && node->dimSize; i++) {
+        h = hashCombine(h, (unsigned long)node->dimSize[i]);
+    }
+
+    for (int i = 0; i < node->indexCount; i++) {
+        h = hashCombine(h, node->indices[i] ? node->indices[i]->structHash : 0);
+    }
+
+    if (sortCommutative && node->type == NodeType_Expression && node->childCount == 2 && isCommutative(node->name)) {
+        if (node->children[1]->structHash < node->children[0]->structHash) {
+            ASTNode* tmp = node->children[0];
+            node->children[0] = node->children[1];
+            node->children[1] = tmp;
+        }
+    }
+
+    for (int i = 0; i < node->childCount; i++) {
+        h = hashCombine(h, node->children[i] ? node->children[i]->structHash : 0);
+    }
+
+    node->structHash = h;
+    if (sortCommutative) node->canonical = 1;
+}
+
+// Post-order: the index expressions, then the children, then the node itself
+static unsigned long hashTree(ASTNode* root, int sortCommutative, CanonicalStack* stack) {
+    stack->count = 0;
+    if (!root || !pushCanonicalFrame(stack, root)) return 0;
+
+    while (stack->count > 0) {
+        CanonicalFrame* frame = &stack->frames[stack->count - 1];
+        ASTNode* node = frame->node;
+        if (frame->next < node->indexCount + node->childCount) {
+            int next = frame->next++;
+            ASTNode* below = next < node->indexCount ? node->indices[next] : node->children[next - node->indexCount];
+            if (below && !pushCanonicalFrame(stack, below)) return 0;
+            continue;
+        }
+        stack->count--;
+        hashNode(node, sortCommutative);
+    }
+    return root->structHash;
+}
+
+unsigned long computeStructuralHash(ASTNode* node) {
+    CanonicalStack stack = {NULL, 0, 0};
+    unsigned long hash = hashTree(node, 0, &stack);
+    simFree(stack.frames);
+    return hash;
+}
+
+void canonicalizeAST(ASTNode* root) {
+    if (!root) {
+        fprintf(stderr, "canonicalizeAST: root is NULL.\n");
+        return;
+    }
+
+    uint64_t started = statsPhaseStart();
+    CanonicalStack stack = {NULL, 0, 0};
+    normalizeLoops(root, &stack);
+
+    RenameTable globals, locals;
+    initRenameTable(&globals, "g");
+    initRenameTable(&locals, "v");
+    alphaRename(root, &globals, &locals, &stack);
+    fprintf(stderr, "Log: Alpha-renamed %d global names.\n", globals.count);
+    freeRenameTable(&globals);
+    freeRenameTable(&locals);
+
+    bindArrayAccesses(root);
+
+    hashTree(root, 1, &stack);
+    simFree(stack.frames);
+    statsPhaseEnd(Phase_Canonicalize, started);
+    fprintf(stderr, "Log: Canonicalized AST %s (hash %lx).\n", root->name ? root->name : "Unnamed", root->structHash);
+}
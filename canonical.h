@@ -0,0 +1,21 @@
+#ifndef CANONICAL_H
+#define CANONICAL_H
+
+#include "ast.h"
+
+// Rewrites an AST in place into its canonical form. Run once per AST after parse():
+//  - while loops with a trailing unit step become for loops, and loop
+//    increments/conditions are written one way (i++ / i--, loop variable on the left)
+//  - identifiers and array names are alpha-renamed by first use: globals g0, g1, ...,
+//    and the names first seen in a function v0, v1, ..., numbered afresh per function
+//  - operands of commutative operators are ordered by structural hash
+//  - array accesses get the flattened affine form of their index (see linearizeArrayAccess)
+// Every node is stamped with its structural hash and marked canonical, so the
+// comparison functions can use plain ordered matching on canonical trees.
+void canonicalizeAST(ASTNode* root);
+
+// Computes (and caches in structHash) the structural hash of a subtree.
+// Does not reorder anything; canonicalizeAST() does that.
+unsigned long computeStructuralHash(ASTNode* node);
+
+#endif
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simanalysis.h"
+#include "daemon.h"
+#include "cohort.h"
+#include "pipeline.h"
+#include "ast.h"
+#include "stats.h"
+#include "trace.h"
+#include "simalloc.h"
+#include "simdlexer.h"
+#include "hashcons.h"
+#include "budget.h"
+#include "approximate.h"
+
+static void printUsage(const char* program) {
+    fprintf(stderr, "Usage: %s [--stats[=file.json]] [--trace <file.json>] [--memory[=file.json]] [--scanner=flex|simd] [--share]\n", program);
+    fprintf(stderr, "       %*s [--time-budget=ms] [--memory-budget=MiB] [--approximate[=error]]\n", (int)strlen(program), "");
+    fprintf(stderr, "       %*s <mode and arguments as below>\n", (int)strlen(program), "");
+    fprintf(stderr, "       %s <file1.c> <file2.c>\n", program);
+    fprintf(stderr, "       %s --serve <socket> [-j workers] <reference.c>...\n", program);
+    fprintf(stderr, "       %s --query <socket> <reference> <submission.c>\n", program);
+    fprintf(stderr, "       %s --cache <file> [--cache-entries N] <reference.c> <submission.c>\n", program);
+    fprintf(stderr, "       %s --cohort [--cache <file>] <submission.c>...\n", program);
+    fprintf(stderr, "       %s --batch [-j workers] <reference.c> <submission.c>...\n", program);
+    fprintf(stderr, "       %s --archive [-j workers] <reference.c> <submissions.tar|->\n", program);
+    fprintf(stderr, "       %s --revisions <reference.c> <revision.c>...\n", program);
+}
+
+// Revision mode: successive versions of one submission, each re-analyzed only where it changed
+static int runRevisions(const char* referencePath, char** paths, int count) {
+    SimContext* context = sim_context_create();
+    if (!context) return EXIT_FAILURE;
+    SimHistory* history = sim_history_create(context);
+    SimProgram* reference = history ? sim_parse_file(context, referencePath) : NULL;
+    if (!reference) {
+        fprintf(stderr, "Error: %s\n", sim_last_error(context));
+        sim_history_free(history);
+        sim_context_free(context);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        size_t length = 0;
+        char* source = readSourceFile(paths[i], &length);
+        SimProgram* revision = source ? sim_parse_revision(context, history, paths[i], source, length) : NULL;
+        SimResult* result = revision ? sim_compare_revision(context, history, reference, revision) : NULL;
+        if (result) {
+            int low = 0, high = 0;
+            int estimated = sim_result_interval(result, &low, &high);
+            char note[SCORE_NOTE_SIZE];
+            printf("Total similarity score between %s and %s is: %d%%%s\n", referencePath, paths[i], sim_result_score(result),
+                   formatScoreNote(note, sim_result_degraded(result), estimated, low, high));
+        } else {
+            fprintf(stderr, "Error: Scoring failed for %s.\n", paths[i]);
+            status = EXIT_FAILURE;
+        }
+        sim_result_free(result);
+        sim_program_free(revision);
+        simFree(source);
+    }
+
+    sim_program_free(reference);
+    sim_history_free(history);
+    sim_context_free(context);
+    return status;
+}
+
+// Score-only mode: the pair is looked up by content hash before anything is parsed
+static int runCached(const char* cachePath, unsigned int entries, const char* path1, const char* path2) {
+    SimContext* context = sim_context_create();
+    if (!context) return EXIT_FAILURE;
+    SimCache* cache = sim_cache_open(context, cachePath, entries);
+    if (!cache) {
+        fprintf(stderr, "Error: %s\n", sim_last_error(context));
+        sim_context_free(context);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_FAILURE;
+    SimProgram* reference = NULL;
+    size_t length1 = 0, length2 = 0;
+    char* source1 = readSourceFile(path1, &length1);
+    char* source2 = readSourceFile(path2, &length2);
+    if (!source1 || !source2) goto done;
+
+    int score;
+    if (sim_cache_lookup(cache, sim_content_hash(source1, length1), sim_content_hash(source2, length2), &score)) {
+        printf("Total similarity score between %s and %s is: %d%% (cached)\n", path1, path2, score);
+        status = EXIT_SUCCESS;
+        goto done;
+    }
+
+    reference = sim_parse_from_buffer(context, path1, source1, length1);
+    if (!reference) {
+        fprintf(stderr, "Error: Parsing failed for %s.\n", path1);
+        goto done;
+    }
+    score = sim_compare_cached(context, cache, reference, path2, source2, length2);
+    if (score < 0) {
+        fprintf(stderr, "Error: %s\n", sim_last_error(context));
+        goto done;
+    }
+    int low = 0, high = 0;
+    int estimated = lastPairInterval(&low, &high);
+    char note[SCORE_NOTE_SIZE];
+    printf("Total similarity score between %s and %s is: %d%%%s\n", path1, path2, score,
+           formatScoreNote(note, lastPairDegraded(), estimated, low, high));
+    status = EXIT_SUCCESS;
+
+done:
+    sim_program_free(reference);
+    simFree(source1);
+    simFree(source2);
+    sim_cache_close(cache);
+    sim_context_free(context);
+    return status;
+}
+
+static int runCommand(int argc, char **argv) {
+    // Server mode: keep the references resident and score submissions sent over a Unix socket
+    if (argc >= 4 && strcmp(argv[1], "--serve") == 0) {
+        int first = 3, workers = DAEMON_DEFAULT_WORKERS;
+        if (argc >= 6 && strcmp(argv[3], "-j") == 0) {
+            workers = atoi(argv[4]);
+            first = 5;
+        }
+        return runScoringDaemon(argv[2], argv + first, argc - first, workers);
+    }
+    if (argc == 5 && strcmp(argv[1], "--query") == 0) {
+        return queryScoringDaemon(argv[2], argv[3], argv[4]);
+    }
+    // Batch mode: many submissions against one reference, loading, parsing and scoring overlapped
+    if (argc >= 4 && strcmp(argv[1], "--batch") == 0) {
+        int first = 2, workers = PIPELINE_DEFAULT_WORKERS;
+        if (argc >= 6 && strcmp(argv[2], "-j") == 0) {
+            workers = atoi(argv[3]);
+            first = 4;
+        }
+        return runBatchPipeline(argv[first], argv + first + 1, argc - first - 1, workers);
+    }
+    if (argc >= 4 && strcmp(argv[1], "--archive") == 0) {
+        int first = 2, workers = PIPELINE_DEFAULT_WORKERS;
+        if (argc == 6 && strcmp(argv[2], "-j") == 0) {
+            workers = atoi(argv[3]);
+            first = 4;
+        }
+        if (argc == first + 2) return runArchivePipeline(argv[first], argv[first + 1], workers);
+    }
+    // Cohort mode: every pair of a cohort, with duplicates grouped before anything is parsed
+    if (argc >= 3 && strcmp(argv[1], "--cohort") == 0) {
+        if (argc >= 5 && strcmp(argv[2], "--cache") == 0) return runCohort(argv + 4, argc - 4, argv[3], 0);
+        return runCohort(argv + 2, argc - 2, NULL, 0);
+    }
+    if (argc >= 4 && strcmp(argv[1], "--revisions") == 0) {
+        return runRevisions(argv[2], argv + 3, argc - 3);
+    }
+    if (argc >= 5 && strcmp(argv[1], "--cache") == 0) {
+        unsigned int entries = 0;
+        int first = 3;
+        if (argc == 7 && strcmp(argv[3], "--cache-entries") == 0) {
+            entries = (unsigned int)strtoul(argv[4], NULL, 10);
+            first = 5;
+        }
+        if (argc == first + 2) return runCached(argv[2], entries, argv[first], argv[first + 1]);
+    }
+
+    if (argc != 3) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SimContext* context = sim_context_create();
+    if (!context) return EXIT_FAILURE;
+
+    SimProgram* reference = sim_parse_file(context, argv[1]);
+    if (!reference) {
+        fprintf(stderr, "Error: Parsing failed for %s.\n", argv[1]);
+        sim_context_free(context);
+        return EXIT_FAILURE;
+    }
+
+    SimProgram* submission = sim_parse_file(context, argv[2]);
+    if (!submission) {
+        fprintf(stderr, "Error: Parsing failed for %s.\n", argv[2]);
+        sim_program_free(reference);
+        sim_context_free(context);
+        return EXIT_FAILURE;
+    }
+
+    sim_print_report(context, reference, submission);
+
+    sim_program_free(reference);
+    sim_program_free(submission);
+    sim_context_free(context);
+    return EXIT_SUCCESS;
+}
+
+// Writes a report requested by a leading option; "" means stderr
+static int writeReport(const char* path, int (*write)(FILE*)) {
+    FILE* output = *path ? fopen(path, "w") : stderr;
+    if (!output) {
+        perror(path);
+        return 0;
+    }
+    int written = write(output);
+    if (output != stderr && fclose(output) != 0) written = 0;
+    return written;
+}
+
+int main(int argc, char **argv) {
+    // --stats, --trace, --memory, --scanner, --share, the budgets and --approximate may precede any mode; the reports are written once the mode is done
+    const char* statsPath = NULL;
+    const char* tracePath = NULL;
+    const char* memoryPath = NULL;
+    double timeBudget = 0, memoryBudget = 0;
+    for (;;) {
+        int consumed = 0;
+        if (argc >= 2 && strncmp(argv[1], "--stats", 7) == 0 && (argv[1][7] == '\0' || argv[1][7] == '=')) {
+            statsPath = argv[1][7] == '=' ? argv[1] + 8 : "";
+            enableStats();
+            consumed = 1;
+        } else if (argc >= 3 && strcmp(argv[1], "--trace") == 0) {
+            tracePath = argv[2];
+            enableTrace();
+            traceNameThread("main");
+            consumed = 2;
+        } else if (argc >= 2 && strncmp(argv[1], "--memory", 8) == 0 && (argv[1][8] == '\0' || argv[1][8] == '=')) {
+            memoryPath = argv[1][8] == '=' ? argv[1] + 9 : "";
+            enableAllocAccounting(); // Nothing has been parsed yet, so this cannot fail
+            consumed = 1;
+        } else if (argc >= 2 && strncmp(argv[1], "--scanner=", 10) == 0) {
+            if (!selectScanner(argv[1] + 10)) {
+                fprintf(stderr, "Unknown scanner %s; expected flex or simd.\n", argv[1] + 10);
+                return EXIT_FAILURE;
+            }
+            consumed = 1;
+        } else if (argc >= 2 && strcmp(argv[1], "--share") == 0) {
+            enableExpressionSharing();
+            consumed = 1;
+        } else if (argc >= 2 && strncmp(argv[1], "--time-budget=", 14) == 0) {
+            timeBudget = atof(argv[1] + 14);
+            consumed = 1;
+        } else if (argc >= 2 && strncmp(argv[1], "--memory-budget=", 16) == 0) {
+            memoryBudget = atof(argv[1] + 16);
+            consumed = 1;
+        } else if (argc >= 2 && strncmp(argv[1], "--approximate", 13) == 0 && (argv[1][13] == '\0' || argv[1][13] == '=')) {
+            double target = argv[1][13] == '=' ? atof(argv[1] + 14) : APPROXIMATE_DEFAULT_ERROR;
+            if (target <= 0) {
+                fprintf(stderr, "Invalid target error %s; expected a positive number of percentage points.\n", argv[1] + 14);
+                return EXIT_FAILURE;
+            }
+            setApproximation(target);
+            consumed = 1;
+        }
+        if (!consumed) break;
+        argv[consumed] = argv[0];
+        argc -= consumed;
+        argv += consumed;
+    }
+
+    if (timeBudget > 0 || memoryBudget > 0) {
+        setPairBudget(timeBudget > 0 ? (uint64_t)(timeBudget * 1e6) : 0,
+                      memoryBudget > 0 ? (size_t)(memoryBudget * 1024 * 1024) : 0);
+    }
+
+    int status = runCommand(argc, argv);
+    // stdout carries the token trace, so the stats go to stderr unless a file is given
+    if (statsPath && !writeReport(statsPath, writeStatsJSON)) status = EXIT_FAILURE;
+    if (tracePath && !writeReport(tracePath, writeTraceJSON)) status = EXIT_FAILURE;
+    if (memoryPath && !writeReport(memoryPath, writeAllocJSON)) status = EXIT_FAILURE;
+    return status;
+}
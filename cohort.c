@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cohort.h"
+#include "simanalysis.h"
+#include "ast.h"
+#include "dedup.h"
+#include "approximate.h"
+#include "simalloc.h"
+
+#define SCORE_PENDING -2
+#define SCORE_FAILED -1
+
+typedef struct Cohort {
+    char** paths;
+    int count;
+    char** sources;
+    size_t* lengths;
+    SourceGroups* groups;
+    SimContext* context;
+    SimCache* cache;
+    SimProgram** programs;  // Parsed representative of every class, on first use
+    int* parseFailed;
+    int* scores;            // classCount x classCount, reference class first
+    char* degraded;         // Same layout; scores estimated after running out of budget
+    int* intervals;         // Two per score: the 95% interval of a sampled score, or -1
+    int parsed, comparisons;
+} Cohort;
+
+static SimProgram* classProgram(Cohort* cohort, int cls) {
+    if (!cohort->programs[cls] && !cohort->parseFailed[cls]) {
+        int index = cohort->groups->representative[cls];
+        cohort->programs[cls] = sim_parse_from_buffer(cohort->context, cohort->paths[index],
+                                                      cohort->sources[index], cohort->lengths[index]);
+        if (!cohort->programs[cls]) {
+            fprintf(stderr, "Error: Parsing failed for %s.\n", cohort->paths[index]);
+            cohort->parseFailed[cls] = 1;
+        } else {
+            cohort->parsed++;
+        }
+    }
+    return cohort->programs[cls];
+}
+
+// Comparison may be asymmetric, so (a, b) and (b, a) are scored separately
+static int classScore(Cohort* cohort, int reference, int submission) {
+    int* score = &cohort->scores[reference * cohort->groups->classCount + submission];
+    if (*score != SCORE_PENDING) return *score;
+
+    int first = cohort->groups->representative[reference];
+    int second = cohort->groups->representative[submission];
+    uint64_t referenceHash = sim_content_hash(cohort->sources[first], cohort->lengths[first]);
+    uint64_t submissionHash = sim_content_hash(cohort->sources[second], cohort->lengths[second]);
+    if (sim_cache_lookup(cohort->cache, referenceHash, submissionHash, score)) return *score;
+
+    SimProgram* program1 = classProgram(cohort, reference);
+    SimProgram* program2 = classProgram(cohort, submission);
+    *score = SCORE_FAILED;
+    if (program1 && program2) {
+        SimResult* result = sim_compare(cohort->context, program1, program2);
+        if (result) {
+            *score = sim_result_score(result);
+            int cell = reference * cohort->groups->classCount + submission;
+            int estimated = sim_result_interval(result, &cohort->intervals[2 * cell], &cohort->intervals[2 * cell + 1]);
+            cohort->degraded[cell] = (char)sim_result_degraded(result);
+            if (!cohort->degraded[cell] && !estimated) sim_cache_store(cohort->cache, referenceHash, submissionHash, *score);
+            cohort->comparisons++;
+        }
+        sim_result_free(result);
+    }
+    return *score;
+}
+
+static void printDuplicates(const Cohort* cohort) {
+    const SourceGroups* groups = cohort->groups;
+    for (int i = 0; i < groups->count; i++) {
+        if (groups->kind[i] == Duplicate_None) continue;
+        printf("Duplicate: %s is %s %s\n", cohort->paths[i],
+               groups->kind[i] == Duplicate_Exact ? "identical to" : "token-identical to",
+               cohort->paths[groups->representative[groups->classOf[i]]]);
+    }
+}
+
+static void freeCohort(Cohort* cohort) {
+    if (cohort->programs) {
+        for (int c = 0; c < cohort->groups->classCount; c++) sim_program_free(cohort->programs[c]);
+    }
+    if (cohort->sources) {
+        for (int i = 0; i < cohort->count; i++) simFree(cohort->sources[i]);
+    }
+    free(cohort->programs);
+    free(cohort->parseFailed);
+    free(cohort->scores);
+    free(cohort->degraded);
+    free(cohort->intervals);
+    free(cohort->sources);
+    free(cohort->lengths);
+    freeSourceGroups(cohort->groups);
+    sim_cache_close(cohort->cache);
+    sim_context_free(cohort->context);
+}
+
+int runCohort(char** paths, int count, const char* cachePath, unsigned int cacheEntries) {
+    Cohort cohort;
+    memset(&cohort, 0, sizeof(Cohort));
+    cohort.paths = paths;
+    cohort.count = count;
+
+    cohort.context = sim_context_create();
+    cohort.sources = calloc(count, sizeof(char*));
+    cohort.lengths = calloc(count, sizeof(size_t));
+    if (!cohort.context || !cohort.sources || !cohort.lengths) {
+        fprintf(stderr, "Memory allocation failed for cohort.\n");
+        freeCohort(&cohort);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < count; i++) {
+        cohort.sources[i] = readSourceFile(paths[i], &cohort.lengths[i]);
+        if (!cohort.sources[i]) {
+            fprintf(stderr, "Error: Cannot read %s.\n", paths[i]);
+            freeCohort(&cohort);
+            return EXIT_FAILURE;
+        }
+    }
+    if (cachePath && !(cohort.cache = sim_cache_open(cohort.context, cachePath, cacheEntries))) {
+        fprintf(stderr, "Error: %s\n", sim_last_error(cohort.context));
+        freeCohort(&cohort);
+        return EXIT_FAILURE;
+    }
+
+    cohort.groups = groupEquivalentSources((const char* const*)cohort.sources, cohort.lengths, count);
+    if (!cohort.groups) {
+        freeCohort(&cohort);
+        return EXIT_FAILURE;
+    }
+    int classCount = cohort.groups->classCount;
+    cohort.programs = calloc(classCount, sizeof(SimProgram*));
+    cohort.parseFailed = calloc(classCount, sizeof(int));
+    cohort.scores = malloc(sizeof(int) * classCount * classCount);
+    cohort.degraded = calloc((size_t)classCount * classCount, 1);
+    cohort.intervals = malloc(sizeof(int) * 2 * classCount * classCount);
+    if (!cohort.programs || !cohort.parseFailed || !cohort.scores || !cohort.degraded || !cohort.intervals) {
+        fprintf(stderr, "Memory allocation failed for cohort scores.\n");
+        freeCohort(&cohort);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < classCount * classCount; i++) cohort.scores[i] = SCORE_PENDING;
+    for (int i = 0; i < 2 * classCount * classCount; i++) cohort.intervals[i] = -1;
+
+    printDuplicates(&cohort);
+
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            int reference = cohort.groups->classOf[i], submission = cohort.groups->classOf[j];
+            int score = classScore(&cohort, reference, submission);
+            if (score == SCORE_FAILED) {
+                fprintf(stderr, "Error: Could not score %s against %s.\n", paths[j], paths[i]);
+                failures++;
+                continue;
+            }
+            int cell = reference * classCount + submission;
+            char note[SCORE_NOTE_SIZE];
+            printf("Total similarity score between %s and %s is: %d%%%s\n", paths[i], paths[j], score,
+                   formatScoreNote(note, cohort.degraded[cell], cohort.intervals[2 * cell] >= 0,
+                                   cohort.intervals[2 * cell], cohort.intervals[2 * cell + 1]));
+        }
+    }
+
+    fprintf(stderr, "Log: Cohort of %d submissions in %d classes: %d parsed, %d comparisons for %d pairs.\n",
+            count, classCount, cohort.parsed, cohort.comparisons, count * (count - 1) / 2);
+    freeCohort(&cohort);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,10 @@
+#ifndef COHORT_H
+#define COHORT_H
+
+// Scores every pair of a cohort of submissions. Identical and token-identical
+// submissions are grouped first: each class is parsed once, each pair of classes is
+// scored once, and the scores are fanned out to every pair of members.
+// cachePath may be NULL; otherwise class scores go through the result cache.
+int runCohort(char** paths, int count, const char* cachePath, unsigned int cacheEntries);
+
+#endif
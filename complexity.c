@@ -0,0 +1,587 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "complexity.h"
+#include "functionindex.h"
+#include "stats.h"
+#include "simalloc.h"
+
+typedef struct TripCount {
+    double estimate;
+    int scales;            // Counts towards the asymptotic degree
+    char text[32];
+} TripCount;
+
+#define COST_STACK_INITIAL 32
+
+// A node whose cost is being added up by costOf, which walks an explicit stack of these
+// so deep generated code cannot overflow a worker thread's stack
+typedef struct CostFrame {
+    ASTNode* node;
+    int next;              // Next child (index expressions first, in an array access) whose cost is due
+    Cost cost;             // The node's own cost and that of the children so far
+    Cost once;             // Loops: the initialization
+    Cost perIteration;     // Loops: what runs on every iteration
+    TripCount trip;        // Loops: the trip count
+} CostFrame;
+
+typedef struct CostContext {
+    ASTNode* root;
+    ASTNode** declarations;
+    int declarationCount;
+    ASTNode** functions;
+    int functionCount;
+    FunctionCost* costs;   // Parallel to functions
+    int* state;            // 0 not estimated, 1 in progress, 2 done
+    FunctionCost* current; // Function whose loop nests are being recorded
+    int loopDepth;
+    int loopCount;
+    CostFrame* frames;     // Stack of costOf; calls nest above the count they started at
+    int frameCount;
+    int frameCapacity;
+} CostContext;
+
+static Cost costOf(CostContext* ctx, ASTNode* node);
+
+static int parseConstant(ASTNode* node, long* value) {
+    if (!node || node->type != NodeType_Constant || !node->name || !*node->name) return 0;
+    for (const char* p = node->name; *p; p++) {
+        if (!isdigit((unsigned char)*p)) return 0;
+    }
+    *value = strtol(node->name, NULL, 10);
+    return 1;
+}
+
+// First identifier of a bound expression in source order, as written in the source
+static const char* symbolOf(ASTNode* node) {
+    WalkStack* walk = threadWalkStack();
+    if (!node || !walk) return "?";
+    int base = walk->count;
+    int queued = pushWalkNode(walk, node);
+
+    const char* symbol = "?";
+    while (queued && walk->count > base) {
+        ASTNode* current = walk->frames[--walk->count].node1;
+        if (current->type == NodeType_Identifier) {
+            symbol = current->sourceName ? current->sourceName : current->name;
+            break;
+        }
+        for (int i = current->childCount - 1; queued && i >= 0; i--) {
+            if (current->children[i]) queued = pushWalkNode(walk, current->children[i]);
+        }
+    }
+    walk->count = base;
+    return symbol;
+}
+
+static Cost zeroCost(void) {
+    Cost cost;
+    memset(&cost, 0, sizeof(Cost));
+    return cost;
+}
+
+// Sequential composition: work adds up, the deepest loop path wins
+static void addCost(Cost* total, const Cost* part) {
+    total->operations += part->operations;
+    total->arrayAccesses += part->arrayAccesses;
+    if (part->degree > total->degree || (part->degree == total->degree && !total->trips[0] && part->trips[0])) {
+        total->degree = part->degree;
+        memcpy(total->trips, part->trips, TRIP_TEXT_LENGTH);
+    }
+}
+
+static ASTNode* findDeclaration(CostContext* ctx, const char* name) {
+    for (int i = 0; i < ctx->declarationCount; i++) {
+        if (strcmp(ctx->declarations[i]->name, name) == 0) return ctx->declarations[i];
+    }
+    return NULL;
+}
+
+// Largest declared extent of an array dimension indexed by the loop variable inside the body
+static long arrayExtent(CostContext* ctx, ASTNode* body, const char* variable) {
+    int slot = affineSlotOf(ctx->root, variable);
+    if (slot < 0) return 0;
+
+    int count = 0;
+    long extent = 0;
+    ASTNode** accesses = collectNodesOfType(body, NodeType_ArrayAccess, &count);
+    for (int i = 0; i < count; i++) {
+        ASTNode* access = accesses[i];
+        ASTNode* declaration = findDeclaration(ctx, access->name);
+        if (!access->affine || !declaration || !declaration->dimSize) continue;
+
+        for (int d = 0; d < access->indexCount && d < declaration->dimensions; d++) {
+            int coefficient = access->affine[d].coefficients[slot];
+            if (!access->affine[d].isAffine || coefficient == 0) continue;
+            long trips = declaration->dimSize[d] / (coefficient < 0 ? -coefficient : coefficient);
+            if (trips > extent) extent = trips;
+        }
+    }
+    simFree(accesses);
+    return extent;
+}
+
+// Trip count of for (v = start; v REL limit; step): concrete when both ends are constants,
+// otherwise symbolic in the bound, estimated from the sizes of the arrays it walks
+static TripCount tripCountOf(CostContext* ctx, ASTNode* forNode) {
+    TripCount trip = { DEFAULT_TRIP_ESTIMATE, 1, "?" };
+    if (forNode->childCount != 4) return trip;
+
+    ASTNode* init = forNode->children[0];
+    ASTNode* cond = forNode->children[1];
+    ASTNode* incr = forNode->children[2];
+    if (!init || init->type != NodeType_Assignment || init->childCount != 2 ||
+        init->children[0]->type != NodeType_Identifier) return trip;
+    ASTNode* variable = init->children[0];
+
+    long step = 0, constant;
+    if (incr && incr->type == NodeType_Expression && incr->childCount == 1 &&
+        incr->children[0]->type == NodeType_Identifier && strcmp(incr->children[0]->name, variable->name) == 0) {
+        step = strcmp(incr->name, "++") == 0 ? 1 : (strcmp(incr->name, "--") == 0 ? -1 : 0);
+    } else if (incr && incr->type == NodeType_Assignment && incr->childCount == 2 &&
+               strcmp(incr->children[0]->name, variable->name) == 0) {
+        // v = v + c / v = v - c
+        ASTNode* update = incr->children[1];
+        if (update->type == NodeType_Expression && update->childCount == 2 &&
+            update->children[0]->type == NodeType_Identifier && strcmp(update->children[0]->name, variable->name) == 0 &&
+            parseConstant(update->children[1], &constant)) {
+            if (strcmp(update->name, "+") == 0) step = constant;
+            else if (strcmp(update->name, "-") == 0) step = -constant;
+        }
+    }
+    if (step == 0 || !cond || cond->type != NodeType_Expression || cond->childCount != 2 ||
+        cond->children[0]->type != NodeType_Identifier || strcmp(cond->children[0]->name, variable->name) != 0) {
+        return trip;
+    }
+
+    ASTNode* startNode = init->children[1];
+    ASTNode* limitNode = cond->children[1];
+    long start, limit;
+    int hasStart = parseConstant(startNode, &start);
+    int hasLimit = parseConstant(limitNode, &limit);
+    long magnitude = step < 0 ? -step : step;
+
+    if (hasStart && hasLimit) {
+        long span = step > 0 ? limit - start : start - limit;
+        const char* rel = cond->name;
+        long count;
+        if ((step > 0 && strcmp(rel, "<") == 0) || (step < 0 && strcmp(rel, ">") == 0) || strcmp(rel, "!=") == 0) {
+            count = (span + magnitude - 1) / magnitude;
+        } else if ((step > 0 && strcmp(rel, "<=") == 0) || (step < 0 && strcmp(rel, ">=") == 0)) {
+            count = span / magnitude + 1;
+        } else {
+            return trip; // Runs the wrong way: leave it symbolic
+        }
+        if (count < 0) count = 0;
+        trip.estimate = count;
+        trip.scales = count > SMALL_TRIP_COUNT;
+        snprintf(trip.text, sizeof(trip.text), "%ld", count);
+        return trip;
+    }
+
+    const char* variableName = variable->sourceName ? variable->sourceName : variable->name;
+    long extent = arrayExtent(ctx, forNode->children[3], variableName);
+    trip.estimate = extent > 0 ? (double)extent / magnitude : DEFAULT_TRIP_ESTIMATE;
+
+    if (!hasStart && !hasLimit) {
+        // Bounded by another loop's variable: a triangular loop does about half the trips
+        snprintf(trip.text, sizeof(trip.text), "%s-%s", symbolOf(step > 0 ? limitNode : startNode),
+                 symbolOf(step > 0 ? startNode : limitNode));
+        trip.estimate /= 2;
+    } else {
+        snprintf(trip.text, sizeof(trip.text), "%s", symbolOf(hasLimit ? startNode : limitNode));
+        if (hasLimit && extent > 0) trip.estimate /= 2; // for (j = i; j < N; j++)
+    }
+    return trip;
+}
+
+static int findFunction(CostContext* ctx, const char* name) {
+    for (int i = 0; i < ctx->functionCount; i++) {
+        if (ctx->functions[i]->name && strcmp(ctx->functions[i]->name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void recordNest(CostContext* ctx, const Cost* nest) {
+    FunctionCost* function = ctx->current;
+    if (!function) return;
+    Cost* nests = realloc(function->nests, sizeof(Cost) * (function->nestCount + 1));
+    if (!nests) {
+        fprintf(stderr, "Memory allocation failed for loop nest cost.\n");
+        return;
+    }
+    function->nests = nests;
+    function->nests[function->nestCount++] = *nest;
+}
+
+static Cost loopCost(CostContext* ctx, TripCount trip, Cost once, Cost perIteration) {
+    Cost cost = once;
+    cost.operations += trip.estimate * perIteration.operations;
+    cost.arrayAccesses += trip.estimate * perIteration.arrayAccesses;
+    cost.degree = perIteration.degree + trip.scales;
+    int length = perIteration.trips[0] ? snprintf(cost.trips, TRIP_TEXT_LENGTH, "%s x %s", trip.text, perIteration.trips)
+                                        : snprintf(cost.trips, TRIP_TEXT_LENGTH, "%s", trip.text);
+    if (length >= TRIP_TEXT_LENGTH) {
+        memcpy(cost.trips + TRIP_TEXT_LENGTH - 4, "...", 4); // A nest too deep to spell out
+    }
+
+    ctx->loopCount++;
+    if (ctx->loopDepth == 0) recordNest(ctx, &cost);
+    return cost;
+}
+
+static void estimateFunction(CostContext* ctx, int index) {
+    if (ctx->state[index] != 0) return;
+    ctx->state[index] = 1;
+
+    FunctionCost* savedCurrent = ctx->current;
+    int savedDepth = ctx->loopDepth;
+    ctx->current = &ctx->costs[index];
+    ctx->loopDepth = 0;
+
+    ASTNode* function = ctx->functions[index];
+    Cost total = zeroCost();
+    for (int i = 0; i < function->childCount; i++) {
+        ASTNode* child = function->children[i];
+        if (!child || child->type == NodeType_ParameterList) continue;
+        Cost part = costOf(ctx, child);
+        addCost(&total, &part);
+    }
+    ctx->costs[index].total = total;
+
+    ctx->current = savedCurrent;
+    ctx->loopDepth = savedDepth;
+    ctx->state[index] = 2;
+}
+
+static int isCountedLoop(ASTNode* node) {
+    return node->type == NodeType_For && node->childCount == 4;
+}
+
+// Children whose cost adds up to a node's: an array access's index expressions come first
+static int costPartCount(ASTNode* node) {
+    return node->childCount + (node->type == NodeType_ArrayAccess ? node->indexCount : 0);
+}
+
+static ASTNode* costPart(ASTNode* node, int k) {
+    if (node->type == NodeType_ArrayAccess) return k < node->indexCount ? node->indices[k] : node->children[k - node->indexCount];
+    return node->children[k];
+}
+
+// 0 when the stack cannot grow; the subtree is then costed as nothing
+static int pushCostFrame(CostContext* ctx) {
+    if (ctx->frameCount == ctx->frameCapacity) {
+        int capacity = ctx->frameCapacity ? ctx->frameCapacity * 2 : COST_STACK_INITIAL;
+        CostFrame* frames = simRealloc(ctx->frames, sizeof(CostFrame) * capacity, Alloc_Scratch);
+        if (!frames) {
+            fprintf(stderr, "Memory allocation failed while growing the cost stack to %d frames.\n", capacity);
+            return 0;
+        }
+        ctx->frames = frames;
+        ctx->frameCapacity = capacity;
+    }
+    ctx->frameCount++;
+    return 1;
+}
+
+// The node's own cost. Returns 1 after pushing a frame when its children still have to be
+// costed; otherwise *cost is the whole subtree's.
+static int startCost(CostContext* ctx, ASTNode* node, Cost* cost) {
+    *cost = zeroCost();
+    if (!node) return 0;
+
+    TripCount trip = { DEFAULT_TRIP_ESTIMATE, 1, "?" };
+    switch (node->type) {
+        case NodeType_For:
+            if (isCountedLoop(node)) trip = tripCountOf(ctx, node);
+            break;
+
+        case NodeType_FunctionCall: {
+            cost->operations = 1;
+            int callee = findFunction(ctx, node->name);
+            if (callee >= 0) {
+                estimateFunction(ctx, callee);
+                if (ctx->state[callee] == 2) {
+                    addCost(cost, &ctx->costs[callee].total);
+                } else if (cost->degree < 1) {
+                    // Recursion: assume it recurses over the input once
+                    cost->degree = 1;
+                    snprintf(cost->trips, TRIP_TEXT_LENGTH, "recursion");
+                }
+            }
+            break;
+        }
+
+        case NodeType_ArrayAccess:
+            cost->arrayAccesses = 1;
+            break;
+
+        case NodeType_Expression:
+        case NodeType_Assignment:
+        case NodeType_Return:
+            cost->operations = 1;
+            break;
+
+        case NodeType_FunctionDef:
+        case NodeType_MainFunction:
+            return 0; // Estimated separately and charged at the call site
+
+        default:
+            break;
+    }
+
+    int isLoop = isCountedLoop(node) || node->type == NodeType_While;
+    if (!isLoop && costPartCount(node) == 0) return 0;
+    if (!pushCostFrame(ctx)) {
+        *cost = zeroCost();
+        return 0;
+    }
+    CostFrame* frame = &ctx->frames[ctx->frameCount - 1];
+    frame->node = node;
+    frame->next = 0;
+    frame->cost = *cost;
+    frame->once = zeroCost();
+    frame->perIteration = zeroCost();
+    frame->trip = trip;
+    if (node->type == NodeType_While) ctx->loopDepth++;
+    return 1;
+}
+
+// Adds the cost of the frame's next child: a for loop's are the initialization, condition,
+// increment and body, in that order
+static void addPartCost(CostContext* ctx, CostFrame* frame, const Cost* part) {
+    int k = frame->next++;
+    if (isCountedLoop(frame->node)) {
+        if (k == 0) frame->once = *part;
+        else if (k == 1) frame->perIteration = *part;
+        else {
+            if (k == 3) ctx->loopDepth--;
+            addCost(&frame->perIteration, part);
+        }
+    } else if (frame->node->type == NodeType_While) {
+        addCost(&frame->perIteration, part);
+    } else {
+        addCost(&frame->cost, part);
+    }
+}
+
+static Cost finishCost(CostContext* ctx, CostFrame* frame) {
+    if (isCountedLoop(frame->node)) return loopCost(ctx, frame->trip, frame->once, frame->perIteration);
+    if (frame->node->type == NodeType_While) {
+        ctx->loopDepth--;
+        return loopCost(ctx, frame->trip, zeroCost(), frame->perIteration);
+    }
+    return frame->cost;
+}
+
+// Frames are re-read by index after every step that can push, since estimating a called
+// function walks the same stack above them
+static Cost costOf(CostContext* ctx, ASTNode* node) {
+    int base = ctx->frameCount;
+    Cost cost;
+    if (!startCost(ctx, node, &cost)) return cost;
+
+    while (1) {
+        CostFrame* frame = &ctx->frames[ctx->frameCount - 1];
+        if (frame->next < costPartCount(frame->node)) {
+            ASTNode* part = costPart(frame->node, frame->next);
+            if (isCountedLoop(frame->node) && frame->next == 3) ctx->loopDepth++; // The body
+            if (startCost(ctx, part, &cost)) continue;
+            addPartCost(ctx, &ctx->frames[ctx->frameCount - 1], &cost);
+            continue;
+        }
+
+        cost = finishCost(ctx, frame);
+        if (--ctx->frameCount == base) return cost;
+        addPartCost(ctx, &ctx->frames[ctx->frameCount - 1], &cost);
+    }
+}
+
+CostProfile* estimateCost(ASTNode* root) {
+    if (!root) return NULL;
+
+    CostProfile* profile = calloc(1, sizeof(CostProfile));
+    if (!profile) {
+        fprintf(stderr, "Memory allocation failed for cost profile.\n");
+        return NULL;
+    }
+
+    CostContext ctx;
+    memset(&ctx, 0, sizeof(CostContext));
+    ctx.root = root;
+    ctx.declarations = collectNodesOfType(root, NodeType_ArrayDeclaration, &ctx.declarationCount);
+
+    int definitions = 0, mains = 0;
+    ASTNode** functions = collectNodesOfType(root, NodeType_FunctionDef, &definitions);
+    ASTNode** mainFunctions = collectNodesOfType(root, NodeType_MainFunction, &mains);
+
+    // Code outside any function is costed as one pseudo-function
+    ctx.functionCount = definitions + mains;
+    ctx.functions = malloc(sizeof(ASTNode*) * (ctx.functionCount > 0 ? ctx.functionCount : 1));
+    ctx.costs = calloc(ctx.functionCount > 0 ? ctx.functionCount : 1, sizeof(FunctionCost));
+    ctx.state = calloc(ctx.functionCount > 0 ? ctx.functionCount : 1, sizeof(int));
+    if (!ctx.functions || !ctx.costs || !ctx.state) {
+        fprintf(stderr, "Memory allocation failed for function costs.\n");
+        free(ctx.functions);
+        free(ctx.costs);
+        free(ctx.state);
+        simFree(functions);
+        simFree(mainFunctions);
+        simFree(ctx.declarations);
+        free(profile);
+        return NULL;
+    }
+    for (int i = 0; i < definitions; i++) ctx.functions[i] = functions[i];
+    for (int i = 0; i < mains; i++) ctx.functions[definitions + i] = mainFunctions[i];
+    if (ctx.functionCount == 0) {
+        ctx.functions[0] = root;
+        ctx.functionCount = 1;
+    }
+    simFree(functions);
+    simFree(mainFunctions);
+
+    for (int i = 0; i < ctx.functionCount; i++) {
+        ctx.costs[i].function = ctx.functions[i];
+        ctx.costs[i].name = ctx.functions[i]->name ? ctx.functions[i]->name : "program";
+        estimateFunction(&ctx, i);
+    }
+
+    profile->functions = ctx.costs;
+    profile->functionCount = ctx.functionCount;
+    profile->loopCount = ctx.loopCount;
+    for (int i = 0; i < ctx.functionCount; i++) {
+        FunctionCost* function = &ctx.costs[i];
+        if (function->total.degree > profile->degree) profile->degree = function->total.degree;
+        // main already includes the functions it calls
+        if (mains == 0 || function->function->type == NodeType_MainFunction) {
+            profile->operations += function->total.operations;
+            profile->arrayAccesses += function->total.arrayAccesses;
+        }
+    }
+
+    free(ctx.functions);
+    free(ctx.state);
+    simFree(ctx.frames);
+    simFree(ctx.declarations);
+
+    fprintf(stderr, "Log: Estimated cost of %s: degree %d, %.0f operations, %.0f array accesses.\n",
+            root->name ? root->name : "Unnamed", profile->degree, profile->operations, profile->arrayAccesses);
+    return profile;
+}
+
+CostProfile* analyzeCost(ASTNode* root) {
+    if (!root) return NULL;
+    if (!root->costProfile) {
+        uint64_t started = statsPhaseStart();
+        root->costProfile = estimateCost(root);
+        statsPhaseEnd(Phase_Cost, started);
+    }
+    return root->costProfile;
+}
+
+void freeCostProfile(CostProfile* profile) {
+    if (!profile) return;
+    for (int i = 0; i < profile->functionCount; i++) {
+        free(profile->functions[i].nests);
+    }
+    free(profile->functions);
+    free(profile);
+}
+
+int compareCostProfiles(CostProfile* profile1, CostProfile* profile2) {
+    if (!profile1 || !profile2) return -1;
+    if (profile1->loopCount == 0 && profile2->loopCount == 0) return -1;
+
+    int degreeScore = 100 - 50 * abs(profile1->degree - profile2->degree);
+    if (degreeScore < 0) degreeScore = 0;
+
+    double low = profile1->operations < profile2->operations ? profile1->operations : profile2->operations;
+    double high = profile1->operations < profile2->operations ? profile2->operations : profile1->operations;
+    int workScore = high > 0 ? (int)(100 * low / high) : 100;
+
+    // The asymptotic degree matters more than constant factors
+    return (degreeScore * 3 + workScore) / 4;
+}
+
+int compareNestedLoops(ASTNode* body1, ASTNode* body2) {
+    return compareCostProfiles(analyzeCost(body1), analyzeCost(body2));
+}
+
+static const char* formatDegree(int degree, char* buffer, size_t size) {
+    if (degree == 0) snprintf(buffer, size, "O(1)");
+    else if (degree == 1) snprintf(buffer, size, "O(n)");
+    else snprintf(buffer, size, "O(n^%d)", degree);
+    return buffer;
+}
+
+static FunctionCost* findFunctionCost(CostProfile* profile, ASTNode* function) {
+    for (int i = 0; function && i < profile->functionCount; i++) {
+        if (profile->functions[i].function == function) return &profile->functions[i];
+    }
+    return NULL;
+}
+
+// The function of the other program that the similarity score pairs this one with. Code
+// outside any function is costed as the Root, and the two Roots are paired with each other.
+static ASTNode* pairedFunction(const FunctionPair* pairs, int count, ASTNode* function, int isReference,
+                               ASTNode* otherRoot) {
+    if (function->type == NodeType_Root) return otherRoot;
+    for (int i = 0; i < count; i++) {
+        if ((isReference ? pairs[i].reference : pairs[i].student) == function) {
+            return isReference ? pairs[i].student : pairs[i].reference;
+        }
+    }
+    return NULL;
+}
+
+void printCostComparison(const char* name1, ASTNode* root1, const char* name2, ASTNode* root2) {
+    CostProfile* profile1 = analyzeCost(root1);
+    CostProfile* profile2 = analyzeCost(root2);
+    if (!profile1 || !profile2) {
+        printf("Cost report unavailable.\n");
+        return;
+    }
+
+    char degree1[16], degree2[16];
+    printf("Estimated cost (%s vs %s):\n", name1, name2);
+    printf("  %-16s %12s %12s%s\n", "asymptotic", formatDegree(profile1->degree, degree1, sizeof(degree1)),
+           formatDegree(profile2->degree, degree2, sizeof(degree2)),
+           profile1->degree != profile2->degree ? "  <- asymptotic cost differs" : "");
+    printf("  %-16s %12.0f %12.0f\n", "operations", profile1->operations, profile2->operations);
+    printf("  %-16s %12.0f %12.0f\n", "array accesses", profile1->arrayAccesses, profile2->arrayAccesses);
+
+    // Functions are paired through the signature index, as the score pairs them
+    FunctionPair* pairs = NULL;
+    int pairCount = pairFunctionSets(root1, root2, &pairs);
+    if (pairCount < 0) pairCount = 0;
+
+    for (int i = 0; i < profile1->functionCount; i++) {
+        FunctionCost* function1 = &profile1->functions[i];
+        FunctionCost* function2 = findFunctionCost(profile2, pairedFunction(pairs, pairCount, function1->function, 1, root2));
+        formatDegree(function1->total.degree, degree1, sizeof(degree1));
+        if (!function2) {
+            printf("  %s: %s, only in %s\n", function1->name, degree1, name1);
+            continue;
+        }
+        formatDegree(function2->total.degree, degree2, sizeof(degree2));
+        if (strcmp(function1->name, function2->name) == 0) printf("  %s: ", function1->name);
+        else printf("  %s / %s: ", function1->name, function2->name);
+        printf("%s vs %s%s\n", degree1, degree2, function1->total.degree != function2->total.degree ? "  <- differs" : "");
+
+        int nests = function1->nestCount > function2->nestCount ? function1->nestCount : function2->nestCount;
+        for (int n = 0; n < nests; n++) {
+            const char* trips1 = n < function1->nestCount ? function1->nests[n].trips : "-";
+            const char* trips2 = n < function2->nestCount ? function2->nests[n].trips : "-";
+            printf("    loop nest %d: %s vs %s\n", n + 1, trips1, trips2);
+        }
+    }
+    for (int i = 0; i < profile2->functionCount; i++) {
+        FunctionCost* function2 = &profile2->functions[i];
+        if (!findFunctionCost(profile1, pairedFunction(pairs, pairCount, function2->function, 0, root1))) {
+            printf("  %s: %s, only in %s\n", function2->name,
+                   formatDegree(function2->total.degree, degree2, sizeof(degree2)), name2);
+        }
+    }
+    simFree(pairs);
+}
@@ -0,0 +1,45 @@
+#ifndef COMPLEXITY_H
+#define COMPLEXITY_H
+
+#include "ast.h"
+
+#define SMALL_TRIP_COUNT 4         // Constant loops up to this many trips count as a constant factor
+#define DEFAULT_TRIP_ESTIMATE 100  // Trips assumed for a symbolic bound with no array size to go by
+#define TRIP_TEXT_LENGTH 96
+
+// Estimated cost of a subtree
+typedef struct Cost {
+    int degree;            // Number of nested loops whose trip count scales with the input
+    double operations;     // Assignments, operators, calls and returns executed
+    double arrayAccesses;  // Array reads and writes executed
+    char trips[TRIP_TEXT_LENGTH]; // Trip counts along the deepest loop path, e.g. "n x n x 3"
+} Cost;
+
+typedef struct FunctionCost {
+    const char* name;
+    ASTNode* function;
+    Cost total;            // Including the cost of called user functions
+    Cost* nests;           // One entry per outermost loop in the body
+    int nestCount;
+} FunctionCost;
+
+typedef struct CostProfile {
+    FunctionCost* functions;
+    int functionCount;
+    int degree;            // Highest degree over all functions
+    double operations;     // Cost of main, or of all functions when there is no main
+    double arrayAccesses;
+    int loopCount;
+} CostProfile;
+
+CostProfile* estimateCost(ASTNode* root);
+// estimateCost once per program: the profile is kept on the Root node and freed with it
+CostProfile* analyzeCost(ASTNode* root);
+void freeCostProfile(CostProfile* profile);
+
+// 0-100 similarity of the asymptotic degree and estimated work, -1 when neither program has a loop
+int compareCostProfiles(CostProfile* profile1, CostProfile* profile2);
+// Per-function costs side by side, with functions paired as compareFunctionSets pairs them
+void printCostComparison(const char* name1, ASTNode* root1, const char* name2, ASTNode* root2);
+
+#endif
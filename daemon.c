@@ -0,0 +1,580 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "canonical.h"
+#include "hashcons.h"
+#include "budget.h"
+#include "approximate.h"
+#include "dependence.h"
+#include "complexity.h"
+#include "simalloc.h"
+
+typedef struct Reference {
+    const char* name;
+    ASTNode* root;
+} Reference;
+
+typedef struct DaemonState {
+    Reference* references;
+    int referenceCount;
+
+    // Connections accepted by the main thread, served by the workers
+    int queue[DAEMON_QUEUE_CAPACITY];
+    int head, count;
+    int stopping;
+    int* active;           // Connection each worker is serving, -1 when idle
+    int workerCount;
+    pthread_mutex_t queueLock;
+    pthread_cond_t notEmpty, notFull;
+
+    unsigned long submissions;
+} DaemonState;
+
+typedef struct Response {
+    char* text;
+    size_t length, capacity;
+} Response;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleStop(int signal) {
+    (void)signal;
+    stopRequested = 1;
+}
+
+static void appendResponse(Response* response, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0) return;
+
+    if (response->length + needed + 1 > response->capacity) {
+        size_t newCapacity = response->capacity ? response->capacity * 2 : 256;
+        while (newCapacity < response->length + needed + 1) newCapacity *= 2;
+        char* text = realloc(response->text, newCapacity);
+        if (!text) {
+            fprintf(stderr, "Memory allocation failed for daemon response.\n");
+            return;
+        }
+        response->text = text;
+        response->capacity = newCapacity;
+    }
+
+    va_start(args, format);
+    vsnprintf(response->text + response->length, response->capacity - response->length, format, args);
+    va_end(args);
+    response->length += needed;
+}
+
+/* ---- Framing ---- */
+
+static uint64_t monotonicMilliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// With a deadline (in monotonicMilliseconds, 0 for none) the bytes must all have arrived
+// by then. 1 when they did, 0 on a clean end of stream, -1 on error or timeout
+static int readFully(int fd, void* buffer, size_t length, uint64_t deadline) {
+    char* p = buffer;
+    while (length > 0) {
+        if (deadline) {
+            uint64_t now = monotonicMilliseconds();
+            struct pollfd readable = { .fd = fd, .events = POLLIN };
+            int ready = now < deadline ? poll(&readable, 1, (int)(deadline - now)) : 0;
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) fprintf(stderr, "Daemon: connection timed out.\n");
+            if (ready <= 0) return -1;
+        }
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n == 0 ? 0 : -1;
+        p += n;
+        length -= n;
+    }
+    return 1;
+}
+
+static int writeFully(int fd, const void* buffer, size_t length) {
+    const char* p = buffer;
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        length -= n;
+    }
+    return 1;
+}
+
+// 1 with the payload length, 0 on a clean end of stream, -1 on error
+static int readMessageLength(int fd, uint32_t* length, uint64_t deadline) {
+    unsigned char header[4];
+    int status = readFully(fd, header, sizeof(header), deadline);
+    if (status <= 0) return status;
+
+    *length = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+    if (*length > DAEMON_MAX_MESSAGE) {
+        fprintf(stderr, "Daemon: message of %u bytes exceeds the limit.\n", *length);
+        return -1;
+    }
+    return 1;
+}
+
+// 1 with a malloc'd payload, 0 on a clean end of stream, -1 on error
+static int readMessage(int fd, char** payload, uint32_t* length) {
+    int status = readMessageLength(fd, length, 0);
+    if (status <= 0) return status;
+
+    *payload = malloc(*length + 1);
+    if (!*payload) {
+        fprintf(stderr, "Memory allocation failed for daemon message.\n");
+        return -1;
+    }
+    if (readFully(fd, *payload, *length, 0) != 1) {
+        free(*payload);
+        return -1;
+    }
+    (*payload)[*length] = '\0';
+    return 1;
+}
+
+static int writeMessage(int fd, const char* payload, uint32_t length) {
+    unsigned char header[4] = {
+        (unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length
+    };
+    if (writeFully(fd, header, sizeof(header)) != 1) return -1;
+    return writeFully(fd, payload, length);
+}
+
+/* ---- Request handling ---- */
+
+static Reference* findReference(DaemonState* state, const char* name) {
+    if (!*name) return &state->references[0];
+    for (int i = 0; i < state->referenceCount; i++) {
+        const char* path = state->references[i].name;
+        const char* base = strrchr(path, '/');
+        if (strcmp(path, name) == 0 || (base && strcmp(base + 1, name) == 0)) return &state->references[i];
+    }
+    return NULL;
+}
+
+// Tabs and newlines would break the line format of the response
+static const char* fieldOf(const char* text) {
+    return text && !strpbrk(text, "\t\n") ? text : "-";
+}
+
+// Reads one request, parsing the submission while its bytes arrive. The whole
+// payload is always consumed, so the connection stays usable after an error.
+// 1 with the response filled in, 0 on a clean end of stream, -1 on error
+// The submission's allocations are charged to *memory, which the caller closes
+static int readRequest(DaemonState* state, int fd, Response* response, Reference** reference, ASTNode** root,
+                       AllocAccount** memory) {
+    uint32_t remaining;
+    int status = readMessageLength(fd, &remaining, monotonicMilliseconds() + DAEMON_IDLE_TIMEOUT_MS);
+    if (status <= 0) return status;
+    uint64_t deadline = monotonicMilliseconds() + DAEMON_REQUEST_TIMEOUT_MS;
+
+    char* chunk = malloc(DAEMON_READ_CHUNK);
+    if (!chunk) {
+        fprintf(stderr, "Memory allocation failed for daemon message.\n");
+        return -1;
+    }
+
+    char referenceName[DAEMON_MAX_NAME];
+    size_t nameLength = 0;
+    int nameComplete = 0, nameTooLong = 0;
+    StreamParser* parser = NULL;
+    *reference = NULL;
+    *root = NULL;
+
+    while (remaining > 0) {
+        size_t count = remaining < DAEMON_READ_CHUNK ? remaining : DAEMON_READ_CHUNK;
+        if (readFully(fd, chunk, count, deadline) != 1) {
+            freeStreamParser(parser);
+            free(chunk);
+            return -1;
+        }
+        remaining -= (uint32_t)count;
+
+        const char* bytes = chunk;
+        if (!nameComplete) {
+            const char* newline = memchr(chunk, '\n', count);
+            size_t take = newline ? (size_t)(newline - chunk) : count;
+            if (nameLength + take >= sizeof(referenceName)) nameTooLong = 1;
+            else memcpy(referenceName + nameLength, chunk, take);
+            nameLength += take;
+            if (!newline) continue;
+
+            nameComplete = 1;
+            bytes = newline + 1;
+            count -= take + 1;
+            if (nameTooLong) continue;
+            referenceName[nameLength] = '\0';
+            if ((*reference = findReference(state, referenceName)) != NULL) {
+                char name[64];
+                snprintf(name, sizeof(name), "submission-%lu", __atomic_add_fetch(&state->submissions, 1, __ATOMIC_RELAXED));
+                *memory = createAllocAccount(name);
+                enterAllocAccount(*memory);
+                parser = createStreamParser(name);
+            }
+        }
+        if (parser && count > 0) feedStreamParser(parser, bytes, count);
+    }
+    free(chunk);
+
+    if (!nameComplete) {
+        appendResponse(response, "error missing reference name\n");
+    } else if (nameTooLong) {
+        appendResponse(response, "error reference name too long\n");
+    } else if (!*reference) {
+        appendResponse(response, "error unknown reference %s\n", referenceName);
+    } else if (!parser || !(*root = finishStreamParser(parser))) {
+        appendResponse(response, "error parsing failed\n");
+    }
+    freeStreamParser(parser);
+    return 1;
+}
+
+static void scoreSubmission(Reference* reference, ASTNode* root, Response* response) {
+    if (!root) {
+        appendResponse(response, "error parsing failed\n");
+        return;
+    }
+
+    // Parsing, canonicalization and analysis only touch the submission's own tree, and
+    // the shared expression table, which has its own lock
+    canonicalizeAST(root);
+    shareExpressions(root);
+    analyzeDependences(root);
+    analyzeCost(root);
+
+    MatchTable* table = initializeMatchTable();
+    if (!table) {
+        appendResponse(response, "error out of memory\n");
+        freeASTNode(root);
+        return;
+    }
+
+    int score = compareASTsWithTable(reference->root, root, table);
+    int low = 0, high = 0;
+    if (lastPairInterval(&low, &high)) {
+        appendResponse(response, "score %d interval %d %d%s\n", score, low, high, lastPairDegraded() ? " degraded" : "");
+    } else {
+        appendResponse(response, lastPairDegraded() ? "score %d degraded\n" : "score %d\n", score);
+    }
+    for (int i = 0; i < table->count; i++) {
+        MatchEntry* entry = &table->entries[i];
+        appendResponse(response, "match\t%s\t%s\t%d\t%d\t%d\t%d\t%s\n", fieldOf(entry->nodeName1), fieldOf(entry->nodeName2),
+                       entry->totalScore, entry->dimensionsMatch, entry->initializationMatch, entry->indexMatch,
+                       fieldOf(entry->details));
+    }
+
+    finalizeMatchTable(table);
+    freeASTNode(root);
+}
+
+static void serveConnection(DaemonState* state, int fd) {
+    for (;;) {
+        Response response = { NULL, 0, 0 };
+        Reference* reference;
+        ASTNode* root = NULL;
+        AllocAccount* memory = NULL;
+        int status = readRequest(state, fd, &response, &reference, &root, &memory);
+        if (status > 0 && !response.text) scoreSubmission(reference, root, &response);
+        else freeASTNode(root);
+        enterAllocAccount(NULL);
+        closeAllocAccount(memory);
+        if (status <= 0) {
+            free(response.text);
+            return;
+        }
+
+        int written = response.text ? writeMessage(fd, response.text, (uint32_t)response.length) : -1;
+        free(response.text);
+        if (written != 1) return;
+    }
+}
+
+typedef struct Worker {
+    DaemonState* state;
+    int slot;              // Index into state->active
+} Worker;
+
+static void* workerMain(void* argument) {
+    Worker* worker = argument;
+    DaemonState* state = worker->state;
+    for (;;) {
+        pthread_mutex_lock(&state->queueLock);
+        while (state->count == 0 && !state->stopping) {
+            pthread_cond_wait(&state->notEmpty, &state->queueLock);
+        }
+        if (state->count == 0) {
+            pthread_mutex_unlock(&state->queueLock);
+            return NULL;
+        }
+        int fd = state->queue[state->head];
+        state->head = (state->head + 1) % DAEMON_QUEUE_CAPACITY;
+        state->count--;
+        state->active[worker->slot] = fd;
+        pthread_cond_signal(&state->notFull);
+        pthread_mutex_unlock(&state->queueLock);
+
+        serveConnection(state, fd);
+
+        // Deregistered before the close, so a stop never shuts down a reused descriptor
+        pthread_mutex_lock(&state->queueLock);
+        state->active[worker->slot] = -1;
+        pthread_mutex_unlock(&state->queueLock);
+        close(fd);
+    }
+}
+
+// Blocks while the queue is full, but never past a stop request: the connection is then
+// closed unserved
+static void enqueueConnection(DaemonState* state, int fd) {
+    pthread_mutex_lock(&state->queueLock);
+    while (state->count == DAEMON_QUEUE_CAPACITY && !stopRequested) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += 100 * 1000000L;
+        if (wake.tv_nsec >= 1000000000L) {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&state->notFull, &state->queueLock, &wake);
+    }
+    if (stopRequested) {
+        pthread_mutex_unlock(&state->queueLock);
+        close(fd);
+        return;
+    }
+    state->queue[(state->head + state->count) % DAEMON_QUEUE_CAPACITY] = fd;
+    state->count++;
+    pthread_cond_signal(&state->notEmpty);
+    pthread_mutex_unlock(&state->queueLock);
+}
+
+/* ---- Setup ---- */
+
+static int openListeningSocket(const char* socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(socketPath); // Stale socket from a previous run
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int loadReferences(DaemonState* state, char** referencePaths, int referenceCount) {
+    state->references = calloc(referenceCount, sizeof(Reference));
+    if (!state->references) {
+        fprintf(stderr, "Memory allocation failed for references.\n");
+        return 0;
+    }
+
+    for (int i = 0; i < referenceCount; i++) {
+        ASTNode* root = parse(referencePaths[i]);
+        if (!root) {
+            fprintf(stderr, "Error: Parsing failed for reference %s.\n", referencePaths[i]);
+            return 0;
+        }
+        // Everything compareASTs would compute lazily on a reference is computed here,
+        // so the workers only ever read the resident trees
+        canonicalizeAST(root);
+        shareExpressions(root);
+        analyzeDependences(root);
+        analyzeCost(root);
+        state->references[state->referenceCount].name = referencePaths[i];
+        state->references[state->referenceCount].root = root;
+        state->referenceCount++;
+    }
+    return 1;
+}
+
+static void freeReferences(DaemonState* state) {
+    for (int i = 0; i < state->referenceCount; i++) {
+        freeASTNode(state->references[i].root);
+    }
+    free(state->references);
+}
+
+int runScoringDaemon(const char* socketPath, char** referencePaths, int referenceCount, int workerCount) {
+    if (referenceCount < 1) {
+        fprintf(stderr, "Daemon needs at least one reference.\n");
+        return EXIT_FAILURE;
+    }
+    if (workerCount < 1) workerCount = DAEMON_DEFAULT_WORKERS;
+
+    DaemonState state;
+    memset(&state, 0, sizeof(state));
+    pthread_mutex_init(&state.queueLock, NULL);
+    pthread_cond_init(&state.notEmpty, NULL);
+    pthread_cond_init(&state.notFull, NULL);
+
+    if (!loadReferences(&state, referencePaths, referenceCount)) {
+        freeReferences(&state);
+        return EXIT_FAILURE;
+    }
+
+    int listenFd = openListeningSocket(socketPath);
+    if (listenFd < 0) {
+        freeReferences(&state);
+        return EXIT_FAILURE;
+    }
+
+    // Only the accepting thread takes SIGINT/SIGTERM, so accept() is the call they interrupt
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = handleStop;
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    sigset_t stopSignals, previous;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+
+    pthread_t* workers = malloc(sizeof(pthread_t) * workerCount);
+    Worker* slots = malloc(sizeof(Worker) * workerCount);
+    state.active = malloc(sizeof(int) * workerCount);
+    int started = 0;
+    if (workers && slots && state.active) {
+        state.workerCount = workerCount;
+        for (int i = 0; i < workerCount; i++) state.active[i] = -1;
+    }
+    for (int i = 0; i < state.workerCount; i++) {
+        slots[i].state = &state;
+        slots[i].slot = i;
+        if (pthread_create(&workers[i], NULL, workerMain, &slots[i]) != 0) break;
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (started == 0) {
+        fprintf(stderr, "Failed to start daemon workers.\n");
+    } else {
+        fprintf(stderr, "Log: Serving %d reference(s) on %s with %d worker(s).\n", state.referenceCount, socketPath, started);
+        while (!stopRequested) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                perror("accept");
+                break;
+            }
+            // A client that stops reading its response cannot block the worker either
+            struct timeval timeout = { DAEMON_IDLE_TIMEOUT_MS / 1000, (DAEMON_IDLE_TIMEOUT_MS % 1000) * 1000 };
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            enqueueConnection(&state, fd);
+        }
+    }
+
+    // Close the connections still queued, and shut down those being served so workers
+    // blocked on a client return at once
+    pthread_mutex_lock(&state.queueLock);
+    state.stopping = 1;
+    for (; state.count > 0; state.count--) {
+        close(state.queue[state.head]);
+        state.head = (state.head + 1) % DAEMON_QUEUE_CAPACITY;
+    }
+    for (int i = 0; i < state.workerCount; i++) {
+        if (state.active[i] >= 0) shutdown(state.active[i], SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&state.notEmpty);
+    pthread_mutex_unlock(&state.queueLock);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    free(slots);
+    free(state.active);
+
+    close(listenFd);
+    unlink(socketPath);
+    freeReferences(&state);
+    pthread_mutex_destroy(&state.queueLock);
+    pthread_cond_destroy(&state.notEmpty);
+    pthread_cond_destroy(&state.notFull);
+
+    fprintf(stderr, "Log: Daemon on %s stopped.\n", socketPath);
+    return started > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ---- Client ---- */
+
+int queryScoringDaemon(const char* socketPath, const char* referenceName, const char* submissionPath) {
+    size_t sourceLength = 0;
+    char* source = readSourceFile(submissionPath, &sourceLength);
+    if (!source) return EXIT_FAILURE;
+
+    size_t nameLength = strlen(referenceName);
+    size_t length = nameLength + 1 + sourceLength;
+    char* request = malloc(length);
+    if (!request || length > DAEMON_MAX_MESSAGE) {
+        fprintf(stderr, "Submission %s is too large to send.\n", submissionPath);
+        free(request);
+        simFree(source);
+        return EXIT_FAILURE;
+    }
+    memcpy(request, referenceName, nameLength);
+    request[nameLength] = '\n';
+    memcpy(request + nameLength + 1, source, sourceLength);
+    simFree(source);
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("connect");
+        if (fd >= 0) close(fd);
+        free(request);
+        return EXIT_FAILURE;
+    }
+
+    char* response = NULL;
+    uint32_t responseLength = 0;
+    int ok = writeMessage(fd, request, (uint32_t)length) == 1 && readMessage(fd, &response, &responseLength) == 1;
+    close(fd);
+    free(request);
+    if (!ok) {
+        fprintf(stderr, "No response from daemon on %s.\n", socketPath);
+        return EXIT_FAILURE;
+    }
+
+    fwrite(response, 1, responseLength, stdout);
+    int failed = strncmp(response, "error", 5) == 0;
+    free(response);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "ast.h"
+
+#define DAEMON_DEFAULT_WORKERS 4
+#define DAEMON_QUEUE_CAPACITY 64             // Accepted connections waiting for a worker
+#define DAEMON_MAX_MESSAGE (16 * 1024 * 1024)
+#define DAEMON_MAX_NAME 4096
+#define DAEMON_READ_CHUNK (64 * 1024)         // Submissions are parsed as each chunk arrives
+#define DAEMON_IDLE_TIMEOUT_MS 30000          // Longest wait for the next request, or for a response to drain
+#define DAEMON_REQUEST_TIMEOUT_MS 120000      // Longest time the payload of one request may take to arrive
+
+// Protocol over a Unix stream socket. Every message, in both directions, is a 4-byte
+// big-endian payload length followed by the payload. A connection may carry any number
+// of requests, each answered in order. It is closed when no request starts within
+// DAEMON_IDLE_TIMEOUT_MS, or a request's payload takes longer than
+// DAEMON_REQUEST_TIMEOUT_MS to arrive, so idle or trickling clients cannot hold a worker.
+//
+// Request:  "<reference name>\n<submission source>"
+//           An empty name selects the first reference; otherwise the name must match
+//           the path the reference was loaded from, or its basename.
+// Response: "score <n>\n", or "score <n> degraded\n" when the comparison ran out of
+//           budget and <n> is an estimate, or "score <n> interval <low> <high>\n" (then
+//           perhaps " degraded") when the array pairs were sampled, followed by one
+//           tab-separated line per MatchTable entry:
+//           "match\t<name1>\t<name2>\t<total>\t<dimensions>\t<initialization>\t<index>\t<details>\n"
+//           or, on failure, "error <message>\n".
+
+// Parses and canonicalizes the references once, then serves requests until SIGINT/SIGTERM.
+// On a stop, queued connections are closed unserved and those being served are shut down.
+int runScoringDaemon(const char* socketPath, char** referencePaths, int referenceCount, int workerCount);
+
+// Sends one submission file to a running daemon and prints the response.
+int queryScoringDaemon(const char* socketPath, const char* referenceName, const char* submissionPath);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "dedup.h"
+#include "ast.h"
+#include "resultcache.h"
+
+typedef struct HashedSource {
+    uint64_t rawHash;
+    uint64_t tokenHash;
+    int index;
+} HashedSource;
+
+static int compareByRawHash(const void* a, const void* b) {
+    const HashedSource* x = a;
+    const HashedSource* y = b;
+    if (x->rawHash != y->rawHash) return x->rawHash < y->rawHash ? -1 : 1;
+    return x->index - y->index;
+}
+
+static int compareByTokenHash(const void* a, const void* b) {
+    const HashedSource* x = a;
+    const HashedSource* y = b;
+    if (x->tokenHash != y->tokenHash) return x->tokenHash < y->tokenHash ? -1 : 1;
+    return x->index - y->index;
+}
+
+void freeSourceGroups(SourceGroups* groups) {
+    if (!groups) return;
+    free(groups->classOf);
+    free(groups->representative);
+    free(groups->classSize);
+    free(groups->kind);
+    free(groups);
+}
+
+SourceGroups* groupEquivalentSources(const char* const* sources, const size_t* lengths, int count) {
+    SourceGroups* groups = calloc(1, sizeof(SourceGroups));
+    HashedSource* hashed = malloc(sizeof(HashedSource) * (count > 0 ? count : 1));
+    int* firstOf = malloc(sizeof(int) * (count > 0 ? count : 1));
+    if (groups) {
+        groups->classOf = malloc(sizeof(int) * (count > 0 ? count : 1));
+        groups->representative = malloc(sizeof(int) * (count > 0 ? count : 1));
+        groups->classSize = calloc(count > 0 ? count : 1, sizeof(int));
+        groups->kind = calloc(count > 0 ? count : 1, sizeof(DuplicateKind));
+    }
+    if (!groups || !hashed || !firstOf || !groups->classOf || !groups->representative ||
+        !groups->classSize || !groups->kind) {
+        fprintf(stderr, "Memory allocation failed for source groups.\n");
+        freeSourceGroups(groups);
+        free(hashed);
+        free(firstOf);
+        return NULL;
+    }
+    groups->count = count;
+
+    for (int i = 0; i < count; i++) {
+        hashed[i].rawHash = contentHash(sources[i], lengths[i]);
+        hashed[i].tokenHash = 0;
+        hashed[i].index = i;
+    }
+
+    // Exact copies share the token hash of the first copy, so only distinct bytes are lexed
+    qsort(hashed, count, sizeof(HashedSource), compareByRawHash);
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && hashed[i].rawHash == hashed[i - 1].rawHash) {
+            hashed[i].tokenHash = hashed[i - 1].tokenHash;
+        } else {
+            hashed[i].tokenHash = tokenStreamHash(sources[hashed[i].index], lengths[hashed[i].index]);
+        }
+    }
+
+    // Within a run of equal token hashes the lowest input index comes first
+    qsort(hashed, count, sizeof(HashedSource), compareByTokenHash);
+    uint64_t firstRawHash = 0;
+    for (int i = 0; i < count; i++) {
+        int index = hashed[i].index;
+        if (i == 0 || hashed[i].tokenHash != hashed[i - 1].tokenHash) {
+            firstOf[index] = index;
+            firstRawHash = hashed[i].rawHash;
+            groups->kind[index] = Duplicate_None;
+        } else {
+            firstOf[index] = firstOf[hashed[i - 1].index];
+            if (hashed[i].rawHash == firstRawHash) {
+                groups->kind[index] = Duplicate_Exact;
+                groups->exactCopies++;
+            } else {
+                groups->kind[index] = Duplicate_TokenIdentical;
+                groups->tokenCopies++;
+            }
+        }
+    }
+
+    // Number the classes in input order
+    for (int i = 0; i < count; i++) {
+        if (firstOf[i] == i) {
+            groups->representative[groups->classCount] = i;
+            groups->classOf[i] = groups->classCount++;
+        } else {
+            groups->classOf[i] = groups->classOf[firstOf[i]];
+        }
+        groups->classSize[groups->classOf[i]]++;
+    }
+
+    fprintf(stderr, "Log: Grouped %d sources into %d classes (%d exact copies, %d token-identical).\n",
+            count, groups->classCount, groups->exactCopies, groups->tokenCopies);
+    free(hashed);
+    free(firstOf);
+    return groups;
+}
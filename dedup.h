@@ -0,0 +1,29 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+
+typedef enum DuplicateKind {
+    Duplicate_None,            // The input is its class representative
+    Duplicate_Exact,           // Same bytes as the representative
+    Duplicate_TokenIdentical   // Differs only in whitespace, comments or preprocessor lines
+} DuplicateKind;
+
+// Equivalence classes of a batch of sources. Members of one class parse to the same
+// AST, so every class needs to be parsed and scored only once.
+typedef struct SourceGroups {
+    int count;                 // Inputs
+    int classCount;
+    int* classOf;              // Class of every input; classes are numbered by first occurrence
+    int* representative;       // First input of every class
+    int* classSize;
+    DuplicateKind* kind;       // How every input matched its representative
+    int exactCopies, tokenCopies;
+} SourceGroups;
+
+// Groups by a hash of the raw bytes, then by a hash of the token stream. Token
+// streams are hashed once per distinct raw source.
+SourceGroups* groupEquivalentSources(const char* const* sources, const size_t* lengths, int count);
+void freeSourceGroups(SourceGroups* groups);
+
+#endif
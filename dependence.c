@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "dependence.h"
+#include "stats.h"
+
+#define MAX_ENUMERATED_LEVELS 4   // 3^4 direction vectors at most per access pair
+
+// Closed integer range; the flags mark an unbounded side
+typedef struct Range {
+    long lo, hi;
+    int loInf, hiInf;
+} Range;
+
+static const char directionChars[3] = {'<', '=', '>'};
+
+static unsigned long mixSignature(unsigned long h, unsigned long v) {
+    return h ^ (v + 0x9e3779b97f4a7c15UL + (h << 6) + (h >> 2));
+}
+
+static const char* displayName(ASTNode* node) {
+    return node->sourceName ? node->sourceName : node->name;
+}
+
+static int parseConstant(ASTNode* node, long* value) {
+    if (!node || node->type != NodeType_Constant || !node->name) return 0;
+    const char* p = node->name;
+    if (!*p) return 0;
+    for (const char* q = p; *q; q++) {
+        if (!isdigit((unsigned char)*q)) return 0;
+    }
+    *value = strtol(p, NULL, 10);
+    return 1;
+}
+
+static long gcdLong(long a, long b) {
+    if (a < 0) a = -a;
+    if (b < 0) b = -b;
+    while (b) {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* ---- Loop nest extraction ---- */
+
+static int addLoop(LoopNest* nest, ASTNode* node, int parent) {
+    if (nest->loopCount == nest->loopCapacity) {
+        int newCapacity = nest->loopCapacity ? nest->loopCapacity * 2 : 4;
+        LoopInfo* loops = realloc(nest->loops, sizeof(LoopInfo) * newCapacity);
+        if (!loops) {
+            fprintf(stderr, "Memory allocation failed for loop info.\n");
+            return -1;
+        }
+        nest->loops = loops;
+        nest->loopCapacity = newCapacity;
+    }
+
+    LoopInfo* loop = &nest->loops[nest->loopCount];
+    memset(loop, 0, sizeof(LoopInfo));
+    loop->node = node;
+    loop->parent = parent;
+    loop->level = parent < 0 ? 0 : nest->loops[parent].level + 1;
+    loop->slot = -1;
+
+    // Only for loops of the form for (v = c; v REL c; v++ / v--) get a variable and bounds
+    if (node->type == NodeType_For && node->childCount == 4) {
+        ASTNode* init = node->children[0];
+        ASTNode* cond = node->children[1];
+        ASTNode* incr = node->children[2];
+
+        if (init && init->type == NodeType_Assignment && init->childCount == 2 &&
+            init->children[0]->type == NodeType_Identifier) {
+            ASTNode* variable = init->children[0];
+            loop->variable = variable->name;
+            loop->slot = affineSlotOf(nest->program, variable->sourceName ? variable->sourceName : variable->name);
+        }
+        if (loop->variable && incr && incr->type == NodeType_Expression && incr->childCount == 1 &&
+            incr->children[0]->type == NodeType_Identifier && strcmp(incr->children[0]->name, loop->variable) == 0) {
+            loop->step = strcmp(incr->name, "++") == 0 ? 1 : (strcmp(incr->name, "--") == 0 ? -1 : 0);
+        }
+
+        long start, limit;
+        if (loop->variable && loop->step != 0 && parseConstant(init->children[1], &start) &&
+            cond && cond->type == NodeType_Expression && cond->childCount == 2 &&
+            cond->children[0]->type == NodeType_Identifier && strcmp(cond->children[0]->name, loop->variable) == 0 &&
+            parseConstant(cond->children[1], &limit)) {
+            int known = 1;
+            if (loop->step > 0) {
+                loop->lower = start;
+                if (strcmp(cond->name, "<") == 0 || strcmp(cond->name, "!=") == 0) loop->upper = limit - 1;
+                else if (strcmp(cond->name, "<=") == 0) loop->upper = limit;
+                else known = 0;
+            } else {
+                loop->upper = start;
+                if (strcmp(cond->name, ">") == 0 || strcmp(cond->name, "!=") == 0) loop->lower = limit + 1;
+                else if (strcmp(cond->name, ">=") == 0) loop->lower = limit;
+                else known = 0;
+            }
+            loop->boundsKnown = known && loop->lower <= loop->upper;
+        }
+    }
+
+    if (loop->level + 1 > nest->depth) nest->depth = loop->level + 1;
+    return nest->loopCount++;
+}
+
+// Maps the affine form stored on the access (over parse-time slots) onto the enclosing loop levels.
+// Slots that are not an enclosing loop variable are symbolic, which makes the subscript non-affine.
+static int subscriptFromForm(const AffineForm* form, LoopNest* nest, const int* chain, int depth, AffineSubscript* out) {
+    if (!form || !form->isAffine) return 0;
+
+    for (int s = 0; s < AFFINE_MAX_VARS; s++) {
+        if (form->coefficients[s] == 0) continue;
+        int level = -1;
+        for (int k = depth - 1; k >= 0 && level < 0; k--) {
+            if (nest->loops[chain[k]].slot == s) level = k;
+        }
+        if (level < 0) return 0;
+        out->coefficients[level] += form->coefficients[s];
+    }
+    out->constant = form->constant;
+    return 1;
+}
+
+static void addAccess(LoopNest* nest, ASTNode* node, int loop, int isWrite) {
+    if (nest->accessCount == nest->accessCapacity) {
+        int newCapacity = nest->accessCapacity ? nest->accessCapacity * 2 : 8;
+        AccessInfo* accesses = realloc(nest->accesses, sizeof(AccessInfo) * newCapacity);
+        if (!accesses) {
+            fprintf(stderr, "Memory allocation failed for access info.\n");
+            return;
+        }
+        nest->accesses = accesses;
+        nest->accessCapacity = newCapacity;
+    }
+
+    AccessInfo* access = &nest->accesses[nest->accessCount++];
+    memset(access, 0, sizeof(AccessInfo));
+    access->node = node;
+    access->arrayName = node->name;
+    access->isWrite = isWrite;
+    access->loop = loop;
+
+    int reversed[MAX_LOOP_DEPTH];
+    int depth = 0;
+    for (int l = loop; l >= 0 && depth < MAX_LOOP_DEPTH; l = nest->loops[l].parent) {
+        reversed[depth++] = l;
+    }
+    access->depth = depth;
+    for (int k = 0; k < depth; k++) {
+        access->loopChain[k] = reversed[depth - 1 - k];
+    }
+
+    access->subscriptCount = node->indexCount < MAX_SUBSCRIPTS ? node->indexCount : MAX_SUBSCRIPTS;
+    for (int d = 0; d < access->subscriptCount; d++) {
+        AffineSubscript* subscript = &access->subscripts[d];
+        subscript->isAffine = node->affine ? subscriptFromForm(&node->affine[d], nest, access->loopChain, depth, subscript) : 0;
+        if (!subscript->isAffine) memset(subscript, 0, sizeof(AffineSubscript));
+    }
+}
+
+// Queues a node of a nest; a NULL node has nothing to queue. 0 when the frame could not be pushed.
+static int pushNestNode(WalkStack* walk, ASTNode* node, int loop, int isWrite, int record) {
+    if (!node) return 1;
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return 0;
+    frame->node1 = node;
+    frame->level = loop;
+    frame->mode = isWrite;
+    frame->pending = record;
+    return 1;
+}
+
+// Walks a nest in execution order: within an assignment the right-hand side is read before the target is written.
+// Each frame holds a node in node1, the innermost loop around it in level and whether it is written in mode; a
+// frame with pending set records its array access, queued below the index expressions that are read first.
+// When the stack cannot grow the nest keeps the accesses found so far.
+static void collectNestAccesses(ASTNode* root, LoopNest* nest) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return;
+    int base = walk->count;
+    int queued = pushNestNode(walk, root, -1, 0, 0);
+
+    while (queued && walk->count > base) {
+        WalkFrame frame = walk->frames[--walk->count];
+        ASTNode* node = frame.node1;
+        int loop = frame.level;
+
+        if (frame.pending) {
+            addAccess(nest, node, loop, frame.mode);
+            continue;
+        }
+
+        if (node->type == NodeType_For || node->type == NodeType_While) {
+            int inner = addLoop(nest, node, loop);
+            if (inner < 0) continue;
+            for (int i = node->childCount - 1; queued && i >= 0; i--) {
+                queued = pushNestNode(walk, node->children[i], inner, 0, 0);
+            }
+        } else if (node->type == NodeType_ArrayAccess) {
+            queued = pushNestNode(walk, node, loop, frame.mode, 1);
+            for (int i = node->indexCount - 1; queued && i >= 0; i--) {
+                queued = pushNestNode(walk, node->indices[i], loop, 0, 0);
+            }
+        } else if (node->type == NodeType_Assignment && node->childCount >= 2) {
+            queued = pushNestNode(walk, node->children[0], loop, 1, 0);
+            for (int i = node->childCount - 1; queued && i >= 1; i--) {
+                queued = pushNestNode(walk, node->children[i], loop, 0, 0);
+            }
+        } else {
+            for (int i = node->childCount - 1; queued && i >= 0; i--) {
+                queued = pushNestNode(walk, node->children[i], loop, 0, 0);
+            }
+        }
+    }
+
+    if (!queued) fprintf(stderr, "Log: Accesses of a loop nest left out: the traversal stack cannot grow.\n");
+    walk->count = base;
+}
+
+/* ---- Dependence tests ---- */
+
+static Range rangeOfTerm(long coefficient, const LoopInfo* loop) {
+    Range r = {0, 0, 0, 0};
+    if (coefficient == 0) return r;
+    if (!loop || !loop->boundsKnown) {
+        r.loInf = r.hiInf = 1;
+        return r;
+    }
+    long a = coefficient * loop->lower, b = coefficient * loop->upper;
+    r.lo = a < b ? a : b;
+    r.hi = a < b ? b : a;
+    return r;
+}
+
+static void addRange(Range* total, Range r) {
+    total->lo += r.lo;
+    total->hi += r.hi;
+    total->loInf |= r.loInf;
+    total->hiInf |= r.hiInf;
+}
+
+static void rangeOfVertices(Range* r, long a, long b, const long vertices[][2], int count) {
+    for (int v = 0; v < count; v++) {
+        long value = a * vertices[v][0] - b * vertices[v][1];
+        if (v == 0 || value < r->lo) r->lo = value;
+        if (v == 0 || value > r->hi) r->hi = value;
+    }
+}
+
+// Banerjee bounds of a*i - b*i' for one common loop under direction dir; returns 0 if the direction is infeasible
+static int levelRange(long a, long b, const LoopInfo* loop, char dir, Range* out) {
+    Range r = {0, 0, 0, 0};
+
+    if (!loop->boundsKnown) {
+        if (a == 0 && b == 0) {
+            *out = r;
+        } else if (dir == '=' && a == b) {
+            *out = r;
+        } else {
+            r.loInf = r.hiInf = 1;
+            *out = r;
+        }
+        return 1;
+    }
+
+    long L = loop->lower, U = loop->upper;
+    if (dir == '=') {
+        rangeOfVertices(&r, a - b, 0, (const long[][2]){{L, 0}, {U, 0}}, 2);
+    } else if (dir == '<') {
+        if (U - 1 < L) return 0;
+        rangeOfVertices(&r, a, b, (const long[][2]){{L, L + 1}, {L, U}, {U - 1, U}}, 3);
+    } else if (dir == '>') {
+        if (U - 1 < L) return 0;
+        rangeOfVertices(&r, a, b, (const long[][2]){{L + 1, L}, {U, L}, {U, U - 1}}, 3);
+    } else {
+        Range ri = rangeOfTerm(a, loop), rj = rangeOfTerm(-b, loop);
+        r = ri;
+        addRange(&r, rj);
+    }
+    *out = r;
+    return 1;
+}
+
+static int inRange(Range r, long value) {
+    return (r.loInf || value >= r.lo) && (r.hiInf || value <= r.hi);
+}
+
+// GCD test over all dimensions
+static int passesGCDTest(LoopNest* nest, AccessInfo* src, AccessInfo* snk) {
+    (void)nest;
+    for (int d = 0; d < src->subscriptCount; d++) {
+        AffineSubscript* f = &src->subscripts[d];
+        AffineSubscript* g = &snk->subscripts[d];
+        if (!f->isAffine || !g->isAffine) continue;
+
+        long divisor = 0;
+        for (int k = 0; k < src->depth; k++) divisor = gcdLong(divisor, f->coefficients[k]);
+        for (int k = 0; k < snk->depth; k++) divisor = gcdLong(divisor, g->coefficients[k]);
+
+        long difference = g->constant - f->constant;
+        if (divisor == 0) {
+            if (difference != 0) return 0;
+        } else if (difference % divisor != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Banerjee test for one direction vector over the common levels
+static int passesBanerjeeTest(LoopNest* nest, AccessInfo* src, AccessInfo* snk, int common, const char* dirs) {
+    for (int d = 0; d < src->subscriptCount; d++) {
+        AffineSubscript* f = &src->subscripts[d];
+        AffineSubscript* g = &snk->subscripts[d];
+        if (!f->isAffine || !g->isAffine) continue;
+
+        Range total = {0, 0, 0, 0};
+        for (int k = 0; k < common; k++) {
+            Range r;
+            if (!levelRange(f->coefficients[k], g->coefficients[k], &nest->loops[src->loopChain[k]], dirs[k], &r)) {
+                return 0;
+            }
+            addRange(&total, r);
+        }
+        for (int k = common; k < src->depth; k++) {
+            addRange(&total, rangeOfTerm(f->coefficients[k], &nest->loops[src->loopChain[k]]));
+        }
+        for (int k = common; k < snk->depth; k++) {
+            addRange(&total, rangeOfTerm(-g->coefficients[k], &nest->loops[snk->loopChain[k]]));
+        }
+
+        if (!inRange(total, g->constant - f->constant)) return 0;
+    }
+    return 1;
+}
+
+// Distance i' - i at a common level when some dimension depends on that level alone with equal coefficients
+static int levelDistance(AccessInfo* src, AccessInfo* snk, int common, int level, long* distance) {
+    for (int d = 0; d < src->subscriptCount; d++) {
+        AffineSubscript* f = &src->subscripts[d];
+        AffineSubscript* g = &snk->subscripts[d];
+        if (!f->isAffine || !g->isAffine) continue;
+
+        long c = f->coefficients[level];
+        if (c == 0 || g->coefficients[level] != c) continue;
+
+        int alone = 1;
+        for (int k = 0; k < src->depth && alone; k++) {
+            if (k != level && f->coefficients[k] != 0) alone = 0;
+        }
+        for (int k = 0; k < snk->depth && alone; k++) {
+            if (k != level && g->coefficients[k] != 0) alone = 0;
+        }
+        if (!alone) continue;
+
+        long difference = f->constant - g->constant;
+        if (difference % c != 0) continue;
+        *distance = difference / c;
+        (void)common;
+        return 1;
+    }
+    return 0;
+}
+
+static int commonLevels(AccessInfo* a, AccessInfo* b) {
+    int common = 0;
+    while (common < a->depth && common < b->depth && a->loopChain[common] == b->loopChain[common]) {
+        common++;
+    }
+    return common;
+}
+
+static DependenceKind kindOf(AccessInfo* src, AccessInfo* snk) {
+    if (src->isWrite && snk->isWrite) return Dependence_Output;
+    return src->isWrite ? Dependence_Flow : Dependence_Anti;
+}
+
+static void addEdge(LoopNest* nest, int source, int sink, int common, const int* dirMask,
+                    const int* distanceKnown, const long* distance) {
+    if (nest->edgeCount == nest->edgeCapacity) {
+        int newCapacity = nest->edgeCapacity ? nest->edgeCapacity * 2 : 8;
+        DependenceEdge* edges = realloc(nest->edges, sizeof(DependenceEdge) * newCapacity);
+        if (!edges) {
+            fprintf(stderr, "Memory allocation failed for dependence edges.\n");
+            return;
+        }
+        nest->edges = edges;
+        nest->edgeCapacity = newCapacity;
+    }
+
+    DependenceEdge* edge = &nest->edges[nest->edgeCount++];
+    memset(edge, 0, sizeof(DependenceEdge));
+    edge->source = source;
+    edge->sink = sink;
+    edge->kind = kindOf(&nest->accesses[source], &nest->accesses[sink]);
+    edge->levels = common;
+    for (int k = 0; k < common; k++) {
+        int mask = dirMask[k];
+        edge->direction[k] = mask == 1 ? '<' : mask == 2 ? '=' : mask == 4 ? '>' : '*';
+        edge->distanceKnown[k] = distanceKnown[k];
+        edge->distance[k] = distance[k];
+    }
+}
+
+// Tests one ordered access pair (first precedes second textually) and records its edges
+static void testAccessPair(LoopNest* nest, int first, int second) {
+    AccessInfo* a = &nest->accesses[first];
+    AccessInfo* b = &nest->accesses[second];
+
+    if (strcmp(a->arrayName, b->arrayName) != 0 || (!a->isWrite && !b->isWrite)) return;
+    if (a->subscriptCount != b->subscriptCount) return;
+    if (!passesGCDTest(nest, a, b)) return;
+
+    int common = commonLevels(a, b);
+    int enumerated = common < MAX_ENUMERATED_LEVELS ? common : MAX_ENUMERATED_LEVELS;
+
+    int knownDistance[MAX_LOOP_DEPTH] = {0};
+    long distance[MAX_LOOP_DEPTH] = {0};
+    for (int k = 0; k < common; k++) {
+        knownDistance[k] = levelDistance(a, b, common, k, &distance[k]);
+    }
+
+    // Forward vectors go first -> second, backward vectors second -> first
+    int forwardMask[MAX_LOOP_DEPTH] = {0}, backwardMask[MAX_LOOP_DEPTH] = {0};
+    int forward = 0, backward = 0;
+
+    int vectors = 1;
+    for (int k = 0; k < enumerated; k++) vectors *= 3;
+
+    for (int v = 0; v < vectors; v++) {
+        char dirs[MAX_LOOP_DEPTH];
+        int code = v, consistent = 1;
+        for (int k = 0; k < common; k++) {
+            if (k < enumerated) {
+                dirs[k] = directionChars[code % 3];
+                code /= 3;
+            } else {
+                dirs[k] = '*';
+            }
+            if (knownDistance[k] && dirs[k] != '*') {
+                char expected = distance[k] > 0 ? '<' : (distance[k] == 0 ? '=' : '>');
+                if (dirs[k] != expected) consistent = 0;
+            }
+        }
+        if (!consistent || !passesBanerjeeTest(nest, a, b, common, dirs)) continue;
+
+        // Sign of the vector: first non-'=' direction. A '*' level beyond the enumerated
+        // ones may be carried either way, so such a vector holds in both directions.
+        int sign = 0, either = 0;
+        for (int k = 0; k < common && sign == 0 && !either; k++) {
+            if (dirs[k] == '<') sign = 1;
+            else if (dirs[k] == '>') sign = -1;
+            else if (dirs[k] == '*') either = 1;
+        }
+
+        if (sign > 0 || either || (sign == 0 && first != second)) {
+            forward = 1;
+            for (int k = 0; k < common; k++) {
+                forwardMask[k] |= dirs[k] == '<' ? 1 : dirs[k] == '=' ? 2 : dirs[k] == '>' ? 4 : 7;
+            }
+        }
+        if ((sign < 0 || either) && first != second) {
+            backward = 1;
+            for (int k = 0; k < common; k++) {
+                // Reverse the vector so it reads from the second access to the first
+                backwardMask[k] |= dirs[k] == '<' ? 4 : dirs[k] == '=' ? 2 : dirs[k] == '>' ? 1 : 7;
+            }
+        }
+    }
+
+    if (forward) {
+        addEdge(nest, first, second, common, forwardMask, knownDistance, distance);
+    }
+    if (backward) {
+        long reversedDistance[MAX_LOOP_DEPTH];
+        for (int k = 0; k < common; k++) reversedDistance[k] = -distance[k];
+        addEdge(nest, second, first, common, backwardMask, knownDistance, reversedDistance);
+    }
+}
+
+static void analyzeNest(LoopNest* nest) {
+    for (int i = 0; i < nest->accessCount; i++) {
+        for (int j = i; j < nest->accessCount; j++) {
+            testAccessPair(nest, i, j);
+        }
+    }
+}
+
+/* ---- Graph construction ---- */
+
+static LoopNest* addNest(DependenceGraph* graph, ASTNode* program, ASTNode* forNode) {
+    if (graph->nestCount == graph->nestCapacity) {
+        int newCapacity = graph->nestCapacity ? graph->nestCapacity * 2 : 4;
+        LoopNest* nests = realloc(graph->nests, sizeof(LoopNest) * newCapacity);
+        if (!nests) {
+            fprintf(stderr, "Memory allocation failed for loop nests.\n");
+            return NULL;
+        }
+        graph->nests = nests;
+        graph->nestCapacity = newCapacity;
+    }
+    LoopNest* nest = &graph->nests[graph->nestCount++];
+    memset(nest, 0, sizeof(LoopNest));
+    nest->program = program;
+    nest->root = forNode;
+    return nest;
+}
+
+// Outermost for loops in source order; when the stack cannot grow the graph keeps the nests found so far
+static void findNests(ASTNode* program, DependenceGraph* graph) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return;
+    int base = walk->count;
+    int queued = pushWalkNode(walk, program);
+
+    while (queued && walk->count > base) {
+        ASTNode* node = walk->frames[--walk->count].node1;
+
+        if (node->type == NodeType_For) {
+            LoopNest* nest = addNest(graph, program, node);
+            if (nest) {
+                collectNestAccesses(node, nest);
+                analyzeNest(nest);
+            }
+            continue;
+        }
+
+        for (int i = node->childCount - 1; queued && i >= 0; i--) {
+            if (node->children[i]) queued = pushWalkNode(walk, node->children[i]);
+        }
+    }
+
+    if (!queued) fprintf(stderr, "Log: Loop nests left out: the traversal stack cannot grow.\n");
+    walk->count = base;
+}
+
+static int compareSignatures(const void* a, const void* b) {
+    unsigned long x = *(const unsigned long*)a, y = *(const unsigned long*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// One signature per nest shape and per edge; names are left out so renamed arrays still match
+static void buildSignatures(DependenceGraph* graph) {
+    int total = graph->nestCount;
+    for (int n = 0; n < graph->nestCount; n++) total += graph->nests[n].edgeCount;
+
+    graph->signatures = malloc(sizeof(unsigned long) * (total > 0 ? total : 1));
+    if (!graph->signatures) {
+        fprintf(stderr, "Memory allocation failed for dependence signatures.\n");
+        return;
+    }
+
+    for (int n = 0; n < graph->nestCount; n++) {
+        LoopNest* nest = &graph->nests[n];
+        unsigned long shape = mixSignature(0x6e657374UL, (unsigned long)nest->depth);
+        shape = mixSignature(shape, (unsigned long)nest->loopCount);
+        graph->signatures[graph->signatureCount++] = shape;
+
+        for (int e = 0; e < nest->edgeCount; e++) {
+            DependenceEdge* edge = &nest->edges[e];
+            unsigned long h = mixSignature(0x65646765UL, (unsigned long)edge->kind);
+            h = mixSignature(h, (unsigned long)edge->levels);
+            h = mixSignature(h, (unsigned long)nest->accesses[edge->source].subscriptCount);
+            for (int k = 0; k < edge->levels; k++) {
+                h = mixSignature(h, (unsigned long)(unsigned char)edge->direction[k]);
+                long d = edge->distanceKnown[k] ? edge->distance[k] : 99;
+                if (d > 8 && d != 99) d = 8;
+                if (d < -8) d = -8;
+                h = mixSignature(h, (unsigned long)(d + 128));
+            }
+            graph->signatures[graph->signatureCount++] = h;
+        }
+    }
+
+    qsort(graph->signatures, graph->signatureCount, sizeof(unsigned long), compareSignatures);
+}
+
+DependenceGraph* buildDependenceGraph(ASTNode* root) {
+    if (!root) return NULL;
+
+    DependenceGraph* graph = calloc(1, sizeof(DependenceGraph));
+    if (!graph) {
+        fprintf(stderr, "Memory allocation failed for dependence graph.\n");
+        return NULL;
+    }
+
+    findNests(root, graph);
+    buildSignatures(graph);
+
+    int edges = 0;
+    for (int n = 0; n < graph->nestCount; n++) edges += graph->nests[n].edgeCount;
+    fprintf(stderr, "Log: Dependence analysis found %d loop nests and %d edges.\n", graph->nestCount, edges);
+    return graph;
+}
+
+DependenceGraph* analyzeDependences(ASTNode* root) {
+    if (!root) return NULL;
+    if (!root->dependenceGraph) {
+        uint64_t started = statsPhaseStart();
+        root->dependenceGraph = buildDependenceGraph(root);
+        statsPhaseEnd(Phase_Dependences, started);
+    }
+    return root->dependenceGraph;
+}
+
+void freeDependenceGraph(DependenceGraph* graph) {
+    if (!graph) return;
+    for (int n = 0; n < graph->nestCount; n++) {
+        free(graph->nests[n].loops);
+        free(graph->nests[n].accesses);
+        free(graph->nests[n].edges);
+    }
+    free(graph->nests);
+    free(graph->signatures);
+    free(graph);
+}
+
+static const char* kindName(DependenceKind kind) {
+    switch (kind) {
+        case Dependence_Flow: return "flow";
+        case Dependence_Anti: return "anti";
+        case Dependence_Output: return "output";
+        default: return "unknown";
+    }
+}
+
+void printDependenceGraph(DependenceGraph* graph) {
+    if (!graph) {
+        printf("Dependence graph is NULL.\n");
+        return;
+    }
+
+    printf("Dependence graph: %d loop nests\n", graph->nestCount);
+    for (int n = 0; n < graph->nestCount; n++) {
+        LoopNest* nest = &graph->nests[n];
+        printf("  Nest %d: depth %d, %d loops, %d accesses, %d dependences\n",
+               n + 1, nest->depth, nest->loopCount, nest->accessCount, nest->edgeCount);
+
+        for (int e = 0; e < nest->edgeCount; e++) {
+            DependenceEdge* edge = &nest->edges[e];
+            AccessInfo* src = &nest->accesses[edge->source];
+            AccessInfo* snk = &nest->accesses[edge->sink];
+
+            printf("    %s %s#%d -> %s#%d direction (", kindName(edge->kind),
+                   displayName(src->node), edge->source, displayName(snk->node), edge->sink);
+            for (int k = 0; k < edge->levels; k++) {
+                printf("%s%c", k ? "," : "", edge->direction[k]);
+            }
+            printf(") distance (");
+            for (int k = 0; k < edge->levels; k++) {
+                if (edge->distanceKnown[k]) printf("%s%ld", k ? "," : "", edge->distance[k]);
+                else printf("%s?", k ? "," : "");
+            }
+            printf(")\n");
+        }
+    }
+}
+
+int compareDependenceGraphs(DependenceGraph* graph1, DependenceGraph* graph2) {
+    if (!graph1 || !graph2) return -1;
+    if (graph1->nestCount == 0 && graph2->nestCount == 0) return -1;
+
+    // Multiset intersection of the sorted signatures (Dice coefficient)
+    int i = 0, j = 0, shared = 0;
+    while (i < graph1->signatureCount && j < graph2->signatureCount) {
+        if (graph1->signatures[i] == graph2->signatures[j]) {
+            shared++;
+            i++;
+            j++;
+        } else if (graph1->signatures[i] < graph2->signatures[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+
+    int total = graph1->signatureCount + graph2->signatureCount;
+    int score = total > 0 ? (shared * 2 * 100) / total : 0;
+    fprintf(stderr, "Dependence graph similarity: %d shared signatures, score %d\n", shared, score);
+    return score;
+}
@@ -0,0 +1,82 @@
+#ifndef DEPENDENCE_H
+#define DEPENDENCE_H
+
+#include "ast.h"
+
+#define MAX_LOOP_DEPTH 8   // Deepest loop nest tracked per access
+#define MAX_SUBSCRIPTS 2   // Arrays are at most 2D in the grammar
+
+// A for (or while) loop inside a nest
+typedef struct LoopInfo {
+    ASTNode* node;
+    const char* variable;  // Loop variable, NULL when unknown
+    int slot;              // Affine slot of the variable, -1 when it has none
+    int parent;            // Enclosing loop within the nest, -1 for the outermost
+    int level;             // 0 for the outermost loop
+    int boundsKnown;
+    long lower, upper;     // Inclusive iteration range when boundsKnown
+    int step;              // +1 / -1, 0 when unknown
+} LoopInfo;
+
+// Subscript as sum(coefficients[k] * loop variable at level k) + constant
+typedef struct AffineSubscript {
+    long coefficients[MAX_LOOP_DEPTH];
+    long constant;
+    int isAffine;
+} AffineSubscript;
+
+typedef struct AccessInfo {
+    ASTNode* node;
+    const char* arrayName;
+    int isWrite;
+    int loop;              // Innermost enclosing loop within the nest
+    int depth;             // Number of enclosing loops
+    int loopChain[MAX_LOOP_DEPTH]; // Enclosing loops from outermost to innermost
+    int subscriptCount;
+    AffineSubscript subscripts[MAX_SUBSCRIPTS];
+} AccessInfo;
+
+typedef enum DependenceKind {
+    Dependence_Flow,    // write then read
+    Dependence_Anti,    // read then write
+    Dependence_Output   // write then write
+} DependenceKind;
+
+typedef struct DependenceEdge {
+    int source, sink;      // Indices into the nest's accesses
+    DependenceKind kind;
+    int levels;            // Number of loops common to source and sink
+    char direction[MAX_LOOP_DEPTH]; // '<', '=', '>' or '*' per common loop
+    int distanceKnown[MAX_LOOP_DEPTH];
+    long distance[MAX_LOOP_DEPTH];
+} DependenceEdge;
+
+typedef struct LoopNest {
+    ASTNode* program;      // Root node owning the affine slot table
+    ASTNode* root;         // Outermost for loop
+    LoopInfo* loops;
+    int loopCount, loopCapacity;
+    int depth;
+    AccessInfo* accesses;
+    int accessCount, accessCapacity;
+    DependenceEdge* edges;
+    int edgeCount, edgeCapacity;
+} LoopNest;
+
+// Per-program dependence graph, stored on the Root node by analyzeDependences()
+typedef struct DependenceGraph {
+    LoopNest* nests;
+    int nestCount, nestCapacity;
+    unsigned long* signatures; // Sorted edge and nest signatures used for comparison
+    int signatureCount;
+} DependenceGraph;
+
+DependenceGraph* buildDependenceGraph(ASTNode* root);
+DependenceGraph* analyzeDependences(ASTNode* root);
+void freeDependenceGraph(DependenceGraph* graph);
+void printDependenceGraph(DependenceGraph* graph);
+
+// 0-100 similarity of two precomputed graphs, -1 when neither has any loop nest
+int compareDependenceGraphs(DependenceGraph* graph1, DependenceGraph* graph2);
+
+#endif
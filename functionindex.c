@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "functionindex.h"
+#include "stats.h"
+#include "simalloc.h"
+#include "budget.h"
+
+static unsigned long mixKey(unsigned long h, unsigned long v) {
+    return h ^ (v + 0x9e3779b97f4a7c15UL + (h << 6) + (h >> 2));
+}
+
+static int isNestingNode(ASTNode* node) {
+    return node->type == NodeType_For || node->type == NodeType_While ||
+           node->type == NodeType_If || node->type == NodeType_IfElse;
+}
+
+// Most loops and conditionals on one path down the body. Each frame holds a node in
+// node1 and the nesting nodes from the body down to it in level; when the stack cannot
+// grow, the depth is that of the paths seen so far.
+static int featureDepth(ASTNode* body) {
+    WalkStack* walk = threadWalkStack();
+    if (!body || !walk) return 0;
+    int base = walk->count;
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return 0;
+    frame->node1 = body;
+    frame->level = isNestingNode(body);
+
+    int maxDepth = 0;
+    while (walk->count > base) {
+        WalkFrame current = walk->frames[--walk->count];
+        if (current.level > maxDepth) maxDepth = current.level;
+        for (int i = 0; i < current.node1->childCount; i++) {
+            ASTNode* child = current.node1->children[i];
+            if (!child) continue;
+            if (!(frame = pushWalkFrame(walk))) {
+                walk->count = base;
+                return maxDepth;
+            }
+            frame->node1 = child;
+            frame->level = current.level + isNestingNode(child);
+        }
+    }
+    return maxDepth;
+}
+
+// In source order, so the first return statement decides the return shape; when the stack
+// cannot grow, the signature keeps the features counted so far
+static void collectFeatures(ASTNode* body, FunctionSignature* signature) {
+    WalkStack* walk = threadWalkStack();
+    if (!body || !walk) return;
+    int base = walk->count;
+    int queued = pushWalkNode(walk, body);
+
+    while (queued && walk->count > base) {
+        ASTNode* node = walk->frames[--walk->count].node1;
+
+        switch (node->type) {
+            case NodeType_For:
+            case NodeType_While:
+                signature->features[Feature_Loops]++;
+                break;
+            case NodeType_If:
+            case NodeType_IfElse:
+                signature->features[Feature_Conditionals]++;
+                break;
+            case NodeType_ArrayAccess:
+                signature->features[Feature_ArrayAccesses]++;
+                break;
+            case NodeType_ArrayDeclaration:
+                signature->features[Feature_ArrayDeclarations]++;
+                break;
+            case NodeType_Assignment:
+                signature->features[Feature_Assignments]++;
+                break;
+            case NodeType_FunctionCall:
+                signature->features[Feature_Calls]++;
+                break;
+            case NodeType_Return:
+                signature->features[Feature_Returns]++;
+                if (signature->returnShape == ReturnShape_None && node->childCount > 0 && node->children[0]) {
+                    switch (node->children[0]->type) {
+                        case NodeType_Constant: signature->returnShape = ReturnShape_Constant; break;
+                        case NodeType_Identifier: signature->returnShape = ReturnShape_Identifier; break;
+                        case NodeType_ArrayAccess: signature->returnShape = ReturnShape_ArrayAccess; break;
+                        case NodeType_FunctionCall: signature->returnShape = ReturnShape_Call; break;
+                        default: signature->returnShape = ReturnShape_Expression; break;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+
+        for (int i = node->childCount - 1; queued && i >= 0; i--) {
+            if (node->children[i]) queued = pushWalkNode(walk, node->children[i]);
+        }
+    }
+    walk->count = base;
+}
+
+void computeFunctionSignature(ASTNode* function, FunctionSignature* signature) {
+    memset(signature, 0, sizeof(FunctionSignature));
+    signature->function = function;
+    signature->name = function->name;
+    signature->isMain = function->type == NodeType_MainFunction;
+
+    if (signature->isMain) {
+        signature->body = function->body;
+    } else if (function->childCount == 2) {
+        ASTNode* paramList = function->children[0];
+        signature->body = function->children[1];
+        for (int i = 0; paramList && i < paramList->childCount; i++) {
+            ASTNode* param = paramList->children[i];
+            if (param->type != NodeType_Parameter) continue;
+            signature->paramCount++;
+            if (param->dataType && strcmp(param->dataType, "int[]") == 0) {
+                signature->arrayParamCount++;
+            }
+        }
+    }
+
+    collectFeatures(signature->body, signature);
+    signature->features[Feature_Depth] = featureDepth(signature->body);
+
+    unsigned long key = mixKey(0, (unsigned long)signature->isMain);
+    key = mixKey(key, (unsigned long)signature->paramCount);
+    key = mixKey(key, (unsigned long)signature->arrayParamCount);
+    key = mixKey(key, (unsigned long)signature->returnShape);
+    signature->key = key;
+    signature->coarseKey = mixKey(mixKey(0, (unsigned long)signature->isMain), (unsigned long)signature->paramCount);
+}
+
+static int appendFunctions(ASTNode* root, NodeType type, FunctionIndex* index, int capacity) {
+    int count = 0;
+    ASTNode** functions = collectNodesOfType(root, type, &count);
+    for (int i = 0; i < count && index->count < capacity; i++) {
+        computeFunctionSignature(functions[i], &index->signatures[index->count++]);
+    }
+    simFree(functions);
+    return count;
+}
+
+int buildFunctionIndex(ASTNode* root, FunctionIndex* index) {
+    memset(index, 0, sizeof(FunctionIndex));
+    if (!root) return 0;
+
+    int capacity = countNodesOfType(root, NodeType_FunctionDef) + countNodesOfType(root, NodeType_MainFunction);
+    if (capacity <= 0) return 0;
+
+    index->signatures = simCalloc(capacity, sizeof(FunctionSignature), Alloc_FunctionIndex);
+    if (!index->signatures) {
+        fprintf(stderr, "Memory allocation failed for function signatures.\n");
+        return 0;
+    }
+
+    appendFunctions(root, NodeType_FunctionDef, index, capacity);
+    appendFunctions(root, NodeType_MainFunction, index, capacity);
+
+    // Power-of-two bucket count keeps lookups O(1) on average
+    index->bucketCount = 1;
+    while (index->bucketCount < index->count * 2) index->bucketCount <<= 1;
+
+    index->buckets = simMalloc(sizeof(int) * index->bucketCount, Alloc_FunctionIndex);
+    index->coarseBuckets = simMalloc(sizeof(int) * index->bucketCount, Alloc_FunctionIndex);
+    index->next = simMalloc(sizeof(int) * index->count, Alloc_FunctionIndex);
+    index->prev = simMalloc(sizeof(int) * index->count, Alloc_FunctionIndex);
+    index->coarseNext = simMalloc(sizeof(int) * index->count, Alloc_FunctionIndex);
+    index->coarsePrev = simMalloc(sizeof(int) * index->count, Alloc_FunctionIndex);
+    if (!index->buckets || !index->coarseBuckets || !index->next || !index->prev || !index->coarseNext || !index->coarsePrev) {
+        fprintf(stderr, "Memory allocation failed for function index buckets.\n");
+        freeFunctionIndex(index);
+        return 0;
+    }
+
+    for (int b = 0; b < index->bucketCount; b++) {
+        index->buckets[b] = -1;
+        index->coarseBuckets[b] = -1;
+    }
+    // Insert in reverse so each chain lists functions in source order
+    for (int i = index->count - 1; i >= 0; i--) {
+        int b = (int)(index->signatures[i].key & (unsigned long)(index->bucketCount - 1));
+        index->next[i] = index->buckets[b];
+        index->prev[i] = -1;
+        if (index->buckets[b] >= 0) index->prev[index->buckets[b]] = i;
+        index->buckets[b] = i;
+
+        int cb = (int)(index->signatures[i].coarseKey & (unsigned long)(index->bucketCount - 1));
+        index->coarseNext[i] = index->coarseBuckets[cb];
+        index->coarsePrev[i] = -1;
+        if (index->coarseBuckets[cb] >= 0) index->coarsePrev[index->coarseBuckets[cb]] = i;
+        index->coarseBuckets[cb] = i;
+    }
+
+    fprintf(stderr, "Log: Indexed %d functions in %d buckets.\n", index->count, index->bucketCount);
+    return index->count;
+}
+
+void freeFunctionIndex(FunctionIndex* index) {
+    simFree(index->signatures);
+    simFree(index->buckets);
+    simFree(index->next);
+    simFree(index->prev);
+    simFree(index->coarseBuckets);
+    simFree(index->coarseNext);
+    simFree(index->coarsePrev);
+    memset(index, 0, sizeof(FunctionIndex));
+}
+
+static int featureDistance(const FunctionSignature* a, const FunctionSignature* b) {
+    int distance = 0;
+    for (int f = 0; f < FUNCTION_FEATURE_COUNT; f++) {
+        distance += abs(a->features[f] - b->features[f]);
+    }
+    return distance;
+}
+
+// Weighted Jaccard similarity of two feature vectors, 0-100; the cheap stand-in for a
+// body comparison once the comparison budget has run out
+static int featureSimilarity(const FunctionSignature* a, const FunctionSignature* b) {
+    int shared = 0, combined = 0;
+    for (int f = 0; f < FUNCTION_FEATURE_COUNT; f++) {
+        shared += min(a->features[f], b->features[f]);
+        combined += max(a->features[f], b->features[f]);
+    }
+    return combined > 0 ? shared * 100 / combined : 100;
+}
+
+// Closest candidate in the bucket chain starting at head, or -1. Matched functions are
+// unlinked from the chains and at most FUNCTION_CANDIDATE_LIMIT candidates with the probe's
+// key are weighed, so a probe costs O(1) however many functions share a signature.
+static int bestCandidate(const FunctionIndex* index, const int* chain, int head, int coarse,
+                         const FunctionSignature* probe) {
+    int best = -1, bestDistance = 0, candidates = 0;
+    for (int i = head; i >= 0 && candidates < FUNCTION_CANDIDATE_LIMIT; i = chain[i]) {
+        const FunctionSignature* candidate = &index->signatures[i];
+        if (coarse ? candidate->coarseKey != probe->coarseKey : candidate->key != probe->key) continue;
+        candidates++;
+        int distance = featureDistance(candidate, probe);
+        if (best < 0 || distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+            if (distance == 0) break; // Ties keep the earlier candidate anyway
+        }
+    }
+    return best;
+}
+
+static void unlinkFromChain(int* buckets, int* next, int* prev, unsigned long key, int bucketCount, int i) {
+    if (prev[i] >= 0) next[prev[i]] = next[i];
+    else buckets[key & (unsigned long)(bucketCount - 1)] = next[i];
+    if (next[i] >= 0) prev[next[i]] = prev[i];
+}
+
+// Takes a matched function out of both chains so later probes never walk past it
+static void unlinkSignature(FunctionIndex* index, int i) {
+    unlinkFromChain(index->buckets, index->next, index->prev, index->signatures[i].key, index->bucketCount, i);
+    unlinkFromChain(index->coarseBuckets, index->coarseNext, index->coarsePrev, index->signatures[i].coarseKey,
+                    index->bucketCount, i);
+}
+
+static void collectCalls(ASTNode* node, ASTNode*** calls, int* count, int* capacity) {
+    traverseAndCollect(node, NodeType_FunctionCall, calls, count, capacity);
+}
+
+// Average of the capped call scores for calls paired in source order
+static int compareCallSequences(ASTNode* body1, ASTNode* body2) {
+    int count1 = 0, count2 = 0, capacity1 = 10, capacity2 = 10;
+    ASTNode** calls1 = simMalloc(sizeof(ASTNode*) * capacity1, Alloc_Scratch);
+    ASTNode** calls2 = simMalloc(sizeof(ASTNode*) * capacity2, Alloc_Scratch);
+    if (!calls1 || !calls2) {
+        simFree(calls1);
+        simFree(calls2);
+        return -1;
+    }
+    collectCalls(body1, &calls1, &count1, &capacity1);
+    collectCalls(body2, &calls2, &count2, &capacity2);
+
+    int score = -1;
+    int paired = min(count1, count2);
+    if (paired > 0) {
+        int sum = 0;
+        for (int i = 0; i < paired; i++) {
+            int callScore = compareFunctionCalls(calls1[i], calls2[i]);
+            sum += callScore > 100 ? 100 : (callScore < 0 ? 0 : callScore);
+        }
+        score = (sum / paired) * paired / max(count1, count2);
+    } else if (count1 + count2 > 0) {
+        score = 0;
+    }
+
+    simFree(calls1);
+    simFree(calls2);
+    return score;
+}
+
+static int scoreFunctionPair(const FunctionSignature* reference, const FunctionSignature* student) {
+    statsCount(Stat_FunctionPairs, 1);
+    ASTNode* body1 = reference->body;
+    ASTNode* body2 = student->body;
+    if (body1 && body2 && body1->canonical && body2->canonical && body1->structHash == body2->structHash &&
+        sameStructure(body1, body2)) {
+        return 100; // Identical canonical bodies
+    }
+
+    int bodyScore = compareFunctionBodies(reference->body, student->body);
+    if (bodyScore < 0) bodyScore = 0;
+    if (bodyScore > 100) bodyScore = 100;
+
+    int callScore = compareCallSequences(reference->body, student->body);
+    if (callScore < 0) return bodyScore;
+    return (bodyScore * 3 + callScore) / 4;
+}
+
+FunctionPairCache* createFunctionPairCache(void) {
+    FunctionPairCache* cache = calloc(1, sizeof(FunctionPairCache));
+    if (!cache) fprintf(stderr, "Memory allocation failed for function pair cache.\n");
+    return cache;
+}
+
+void freeFunctionPairCache(FunctionPairCache* cache) {
+    if (cache) {
+        fprintf(stderr, "Log: Function pair cache: %lu hits, %lu misses.\n", cache->hits, cache->misses);
+    }
+    free(cache);
+}
+
+// Only canonical bodies have a structHash that identifies them
+static int pairCacheable(const FunctionSignature* reference, const FunctionSignature* student) {
+    return reference->body && student->body && reference->body->canonical && student->body->canonical;
+}
+
+static FunctionPairEntry* pairSlot(FunctionPairCache* cache, unsigned long referenceHash, unsigned long studentHash) {
+    unsigned long h = referenceHash * 0x9E3779B97F4A7C15UL ^ studentHash;
+    h ^= h >> 29;
+    unsigned long mask = FUNCTION_PAIR_CACHE_SIZE - 1;
+    for (unsigned long i = 0; i < FUNCTION_PAIR_CACHE_SIZE; i++) {
+        FunctionPairEntry* slot = &cache->slots[(h + i) & mask];
+        if (!slot->used || (slot->referenceHash == referenceHash && slot->studentHash == studentHash)) return slot;
+    }
+    return NULL;
+}
+
+static int cachedPairScore(FunctionPairCache* cache, const FunctionSignature* reference, const FunctionSignature* student) {
+    if (!cache || !pairCacheable(reference, student)) return scoreFunctionPair(reference, student);
+
+    unsigned long referenceHash = reference->body->structHash, studentHash = student->body->structHash;
+    FunctionPairEntry* slot = pairSlot(cache, referenceHash, studentHash);
+    if (slot && slot->used) {
+        cache->hits++;
+        return slot->score;
+    }
+    cache->misses++;
+    int score = scoreFunctionPair(reference, student);
+    if (budgetRanOut()) return score; // Cut short; the caller replaces it
+
+    // Keep the table at most half full; starting over is cheaper than evicting
+    if (cache->count >= FUNCTION_PAIR_CACHE_SIZE / 2) {
+        memset(cache->slots, 0, sizeof(cache->slots));
+        cache->count = 0;
+        slot = pairSlot(cache, referenceHash, studentHash);
+    }
+    slot->referenceHash = referenceHash;
+    slot->studentHash = studentHash;
+    slot->score = score;
+    slot->used = 1;
+    cache->count++;
+    return score;
+}
+
+// The reference function a student function is paired with, taken out of the index, or -1:
+// the closest with the same signature, else the closest with the same parameter count
+static int matchSignature(FunctionIndex* reference, const FunctionSignature* probe) {
+    if (reference->count == 0) return -1;
+    int mask = reference->bucketCount - 1;
+    int match = bestCandidate(reference, reference->next, reference->buckets[probe->key & (unsigned long)mask], 0, probe);
+    if (match < 0) {
+        match = bestCandidate(reference, reference->coarseNext, reference->coarseBuckets[probe->coarseKey & (unsigned long)mask], 1, probe);
+    }
+    if (match >= 0) unlinkSignature(reference, match);
+    return match;
+}
+
+int pairFunctionSets(ASTNode* root1, ASTNode* root2, FunctionPair** pairs) {
+    *pairs = NULL;
+    FunctionIndex reference, student;
+    buildFunctionIndex(root1, &reference);
+    buildFunctionIndex(root2, &student);
+
+    int count = 0;
+    if (reference.count > 0 && student.count > 0) {
+        *pairs = simMalloc(sizeof(FunctionPair) * student.count, Alloc_Scratch);
+        if (!*pairs) {
+            fprintf(stderr, "Memory allocation failed for function pairs.\n");
+            count = -1;
+        }
+    }
+    for (int s = 0; *pairs && s < student.count; s++) {
+        int match = matchSignature(&reference, &student.signatures[s]);
+        if (match < 0) continue;
+        (*pairs)[count].reference = reference.signatures[match].function;
+        (*pairs)[count].student = student.signatures[s].function;
+        count++;
+    }
+
+    freeFunctionIndex(&reference);
+    freeFunctionIndex(&student);
+    return count;
+}
+
+int compareFunctionSets(ASTNode* root1, ASTNode* root2, MatchTable* table) {
+    return compareFunctionSetsCached(root1, root2, table, NULL);
+}
+
+int compareFunctionSetsCached(ASTNode* root1, ASTNode* root2, MatchTable* table, FunctionPairCache* cache) {
+    FunctionIndex reference, student;
+    buildFunctionIndex(root1, &reference);
+    buildFunctionIndex(root2, &student);
+
+    if (reference.count == 0 && student.count == 0) {
+        freeFunctionIndex(&reference);
+        freeFunctionIndex(&student);
+        return -1;
+    }
+
+    int totalScore = 0;
+    for (int s = 0; s < student.count && reference.count > 0; s++) {
+        const FunctionSignature* probe = &student.signatures[s];
+        int match = matchSignature(&reference, probe);
+        if (match < 0) {
+            fprintf(stderr, "No signature match for function %s.\n", probe->name);
+            continue;
+        }
+
+        const FunctionSignature* matched = &reference.signatures[match];
+        int pairScore = budgetExhausted() ? 0 : cachedPairScore(cache, matched, probe);
+        if (budgetRanOut()) { // Before or during the body comparison
+            pairScore = featureSimilarity(matched, probe);
+            fprintf(stderr, "Function %s matched %s by signature, estimated score %d.\n", probe->name, matched->name, pairScore);
+        } else {
+            fprintf(stderr, "Function %s matched %s by signature, score %d.\n", probe->name, matched->name, pairScore);
+        }
+        totalScore += pairScore;
+
+        if (table) {
+            MatchEntry entry = {
+                .nodeName1 = simStrdup(matched->name, Alloc_MatchTable),
+                .nodeName2 = simStrdup(probe->name, Alloc_MatchTable),
+                .totalScore = pairScore,
+                .details = "Function matched by signature"
+            };
+            addMatchEntry(table, entry);
+        }
+    }
+
+    // Unmatched functions on either side count as zero
+    int score = totalScore / max(reference.count, student.count);
+
+    freeFunctionIndex(&reference);
+    freeFunctionIndex(&student);
+    return score;
+}
@@ -0,0 +1,99 @@
+#ifndef FUNCTIONINDEX_H
+#define FUNCTIONINDEX_H
+
+#include "ast.h"
+
+// Return shapes used in function signatures
+typedef enum ReturnShape {
+    ReturnShape_None,
+    ReturnShape_Constant,
+    ReturnShape_Identifier,
+    ReturnShape_Expression,
+    ReturnShape_ArrayAccess,
+    ReturnShape_Call
+} ReturnShape;
+
+// Body feature vector slots
+typedef enum FunctionFeature {
+    Feature_Loops,
+    Feature_Conditionals,
+    Feature_ArrayAccesses,
+    Feature_ArrayDeclarations,
+    Feature_Assignments,
+    Feature_Calls,
+    Feature_Returns,
+    Feature_Depth,
+    FUNCTION_FEATURE_COUNT
+} FunctionFeature;
+
+typedef struct FunctionSignature {
+    ASTNode* function;      // FunctionDef or MainFunction node
+    ASTNode* body;          // Body node of the function
+    const char* name;
+    int isMain;
+    int paramCount;
+    int arrayParamCount;
+    ReturnShape returnShape;
+    int features[FUNCTION_FEATURE_COUNT];
+    unsigned long key;      // Hash of the exact signature
+    unsigned long coarseKey; // Hash of the parameter count only
+} FunctionSignature;
+
+// Hashed index over the functions of one AST. Buckets are doubly chained through
+// next/prev and coarseNext/coarsePrev so matched functions can be unlinked.
+typedef struct FunctionIndex {
+    FunctionSignature* signatures;
+    int count;
+    int bucketCount;
+    int* buckets;
+    int* next;
+    int* prev;
+    int* coarseBuckets;
+    int* coarseNext;
+    int* coarsePrev;
+} FunctionIndex;
+
+#define FUNCTION_CANDIDATE_LIMIT 32  // Same-key candidates weighed per probe
+
+int buildFunctionIndex(ASTNode* root, FunctionIndex* index);
+void freeFunctionIndex(FunctionIndex* index);
+void computeFunctionSignature(ASTNode* function, FunctionSignature* signature);
+
+// Matches the functions of root2 against those of root1 through the signature index and
+// compares the bodies of matched pairs. Returns a 0-100 score, or -1 when neither AST has functions.
+int compareFunctionSets(ASTNode* root1, ASTNode* root2, MatchTable* table);
+
+typedef struct FunctionPair {
+    ASTNode* reference;     // FunctionDef or MainFunction node of root1
+    ASTNode* student;       // The function of root2 paired with it
+} FunctionPair;
+
+// The pairs compareFunctionSets scores, without comparing any bodies. Returns how many were
+// stored in *pairs, which the caller releases with simFree, or -1 when they cannot be stored.
+int pairFunctionSets(ASTNode* root1, ASTNode* root2, FunctionPair** pairs);
+
+#define FUNCTION_PAIR_CACHE_SIZE 4096  // Slots; must be a power of two
+
+// Scores of function pairs keyed by the canonical structural hashes of the two bodies.
+// A pair score depends only on the two bodies, so it carries over between revisions of
+// a submission for every function that did not change.
+typedef struct FunctionPairEntry {
+    unsigned long referenceHash;
+    unsigned long studentHash;
+    int score;
+    int used;
+} FunctionPairEntry;
+
+typedef struct FunctionPairCache {
+    FunctionPairEntry slots[FUNCTION_PAIR_CACHE_SIZE];
+    int count;
+    unsigned long hits, misses;
+} FunctionPairCache;
+
+FunctionPairCache* createFunctionPairCache(void);
+void freeFunctionPairCache(FunctionPairCache* cache);
+
+// compareFunctionSets with pair scores taken from and stored in cache (may be NULL)
+int compareFunctionSetsCached(ASTNode* root1, ASTNode* root2, MatchTable* table, FunctionPairCache* cache);
+
+#endif
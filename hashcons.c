@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hashcons.h"
+#include "stats.h"
+#include "simalloc.h"
+
+#define SHARE_TABLE_INITIAL 1024
+
+// Chained hash table of the shared nodes, keyed by structural hash and source name.
+// Chains make removing a node freed by its last release easy.
+typedef struct ShareEntry {
+    ASTNode* node;
+    struct ShareEntry* next;
+} ShareEntry;
+
+static int sharingEnabled;
+static pthread_mutex_t shareLock = PTHREAD_MUTEX_INITIALIZER;
+static ShareEntry** buckets;
+static size_t bucketCount, entryCount;
+static AllocAccount* sharedMemory;
+static int sharedMemoryCreated;
+
+void enableExpressionSharing(void) {
+    sharingEnabled = 1;
+}
+
+int expressionSharingEnabled(void) {
+    return sharingEnabled;
+}
+
+// The canonical hash covers everything but the source name, which the reports print
+static unsigned long shareKey(const ASTNode* node) {
+    unsigned long h = node->structHash;
+    for (const char* s = node->sourceName; s && *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static int sameString(const char* a, const char* b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+// Identifiers, constants and expressions over them, with nothing else attached
+static int isShareable(const ASTNode* node) {
+    if (node->type != NodeType_Identifier && node->type != NodeType_Constant &&
+        node->type != NodeType_Number && node->type != NodeType_Expression) {
+        return 0;
+    }
+    return node->canonical && !node->params && !node->indices && !node->dimSize && !node->extra &&
+           !node->condition && !node->body && !node->functions && !node->mainFunction &&
+           !node->initializationExpression && !node->increment && !node->left && !node->right &&
+           !node->initExpr && !node->indexExpr && !node->arrayType && !node->arrayName &&
+           !node->affine && !node->linearAffine && !node->affineSlots && !node->dependenceGraph && !node->costProfile;
+}
+
+// Children are shared before their parent, so equal subtrees have identical children
+static int sameShape(const ASTNode* shared, const ASTNode* node) {
+    if (shared->structHash != node->structHash || shared->type != node->type ||
+        shared->operation != node->operation || shared->childCount != node->childCount) {
+        return 0;
+    }
+    if (!sameString(shared->name, node->name) || !sameString(shared->value, node->value) ||
+        !sameString(shared->dataType, node->dataType) || !sameString(shared->sourceName, node->sourceName)) {
+        return 0;
+    }
+    for (int i = 0; i < node->childCount; i++) {
+        if (shared->children[i] != node->children[i]) return 0;
+    }
+    return 1;
+}
+
+static char* copyString(const char* text, AllocTag tag) {
+    return text ? simStrdup(text, tag) : NULL;
+}
+
+// Called with shareLock held. The copy takes a reference to each (shared) child.
+static ASTNode* createSharedNode(const ASTNode* node) {
+    AllocTag tag = nodeAllocTag(node->type);
+    ASTNode* shared = simMalloc(sizeof(ASTNode), tag);
+    if (!shared) return NULL;
+    *shared = *node;
+    shared->name = copyString(node->name, tag);
+    shared->value = copyString(node->value, tag);
+    shared->dataType = copyString(node->dataType, tag);
+    shared->sourceName = copyString(node->sourceName, tag);
+    shared->parent = NULL;
+    shared->children = node->childCount > 0 ? simMalloc(sizeof(ASTNode*) * node->childCount, tag) : NULL;
+    shared->capacity = node->childCount;
+    shared->shareCount = 0;
+
+    if ((node->name && !shared->name) || (node->value && !shared->value) || (node->dataType && !shared->dataType) ||
+        (node->sourceName && !shared->sourceName) || (node->childCount > 0 && !shared->children)) {
+        shared->childCount = 0;
+        freeASTNode(shared);
+        return NULL;
+    }
+    for (int i = 0; i < node->childCount; i++) {
+        shared->children[i] = node->children[i];
+        shared->children[i]->shareCount++;
+    }
+    shared->shareCount = 1;
+    return shared;
+}
+
+static int growShareTable(void) {
+    size_t newCount = bucketCount ? bucketCount * 2 : SHARE_TABLE_INITIAL;
+    ShareEntry** newBuckets = calloc(newCount, sizeof(ShareEntry*));
+    if (!newBuckets) {
+        fprintf(stderr, "Memory allocation failed while growing the shared expression table.\n");
+        return 0;
+    }
+    for (size_t b = 0; b < bucketCount; b++) {
+        ShareEntry* entry = buckets[b];
+        while (entry) {
+            ShareEntry* next = entry->next;
+            size_t slot = shareKey(entry->node) & (newCount - 1);
+            entry->next = newBuckets[slot];
+            newBuckets[slot] = entry;
+            entry = next;
+        }
+    }
+    free(buckets);
+    buckets = newBuckets;
+    bucketCount = newCount;
+    return 1;
+}
+
+// The shared node equal to node, with a new reference taken, or NULL when out of memory
+static ASTNode* internNode(const ASTNode* node) {
+    pthread_mutex_lock(&shareLock);
+    if (entryCount >= bucketCount && !growShareTable() && !bucketCount) {
+        pthread_mutex_unlock(&shareLock);
+        return NULL;
+    }
+
+    size_t slot = shareKey(node) & (bucketCount - 1);
+    for (ShareEntry* entry = buckets[slot]; entry; entry = entry->next) {
+        if (sameShape(entry->node, node)) {
+            entry->node->shareCount++;
+            pthread_mutex_unlock(&shareLock);
+            return entry->node;
+        }
+    }
+
+    if (!sharedMemoryCreated) {
+        sharedMemory = createAllocAccount("shared expressions");
+        sharedMemoryCreated = 1;
+    }
+    AllocAccount* previous = enterAllocAccount(sharedMemory);
+    ASTNode* shared = createSharedNode(node);
+    enterAllocAccount(previous);
+    ShareEntry* entry = shared ? malloc(sizeof(ShareEntry)) : NULL;
+    if (!entry) {
+        if (shared) {
+            fprintf(stderr, "Memory allocation failed for a shared expression entry.\n");
+            for (int i = 0; i < shared->childCount; i++) shared->children[i]->shareCount--;
+            shared->childCount = 0;
+            shared->shareCount = 0;
+            freeASTNode(shared);
+        }
+        pthread_mutex_unlock(&shareLock);
+        return NULL;
+    }
+    entry->node = shared;
+    entry->next = buckets[slot];
+    buckets[slot] = entry;
+    entryCount++;
+    pthread_mutex_unlock(&shareLock);
+    return shared;
+}
+
+ASTNode* retainSharedNode(ASTNode* node) {
+    pthread_mutex_lock(&shareLock);
+    node->shareCount++;
+    pthread_mutex_unlock(&shareLock);
+    return node;
+}
+
+int releaseSharedNode(ASTNode* node) {
+    pthread_mutex_lock(&shareLock);
+    int last = --node->shareCount == 0;
+    if (last) {
+        ShareEntry** link = &buckets[shareKey(node) & (bucketCount - 1)];
+        while (*link && (*link)->node != node) link = &(*link)->next;
+        if (*link) {
+            ShareEntry* entry = *link;
+            *link = entry->next;
+            free(entry);
+            entryCount--;
+        }
+    }
+    pthread_mutex_unlock(&shareLock);
+    return last;
+}
+
+// Whether one of the node's pointer fields refers to the child, as main's body does
+static int isAliased(const ASTNode* node, const ASTNode* child) {
+    return node->body == child || node->functions == child || node->mainFunction == child ||
+           node->condition == child || node->initExpr == child || node->indexExpr == child ||
+           node->initializationExpression == child || node->increment == child ||
+           node->left == child || node->right == child;
+}
+
+// Queues a subtree to be shared; its frame holds it in node1, whether its parent may point
+// at a shared node instead in mode, and in score whether it can still be shared itself
+static int pushSharedSubtree(WalkStack* walk, ASTNode* node, int replaceable) {
+    WalkFrame* frame = pushWalkFrame(walk);
+    if (!frame) return 0;
+    frame->node1 = node;
+    frame->mode = replaceable;
+    frame->score = replaceable && isShareable(node);
+    return 1;
+}
+
+// Shares the subtrees below each node, then the node itself when it can be and nothing
+// else refers to it; the parent's child or index then points at the shared node. A frame's
+// next counts its children, then an array access's indices. A subtree that cannot be queued
+// is left unshared, and so is every node above it.
+static void shareSubtrees(ASTNode* root, int* replaced) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk || !root || root->shareCount) return;
+    int base = walk->count;
+    if (!pushSharedSubtree(walk, root, 0)) return;
+
+    while (walk->count > base) {
+        WalkFrame* frame = &walk->frames[walk->count - 1];
+        ASTNode* node = frame->node1;
+        int indexCount = node->type == NodeType_ArrayAccess ? node->indexCount : 0;
+
+        if (frame->next < node->childCount + indexCount) {
+            int isChild = frame->next < node->childCount;
+            ASTNode* part = isChild ? node->children[frame->next] : node->indices[frame->next - node->childCount];
+            if (part && !part->shareCount && pushSharedSubtree(walk, part, !isChild || !isAliased(node, part))) continue;
+
+            frame = &walk->frames[walk->count - 1];
+            if (isChild && (!part || !part->shareCount)) frame->score = 0;
+            frame->next++;
+            continue;
+        }
+
+        ASTNode* result = node;
+        if (frame->score) {
+            ASTNode* shared = internNode(node);
+            if (shared) {
+                freeASTNode(node); // Releases its children, which the shared node holds as well
+                (*replaced)++;
+                result = shared;
+            }
+        }
+        if (--walk->count == base) return;
+
+        WalkFrame* parent = &walk->frames[walk->count - 1];
+        int k = parent->next++;
+        if (k < parent->node1->childCount) {
+            parent->node1->children[k] = result;
+            if (!result->shareCount) parent->score = 0;
+        } else {
+            parent->node1->indices[k - parent->node1->childCount] = result;
+        }
+    }
+}
+
+int shareExpressions(ASTNode* root) {
+    if (!sharingEnabled || !root) return 0;
+
+    int replaced = 0;
+    shareSubtrees(root, &replaced);
+    statsCount(Stat_SharedNodes, (uint64_t)replaced);
+
+    pthread_mutex_lock(&shareLock);
+    size_t distinct = entryCount;
+    pthread_mutex_unlock(&shareLock);
+    fprintf(stderr, "Log: Shared %d expression nodes of %s; %zu distinct shared nodes in use.\n",
+            replaced, root->name ? root->name : "Unnamed", distinct);
+    return replaced;
+}
@@ -0,0 +1,31 @@
+#ifndef HASHCONS_H
+#define HASHCONS_H
+
+#include "ast.h"
+
+// Optional hash-consing of expression subtrees across every tree of a run. Once a tree
+// is canonicalized, its identifiers, constants and the expressions built only from
+// them are replaced by shared read-only nodes from one process-wide table, so `i`,
+// `i + 1` or `i * v1 + j` exist once however many submissions contain them, and two
+// trees holding the same shared node compare it by identity.
+//
+// Trees are still written to while they are built and canonicalized, so nodes are
+// shared after canonicalizeAST() and before analyzeDependences(), never in the builders.
+// A shared node carries the number of references to it in shareCount; freeASTNode()
+// drops one and frees the node with the last. Its memory is charged to a "shared
+// expressions" account rather than to any submission.
+
+// Off by default; turn it on before anything is parsed
+void enableExpressionSharing(void);
+int expressionSharingEnabled(void);
+
+// Replaces the shareable subtrees of a canonical tree by shared nodes. Returns the
+// number of nodes replaced, 0 while sharing is off.
+int shareExpressions(ASTNode* root);
+
+// Reference counting of shared nodes, thread-safe. releaseSharedNode returns 1 when it
+// dropped the last reference: the node has left the table and the caller frees it.
+ASTNode* retainSharedNode(ASTNode* node);
+int releaseSharedNode(ASTNode* node);
+
+#endif
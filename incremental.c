@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "incremental.h"
+#include "resultcache.h"
+
+/* ---- Chunking ---- */
+
+static int isIdentifierChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// The lexer drops ("void"|"extern"|"typedef")[ \t]+[^;\n]*; as a whole, braces included.
+// Returns the index after the ';', or 0 when there is no such match at i.
+static size_t ignoredDeclarationEnd(const char* p, size_t i, size_t length) {
+    static const char* keywords[] = { "void", "extern", "typedef", NULL };
+    for (int k = 0; keywords[k]; k++) {
+        size_t n = strlen(keywords[k]);
+        if (i + n >= length || memcmp(p + i, keywords[k], n) != 0) continue;
+        size_t j = i + n;
+        if (p[j] != ' ' && p[j] != '\t') continue;
+        while (j < length && (p[j] == ' ' || p[j] == '\t')) j++;
+        while (j < length && p[j] != ';' && p[j] != '\n') j++;
+        if (j < length && p[j] == ';') return j + 1;
+    }
+    return 0;
+}
+
+static int appendChunk(SourceChunk** chunks, int* count, int* capacity, size_t start, size_t end) {
+    if (*count == *capacity) {
+        int newCapacity = *capacity ? *capacity * 2 : 16;
+        SourceChunk* grown = realloc(*chunks, sizeof(SourceChunk) * newCapacity);
+        if (!grown) return 0;
+        *chunks = grown;
+        *capacity = newCapacity;
+    }
+    (*chunks)[*count].offset = start;
+    (*chunks)[*count].length = end - start;
+    (*count)++;
+    return 1;
+}
+
+int splitTopLevelChunks(const char* source, size_t length, SourceChunk** chunks) {
+    *chunks = NULL;
+    int count = 0, capacity = 0, depth = 0, hasContent = 0;
+    size_t start = 0, i = 0;
+
+    while (i < length) {
+        char c = source[i];
+        char next = i + 1 < length ? source[i + 1] : '\0';
+        size_t end;
+
+        if (c == '/' && next == '/') {
+            while (i < length && source[i] != '\n') i++;
+        } else if (c == '/' && next == '*') {
+            const char* close = NULL;
+            for (size_t j = i + 2; j + 1 < length; j++) {
+                if (source[j] == '*' && source[j + 1] == '/') {
+                    close = source + j;
+                    break;
+                }
+            }
+            i = close ? (size_t)(close - source) + 2 : length;
+        } else if (c == '#') {
+            while (i < length && source[i] != '\n') i++;
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            i++;
+        } else if ((i == 0 || !isIdentifierChar(source[i - 1])) && (end = ignoredDeclarationEnd(source, i, length)) != 0) {
+            i = end;
+        } else if (isIdentifierChar(c)) {
+            while (i < length && isIdentifierChar(source[i])) i++;
+            hasContent = 1;
+        } else {
+            if (c == '"') {
+                // A string literal is one token; an unterminated quote is a single bad character
+                size_t j = i + 1;
+                while (j < length && source[j] != '"') j += source[j] == '\\' ? 2 : 1;
+                if (j < length) i = j;
+            }
+            hasContent = 1;
+            int boundary = 0;
+            if (c == '{') {
+                depth++;
+            } else if (c == '}') {
+                if (depth > 0) depth--;
+                boundary = depth == 0;
+            } else if (c == ';') {
+                boundary = depth == 0;
+            }
+            i++;
+            if (boundary) {
+                if (!appendChunk(chunks, &count, &capacity, start, i)) goto failed;
+                start = i;
+                hasContent = 0;
+            }
+        }
+    }
+
+    // Trailing comments and whitespace belong to the last chunk
+    if (hasContent || count == 0) {
+        if (start < length && !appendChunk(chunks, &count, &capacity, start, length)) goto failed;
+    } else {
+        (*chunks)[count - 1].length = length - (*chunks)[count - 1].offset;
+    }
+    for (int k = 0; k < count; k++) {
+        (*chunks)[k].hash = contentHash(source + (*chunks)[k].offset, (*chunks)[k].length);
+    }
+    return count;
+
+failed:
+    fprintf(stderr, "Memory allocation failed while splitting source into chunks.\n");
+    free(*chunks);
+    *chunks = NULL;
+    return -1;
+}
+
+/* ---- Merging ---- */
+
+static void remapForm(AffineForm* form, const int* map) {
+    if (!form->isAffine) return;
+    int coefficients[AFFINE_MAX_VARS] = { 0 };
+    for (int k = 0; k < AFFINE_MAX_VARS; k++) {
+        if (form->coefficients[k]) coefficients[map[k]] += form->coefficients[k];
+    }
+    memcpy(form->coefficients, coefficients, sizeof(coefficients));
+}
+
+// map == NULL lowers the index expressions again against the file-wide table instead. That
+// table is full by then, so nothing is added to it and the result does not depend on order.
+// 0 when the traversal stack cannot grow; the merge is then abandoned.
+static int remapAffineSlots(ASTNode* root, const int* map, AffineSlotTable* slots) {
+    WalkStack* walk = threadWalkStack();
+    if (!walk) return 0;
+    int base = walk->count;
+    int queued = !root || pushWalkNode(walk, root);
+
+    while (queued && walk->count > base) {
+        ASTNode* node = walk->frames[--walk->count].node1;
+        if (node->type == NodeType_ArrayAccess) {
+            for (int i = 0; node->affine && i < node->indexCount; i++) {
+                if (map) remapForm(&node->affine[i], map);
+                else lowerToAffineForm(node->indices[i], &node->affine[i], slots);
+            }
+            if (node->linearAffine && map) remapForm(node->linearAffine, map);
+            for (int i = 0; queued && node->indices && i < node->indexCount; i++) {
+                if (node->indices[i]) queued = pushWalkNode(walk, node->indices[i]);
+            }
+        }
+        for (int i = 0; queued && i < node->childCount; i++) {
+            if (node->children[i]) queued = pushWalkNode(walk, node->children[i]);
+        }
+        for (int i = 0; queued && node->params && i < node->paramCount; i++) {
+            if (node->params[i]) queued = pushWalkNode(walk, node->params[i]);
+        }
+    }
+    walk->count = base;
+    return queued;
+}
+
+// Same bookkeeping as the program rule in parser.y
+static void adoptTopLevel(ASTNode* root, ASTNode* node) {
+    if (node->type != NodeType_Functions) {
+        addASTChild(root, node);
+        return;
+    }
+    if (!root->functions) {
+        root->functions = createASTNode(NodeType_Functions, "Functions");
+        addASTChild(root, root->functions);
+    }
+    for (int i = 0; i < node->childCount; i++) addASTChild(root->functions, node->children[i]);
+    node->childCount = 0;
+    freeASTNode(node);
+}
+
+ASTNode* mergeChunkTrees(const char* name, ASTNode** chunkRoots, int count) {
+    AffineSlotTable slots;
+    memset(&slots, 0, sizeof(AffineSlotTable));
+
+    // Number the slots first, so nothing is moved when the merge has to be abandoned.
+    // A chunk's slots in order are the names it met first, so adding them chunk by chunk
+    // builds the table a whole-file parse would have built.
+    int (*maps)[AFFINE_MAX_VARS] = calloc(count > 0 ? count : 1, sizeof(*maps));
+    int* relower = calloc(count > 0 ? count : 1, sizeof(int));
+    if (!maps || !relower) {
+        fprintf(stderr, "Memory allocation failed while merging chunks of %s.\n", name);
+        free(maps);
+        free(relower);
+        return NULL;
+    }
+    for (int c = 0; c < count; c++) {
+        ASTNode* chunk = chunkRoots[c];
+        // A full chunk table may have turned names away that the file-wide table had room for
+        if (chunk->affineSlotCount >= AFFINE_MAX_VARS) {
+            fprintf(stderr, "Log: Affine slots of a chunk of %s overflow, parsing it whole.\n", name);
+            freeAffineSlots(&slots);
+            free(maps);
+            free(relower);
+            return NULL;
+        }
+        for (int k = 0; k < chunk->affineSlotCount; k++) {
+            maps[c][k] = affineSlotFor(&slots, chunk->affineSlots[k]);
+            if (maps[c][k] < 0) relower[c] = 1;
+        }
+    }
+
+    // Chunks are only adopted once all of them are remapped, so the chunk trees are
+    // still whole if the merge has to be abandoned
+    for (int c = 0; c < count; c++) {
+        ASTNode* chunk = chunkRoots[c];
+        for (int i = 0; i < chunk->childCount; i++) {
+            if (!remapAffineSlots(chunk->children[i], relower[c] ? NULL : maps[c], &slots)) {
+                fprintf(stderr, "Log: Could not remap the affine slots of %s, parsing it whole.\n", name);
+                freeAffineSlots(&slots);
+                free(maps);
+                free(relower);
+                return NULL;
+            }
+        }
+    }
+
+    char rootNodeName[256];
+    snprintf(rootNodeName, sizeof(rootNodeName), "%s Root", name);
+    ASTNode* root = createASTNode(NodeType_Root, rootNodeName);
+    if (!root) {
+        freeAffineSlots(&slots);
+        free(maps);
+        free(relower);
+        return NULL;
+    }
+
+    for (int c = 0; c < count; c++) {
+        ASTNode* chunk = chunkRoots[c];
+        for (int i = 0; i < chunk->childCount; i++) {
+            adoptTopLevel(root, chunk->children[i]);
+        }
+        chunk->childCount = 0;
+        chunk->functions = NULL;
+        freeASTNode(chunk);
+        chunkRoots[c] = NULL;
+    }
+    storeAffineSlots(root, &slots);
+    free(maps);
+    free(relower);
+    return root;
+}
+
+/* ---- Revisions ---- */
+
+RevisionParser* createRevisionParser(void) {
+    RevisionParser* parser = calloc(1, sizeof(RevisionParser));
+    if (!parser) fprintf(stderr, "Memory allocation failed for revision parser.\n");
+    return parser;
+}
+
+void freeRevisionParser(RevisionParser* parser) {
+    if (!parser) return;
+    for (int i = 0; i < parser->count; i++) freeASTNode(parser->entries[i].tree);
+    free(parser->entries);
+    free(parser);
+}
+
+static ChunkCacheEntry* findChunk(RevisionParser* parser, uint64_t hash) {
+    for (int i = 0; i < parser->count; i++) {
+        if (parser->entries[i].hash == hash) return &parser->entries[i];
+    }
+    return NULL;
+}
+
+static ChunkCacheEntry* addChunk(RevisionParser* parser, uint64_t hash, ASTNode* tree) {
+    if (parser->count == parser->capacity) {
+        int capacity = parser->capacity ? parser->capacity * 2 : 16;
+        ChunkCacheEntry* grown = realloc(parser->entries, sizeof(ChunkCacheEntry) * capacity);
+        if (!grown) return NULL;
+        parser->entries = grown;
+        parser->capacity = capacity;
+    }
+    ChunkCacheEntry* entry = &parser->entries[parser->count++];
+    entry->hash = hash;
+    entry->tree = tree;
+    entry->generation = parser->generation;
+    return entry;
+}
+
+// Only the chunks of the latest revision are kept
+static void dropStaleChunks(RevisionParser* parser) {
+    int kept = 0;
+    for (int i = 0; i < parser->count; i++) {
+        if (parser->entries[i].generation == parser->generation) {
+            parser->entries[kept++] = parser->entries[i];
+        } else {
+            freeASTNode(parser->entries[i].tree);
+        }
+    }
+    parser->count = kept;
+}
+
+static ASTNode* parseWhole(RevisionParser* parser, const char* name, const char* source, size_t length) {
+    parser->fullParses++;
+    return parseBuffer(name, source, length);
+}
+
+ASTNode* parseRevision(RevisionParser* parser, const char* name, const char* source, size_t length) {
+    SourceChunk* chunks;
+    int count = splitTopLevelChunks(source, length, &chunks);
+    if (count <= 0) return parseWhole(parser, name, source, length);
+
+    ASTNode** trees = calloc(count, sizeof(ASTNode*));
+    if (!trees) {
+        free(chunks);
+        return parseWhole(parser, name, source, length);
+    }
+
+    parser->generation++;
+    int reused = 0, parsed = 0, failed = 0;
+    for (int c = 0; c < count && !failed; c++) {
+        ChunkCacheEntry* entry = findChunk(parser, chunks[c].hash);
+        if (entry) {
+            entry->generation = parser->generation;
+            reused++;
+        } else {
+            ASTNode* tree = parseBuffer(name, source + chunks[c].offset, chunks[c].length);
+            if (!tree) {
+                failed = 1; // Let the whole-file parse report the error
+                break;
+            }
+            if (!(entry = addChunk(parser, chunks[c].hash, tree))) {
+                freeASTNode(tree);
+                failed = 1;
+                break;
+            }
+            parsed++;
+        }
+        if (!(trees[c] = copyASTTree(entry->tree))) failed = 1;
+    }
+
+    ASTNode* root = NULL;
+    if (!failed) root = mergeChunkTrees(name, trees, count);
+    for (int c = 0; c < count; c++) freeASTNode(trees[c]); // Left over when the merge did not happen
+    free(trees);
+    free(chunks);
+    dropStaleChunks(parser);
+
+    if (!root) return parseWhole(parser, name, source, length);
+    parser->reusedChunks += reused;
+    parser->parsedChunks += parsed;
+    fprintf(stderr, "Log: Revision %d of %s: %d chunks reused, %d parsed.\n", parser->generation, name, reused, parsed);
+    return root;
+}
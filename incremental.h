@@ -0,0 +1,47 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdint.h>
+#include "ast.h"
+
+// One top-level element of a source file (a function, main, or a global declaration),
+// with the comments and whitespace in front of it
+typedef struct SourceChunk {
+    size_t offset;
+    size_t length;
+    uint64_t hash;  // Of the chunk's bytes
+} SourceChunk;
+
+// Brace-balanced pre-scan that splits a source at the top-level boundaries the
+// program rule in parser.y reduces at. Follows the lexer's comment, string,
+// preprocessor and ignored-declaration rules, so braces inside them do not count.
+// Returns the number of chunks (*chunks is malloc'd), or -1 on allocation failure.
+int splitTopLevelChunks(const char* source, size_t length, SourceChunk** chunks);
+
+// Builds one Root from the Roots of separately parsed chunks, in chunk order, the
+// same tree a parse of the whole file gives. The chunk trees are moved (the chunk
+// Roots are freed) and their affine slots renumbered into one file-wide table.
+// Returns NULL when a single chunk filled its own slot table, where a whole-file
+// parse can number the slots differently; the caller then parses the whole file.
+ASTNode* mergeChunkTrees(const char* name, ASTNode** chunkRoots, int count);
+
+// Keeps the parsed chunks of the previous revision of a submission. A new revision
+// only parses the chunks whose bytes changed; unchanged ones are copied from the cache.
+typedef struct ChunkCacheEntry {
+    uint64_t hash;
+    ASTNode* tree;      // Chunk Root as parsed, never canonicalized
+    int generation;     // Revision that last used it
+} ChunkCacheEntry;
+
+typedef struct RevisionParser {
+    ChunkCacheEntry* entries;
+    int count, capacity;
+    int generation;
+    unsigned long reusedChunks, parsedChunks, fullParses;
+} RevisionParser;
+
+RevisionParser* createRevisionParser(void);
+void freeRevisionParser(RevisionParser* parser);
+ASTNode* parseRevision(RevisionParser* parser, const char* name, const char* source, size_t length);
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "parallelparse.h"
+#include "incremental.h"
+#include "trace.h"
+#include "simalloc.h"
+
+typedef struct ParallelParse {
+    const char* name;
+    const char* source;
+    const SourceChunk* chunks;
+    ASTNode** trees;
+    int count;
+    int next;    // Next chunk to hand out
+    int failed;  // Set once any chunk fails; the others stop early
+    AllocAccount* memory;  // The caller's, so the chunk trees are charged to the submission
+} ParallelParse;
+
+// Chunks are handed out one at a time, so a few long functions do not stall a worker
+// while the others sit idle
+static void* parseWorker(void* argument) {
+    ParallelParse* work = argument;
+    AllocAccount* previous = enterAllocAccount(work->memory);
+    for (;;) {
+        if (__atomic_load_n(&work->failed, __ATOMIC_RELAXED)) break;
+        int c = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (c >= work->count) break;
+        const SourceChunk* chunk = &work->chunks[c];
+        work->trees[c] = parseBuffer(work->name, work->source + chunk->offset, chunk->length);
+        if (!work->trees[c]) __atomic_store_n(&work->failed, 1, __ATOMIC_RELAXED);
+    }
+    enterAllocAccount(previous);
+    return NULL;
+}
+
+ASTNode* parseBufferParallel(const char* name, const char* source, size_t length, int workers) {
+    if (length < PARALLEL_PARSE_MIN_BYTES) return parseBuffer(name, source, length);
+    if (workers <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (int)online : 1;
+    }
+
+    SourceChunk* chunks;
+    int count = splitTopLevelChunks(source, length, &chunks);
+    if (count < 2 || workers < 2) {
+        free(chunks);
+        return parseBuffer(name, source, length);
+    }
+    if (workers > count) workers = count;
+
+    ParallelParse work = { name, source, chunks, calloc(count, sizeof(ASTNode*)), count, 0, 0, currentAllocAccount() };
+    pthread_t* threads = malloc(sizeof(pthread_t) * workers);
+    if (!work.trees || !threads) {
+        fprintf(stderr, "Memory allocation failed for parallel parse of %s.\n", name);
+        free(work.trees);
+        free(threads);
+        free(chunks);
+        return parseBuffer(name, source, length);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // The calling thread is one of the workers
+    int started = 0;
+    while (started < workers - 1 && pthread_create(&threads[started], NULL, parseWorker, &work) == 0) started++;
+    parseWorker(&work);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+
+    ASTNode* root = NULL;
+    if (!work.failed) {
+        uint64_t traced = traceSpanStart();
+        root = mergeChunkTrees(name, work.trees, count);
+        traceSpanEnd("merge chunks", "parse", traced, name, NULL);
+    }
+    for (int c = 0; c < count; c++) freeASTNode(work.trees[c]); // Left over when the merge did not happen
+    free(work.trees);
+    free(chunks);
+
+    if (!root) {
+        fprintf(stderr, "Log: Parallel parse of %s failed, parsing it on one thread.\n", name);
+        return parseBuffer(name, source, length);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fprintf(stderr, "Log: Parsed %s as %d chunks on %d threads in %.3fs.\n", name, count, started + 1,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    return root;
+}
@@ -0,0 +1,16 @@
+#ifndef PARALLELPARSE_H
+#define PARALLELPARSE_H
+
+#include "ast.h"
+
+#define PARALLEL_PARSE_MIN_BYTES (64 * 1024)  // Smaller sources are parsed on the calling thread
+#define PARALLEL_PARSE_DEFAULT_WORKERS 0      // One per online CPU
+
+// Parses one large source on several threads: the source is split at its top-level
+// functions and declarations, the chunks are parsed concurrently with the reentrant
+// parser, and the chunk trees are merged under one Root in source order. Gives the
+// same tree as parseBuffer; falls back to it for small sources and whenever a chunk
+// cannot be parsed or merged on its own (so errors are reported for the whole file).
+ASTNode* parseBufferParallel(const char* name, const char* source, size_t length, int workers);
+
+#endif
@@ -1,57 +1,97 @@
-%{
+%code requires {
+#include "ast.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+// Everything one parse works on. Passed to every action instead of file-scope
+// globals, so any number of files can be parsed at once on different threads.
+typedef struct ParseState {
+    ASTNode* root;                 // Root node of the file being parsed
+    ASTNode* currentFunctionBody;  // Body of the function being reduced, if any
+    AffineSlotTable slots;         // Affine index slots, numbered per file
+} ParseState;
+}
+
+%code {
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include "ast.h"
-#include "y.tab.h"
+#include "resultcache.h"
+#include "stats.h"
+#include "trace.h"
+#include "simalloc.h"
+#include "simdlexer.h"
+
+// Parser stacks beyond the initial depth and push parser state
+#define YYMALLOC(size) simMalloc(size, Alloc_Parser)
+#define YYFREE simFree
+
+int yylex(YYSTYPE* yylval_param, yyscan_t scanner);
+void yyerror(ParseState* state, yyscan_t scanner, const char* s);
+
+// Reentrant scanner interface generated by flex (lexer.l)
+int yylex_init(yyscan_t* scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE* input, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
+char* yyget_text(yyscan_t scanner);
+void yyset_lineno(int lineNumber, yyscan_t scanner);
+struct yy_buffer_state* yy_scan_bytes(const char* bytes, int length, yyscan_t scanner);
+void yy_delete_buffer(struct yy_buffer_state* buffer, yyscan_t scanner);
+
+// Every token of every pass goes through here, so the stats can count them. With the
+// simd backend, yyscan_t is a SimdLexer rather than a flex scanner.
+static int countedLex(YYSTYPE* value, yyscan_t scanner) {
+    statsCount(Stat_TokensLexed, 1);
+    if (scannerBackend == Scanner_Simd) return simdLex(scanner, value);
+    return yylex(value, scanner);
+}
+#define yylex countedLex
 
-extern int yylineno;
-extern char* yytext;
-void yyerror(const char *s);
-int yylex(void);
-extern FILE *yyin;
-extern int yyparse(void);
-extern ASTNode* globalRoot;
+static int openScanner(yyscan_t* scanner) {
+    if (scannerBackend == Scanner_Simd) return (*scanner = createSimdLexer()) ? 0 : 1;
+    return yylex_init(scanner);
+}
 
-static ASTNode* currentFunctionBody = NULL;
+static void closeScanner(yyscan_t scanner) {
+    if (scannerBackend == Scanner_Simd) freeSimdLexer(scanner);
+    else yylex_destroy(scanner);
+}
 
-ASTNode* g_localRoot = NULL;
+// Returns the buffer to pass to endScanBytes, or NULL on failure. The simd backend
+// scans the bytes in place.
+static void* scanBytes(yyscan_t scanner, const char* bytes, size_t length) {
+    if (scannerBackend == Scanner_Flex) return yy_scan_bytes(bytes, (int)length, scanner);
+    simdLexBytes(scanner, bytes, length);
+    return scanner;
+}
 
-ASTNode* parse(const char* filename) {
-    yyin = fopen(filename, "r");
-    if (!yyin) {
-        perror("File opening error");
-        return NULL;
-    }
-    char rootNodeName[256];
-    snprintf(rootNodeName, sizeof(rootNodeName), "%s Root", filename);
+static void endScanBytes(yyscan_t scanner, void* buffer) {
+    if (scannerBackend == Scanner_Flex) yy_delete_buffer(buffer, scanner);
+}
 
-    ASTNode* localRoot = createASTNode(NodeType_Root, rootNodeName);
-    if (!localRoot) {
-        fprintf(stderr, "Failed to create root node.\n");
-        fclose(yyin);
-        return NULL;
-    }
-    
-    g_localRoot = localRoot;
-    
-    fprintf(stderr, "Log: Created local Root for parsing file: %s\n", filename);
-    printf("Parsing file: %s\n", filename);
-    fprintf(stderr, "Starting parsing process.\n");
-    int parseResult = yyparse();
-    fclose(yyin);
-    
-    if (parseResult != 0) {
-        fprintf(stderr, "Parsing failed with error %d\n", parseResult);
-        freeASTNode(localRoot);
-        return NULL;
-    }
+static int scannerLine(yyscan_t scanner) {
+    return scannerBackend == Scanner_Simd ? simdLexLine(scanner) : yyget_lineno(scanner);
+}
 
-    fprintf(stderr, "Finished parsing file: %s\n", filename);
-    return g_localRoot;
+static void setScannerLine(yyscan_t scanner, int lineNumber) {
+    if (scannerBackend == Scanner_Simd) simdLexSetLine(scanner, lineNumber);
+    else yyset_lineno(lineNumber, scanner);
+}
+
+static const char* scannerText(yyscan_t scanner) {
+    return scannerBackend == Scanner_Simd ? simdLexText(scanner) : yyget_text(scanner);
+}
 }
-%}
+
+%define api.pure full
+%define api.push-pull both
+%parse-param {ParseState* state} {yyscan_t scanner}
+%lex-param {yyscan_t scanner}
 
 %union {
     char* sval;
@@ -59,6 +99,10 @@ ASTNode* parse(const char* filename) {
 }
 
 %token <sval> IDENTIFIER NUMBER STRING_LITERAL
+
+// Token text is copied into the nodes, so every action frees the text it consumes;
+// this covers the tokens still on the stack when a parse is abandoned
+%destructor { simFree($$); } <sval>
 %token INT RETURN MAIN IF ELSE WHILE FOR VOID
 %token PLUS MINUS TIMES DIVIDE ASSIGN SEMICOLON LPAREN RPAREN COMMA LBRACKET RBRACKET LBRACE RBRACE PLUSPLUS MINUSMINUS
 %token LT GT LE GE EQ NE AND OR NOT MOD BITAND BITOR XOR SHL SHR
@@ -89,37 +133,45 @@ ASTNode* parse(const char* filename) {
 
 %type <ast> program main_function function_definition printf_statement array_access param_list param_list_nonempty function_call statements statement compound_statement expression parameter_list parameter array_declaration for_initialization for_condition for_increment
 
+// Subtrees still on the stack when a parse fails; program holds the root, which
+// endParse releases
+%destructor { freeASTNode($$); } <ast>
+%destructor { } program
+
 %%
 
 program:
     function_definition {
-        if (!g_localRoot->functions) {
-            g_localRoot->functions = createASTNode(NodeType_Functions, "Functions");
-            addASTChild(g_localRoot, g_localRoot->functions);
+        if (!state->root->functions) {
+            state->root->functions = createASTNode(NodeType_Functions, "Functions");
+            addASTChild(state->root, state->root->functions);
         }
-        addASTChild(g_localRoot->functions, $1);
+        addASTChild(state->root->functions, $1);
+        $$ = state->root;
     }
     | program function_definition {
-        if (!g_localRoot->functions) {
-            g_localRoot->functions = createASTNode(NodeType_Functions, "Functions");
-            addASTChild(g_localRoot, g_localRoot->functions);
+        if (!state->root->functions) {
+            state->root->functions = createASTNode(NodeType_Functions, "Functions");
+            addASTChild(state->root, state->root->functions);
         }
-        addASTChild(g_localRoot->functions, $2);
+        addASTChild(state->root->functions, $2);
         $$ = $1;
     }
     | main_function {
-        addASTChild(g_localRoot, $1);
+        addASTChild(state->root, $1);
+        $$ = state->root;
     }
     | program main_function {
-        addASTChild(g_localRoot, $2);
+        addASTChild(state->root, $2);
         $$ = $1;
     }
 	
 	| array_declaration {
-       addASTChild(g_localRoot, $1);
+       addASTChild(state->root, $1);
+       $$ = state->root;
     }
     | program array_declaration {
-        addASTChild(g_localRoot, $2);
+        addASTChild(state->root, $2);
         $$ = $1;
     }
 ;
@@ -128,9 +180,9 @@ main_function:
     INT MAIN LPAREN RPAREN compound_statement
     {
         $$ = createMainFunctionNode("Main", $5);
-        currentFunctionBody = $5; // Set the current function body to the compound statement
+        state->currentFunctionBody = $5; // Set the current function body to the compound statement
 		fprintf(stderr, "Log: Created main function node with body\n");
-		currentFunctionBody = NULL;
+		state->currentFunctionBody = NULL;
     }
 ;
 
@@ -151,11 +203,14 @@ printf_statement:
         ASTNode* printfNode = createFunctionCallNode("printf", NULL);
         addASTChild(printfNode, createASTNode(NodeType_Constant, $3));
         addASTChild(printfNode, createASTNode(NodeType_Identifier, $5));
+        simFree($3);
+        simFree($5);
         $$ = printfNode;
     }
     | PRINTF LPAREN STRING_LITERAL RPAREN SEMICOLON {
         ASTNode* printfNode = createFunctionCallNode("printf", NULL);
         addASTChild(printfNode, createASTNode(NodeType_Constant, $3));
+        simFree($3);
         $$ = printfNode;
     }
     ;
@@ -164,7 +219,10 @@ printf_statement:
 
 
 statements:
-    statement { $$ = $1; }
+    statement {
+        $$ = createASTNode(NodeType_Statements, "Statements");
+        addASTChild($$, $1);
+    }
     | statements statement { addASTChild($1, $2); $$ = $1; }
     ;
 
@@ -173,59 +231,64 @@ statement:
         ASTNode* assign = createASTNode(NodeType_Assignment, "=");
         addASTChild(assign, createASTNode(NodeType_Identifier, $2));
         addASTChild(assign, $4);
+        simFree($2);
         $$ = assign;
     }
     | INT IDENTIFIER ASSIGN function_call SEMICOLON {
         ASTNode* assign = createASTNode(NodeType_Assignment, "=");
         addASTChild(assign, createASTNode(NodeType_Identifier, $2));
         addASTChild(assign, $4);
+        simFree($2);
         $$ = assign;
     }
     | IDENTIFIER ASSIGN expression SEMICOLON {
         ASTNode* assign = createASTNode(NodeType_Assignment, "=");
         addASTChild(assign, createASTNode(NodeType_Identifier, $1));
         addASTChild(assign, $3);
+        simFree($1);
         $$ = assign;
     }
     | IDENTIFIER LBRACKET expression RBRACKET ASSIGN expression SEMICOLON {
     ASTNode* indices[1] = {$3};
-    ASTNode* arrayUsage = createArrayAccessNode($1, "int", indices, 1);
+    ASTNode* arrayUsage = createArrayAccessNode($1, "int", indices, 1, &state->slots);
+    simFree($1);
     if (!arrayUsage) {
-        yyerror("Failed to create array access node");
+        yyerror(state, scanner, "Failed to create array access node");
         YYABORT;
     }
 
     ASTNode* assign = createASTNode(NodeType_Assignment, "=");
     if (!assign) {
-        yyerror("Failed to create assignment node");
+        yyerror(state, scanner, "Failed to create assignment node");
         YYABORT;
     }
     addASTChild(assign, arrayUsage);
     addASTChild(assign, $6);
 
-    if (currentFunctionBody) {
-        addASTChild(currentFunctionBody, assign);
+    if (state->currentFunctionBody) {
+        addASTChild(state->currentFunctionBody, assign);
     }
     $$ = assign;
 }
 	| IDENTIFIER LBRACKET expression RBRACKET LBRACKET expression RBRACKET ASSIGN expression SEMICOLON {
     ASTNode* indices[2] = {$3, $6};
-    ASTNode* arrayUsage = createArrayAccessNode($1, "int", indices, 2);
+    ASTNode* arrayUsage = createArrayAccessNode($1, "int", indices, 2, &state->slots);
+    simFree($1);
     if (!arrayUsage) {
-        yyerror("Failed to create array access node");
+        yyerror(state, scanner, "Failed to create array access node");
         YYABORT;
     }
 
     ASTNode* assign = createASTNode(NodeType_Assignment, "=");
     if (!assign) {
-        yyerror("Failed to create assignment node");
+        yyerror(state, scanner, "Failed to create assignment node");
         YYABORT;
     }
     addASTChild(assign, arrayUsage);
     addASTChild(assign, $9);
 
-    if (currentFunctionBody) {
-        addASTChild(currentFunctionBody, assign);
+    if (state->currentFunctionBody) {
+        addASTChild(state->currentFunctionBody, assign);
     }
     $$ = assign;
 }
@@ -233,6 +296,7 @@ statement:
         ASTNode* assign = createASTNode(NodeType_Assignment, "=");
         addASTChild(assign, createASTNode(NodeType_Identifier, $1));
         addASTChild(assign, $3);
+        simFree($1);
         $$ = assign;
     }
     | RETURN expression SEMICOLON {
@@ -284,6 +348,7 @@ statement:
             $$ = forNode;
         }
     }
+    | compound_statement { $$ = $1; }
     | function_definition { $$ = $1; }
     | function_call SEMICOLON { $$ = $1; } %prec LOWER_THAN_SEMICOLON
     | array_declaration { $$ = $1; }
@@ -291,23 +356,22 @@ statement:
     | printf_statement { $$ = $1; }  // Treat printf_statement as a part of statement
     | INT IDENTIFIER LBRACKET NUMBER RBRACKET { // for 1D arrays
         ASTNode* array_decl = createArrayNode("int", $2, $4);
-        if (currentFunctionBody) {
-            addASTChild(currentFunctionBody, array_decl);
+        simFree($2);
+        simFree($4);
+        if (state->currentFunctionBody) {
+            addASTChild(state->currentFunctionBody, array_decl);
             fprintf(stderr, "Added 1D array to current function body.\n");
-        } else {
-            addASTChild(g_localRoot, array_decl); // Adding directly under the global root or a designated global scope node.
-            fprintf(stderr, "Added 1D global array declaration.\n");
         }
         $$ = array_decl;
     }
     | INT IDENTIFIER LBRACKET NUMBER RBRACKET LBRACKET NUMBER RBRACKET { // for 2D arrays
         ASTNode* array_decl = create2DArrayNode("int", $2, $4, $7);
-        if (currentFunctionBody) {
-            addASTChild(currentFunctionBody, array_decl);
+        simFree($2);
+        simFree($4);
+        simFree($7);
+        if (state->currentFunctionBody) {
+            addASTChild(state->currentFunctionBody, array_decl);
             fprintf(stderr, "Added 2D array to current function body.\n");
-        } else {
-            addASTChild(g_localRoot, array_decl); // Adding directly under the global root or a designated global scope node.
-            fprintf(stderr, "Added 2D global array declaration.\n");
         }
         $$ = array_decl;
     }
@@ -319,11 +383,11 @@ function_definition:
     INT IDENTIFIER LPAREN param_list RPAREN compound_statement
     {
         ASTNode* functionNode = createFunctionNode($2, $4, $6);
-        currentFunctionBody = $6; // Set the body of the function
-        addASTChild(globalRoot, functionNode); // Add this function to the global AST root
+        state->currentFunctionBody = $6; // Set the body of the function
         fprintf(stderr, "Log: Created function node %s with body\n", $2);
+        simFree($2);
         $$ = functionNode;
-        currentFunctionBody = NULL; // Reset after function is handled
+        state->currentFunctionBody = NULL; // Reset after function is handled
     }
 ;
 
@@ -332,11 +396,13 @@ function_call:
     IDENTIFIER LPAREN parameter_list RPAREN {
         $$ = createFunctionCallNode($1, $3);
         fprintf(stderr, "Log: Created function call node: %s with parameters.\n", $1);
+        simFree($1);
     }
     | PRINTF LPAREN STRING_LITERAL COMMA expression RPAREN {
         ASTNode* printfNode = createFunctionCallNode("printf", NULL);
         addASTChild(printfNode, createASTNode(NodeType_Constant, $3));
         addASTChild(printfNode, $5);
+        simFree($3);
         $$ = printfNode;
     }
 ;
@@ -346,12 +412,14 @@ for_initialization:
         ASTNode* initNode = createASTNode(NodeType_Assignment, "=");
         addASTChild(initNode, createASTNode(NodeType_Identifier, $2));
         addASTChild(initNode, $4);
+        simFree($2);
         $$ = initNode;
     }
     | IDENTIFIER ASSIGN expression {
         ASTNode* initNode = createASTNode(NodeType_Assignment, "=");
         addASTChild(initNode, createASTNode(NodeType_Identifier, $1));
         addASTChild(initNode, $3);
+        simFree($1);
         $$ = initNode;
     }
 ;
@@ -364,17 +432,20 @@ for_increment:
     IDENTIFIER PLUSPLUS {
         ASTNode* incrNode = createASTNode(NodeType_Expression, "++");
         addASTChild(incrNode, createASTNode(NodeType_Identifier, $1));
+        simFree($1);
         $$ = incrNode;
     }
     | IDENTIFIER MINUSMINUS {
         ASTNode* decrNode = createASTNode(NodeType_Expression, "--");
         addASTChild(decrNode, createASTNode(NodeType_Identifier, $1));
+        simFree($1);
         $$ = decrNode;
     }
     | IDENTIFIER ASSIGN expression {
         ASTNode* assignNode = createASTNode(NodeType_Assignment, "=");
         addASTChild(assignNode, createASTNode(NodeType_Identifier, $1));
         addASTChild(assignNode, $3);
+        simFree($1);
         $$ = assignNode;
     }
 ;
@@ -388,11 +459,13 @@ parameter:
     INT IDENTIFIER {
         ASTNode* paramNode = createParameterNode("int");
         addASTChild(paramNode, createASTNode(NodeType_Identifier, $2));
+        simFree($2);
         $$ = paramNode;
     }
     | INT IDENTIFIER LBRACKET RBRACKET {
         ASTNode* paramNode = createParameterNode("int[]");
         addASTChild(paramNode, createASTNode(NodeType_Identifier, $2));
+        simFree($2);
         $$ = paramNode;
     }
 ;
@@ -436,9 +509,9 @@ parameter_list:
 ;
 
 expression:
-    IDENTIFIER { $$ = createASTNode(NodeType_Identifier, $1); } %prec LOWER_THAN_RPAREN
-    | NUMBER { $$ = createASTNode(NodeType_Constant, $1); }
-    | STRING_LITERAL { $$ = createASTNode(NodeType_Constant, $1); }
+    IDENTIFIER { $$ = createASTNode(NodeType_Identifier, $1); simFree($1); } %prec LOWER_THAN_RPAREN
+    | NUMBER { $$ = createASTNode(NodeType_Constant, $1); simFree($1); }
+    | STRING_LITERAL { $$ = createASTNode(NodeType_Constant, $1); simFree($1); }
 	| LPAREN expression RPAREN { $$ = $2; }
     | expression PLUS expression {
         ASTNode* plusExpr = createASTNode(NodeType_Expression, "+");
@@ -474,12 +547,14 @@ expression:
     | IDENTIFIER LBRACKET expression RBRACKET {
     ASTNode* indices[1] = {$3};  // Create an array with a single index
     // Assuming the data type is known, e.g., "int"
-    $$ = createArrayAccessNode($1, "int", indices, 1);  // Pass the array and the count of indices
+    $$ = createArrayAccessNode($1, "int", indices, 1, &state->slots);  // Pass the array and the count of indices
+    simFree($1);
 }
 	| IDENTIFIER LBRACKET expression RBRACKET LBRACKET expression RBRACKET {
     ASTNode* indices[2] = {$3, $6};  // Create an array with two indices
     // Assuming the data type is known, e.g., "int"
-    $$ = createArrayAccessNode($1, "int", indices, 2);  // Pass the array and the count of indices
+    $$ = createArrayAccessNode($1, "int", indices, 2, &state->slots);  // Pass the array and the count of indices
+    simFree($1);
 }
 
 
@@ -529,12 +604,11 @@ array_declaration:
     { 
         fprintf(stderr, "Parsing 1D array declaration: %s[%s]\n", $2, $4);
         ASTNode* array_decl = createArrayNode("int", $2, $4);
-        if (currentFunctionBody) {
-            addASTChild(currentFunctionBody, array_decl);
+        simFree($2);
+        simFree($4);
+        if (state->currentFunctionBody) {
+            addASTChild(state->currentFunctionBody, array_decl);
             fprintf(stderr, "Added 1D array to function body.\n");
-        } else {
-            fprintf(stderr, "Error: No current function body found for 1D array.\n");
-            addASTChild(g_localRoot, array_decl); // Add to global root if not within a function.
         }
         $$ = array_decl;
     }
@@ -542,12 +616,12 @@ array_declaration:
     {
         fprintf(stderr, "Parsing 2D array declaration: %s[%s][%s]\n", $2, $4, $7);
         ASTNode* array_decl = create2DArrayNode("int", $2, $4, $7);
-        if (currentFunctionBody) {
-            addASTChild(currentFunctionBody, array_decl);
+        simFree($2);
+        simFree($4);
+        simFree($7);
+        if (state->currentFunctionBody) {
+            addASTChild(state->currentFunctionBody, array_decl);
             fprintf(stderr, "Added 2D array to function body.\n");
-        } else {
-            fprintf(stderr, "Error: No current function body found for 2D array.\n");
-            addASTChild(g_localRoot, array_decl); // Add to global root if not within a function.
         }
         $$ = array_decl;
     }
@@ -558,9 +632,10 @@ array_access:
     IDENTIFIER LBRACKET expression RBRACKET {
         // Single index array access
         ASTNode* indices[1] = {$3};
-        ASTNode* arrayAccessNode = createArrayAccessNode($1, "int", indices, 1); // Assuming the data type is known, e.g., "int"
-        if (currentFunctionBody) {
-            addASTChild(currentFunctionBody, arrayAccessNode); // Add to the current function body if it exists
+        ASTNode* arrayAccessNode = createArrayAccessNode($1, "int", indices, 1, &state->slots); // Assuming the data type is known, e.g., "int"
+        simFree($1);
+        if (state->currentFunctionBody) {
+            addASTChild(state->currentFunctionBody, arrayAccessNode); // Add to the current function body if it exists
         } else {
             fprintf(stderr, "Error: No current function body found for single index array access.\n");
         }
@@ -569,9 +644,10 @@ array_access:
     | IDENTIFIER LBRACKET expression RBRACKET LBRACKET expression RBRACKET {
         // Two-dimensional array access
         ASTNode* indices[2] = {$3, $6}; // Capture both indices
-        ASTNode* arrayAccessNode = createArrayAccessNode($1, "int", indices, 2); // Assuming the data type is known, e.g., "int"
-        if (currentFunctionBody) {
-            addASTChild(currentFunctionBody, arrayAccessNode); // Add to the current function body if it exists
+        ASTNode* arrayAccessNode = createArrayAccessNode($1, "int", indices, 2, &state->slots); // Assuming the data type is known, e.g., "int"
+        simFree($1);
+        if (state->currentFunctionBody) {
+            addASTChild(state->currentFunctionBody, arrayAccessNode); // Add to the current function body if it exists
         } else {
             fprintf(stderr, "Error: No current function body found for two-dimensional array access.\n");
         }
@@ -585,39 +661,317 @@ array_access:
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "%s at line %d before '%s'\n", s, yylineno, yytext);
+void yyerror(ParseState* state, yyscan_t scanner, const char* s) {
+    (void)state;
+    fprintf(stderr, "%s at line %d before '%s'\n", s, scannerLine(scanner), scannerText(scanner));
+}
+
+static int beginParse(ParseState* state, const char* filename) {
+    memset(state, 0, sizeof(ParseState));
+
+    char rootNodeName[256];
+    snprintf(rootNodeName, sizeof(rootNodeName), "%s Root", filename);
+
+    state->root = createASTNode(NodeType_Root, rootNodeName);
+    if (!state->root) {
+        fprintf(stderr, "Failed to create root node.\n");
+        return 0;
+    }
+
+    fprintf(stderr, "Log: Created local Root for parsing file: %s\n", filename);
+    printf("Parsing file: %s\n", filename);
+    fprintf(stderr, "Starting parsing process.\n");
+    return 1;
+}
+
+static ASTNode* endParse(ParseState* state, int parseResult, const char* filename) {
+    if (parseResult != 0) {
+        fprintf(stderr, "Parsing failed with error %d\n", parseResult);
+        freeASTNode(state->root);
+        freeAffineSlots(&state->slots);
+        return NULL;
+    }
+
+    storeAffineSlots(state->root, &state->slots);
+    fprintf(stderr, "Finished parsing file: %s\n", filename);
+    return state->root;
 }
 
-int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <file1.c> <file2.c>\n", argv[0]);
-        return EXIT_FAILURE;
+static ASTNode* parseWithScanner(yyscan_t scanner, const char* filename) {
+    ParseState state;
+    if (!beginParse(&state, filename)) return NULL;
+    uint64_t traced = traceSpanStart();
+    uint64_t started = statsPhaseStart();
+    int result = yyparse(&state, scanner);
+    statsPhaseEnd(Phase_Parse, started);
+    ASTNode* root = endParse(&state, result, filename);
+    traceSpanEnd("parse", "parse", traced, filename, NULL);
+    return root;
+}
+
+ASTNode* parse(const char* filename) {
+    if (scannerBackend == Scanner_Simd) {
+        // The simd scanner works on the whole file in memory
+        size_t length = 0;
+        char* source = readSourceFile(filename, &length);
+        if (!source) return NULL;
+        ASTNode* root = parseBuffer(filename, source, length);
+        simFree(source);
+        return root;
+    }
+
+    FILE* input = fopen(filename, "r");
+    if (!input) {
+        perror("File opening error");
+        return NULL;
     }
 
-    ASTNode* root1 = parse(argv[1]);
-    if (!root1) {
-        fprintf(stderr, "Error: Parsing failed for %s.\n", argv[1]);
-        return EXIT_FAILURE;
+    yyscan_t scanner;
+    if (yylex_init(&scanner) != 0) {
+        fprintf(stderr, "Failed to create scanner for %s.\n", filename);
+        fclose(input);
+        return NULL;
     }
+    yyset_in(input, scanner);
 
-    ASTNode* root2 = parse(argv[2]);
-    if (!root2) {
-        fprintf(stderr, "Error: Parsing failed for %s.\n", argv[2]);
-        freeASTNode(root1);
-        return EXIT_FAILURE;
+    ASTNode* root = parseWithScanner(scanner, filename);
+    yylex_destroy(scanner);
+    fclose(input);
+    return root;
+}
+
+// Hash of the token stream the parser would see. The lexer already drops comments,
+// whitespace and preprocessor lines, so sources differing only in those hash equal.
+uint64_t tokenStreamHash(const char* source, size_t length) {
+    yyscan_t scanner;
+    if (openScanner(&scanner) != 0) {
+        fprintf(stderr, "Failed to create scanner for token hashing.\n");
+        return contentHash(source, length);
+    }
+    if (!scanBytes(scanner, source, length)) {
+        fprintf(stderr, "Failed to create scanner for token hashing.\n");
+        closeScanner(scanner);
+        return contentHash(source, length);
+    }
+    setScannerLine(scanner, 1);
+
+    uint64_t started = statsPhaseStart();
+    uint64_t hash = CONTENT_HASH_SEED;
+    YYSTYPE value;
+    int token;
+    while ((token = yylex(&value, scanner)) != 0) {
+        hash = contentHashUpdate(hash, &token, sizeof(token));
+        if (token == IDENTIFIER || token == NUMBER || token == STRING_LITERAL) {
+            hash = contentHashUpdate(hash, value.sval, strlen(value.sval) + 1);
+            simFree(value.sval);
+        }
     }
+    statsPhaseEnd(Phase_Lex, started);
+    closeScanner(scanner);
+    return hash;
+}
 
-    printf("AST for %s:\n", argv[1]);
-    printAST(root1);
-    printf("AST for %s:\n", argv[2]);
-    printAST(root2);
+// Parses source held in memory, e.g. a submission received by the scoring daemon
+ASTNode* parseBuffer(const char* name, const char* source, size_t length) {
+    yyscan_t scanner;
+    if (openScanner(&scanner) != 0) {
+        fprintf(stderr, "Failed to create scanner for %s.\n", name);
+        return NULL;
+    }
+    if (!scanBytes(scanner, source, length)) {
+        fprintf(stderr, "Failed to create scan buffer for %s.\n", name);
+        closeScanner(scanner);
+        return NULL;
+    }
+    setScannerLine(scanner, 1);
 
-    int similarityScore = compareASTs(root1, root2);
-    printf("Total similarity score between %s and %s is: %d%%\n", argv[1], argv[2], similarityScore);
+    ASTNode* root = parseWithScanner(scanner, name);
+    closeScanner(scanner); // Also frees the scan buffer
+    return root;
+}
 
-    freeASTNode(root1);
-    freeASTNode(root2);
+/* ---- Incremental parsing ---- */
+
+// Where the boundary scan is inside the pending bytes
+typedef enum StreamContext {
+    StreamContext_Code,
+    StreamContext_LineComment,   // Also preprocessor lines
+    StreamContext_BlockComment,
+    StreamContext_String
+} StreamContext;
+
+struct StreamParser {
+    char* name;
+    ParseState state;
+    yyscan_t scanner;
+    yypstate* parser;
+    int status;          // YYPUSH_MORE until the parse is accepted (0) or has failed
+    int lineNumber;      // Carried from one scan buffer to the next
+
+    char* pending;       // Bytes received but not yet scanned
+    size_t pendingLength, pendingCapacity;
+    size_t classified;   // Prefix of pending already seen by the boundary scan
+    size_t safeLength;   // Longest prefix that ends at a safe boundary
+    StreamContext context;
+};
+
+// A safe boundary is just after a newline in code that is followed by a character
+// which cannot continue a whitespace run. No token, comment or string crosses it,
+// and the lexer's line counting sees the same matches as with the whole file.
+static void findSafeBoundary(StreamParser* stream) {
+    const char* p = stream->pending;
+    size_t i = stream->classified;
+    while (i + 1 < stream->pendingLength) {
+        char c = p[i], next = p[i + 1];
+        switch (stream->context) {
+        case StreamContext_Code:
+            if (c == '/' && next == '/') {
+                stream->context = StreamContext_LineComment;
+                i += 2;
+            } else if (c == '/' && next == '*') {
+                stream->context = StreamContext_BlockComment;
+                i += 2;
+            } else if (c == '#') {
+                stream->context = StreamContext_LineComment;
+                i++;
+            } else if (c == '"') {
+                stream->context = StreamContext_String;
+                i++;
+            } else {
+                if (c == '\n' && next != ' ' && next != '\t' && next != '\n') stream->safeLength = i + 1;
+                i++;
+            }
+            break;
+        case StreamContext_LineComment:
+            if (c == '\n') stream->context = StreamContext_Code; // The newline is looked at again as code
+            else i++;
+            break;
+        case StreamContext_BlockComment:
+            if (c == '*' && next == '/') {
+                stream->context = StreamContext_Code;
+                i += 2;
+            } else {
+                i++;
+            }
+            break;
+        case StreamContext_String:
+            if (c == '\\') i += 2;
+            else {
+                if (c == '"') stream->context = StreamContext_Code;
+                i++;
+            }
+            break;
+        }
+    }
+    stream->classified = i;
+}
+
+// Scans one segment and pushes its tokens. The end of input is pushed while the
+// last segment's buffer is still alive, so yyerror can report its line and text.
+static void pushSegment(StreamParser* stream, const char* bytes, size_t length, int last) {
+    void* buffer = scanBytes(stream->scanner, bytes, length);
+    if (!buffer) {
+        fprintf(stderr, "Failed to create scan buffer for %s.\n", stream->name);
+        stream->status = 1;
+        return;
+    }
+    setScannerLine(stream->scanner, stream->lineNumber);
+
+    uint64_t traced = traceSpanStart();
+    uint64_t started = statsPhaseStart();
+    YYSTYPE value;
+    int token;
+    while (stream->status == YYPUSH_MORE && (token = yylex(&value, stream->scanner)) != 0) {
+        stream->status = yypush_parse(stream->parser, token, &value, &stream->state, stream->scanner);
+    }
+    if (last && stream->status == YYPUSH_MORE) {
+        stream->status = yypush_parse(stream->parser, 0, NULL, &stream->state, stream->scanner);
+    }
+    statsPhaseEnd(Phase_Parse, started);
+    traceSpanEnd("parse segment", "parse", traced, stream->name, NULL);
+
+    stream->lineNumber = scannerLine(stream->scanner);
+    endScanBytes(stream->scanner, buffer);
+}
+
+StreamParser* createStreamParser(const char* name) {
+    StreamParser* stream = simCalloc(1, sizeof(StreamParser), Alloc_Parser);
+    if (!stream || !(stream->name = simStrdup(name, Alloc_Parser))) {
+        fprintf(stderr, "Memory allocation failed for stream parser.\n");
+        simFree(stream);
+        return NULL;
+    }
+    if (openScanner(&stream->scanner) != 0) {
+        fprintf(stderr, "Failed to create scanner for %s.\n", name);
+        stream->scanner = NULL;
+        freeStreamParser(stream);
+        return NULL;
+    }
+    if (!(stream->parser = yypstate_new()) || !beginParse(&stream->state, name)) {
+        freeStreamParser(stream);
+        return NULL;
+    }
+    stream->status = YYPUSH_MORE;
+    stream->lineNumber = 1;
+    return stream;
+}
+
+int feedStreamParser(StreamParser* stream, const char* bytes, size_t length) {
+    if (stream->status != YYPUSH_MORE) return 0;
+
+    if (stream->pendingLength + length > stream->pendingCapacity) {
+        size_t capacity = stream->pendingCapacity ? stream->pendingCapacity : 4096;
+        while (capacity < stream->pendingLength + length) capacity *= 2;
+        char* grown = simRealloc(stream->pending, capacity, Alloc_Scanner);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for stream parser input.\n");
+            stream->status = 1;
+            return 0;
+        }
+        stream->pending = grown;
+        stream->pendingCapacity = capacity;
+    }
+    memcpy(stream->pending + stream->pendingLength, bytes, length);
+    stream->pendingLength += length;
+
+    findSafeBoundary(stream);
+    if (stream->safeLength > 0) {
+        size_t consumed = stream->safeLength;
+        pushSegment(stream, stream->pending, consumed, 0);
+        memmove(stream->pending, stream->pending + consumed, stream->pendingLength - consumed);
+        stream->pendingLength -= consumed;
+        stream->classified -= consumed;
+        stream->safeLength = 0;
+    }
+    return stream->status == YYPUSH_MORE;
+}
+
+ASTNode* finishStreamParser(StreamParser* stream) {
+    if (stream->status == YYPUSH_MORE) {
+        pushSegment(stream, stream->pending ? stream->pending : "", stream->pendingLength, 1);
+        stream->pendingLength = 0;
+    }
+    ASTNode* root = endParse(&stream->state, stream->status, stream->name);
+    stream->state.root = NULL; // Owned by the caller now, or already freed
+    stream->status = 1;
+    return root;
+}
 
-    return EXIT_SUCCESS;
+void freeStreamParser(StreamParser* stream) {
+    if (!stream) return;
+    if (stream->status == YYPUSH_MORE) {
+        // Ending the input lets the parser release the nodes still on its stack
+        fprintf(stderr, "Log: Abandoning the parse of %s.\n", stream->name);
+        pushSegment(stream, "", 0, 1);
+    }
+    if (stream->state.root) {
+        // Abandoned before finishStreamParser
+        freeASTNode(stream->state.root);
+        freeAffineSlots(&stream->state.slots);
+    }
+    if (stream->parser) yypstate_delete(stream->parser);
+    if (stream->scanner) closeScanner(stream->scanner);
+    simFree(stream->pending);
+    simFree(stream->name);
+    simFree(stream);
 }
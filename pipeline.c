@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "pipeline.h"
+#include "simanalysis.h"
+#include "ast.h"
+#include "tarreader.h"
+#include "trace.h"
+#include "approximate.h"
+#include "simalloc.h"
+
+// Bounded multi-producer multi-consumer ring (Vyukov). Every cell carries a sequence
+// number telling producers and consumers whose turn it is, so no locks are taken.
+typedef struct QueueCell {
+    size_t sequence;
+    void* data;
+} QueueCell;
+
+typedef struct BoundedQueue {
+    QueueCell* cells;
+    size_t mask;
+    char padding1[64];
+    size_t enqueuePosition;
+    char padding2[64];
+    size_t dequeuePosition;
+    char padding3[64];
+} BoundedQueue;
+
+typedef struct BatchItem {
+    int sequence;
+    char* path;           // File name, or member path inside the archive
+    const char* source;
+    size_t length;
+    int ownsSource;       // Members of a mapped archive point into the mapping
+    SimProgram* program;
+    int score;            // -1 when the submission could not be read, parsed or scored
+    char note[SCORE_NOTE_SIZE];  // Printed after the score when it is an estimate
+} BatchItem;
+
+typedef struct Pipeline {
+    SimProgram* reference;
+    char** paths;         // Submissions come from these files,
+    int count;
+    TarArchive* archive;  // or from the members of this archive
+    int total;            // Set by the loader once every submission is queued; -1 before
+    int loadFailed;
+    int parserCount, scorerCount;
+
+    BoundedQueue parseQueue, scoreQueue;
+    BatchItem* finished[PIPELINE_WINDOW];  // Reorder buffer indexed by sequence % window
+    int emitted;                           // Written by the output stage only
+    int parsersRunning;
+} Pipeline;
+
+static int initializeQueue(BoundedQueue* queue, size_t capacity) {
+    memset(queue, 0, sizeof(BoundedQueue));
+    queue->cells = malloc(sizeof(QueueCell) * capacity);
+    if (!queue->cells) return 0;
+    for (size_t i = 0; i < capacity; i++) queue->cells[i].sequence = i;
+    queue->mask = capacity - 1;
+    return 1;
+}
+
+static int tryEnqueue(BoundedQueue* queue, void* data) {
+    size_t position = __atomic_load_n(&queue->enqueuePosition, __ATOMIC_RELAXED);
+    for (;;) {
+        QueueCell* cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long difference = (long)sequence - (long)position;
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueuePosition, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->data = data;
+                __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (difference < 0) {
+            return 0; // Full
+        } else {
+            position = __atomic_load_n(&queue->enqueuePosition, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int tryDequeue(BoundedQueue* queue, void** data) {
+    size_t position = __atomic_load_n(&queue->dequeuePosition, __ATOMIC_RELAXED);
+    for (;;) {
+        QueueCell* cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long difference = (long)sequence - (long)(position + 1);
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeuePosition, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *data = cell->data;
+                __atomic_store_n(&cell->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (difference < 0) {
+            return 0; // Empty
+        } else {
+            position = __atomic_load_n(&queue->dequeuePosition, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Spin briefly, then sleep, so a stage waiting on a slower one does not burn its core
+static void backoff(int* attempts) {
+    if ((*attempts)++ < 64) {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = { 0, 50 * 1000 };
+    nanosleep(&pause, NULL);
+}
+
+static void enqueueWaiting(BoundedQueue* queue, void* data) {
+    int attempts = 0;
+    while (!tryEnqueue(queue, data)) backoff(&attempts);
+}
+
+static void* dequeueWaiting(BoundedQueue* queue) {
+    void* data;
+    int attempts = 0;
+    while (!tryDequeue(queue, &data)) backoff(&attempts);
+    return data;
+}
+
+static void finishItem(Pipeline* pipeline, BatchItem* item) {
+    __atomic_store_n(&pipeline->finished[item->sequence % PIPELINE_WINDOW], item, __ATOMIC_RELEASE);
+}
+
+static void freeItem(BatchItem* item) {
+    if (item->ownsSource) simFree((char*)item->source);
+    free(item->path);
+    free(item);
+}
+
+// Backpressure: never more than a window of submissions in memory
+static BatchItem* newItem(Pipeline* pipeline, int sequence, const char* path) {
+    int attempts = 0;
+    while (sequence - __atomic_load_n(&pipeline->emitted, __ATOMIC_ACQUIRE) >= PIPELINE_WINDOW) backoff(&attempts);
+
+    BatchItem* item = calloc(1, sizeof(BatchItem));
+    if (!item || !(item->path = strdup(path))) {
+        fprintf(stderr, "Memory allocation failed for batch item.\n");
+        exit(EXIT_FAILURE);
+    }
+    item->sequence = sequence;
+    item->score = -1;
+    return item;
+}
+
+static int loadFiles(Pipeline* pipeline) {
+    for (int i = 0; i < pipeline->count; i++) {
+        BatchItem* item = newItem(pipeline, i, pipeline->paths[i]);
+        char* source = readSourceFile(item->path, &item->length);
+        if (!source) {
+            finishItem(pipeline, item);
+            continue;
+        }
+        item->source = source;
+        item->ownsSource = 1;
+        enqueueWaiting(&pipeline->parseQueue, item);
+    }
+    return pipeline->count;
+}
+
+// Only .c members are submissions; a stream's member bytes are copied before the next read
+static int loadArchive(Pipeline* pipeline) {
+    TarMember member;
+    int sequence = 0, status;
+    while ((status = nextTarMember(pipeline->archive, &member)) == 1) {
+        size_t nameLength = strlen(member.path);
+        if (nameLength < 2 || strcmp(member.path + nameLength - 2, ".c") != 0) continue;
+
+        BatchItem* item = newItem(pipeline, sequence++, member.path);
+        item->length = member.size;
+        if (member.persistent) {
+            item->source = member.data;
+        } else {
+            char* copy = simMalloc(member.size ? member.size : 1, Alloc_Scratch);
+            if (!copy) {
+                fprintf(stderr, "Memory allocation failed for %s.\n", member.path);
+                finishItem(pipeline, item);
+                continue;
+            }
+            memcpy(copy, member.data, member.size);
+            item->source = copy;
+            item->ownsSource = 1;
+        }
+        enqueueWaiting(&pipeline->parseQueue, item);
+    }
+    if (status < 0) {
+        fprintf(stderr, "Error: Stopped reading a corrupt archive after %d submissions.\n", sequence);
+        pipeline->loadFailed = 1;
+    }
+    return sequence;
+}
+
+static void* loaderMain(void* argument) {
+    Pipeline* pipeline = argument;
+    traceNameThread("loader");
+    int total = pipeline->archive ? loadArchive(pipeline) : loadFiles(pipeline);
+    __atomic_store_n(&pipeline->total, total, __ATOMIC_RELEASE);
+
+    // One stop marker per parser
+    for (int i = 0; i < pipeline->parserCount; i++) enqueueWaiting(&pipeline->parseQueue, NULL);
+    return NULL;
+}
+
+static void* parserMain(void* argument) {
+    Pipeline* pipeline = argument;
+    traceNameThread("parser");
+    SimContext* context = sim_context_create();
+    BatchItem* item;
+    while ((item = dequeueWaiting(&pipeline->parseQueue)) != NULL) {
+        item->program = context ? sim_parse_from_buffer(context, item->path, item->source, item->length) : NULL;
+        if (item->ownsSource) simFree((char*)item->source);
+        item->source = NULL;
+        if (!item->program) {
+            fprintf(stderr, "Error: Parsing failed for %s.\n", item->path);
+            finishItem(pipeline, item);
+            continue;
+        }
+        enqueueWaiting(&pipeline->scoreQueue, item);
+    }
+    sim_context_free(context);
+
+    // The last parser out stops the scorers
+    if (__atomic_sub_fetch(&pipeline->parsersRunning, 1, __ATOMIC_ACQ_REL) == 0) {
+        for (int i = 0; i < pipeline->scorerCount; i++) enqueueWaiting(&pipeline->scoreQueue, NULL);
+    }
+    return NULL;
+}
+
+static void* scorerMain(void* argument) {
+    Pipeline* pipeline = argument;
+    traceNameThread("scorer");
+    SimContext* context = sim_context_create();
+    BatchItem* item;
+    while ((item = dequeueWaiting(&pipeline->scoreQueue)) != NULL) {
+        SimResult* result = context ? sim_compare(context, pipeline->reference, item->program) : NULL;
+        if (result) {
+            item->score = sim_result_score(result);
+            int low = 0, high = 0;
+            int estimated = sim_result_interval(result, &low, &high);
+            formatScoreNote(item->note, sim_result_degraded(result), estimated, low, high);
+        }
+        sim_result_free(result);
+        sim_program_free(item->program);
+        item->program = NULL;
+        finishItem(pipeline, item);
+    }
+    sim_context_free(context);
+    return NULL;
+}
+
+static double secondsSince(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int runPipeline(const char* referencePath, Pipeline* source, int workers) {
+    if (workers <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (int)online : 1;
+    }
+
+    SimContext* context = sim_context_create();
+    if (!context) return EXIT_FAILURE;
+    Pipeline pipeline = *source;
+    pipeline.total = -1;
+    pipeline.reference = sim_parse_file(context, referencePath);
+    if (!pipeline.reference) {
+        fprintf(stderr, "Error: Parsing failed for %s.\n", referencePath);
+        sim_context_free(context);
+        return EXIT_FAILURE;
+    }
+    pipeline.parserCount = workers;
+    pipeline.scorerCount = workers;
+    pipeline.parsersRunning = workers;
+
+    // A window plus the stop markers always fits, so the loader only waits on the window
+    int threadCount = 1 + pipeline.parserCount + pipeline.scorerCount;
+    size_t capacity = 1;
+    while (capacity < (size_t)(PIPELINE_WINDOW + workers)) capacity <<= 1;
+    pthread_t* threads = malloc(sizeof(pthread_t) * threadCount);
+    if (!threads || !initializeQueue(&pipeline.parseQueue, capacity) || !initializeQueue(&pipeline.scoreQueue, capacity)) {
+        fprintf(stderr, "Memory allocation failed for batch pipeline.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Log: Batch pipeline: %d parsers, %d scorers, window %d.\n",
+            pipeline.parserCount, pipeline.scorerCount, PIPELINE_WINDOW);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    void* (*entry[3])(void*) = { loaderMain, parserMain, scorerMain };
+    for (int i = 0; i < threadCount; i++) {
+        void* (*function)(void*) = entry[i == 0 ? 0 : (i <= pipeline.parserCount ? 1 : 2)];
+        if (pthread_create(&threads[i], NULL, function, &pipeline) != 0) {
+            // Without every stage the pipeline cannot drain
+            fprintf(stderr, "Failed to start batch pipeline thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Output stage: print strictly in submission order, then free the slot for the loader
+    int failures = 0, count = 0;
+    for (;; count++) {
+        BatchItem** slot = &pipeline.finished[count % PIPELINE_WINDOW];
+        BatchItem* item;
+        int attempts = 0;
+        while ((item = __atomic_load_n(slot, __ATOMIC_ACQUIRE)) == NULL) {
+            int total = __atomic_load_n(&pipeline.total, __ATOMIC_ACQUIRE);
+            if (total >= 0 && count >= total) break;
+            backoff(&attempts);
+        }
+        if (!item) break;
+        __atomic_store_n(slot, NULL, __ATOMIC_RELAXED);
+
+        if (item->score < 0) {
+            failures++;
+        } else {
+            printf("Total similarity score between %s and %s is: %d%%%s\n", referencePath, item->path, item->score,
+                   item->note);
+        }
+        freeItem(item);
+        __atomic_store_n(&pipeline.emitted, count + 1, __ATOMIC_RELEASE);
+    }
+    for (int i = 0; i < threadCount; i++) pthread_join(threads[i], NULL);
+
+    double elapsed = secondsSince(&start);
+    fprintf(stderr, "Log: Batch pipeline finished %d submissions in %.3fs (%.1f files/s), %d failed.\n",
+            count, elapsed, elapsed > 0 ? count / elapsed : 0.0, failures);
+
+    free(threads);
+    free(pipeline.parseQueue.cells);
+    free(pipeline.scoreQueue.cells);
+    sim_program_free(pipeline.reference);
+    sim_context_free(context);
+    return failures || pipeline.loadFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int runBatchPipeline(const char* referencePath, char** paths, int count, int workers) {
+    Pipeline source;
+    memset(&source, 0, sizeof(Pipeline));
+    source.paths = paths;
+    source.count = count;
+    return runPipeline(referencePath, &source, workers);
+}
+
+int runArchivePipeline(const char* referencePath, const char* archivePath, int workers) {
+    Pipeline source;
+    memset(&source, 0, sizeof(Pipeline));
+    if (!(source.archive = openTarArchive(archivePath))) return EXIT_FAILURE;
+    // Mapped members are parsed in place, so the archive outlives the pipeline
+    int status = runPipeline(referencePath, &source, workers);
+    closeTarArchive(source.archive);
+    return status;
+}
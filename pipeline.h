@@ -0,0 +1,22 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#define PIPELINE_WINDOW 64           // Submissions between loading and output; a power of two
+#define PIPELINE_DEFAULT_WORKERS 0   // One parser and one scorer per online CPU
+
+// Scores many submissions against one reference through a staged pipeline:
+//
+//   loader thread --> parse queue --> parser workers --> score queue --> scorer workers
+//        ^                                                                     |
+//        '---- at most PIPELINE_WINDOW in flight <-- in-order output <---------'
+//
+// The queues are bounded lock-free rings. The loader runs ahead of the parsers until
+// the window is full, which bounds memory whatever the cohort size, and results are
+// printed in submission order.
+int runBatchPipeline(const char* referencePath, char** paths, int count, int workers);
+
+// Same, with the submissions read straight from the .c members of a tar archive
+// (a file, or "-" for stdin). Results are reported under the member paths.
+int runArchivePipeline(const char* referencePath, const char* archivePath, int workers);
+
+#endif
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "resultcache.h"
+
+uint64_t contentHashUpdate(uint64_t hash, const void* bytes, size_t length) {
+    const unsigned char* p = bytes;
+    for (size_t i = 0; i < length; i++) { // FNV-1a
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t contentHash(const void* bytes, size_t length) {
+    return contentHashUpdate(CONTENT_HASH_SEED, bytes, length);
+}
+
+static size_t fileBytesFor(uint32_t slotCount) {
+    return sizeof(ResultCacheHeader) + (size_t)slotCount * sizeof(ResultCacheSlot);
+}
+
+static uint32_t homeSlot(const ResultCache* cache, uint64_t referenceHash, uint64_t submissionHash, uint32_t version) {
+    uint64_t h = referenceHash ^ ((submissionHash << 29) | (submissionHash >> 35)) ^ (version * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (uint32_t)(h % cache->header->slotCount);
+}
+
+static void unmapCache(ResultCache* cache) {
+    if (cache->header) munmap(cache->header, cache->mappedBytes);
+    cache->header = NULL;
+    cache->slots = NULL;
+    cache->mappedBytes = 0;
+}
+
+static int mapCache(ResultCache* cache, size_t bytes) {
+    void* base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap result cache");
+        return 0;
+    }
+    cache->header = base;
+    cache->slots = (ResultCacheSlot*)((char*)base + sizeof(ResultCacheHeader));
+    cache->mappedBytes = bytes;
+    return 1;
+}
+
+// Another process may have resized the file since we mapped it; call with the lock held
+static int ensureMapped(ResultCache* cache) {
+    if (!cache->header) return 0;
+    size_t bytes = fileBytesFor(cache->header->slotCount);
+    if (bytes == cache->mappedBytes) return 1;
+    unmapCache(cache);
+    return mapCache(cache, bytes);
+}
+
+static int initializeCache(ResultCache* cache, uint32_t slotCount) {
+    unmapCache(cache);
+    size_t bytes = fileBytesFor(slotCount);
+    if (ftruncate(cache->fd, 0) != 0 || ftruncate(cache->fd, (off_t)bytes) != 0) {
+        perror("ftruncate result cache");
+        return 0;
+    }
+    if (!mapCache(cache, bytes)) return 0;
+    memcpy(cache->header->magic, RESULT_CACHE_MAGIC, sizeof(cache->header->magic));
+    cache->header->format = RESULT_CACHE_FORMAT;
+    cache->header->slotCount = slotCount;
+    cache->header->clock = 0;
+    return 1;
+}
+
+static uint64_t tick(ResultCache* cache) {
+    return __atomic_add_fetch(&cache->header->clock, 1, __ATOMIC_RELAXED);
+}
+
+// Writes an entry into its probe window: same key, else an empty slot, else the least recently used
+static void insertSlot(ResultCache* cache, const ResultCacheSlot* entry) {
+    uint32_t slotCount = cache->header->slotCount;
+    uint32_t home = homeSlot(cache, entry->referenceHash, entry->submissionHash, entry->scorerVersion);
+    uint32_t window = slotCount < RESULT_CACHE_PROBE_LIMIT ? slotCount : RESULT_CACHE_PROBE_LIMIT;
+
+    ResultCacheSlot* target = NULL;
+    ResultCacheSlot* oldest = NULL;
+    for (uint32_t i = 0; i < window; i++) {
+        ResultCacheSlot* slot = &cache->slots[(home + i) % slotCount];
+        if (slot->lastUsed == 0 ||
+            (slot->referenceHash == entry->referenceHash && slot->submissionHash == entry->submissionHash &&
+             slot->scorerVersion == entry->scorerVersion)) {
+            target = slot;
+            break;
+        }
+        if (!oldest || slot->lastUsed < oldest->lastUsed) oldest = slot;
+    }
+    if (!target) {
+        target = oldest;
+        cache->evictions++;
+    }
+
+    // lastUsed goes last, so a reader never sees a half-written slot as valid
+    __atomic_store_n(&target->lastUsed, 0, __ATOMIC_RELEASE);
+    target->referenceHash = entry->referenceHash;
+    target->submissionHash = entry->submissionHash;
+    target->scorerVersion = entry->scorerVersion;
+    target->score = entry->score;
+    __atomic_store_n(&target->lastUsed, entry->lastUsed, __ATOMIC_RELEASE);
+}
+
+static int compareByLastUsed(const void* a, const void* b) {
+    uint64_t x = ((const ResultCacheSlot*)a)->lastUsed, y = ((const ResultCacheSlot*)b)->lastUsed;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Rebuilds the table with a new slot count; the most recent entries win collisions
+static int resizeCache(ResultCache* cache, uint32_t slotCount) {
+    uint32_t oldCount = cache->header->slotCount;
+    uint64_t clock = cache->header->clock;
+    ResultCacheSlot* live = malloc(sizeof(ResultCacheSlot) * (oldCount ? oldCount : 1));
+    if (!live) {
+        fprintf(stderr, "Memory allocation failed while resizing result cache.\n");
+        return 0;
+    }
+    uint32_t liveCount = 0;
+    for (uint32_t i = 0; i < oldCount; i++) {
+        if (cache->slots[i].lastUsed != 0) live[liveCount++] = cache->slots[i];
+    }
+    qsort(live, liveCount, sizeof(ResultCacheSlot), compareByLastUsed);
+
+    int ok = initializeCache(cache, slotCount);
+    if (ok) {
+        cache->header->clock = clock;
+        for (uint32_t i = 0; i < liveCount; i++) insertSlot(cache, &live[i]);
+        cache->evictions = 0;
+    }
+    free(live);
+    fprintf(stderr, "Log: Resized result cache %s from %u to %u entries.\n", cache->path, oldCount, slotCount);
+    return ok;
+}
+
+ResultCache* openResultCache(const char* path, uint32_t maxEntries) {
+    if (maxEntries == 0) maxEntries = RESULT_CACHE_DEFAULT_ENTRIES;
+
+    ResultCache* cache = calloc(1, sizeof(ResultCache));
+    if (!cache || !(cache->path = strdup(path))) {
+        fprintf(stderr, "Memory allocation failed for result cache.\n");
+        free(cache);
+        return NULL;
+    }
+    cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0) {
+        perror("open result cache");
+        free(cache->path);
+        free(cache);
+        return NULL;
+    }
+
+    flock(cache->fd, LOCK_EX);
+    struct stat info;
+    int ok = fstat(cache->fd, &info) == 0;
+    if (ok && (size_t)info.st_size >= sizeof(ResultCacheHeader)) {
+        ok = mapCache(cache, sizeof(ResultCacheHeader));
+        int valid = ok && memcmp(cache->header->magic, RESULT_CACHE_MAGIC, sizeof(cache->header->magic)) == 0 &&
+                    cache->header->format == RESULT_CACHE_FORMAT && cache->header->slotCount > 0 &&
+                    (size_t)info.st_size == fileBytesFor(cache->header->slotCount);
+        if (!valid) {
+            fprintf(stderr, "Log: Result cache %s is not valid, starting a new one.\n", path);
+            ok = initializeCache(cache, maxEntries);
+        } else {
+            ok = ensureMapped(cache);
+            if (ok && cache->header->slotCount != maxEntries) ok = resizeCache(cache, maxEntries);
+        }
+    } else if (ok) {
+        ok = initializeCache(cache, maxEntries);
+    }
+    flock(cache->fd, LOCK_UN);
+
+    if (!ok) {
+        closeResultCache(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void closeResultCache(ResultCache* cache) {
+    if (!cache) return;
+    fprintf(stderr, "Log: Result cache %s: %lu hits, %lu misses, %lu evictions.\n",
+            cache->path, cache->hits, cache->misses, cache->evictions);
+    unmapCache(cache);
+    if (cache->fd >= 0) close(cache->fd);
+    free(cache->path);
+    free(cache);
+}
+
+int lookupResult(ResultCache* cache, uint64_t referenceHash, uint64_t submissionHash, int* score) {
+    if (!cache) return 0;
+
+    int found = 0;
+    flock(cache->fd, LOCK_SH);
+    if (ensureMapped(cache)) {
+        uint32_t slotCount = cache->header->slotCount;
+        uint32_t home = homeSlot(cache, referenceHash, submissionHash, SCORER_VERSION);
+        uint32_t window = slotCount < RESULT_CACHE_PROBE_LIMIT ? slotCount : RESULT_CACHE_PROBE_LIMIT;
+        for (uint32_t i = 0; i < window; i++) {
+            ResultCacheSlot* slot = &cache->slots[(home + i) % slotCount];
+            if (__atomic_load_n(&slot->lastUsed, __ATOMIC_ACQUIRE) == 0) break;
+            if (slot->referenceHash == referenceHash && slot->submissionHash == submissionHash &&
+                slot->scorerVersion == SCORER_VERSION) {
+                *score = slot->score;
+                __atomic_store_n(&slot->lastUsed, tick(cache), __ATOMIC_RELAXED);
+                found = 1;
+                break;
+            }
+        }
+    }
+    flock(cache->fd, LOCK_UN);
+
+    if (found) cache->hits++;
+    else cache->misses++;
+    return found;
+}
+
+void storeResult(ResultCache* cache, uint64_t referenceHash, uint64_t submissionHash, int score) {
+    if (!cache) return;
+
+    flock(cache->fd, LOCK_EX);
+    if (ensureMapped(cache)) {
+        ResultCacheSlot entry = { referenceHash, submissionHash, SCORER_VERSION, score, tick(cache) };
+        insertSlot(cache, &entry);
+    }
+    flock(cache->fd, LOCK_UN);
+}
@@ -0,0 +1,59 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bump whenever compareASTs can return a different score for the same inputs,
+// so results cached by an older scorer are never reused
+#define SCORER_VERSION 5
+
+#define RESULT_CACHE_MAGIC "SIMCACHE"
+#define RESULT_CACHE_FORMAT 1
+#define RESULT_CACHE_DEFAULT_ENTRIES 65536
+#define RESULT_CACHE_PROBE_LIMIT 16  // Slots searched per key; the least recently used one is evicted
+
+// On-disk layout: one header followed by a fixed array of slots, mapped shared.
+// Slots are found by open addressing on the key; an empty slot has lastUsed == 0.
+typedef struct ResultCacheHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t slotCount;
+    uint64_t clock;          // Bumped on every hit or store, stamped into lastUsed
+    uint64_t reserved[5];
+} ResultCacheHeader;
+
+typedef struct ResultCacheSlot {
+    uint64_t referenceHash;
+    uint64_t submissionHash;
+    uint32_t scorerVersion;
+    int32_t score;
+    uint64_t lastUsed;
+} ResultCacheSlot;
+
+typedef struct ResultCache {
+    int fd;
+    char* path;
+    ResultCacheHeader* header;
+    ResultCacheSlot* slots;
+    size_t mappedBytes;
+    unsigned long hits, misses, evictions;
+} ResultCache;
+
+#define CONTENT_HASH_SEED 14695981039346656037ULL
+
+// Hash of raw source bytes used as a cache key
+uint64_t contentHash(const void* bytes, size_t length);
+// Continues a hash over more bytes; contentHash(b, n) == contentHashUpdate(CONTENT_HASH_SEED, b, n)
+uint64_t contentHashUpdate(uint64_t hash, const void* bytes, size_t length);
+
+// Opens or creates the cache file. A file created with a different entry count is
+// resized, keeping the most recently used results.
+ResultCache* openResultCache(const char* path, uint32_t maxEntries);
+void closeResultCache(ResultCache* cache);
+
+// Both are safe to call from concurrent processes sharing the file (flock)
+int lookupResult(ResultCache* cache, uint64_t referenceHash, uint64_t submissionHash, int* score);
+void storeResult(ResultCache* cache, uint64_t referenceHash, uint64_t submissionHash, int score);
+
+#endif
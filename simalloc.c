@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "simalloc.h"
+
+struct AllocAccount {
+    char name[256];
+    size_t live;
+    size_t peak;
+    size_t allocations;
+    size_t liveBlocks;
+    size_t liveByTag[ALLOC_TAG_COUNT];
+    size_t blocksByTag[ALLOC_TAG_COUNT];
+};
+
+// Sits in front of every block while accounting or live byte tracking is on; the union
+// keeps the block behind it aligned like anything malloc returns
+typedef union AllocHeader {
+    struct {
+        size_t size;
+        AllocAccount* account;
+        AllocTag tag;
+    } block;
+    long double align;
+    void* pointer;
+} AllocHeader;
+
+// Totals over all accounts, and over blocks allocated outside any account
+typedef struct AllocTotals {
+    size_t live;
+    size_t peak;
+    size_t allocations;
+} AllocTotals;
+
+static void* defaultAllocate(size_t size, void* user) {
+    (void)user;
+    return malloc(size);
+}
+
+static void* defaultReallocate(void* block, size_t size, void* user) {
+    (void)user;
+    return realloc(block, size);
+}
+
+static void defaultRelease(void* block, void* user) {
+    (void)user;
+    free(block);
+}
+
+static SimAllocator allocator = { defaultAllocate, defaultReallocate, defaultRelease, NULL };
+static int accounting = 0;
+static int blockHeaders = 0;  // Accounting or live byte tracking: every block knows its size
+static int allocationsStarted = 0;
+
+static AllocTotals totals;
+static AllocTotals tagTotals[ALLOC_TAG_COUNT];
+
+static __thread AllocAccount* currentAccount;
+static __thread size_t threadAllocated;  // Bytes requested by this thread, whatever the accounting
+static __thread int64_t threadLive;      // Bytes allocated minus bytes freed by this thread, with block headers
+
+static pthread_mutex_t accountsLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t accountsClosed, accountsLeaking;
+static size_t largestPeak;
+static char largestName[256];
+
+static const char* tagNames[] = {
+    "Program", "Root", "FunctionDef", "MainFunction", "Functions", "Body", "FunctionCall", "Expression",
+    "Parameter", "VariableDecl", "Assignment", "Return", "Condition", "IfBody", "ElseBody", "WhileBody",
+    "ForInit", "ForIncrement", "ForBody", "If", "IfElse", "While", "For", "Statements", "ControlStructure",
+    "ParameterList", "Identifier", "Array", "Loop", "Number", "Break", "Continue", "ArrayAccess",
+    "ArrayDeclaration", "ArrayUsage", "Variable", "Iteration", "Constant",
+    "match_table", "token", "scanner", "parser", "affine_slots", "function_index", "scratch"
+};
+typedef char tagNamesCoverEveryTag[sizeof(tagNames) / sizeof(tagNames[0]) == ALLOC_TAG_COUNT ? 1 : -1];
+
+int setAllocator(const SimAllocator* replacement) {
+    if (__atomic_load_n(&allocationsStarted, __ATOMIC_RELAXED) || !replacement ||
+        !replacement->allocate || !replacement->reallocate || !replacement->release) {
+        return 0;
+    }
+    allocator = *replacement;
+    return 1;
+}
+
+int enableAllocAccounting(void) {
+    if (__atomic_load_n(&allocationsStarted, __ATOMIC_RELAXED)) return 0;
+    accounting = 1;
+    blockHeaders = 1;
+    return 1;
+}
+
+int enableLiveByteTracking(void) {
+    if (blockHeaders) return 1;
+    if (__atomic_load_n(&allocationsStarted, __ATOMIC_RELAXED)) return 0;
+    blockHeaders = 1;
+    return 1;
+}
+
+int liveByteTrackingEnabled(void) {
+    return blockHeaders;
+}
+
+int allocAccountingEnabled(void) {
+    return accounting;
+}
+
+static void raisePeak(size_t* peak, size_t live) {
+    size_t seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (live > seen && !__atomic_compare_exchange_n(peak, &seen, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void addToTotals(AllocTotals* total, size_t size) {
+    size_t live = __atomic_add_fetch(&total->live, size, __ATOMIC_RELAXED);
+    raisePeak(&total->peak, live);
+    __atomic_add_fetch(&total->allocations, 1, __ATOMIC_RELAXED);
+}
+
+static void charge(AllocAccount* account, AllocTag tag, size_t size) {
+    addToTotals(&totals, size);
+    addToTotals(&tagTotals[tag], size);
+    if (!account) return;
+    size_t live = __atomic_add_fetch(&account->live, size, __ATOMIC_RELAXED);
+    raisePeak(&account->peak, live);
+    __atomic_add_fetch(&account->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&account->liveBlocks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&account->liveByTag[tag], size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&account->blocksByTag[tag], 1, __ATOMIC_RELAXED);
+}
+
+static void refund(AllocAccount* account, AllocTag tag, size_t size) {
+    __atomic_sub_fetch(&totals.live, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&tagTotals[tag].live, size, __ATOMIC_RELAXED);
+    if (!account) return;
+    __atomic_sub_fetch(&account->live, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&account->liveBlocks, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&account->liveByTag[tag], size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&account->blocksByTag[tag], 1, __ATOMIC_RELAXED);
+}
+
+void* simMalloc(size_t size, AllocTag tag) {
+    if (__builtin_expect(!__atomic_load_n(&allocationsStarted, __ATOMIC_RELAXED), 0)) {
+        __atomic_store_n(&allocationsStarted, 1, __ATOMIC_RELAXED);
+    }
+    threadAllocated += size;
+    if (!blockHeaders) return allocator.allocate(size, allocator.user);
+
+    if (size > SIZE_MAX - sizeof(AllocHeader)) return NULL;
+    AllocHeader* header = allocator.allocate(sizeof(AllocHeader) + size, allocator.user);
+    if (!header) return NULL;
+    header->block.size = size;
+    header->block.account = currentAccount;
+    header->block.tag = tag;
+    threadLive += (int64_t)size;
+    if (accounting) charge(header->block.account, tag, size);
+    return header + 1;
+}
+
+void* simCalloc(size_t count, size_t size, AllocTag tag) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* block = simMalloc(count * size, tag);
+    if (block) memset(block, 0, count * size);
+    return block;
+}
+
+void* simRealloc(void* block, size_t size, AllocTag tag) {
+    if (!block) return simMalloc(size, tag);
+    threadAllocated += size;
+    if (!blockHeaders) return allocator.reallocate(block, size, allocator.user);
+
+    if (size > SIZE_MAX - sizeof(AllocHeader)) return NULL;
+    AllocHeader* header = (AllocHeader*)block - 1;
+    AllocHeader* grown = allocator.reallocate(header, sizeof(AllocHeader) + size, allocator.user);
+    if (!grown) return NULL;
+    // Charged as a free of the old size and an allocation of the new one
+    threadLive += (int64_t)size - (int64_t)grown->block.size;
+    if (accounting) {
+        refund(grown->block.account, grown->block.tag, grown->block.size);
+        charge(grown->block.account, grown->block.tag, size);
+    }
+    grown->block.size = size;
+    return grown + 1;
+}
+
+char* simStrdup(const char* text, AllocTag tag) {
+    size_t length = strlen(text) + 1;
+    char* copy = simMalloc(length, tag);
+    if (copy) memcpy(copy, text, length);
+    return copy;
+}
+
+void simFree(void* block) {
+    if (!block) return;
+    if (!blockHeaders) {
+        allocator.release(block, allocator.user);
+        return;
+    }
+    AllocHeader* header = (AllocHeader*)block - 1;
+    threadLive -= (int64_t)header->block.size;
+    if (accounting) refund(header->block.account, header->block.tag, header->block.size);
+    allocator.release(header, allocator.user);
+}
+
+size_t simThreadAllocated(void) {
+    return threadAllocated;
+}
+
+int64_t simThreadLive(void) {
+    return threadLive;
+}
+
+AllocAccount* createAllocAccount(const char* name) {
+    if (!accounting) return NULL;
+    AllocAccount* account = calloc(1, sizeof(AllocAccount));
+    if (!account) {
+        fprintf(stderr, "Memory allocation failed for the allocation account of %s.\n", name);
+        return NULL;
+    }
+    snprintf(account->name, sizeof(account->name), "%s", name);
+    return account;
+}
+
+AllocAccount* enterAllocAccount(AllocAccount* account) {
+    AllocAccount* previous = currentAccount;
+    currentAccount = account;
+    return previous;
+}
+
+AllocAccount* currentAllocAccount(void) {
+    return currentAccount;
+}
+
+void allocAccountUsage(const AllocAccount* account, size_t* liveBytes, size_t* peakBytes, size_t* allocations) {
+    if (liveBytes) *liveBytes = account ? __atomic_load_n(&account->live, __ATOMIC_RELAXED) : 0;
+    if (peakBytes) *peakBytes = account ? __atomic_load_n(&account->peak, __ATOMIC_RELAXED) : 0;
+    if (allocations) *allocations = account ? __atomic_load_n(&account->allocations, __ATOMIC_RELAXED) : 0;
+}
+
+void closeAllocAccount(AllocAccount* account) {
+    if (!account) return;
+    if (currentAccount == account) currentAccount = NULL;
+
+    size_t live = __atomic_load_n(&account->live, __ATOMIC_RELAXED);
+    fprintf(stderr, "Log: Memory for %s: peak %zu bytes, %zu allocations.\n", account->name,
+            account->peak, account->allocations);
+
+    pthread_mutex_lock(&accountsLock);
+    accountsClosed++;
+    if (account->peak > largestPeak) {
+        largestPeak = account->peak;
+        snprintf(largestName, sizeof(largestName), "%s", account->name);
+    }
+    if (live) accountsLeaking++;
+    pthread_mutex_unlock(&accountsLock);
+
+    if (!live) {
+        free(account);
+        return;
+    }
+    fprintf(stderr, "Leak: %s still holds %zu bytes in %zu blocks.\n", account->name, live, account->liveBlocks);
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        if (account->blocksByTag[t]) {
+            fprintf(stderr, "Leak:   %s: %zu bytes in %zu blocks\n", tagNames[t], account->liveByTag[t], account->blocksByTag[t]);
+        }
+    }
+}
+
+static void writeJSONName(FILE* output, const char* text) {
+    fputc('"', output);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(output, "\\%c", *c);
+        else if (*c < 0x20) fprintf(output, "\\u%04x", *c);
+        else fputc(*c, output);
+    }
+    fputc('"', output);
+}
+
+int writeAllocJSON(FILE* output) {
+    pthread_mutex_lock(&accountsLock);
+    fprintf(output, "{\n  \"memory\": {\n    \"accounting\": %s,\n", accounting ? "true" : "false");
+    fprintf(output, "    \"live_bytes\": %zu,\n    \"peak_bytes\": %zu,\n    \"allocations\": %zu,\n",
+            totals.live, totals.peak, totals.allocations);
+    fprintf(output, "    \"submissions\": %zu,\n    \"leaking_submissions\": %zu,\n", accountsClosed, accountsLeaking);
+    fprintf(output, "    \"largest_submission\": { \"name\": ");
+    writeJSONName(output, largestName);
+    fprintf(output, ", \"peak_bytes\": %zu },\n    \"tags\": {\n", largestPeak);
+    int written = 0;
+    for (int t = 0; t < ALLOC_TAG_COUNT; t++) {
+        if (!tagTotals[t].allocations) continue;
+        fprintf(output, "%s      \"%s\": { \"allocations\": %zu, \"peak_bytes\": %zu, \"live_bytes\": %zu }",
+                written++ ? ",\n" : "", tagNames[t], tagTotals[t].allocations, tagTotals[t].peak, tagTotals[t].live);
+    }
+    fprintf(output, "\n    }\n  }\n}\n");
+    pthread_mutex_unlock(&accountsLock);
+    return fflush(output) == 0 && !ferror(output);
+}
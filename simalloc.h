@@ -0,0 +1,77 @@
+#ifndef SIMALLOC_H
+#define SIMALLOC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// Allocation layer for everything a parse produces: AST nodes and what they own,
+// token text, scanner buffers, parser stacks and match tables. Memory from here must
+// be released with simFree, never free().
+//
+// With accounting on, every block carries a small header naming its tag and the
+// account that was current when it was allocated, so frees are charged back to the
+// right submission on whichever thread they happen. Accounting and the allocator can
+// only be changed before the first allocation.
+
+typedef enum AllocTag {
+    Alloc_Node,  // One tag per NodeType, Alloc_Node + type: the node and the strings and arrays it owns
+    Alloc_MatchTable = Alloc_Node + NodeType_Constant + 1,
+    Alloc_Token,     // Token text, until the grammar action that consumes it
+    Alloc_Scanner,   // Scanner state and scan buffers
+    Alloc_Parser,    // Parser stacks and push parser state
+    Alloc_Slots,     // Affine slot names
+    Alloc_FunctionIndex, // Signatures and bucket chains of a function signature index
+    Alloc_Scratch,   // Work arrays that do not outlive the call that made them
+    ALLOC_TAG_COUNT
+} AllocTag;
+
+#define nodeAllocTag(type) ((AllocTag)(Alloc_Node + (type)))
+
+// Pluggable backing allocator; the default is malloc, realloc and free
+typedef struct SimAllocator {
+    void* (*allocate)(size_t size, void* user);
+    void* (*reallocate)(void* block, size_t size, void* user);
+    void (*release)(void* block, void* user);
+    void* user;
+} SimAllocator;
+
+// Live bytes, peak and allocation counts of one submission (or any other unit of work)
+typedef struct AllocAccount AllocAccount;
+
+int setAllocator(const SimAllocator* allocator);  // 0 once something has been allocated
+int enableAllocAccounting(void);                   // Same restriction
+int allocAccountingEnabled(void);
+// Block headers without the accounts, so frees know their size; implied by accounting.
+// Same restriction.
+int enableLiveByteTracking(void);
+int liveByteTrackingEnabled(void);
+
+void* simMalloc(size_t size, AllocTag tag);
+void* simCalloc(size_t count, size_t size, AllocTag tag);
+void* simRealloc(void* block, size_t size, AllocTag tag);  // A block keeps its first tag and account
+char* simStrdup(const char* text, AllocTag tag);
+void simFree(void* block);
+// Bytes the calling thread has requested so far, frees not deducted; a realloc counts its
+// new size. Kept with accounting off too.
+size_t simThreadAllocated(void);
+// Bytes the calling thread has allocated minus those it has freed, whoever allocated them,
+// so it can go negative; a realloc counts its change in size. Only kept with live byte
+// tracking.
+int64_t simThreadLive(void);
+
+// Allocations of the calling thread are charged to the entered account until the
+// previous one is entered again. Accounts are NULL while accounting is off.
+AllocAccount* createAllocAccount(const char* name);
+AllocAccount* enterAllocAccount(AllocAccount* account);  // Returns the account it replaces
+AllocAccount* currentAllocAccount(void);
+void allocAccountUsage(const AllocAccount* account, size_t* liveBytes, size_t* peakBytes, size_t* allocations);
+// Logs the account's peak, and as a leak whatever it still holds. An account that still
+// holds blocks is kept, since those blocks point to it.
+void closeAllocAccount(AllocAccount* account);
+
+// Per-tag totals and the largest submission; 0 on an I/O error
+int writeAllocJSON(FILE* output);
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef SIMANALYSIS_H
+#define SIMANALYSIS_H
+
+// Public C API of libsimanalysis. Only what is declared here is exported from the
+// shared library; the AST and comparison internals may change between versions.
+//
+// A context carries per-caller state (last error, counters). Use one context per
+// thread. Parsed programs are read-only after sim_parse_*, so one reference program
+// may be compared against submissions from several threads at once.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SIM_API __attribute__((visibility("default")))
+#else
+#define SIM_API
+#endif
+
+#define SIM_API_VERSION 1
+
+typedef struct SimContext SimContext;
+typedef struct SimProgram SimProgram;
+typedef struct SimResult SimResult;
+typedef struct SimCache SimCache;
+typedef struct SimHistory SimHistory;
+
+// One MatchTable entry. The strings are owned by the result.
+typedef struct SimMatch {
+    const char* name1;  // Names as written in the sources, not the canonical ones
+    const char* name2;
+    const char* details;
+    int totalScore;
+    int dimensionsMatch;
+    int initializationMatch;
+    int indexMatch;
+} SimMatch;
+
+SIM_API int sim_api_version(void);
+
+SIM_API SimContext* sim_context_create(void);
+SIM_API void sim_context_free(SimContext* context);
+// Message of the last failed call on this context, or "" when there is none
+SIM_API const char* sim_last_error(const SimContext* context);
+
+// Parses, canonicalizes and analyzes a program. Returns NULL on failure.
+SIM_API SimProgram* sim_parse_from_buffer(SimContext* context, const char* name, const char* source, size_t length);
+SIM_API SimProgram* sim_parse_file(SimContext* context, const char* path);
+SIM_API void sim_program_free(SimProgram* program);
+SIM_API const char* sim_program_name(const SimProgram* program);
+
+// Compares a submission against a reference. Returns NULL on failure.
+SIM_API SimResult* sim_compare(SimContext* context, const SimProgram* reference, const SimProgram* submission);
+SIM_API void sim_result_free(SimResult* result);
+SIM_API int sim_result_score(const SimResult* result);
+// 1 when the comparison ran out of budget (see sim_budget_set) and the score is an estimate
+SIM_API int sim_result_degraded(const SimResult* result);
+// Fills the 95% interval of a sampled score (see sim_approximate_set); returns 0 when
+// the score is exact
+SIM_API int sim_result_interval(const SimResult* result, int* low, int* high);
+SIM_API int sim_result_match_count(const SimResult* result);
+// Fills *match for 0 <= index < sim_result_match_count(); returns 0 when out of range
+SIM_API int sim_result_match(const SimResult* result, int index, SimMatch* match);
+
+// Persistent score cache keyed by (reference hash, submission hash, scorer version).
+// The file may be shared by concurrent processes; max_entries of 0 picks the default.
+SIM_API SimCache* sim_cache_open(SimContext* context, const char* path, unsigned int max_entries);
+SIM_API void sim_cache_close(SimCache* cache);
+SIM_API uint64_t sim_content_hash(const void* bytes, size_t length);
+SIM_API int sim_cache_lookup(SimCache* cache, uint64_t reference_hash, uint64_t submission_hash, int* score);
+SIM_API void sim_cache_store(SimCache* cache, uint64_t reference_hash, uint64_t submission_hash, int score);
+SIM_API uint64_t sim_program_hash(const SimProgram* program);
+
+// Scores a submission held in memory against a parsed reference, parsing the
+// submission only on a cache miss. Returns the score, or -1 on failure.
+SIM_API int sim_compare_cached(SimContext* context, SimCache* cache, const SimProgram* reference,
+                               const char* name, const char* source, size_t length);
+
+// Revision history of one submission. Each new revision only re-parses the top-level
+// functions and declarations whose text changed, and only re-scores the function pairs
+// whose canonical bodies changed. Not thread-safe; use one history per submission.
+SIM_API SimHistory* sim_history_create(SimContext* context);
+SIM_API void sim_history_free(SimHistory* history);
+SIM_API SimProgram* sim_parse_revision(SimContext* context, SimHistory* history, const char* name,
+                                       const char* source, size_t length);
+// Same as sim_compare, reusing the function pair scores of earlier revisions
+SIM_API SimResult* sim_compare_revision(SimContext* context, SimHistory* history,
+                                        const SimProgram* reference, const SimProgram* submission);
+
+// Built-in phase timers and counters, off by default. Enable before creating any
+// threads that use the library; sim_stats_report returns the counters of all threads
+// so far as a malloc'd JSON document (free it), or NULL when out of memory.
+SIM_API void sim_stats_enable(void);
+SIM_API char* sim_stats_report(void);
+
+// Span tracing of parses and comparisons, off by default. Enable it before creating any
+// threads; sim_trace_write saves every thread's spans as Chrome trace-event JSON
+// (viewable in Perfetto). Returns 0 on failure.
+SIM_API void sim_trace_enable(void);
+SIM_API int sim_trace_write(const char* path);
+
+// Per-submission allocation accounting, off by default. sim_memory_enable only works
+// before the library has allocated anything (it returns 0 otherwise). Each program is
+// charged for its parse and the comparisons it is the submission of, and logs its peak
+// and any leaked blocks when freed. sim_memory_report returns the per-node-type totals
+// as a malloc'd JSON document (free it), or NULL when out of memory.
+SIM_API int sim_memory_enable(void);
+SIM_API char* sim_memory_report(void);
+// Fills the program's live and peak bytes; returns 0 when accounting is off
+SIM_API int sim_program_memory(const SimProgram* program, size_t* live_bytes, size_t* peak_bytes);
+
+// Scanner backend for every later parse: "flex" (the default unless built with
+// SCANNER=simd) or "simd", a hand-written scanner giving the same tokens. Select it
+// before parsing anything; returns 0 for an unknown name.
+SIM_API int sim_scanner_select(const char* name);
+
+// Hash-consing of expressions, off by default: identifiers, constants and expressions
+// over them are shared between every program parsed afterwards, so a cohort holds one
+// copy of each. Enable it before parsing anything. Shared nodes are charged to a
+// "shared expressions" account, not to the programs holding them.
+SIM_API void sim_share_enable(void);
+
+// Wall-time and allocation budget of every later comparison, 0 for no limit (the
+// default). A comparison that runs out estimates the array pairs it has not compared
+// from a sample and the function bodies from their feature counts, and its result is
+// marked degraded; sim_compare_cached does not store such scores. Set it before
+// creating any threads that compare. The byte limit is on memory a comparison holds,
+// not on what it allocates and frees again, when it is set before parsing anything.
+SIM_API void sim_budget_set(double milliseconds, size_t bytes);
+
+// Approximate comparison for very large programs, off by default (a target of 0). The
+// declaration and access pairs are sampled, stratified by index count and first index,
+// until the 95% interval of the score is at most target_error percentage points either
+// side; sim_result_interval returns it. Pair loops of up to 4096 pairs are still
+// compared exactly, and sim_compare_cached does not store sampled scores. Set it before
+// creating any threads that compare.
+SIM_API void sim_approximate_set(double target_error);
+
+// Prints the full text report (ASTs, dependences, locality, cost) to stdout
+SIM_API void sim_print_report(SimContext* context, const SimProgram* reference, const SimProgram* submission);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ast.h"
+#include "simalloc.h"
+#include "simdlexer.h"
+#include "y.tab.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SIMD_LEXER_X86 1
+#include <immintrin.h>
+#endif
+
+ScannerBackend scannerBackend = SIM_DEFAULT_SCANNER;
+
+struct SimdLexer {
+    const char* input;
+    size_t length;
+    size_t position;
+    int lineNumber;
+    const char* text;   // Last token, not terminated
+    size_t textLength;
+    char* textCopy;     // Terminated copy of it for simdLexText
+    size_t textCapacity;
+};
+
+// Each kernel returns the first index in [i, n) whose byte is outside its class
+// (or, for findEither, equal to one of the two bytes), and n when there is none
+typedef struct ScanKernels {
+    const char* name;
+    size_t (*skipWhitespace)(const char* p, size_t i, size_t n);
+    size_t (*skipWord)(const char* p, size_t i, size_t n);
+    size_t (*skipDigits)(const char* p, size_t i, size_t n);
+    size_t (*findEither)(const char* p, size_t i, size_t n, char a, char b);
+} ScanKernels;
+
+int selectScanner(const char* name) {
+    if (strcmp(name, "flex") == 0) scannerBackend = Scanner_Flex;
+    else if (strcmp(name, "simd") == 0) scannerBackend = Scanner_Simd;
+    else return 0;
+    return 1;
+}
+
+const char* scannerName(void) {
+    return scannerBackend == Scanner_Simd ? "simd" : "flex";
+}
+
+/* ---- Byte loops: the tails of the vector kernels, and the kernels elsewhere ---- */
+
+static inline int isWordByte(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+static size_t skipWhitespaceScalar(const char* p, size_t i, size_t n) {
+    while (i < n && (p[i] == ' ' || p[i] == '\t' || p[i] == '\n')) i++;
+    return i;
+}
+
+static size_t skipWordScalar(const char* p, size_t i, size_t n) {
+    while (i < n && isWordByte((unsigned char)p[i])) i++;
+    return i;
+}
+
+static size_t skipDigitsScalar(const char* p, size_t i, size_t n) {
+    while (i < n && (unsigned char)(p[i] - '0') < 10) i++;
+    return i;
+}
+
+static size_t findEitherScalar(const char* p, size_t i, size_t n, char a, char b) {
+    while (i < n && p[i] != a && p[i] != b) i++;
+    return i;
+}
+
+static const ScanKernels scalarKernels = {
+    "scalar", skipWhitespaceScalar, skipWordScalar, skipDigitsScalar, findEitherScalar
+};
+
+#ifdef SIMD_LEXER_X86
+
+/* ---- SSE2: 16 bytes per step ---- */
+
+// Bytes in [lo, hi]: min(v - lo, hi - lo) == v - lo, compared unsigned
+static inline __m128i inRange16(__m128i v, char lo, char hi) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8((char)(hi - lo))), offset);
+}
+
+static inline unsigned whitespaceMask16(__m128i v) {
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+}
+
+static inline unsigned wordMask16(__m128i v) {
+    __m128i letter = inRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digitOrUnderscore = _mm_or_si128(inRange16(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(letter, digitOrUnderscore));
+}
+
+static size_t skipWhitespaceSse2(const char* p, size_t i, size_t n) {
+    for (; i + 16 <= n; i += 16) {
+        unsigned outside = ~whitespaceMask16(_mm_loadu_si128((const __m128i*)(p + i))) & 0xFFFF;
+        if (outside) return i + __builtin_ctz(outside);
+    }
+    return skipWhitespaceScalar(p, i, n);
+}
+
+static size_t skipWordSse2(const char* p, size_t i, size_t n) {
+    for (; i + 16 <= n; i += 16) {
+        unsigned outside = ~wordMask16(_mm_loadu_si128((const __m128i*)(p + i))) & 0xFFFF;
+        if (outside) return i + __builtin_ctz(outside);
+    }
+    return skipWordScalar(p, i, n);
+}
+
+static size_t skipDigitsSse2(const char* p, size_t i, size_t n) {
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        unsigned outside = ~(unsigned)_mm_movemask_epi8(inRange16(v, '0', '9')) & 0xFFFF;
+        if (outside) return i + __builtin_ctz(outside);
+    }
+    return skipDigitsScalar(p, i, n);
+}
+
+static size_t findEitherSse2(const char* p, size_t i, size_t n, char a, char b) {
+    __m128i first = _mm_set1_epi8(a), second = _mm_set1_epi8(b);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        unsigned found = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, first), _mm_cmpeq_epi8(v, second)));
+        if (found) return i + __builtin_ctz(found);
+    }
+    return findEitherScalar(p, i, n, a, b);
+}
+
+static const ScanKernels sse2Kernels = {
+    "sse2", skipWhitespaceSse2, skipWordSse2, skipDigitsSse2, findEitherSse2
+};
+
+/* ---- AVX2: 32 bytes per step, compiled for AVX2 and only called where the CPU has it ---- */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i inRange32(__m256i v, char lo, char hi) {
+    __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8((char)(hi - lo))), offset);
+}
+
+static AVX2 size_t skipWhitespaceAvx2(const char* p, size_t i, size_t n) {
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        space = _mm256_or_si256(space, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        unsigned outside = ~(unsigned)_mm256_movemask_epi8(space);
+        if (outside) return i + __builtin_ctz(outside);
+    }
+    return skipWhitespaceSse2(p, i, n);
+}
+
+static AVX2 size_t skipWordAvx2(const char* p, size_t i, size_t n) {
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i letter = inRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        __m256i digitOrUnderscore = _mm256_or_si256(inRange32(v, '0', '9'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        unsigned outside = ~(unsigned)_mm256_movemask_epi8(_mm256_or_si256(letter, digitOrUnderscore));
+        if (outside) return i + __builtin_ctz(outside);
+    }
+    return skipWordSse2(p, i, n);
+}
+
+static AVX2 size_t skipDigitsAvx2(const char* p, size_t i, size_t n) {
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        unsigned outside = ~(unsigned)_mm256_movemask_epi8(inRange32(v, '0', '9'));
+        if (outside) return i + __builtin_ctz(outside);
+    }
+    return skipDigitsSse2(p, i, n);
+}
+
+static AVX2 size_t findEitherAvx2(const char* p, size_t i, size_t n, char a, char b) {
+    __m256i first = _mm256_set1_epi8(a), second = _mm256_set1_epi8(b);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        unsigned found = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, first), _mm256_cmpeq_epi8(v, second)));
+        if (found) return i + __builtin_ctz(found);
+    }
+    return findEitherSse2(p, i, n, a, b);
+}
+
+static const ScanKernels avx2Kernels = {
+    "avx2", skipWhitespaceAvx2, skipWordAvx2, skipDigitsAvx2, findEitherAvx2
+};
+
+static int cpuHasAvx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+static const ScanKernels* kernels;
+static pthread_once_t kernelsChosen = PTHREAD_ONCE_INIT;
+
+static void chooseKernels(void) {
+    if (kernels) return; // Selected explicitly
+#ifdef SIMD_LEXER_X86
+    kernels = cpuHasAvx2() ? &avx2Kernels : &sse2Kernels;
+#else
+    kernels = &scalarKernels;
+#endif
+}
+
+int selectSimdKernel(const char* name) {
+    if (strcmp(name, "scalar") == 0) {
+        kernels = &scalarKernels;
+        return 1;
+    }
+#ifdef SIMD_LEXER_X86
+    if (strcmp(name, "sse2") == 0) {
+        kernels = &sse2Kernels;
+        return 1;
+    }
+    if (strcmp(name, "avx2") == 0 && cpuHasAvx2()) {
+        kernels = &avx2Kernels;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+const char* simdKernelName(void) {
+    pthread_once(&kernelsChosen, chooseKernels);
+    return kernels->name;
+}
+
+/* ---- The scanner ---- */
+
+SimdLexer* createSimdLexer(void) {
+    pthread_once(&kernelsChosen, chooseKernels);
+    SimdLexer* lexer = simCalloc(1, sizeof(SimdLexer), Alloc_Scanner);
+    if (!lexer) return NULL;
+    lexer->input = "";
+    lexer->lineNumber = 1;
+    lexer->text = "";
+    return lexer;
+}
+
+void freeSimdLexer(SimdLexer* lexer) {
+    if (!lexer) return;
+    simFree(lexer->textCopy);
+    simFree(lexer);
+}
+
+void simdLexBytes(SimdLexer* lexer, const char* bytes, size_t length) {
+    lexer->input = bytes;
+    lexer->length = length;
+    lexer->position = 0;
+    lexer->text = "";
+    lexer->textLength = 0;
+}
+
+int simdLexLine(const SimdLexer* lexer) {
+    return lexer->lineNumber;
+}
+
+void simdLexSetLine(SimdLexer* lexer, int lineNumber) {
+    lexer->lineNumber = lineNumber;
+}
+
+const char* simdLexText(SimdLexer* lexer) {
+    if (lexer->textLength + 1 > lexer->textCapacity) {
+        char* grown = simRealloc(lexer->textCopy, lexer->textLength + 1, Alloc_Scanner);
+        if (!grown) return "";
+        lexer->textCopy = grown;
+        lexer->textCapacity = lexer->textLength + 1;
+    }
+    memcpy(lexer->textCopy, lexer->text, lexer->textLength);
+    lexer->textCopy[lexer->textLength] = '\0';
+    return lexer->textCopy;
+}
+
+// The keyword rules come before the identifier rule, so they win at equal length
+static int keywordToken(const char* word, size_t length) {
+    switch (length) {
+    case 2: return memcmp(word, "if", 2) == 0 ? IF : 0;
+    case 3:
+        if (memcmp(word, "int", 3) == 0) return INT;
+        return memcmp(word, "for", 3) == 0 ? FOR : 0;
+    case 4:
+        if (memcmp(word, "main", 4) == 0) return MAIN;
+        if (memcmp(word, "else", 4) == 0) return ELSE;
+        return memcmp(word, "void", 4) == 0 ? VOID : 0;
+    case 5: return memcmp(word, "while", 5) == 0 ? WHILE : 0;
+    case 6:
+        if (memcmp(word, "return", 6) == 0) return RETURN;
+        return memcmp(word, "printf", 6) == 0 ? PRINTF : 0;
+    default: return 0;
+    }
+}
+
+// "extern", "typedef" and "void" followed by blanks and the rest of a declaration up to
+// ';' on the same line: the whole match is dropped. Returns its end, or 0 when there
+// is no such match and the word is an ordinary token.
+static size_t declarationEnd(const char* p, size_t start, size_t end, size_t n) {
+    size_t length = end - start;
+    if (!((length == 6 && memcmp(p + start, "extern", 6) == 0) ||
+          (length == 7 && memcmp(p + start, "typedef", 7) == 0) ||
+          (length == 4 && memcmp(p + start, "void", 4) == 0))) {
+        return 0;
+    }
+    if (end >= n || (p[end] != ' ' && p[end] != '\t')) return 0;
+    size_t stop = kernels->findEither(p, end + 1, n, ';', '\n');
+    return stop < n && p[stop] == ';' ? stop + 1 : 0;
+}
+
+// The first "*/" after the opening "/*"; 0 when the comment never ends
+static size_t blockCommentEnd(const char* p, size_t i, size_t n) {
+    while (i + 1 < n) {
+        const char* star = memchr(p + i, '*', n - i - 1);
+        if (!star) return 0;
+        i = (size_t)(star - p);
+        if (p[i + 1] == '/') return i + 2;
+        i++;
+    }
+    return 0;
+}
+
+// Just past the closing quote, or 0 when the literal is unterminated or a backslash is
+// followed by a newline, which the flex rule cannot match
+static size_t stringEnd(const char* p, size_t i, size_t n) {
+    for (;;) {
+        i = kernels->findEither(p, i, n, '"', '\\');
+        if (i >= n) return 0;
+        if (p[i] == '"') return i + 1;
+        if (i + 1 >= n || p[i + 1] == '\n') return 0;
+        i += 2;
+    }
+}
+
+static size_t lineEnd(const char* p, size_t i, size_t n) {
+    const char* newline = i < n ? memchr(p + i, '\n', n - i) : NULL;
+    return newline ? (size_t)(newline - p) : n;
+}
+
+static int operatorToken(SimdLexer* lexer, size_t start, size_t length, int token) {
+    lexer->text = lexer->input + start;
+    lexer->textLength = length;
+    lexer->position = start + length;
+    fwrite(lexer->text, 1, length, stdout);
+    putchar('\n');
+    return token;
+}
+
+// The flex actions strdup and print yytext, so a string literal holding a NUL byte is
+// cut short there in both its value and the trace
+static int valueToken(SimdLexer* lexer, union YYSTYPE* value, size_t start, size_t end, int token) {
+    lexer->text = lexer->input + start;
+    lexer->textLength = end - start;
+    lexer->position = end;
+    const char* nul = memchr(lexer->text, '\0', lexer->textLength);
+    size_t length = nul ? (size_t)(nul - lexer->text) : lexer->textLength;
+    value->sval = simMalloc(length + 1, Alloc_Token);
+    if (value->sval) {
+        memcpy(value->sval, lexer->text, length);
+        value->sval[length] = '\0';
+    }
+    if (token == STRING_LITERAL) fputs("Token STRING_LITERAL generated: ", stdout);
+    fwrite(lexer->text, 1, length, stdout);
+    putchar('\n');
+    return token;
+}
+
+int simdLex(SimdLexer* lexer, union YYSTYPE* value) {
+    const char* p = lexer->input;
+    size_t n = lexer->length;
+
+    for (;;) {
+        size_t start = lexer->position;
+        if (start >= n) {
+            lexer->text = "";
+            lexer->textLength = 0;
+            return 0;
+        }
+        unsigned char c = (unsigned char)p[start];
+        unsigned char next = start + 1 < n ? (unsigned char)p[start + 1] : '\0';
+        size_t end;
+
+        switch (c) {
+        case ' ': case '\t': case '\n':
+            end = kernels->skipWhitespace(p, start + 1, n);
+            // A lone newline ties with the whitespace rule and the earlier \n rule wins;
+            // newlines inside longer runs are not counted
+            if (c == '\n' && end == start + 1) lexer->lineNumber++;
+            lexer->position = end;
+            continue;
+
+        case '#':
+            lexer->position = lineEnd(p, start + 1, n);
+            continue;
+
+        case '/':
+            if (next == '/') {
+                lexer->position = lineEnd(p, start + 2, n);
+                continue;
+            }
+            if (next == '*' && (end = blockCommentEnd(p, start + 2, n)) != 0) {
+                lexer->position = end;
+                continue;
+            }
+            return operatorToken(lexer, start, 1, DIVIDE);
+
+        case '"':
+            if ((end = stringEnd(p, start + 1, n)) != 0) return valueToken(lexer, value, start, end, STRING_LITERAL);
+            break;
+
+        case '0' ... '9':
+            return valueToken(lexer, value, start, kernels->skipDigits(p, start + 1, n), NUMBER);
+
+        case 'a' ... 'z': case 'A' ... 'Z': case '_': {
+            end = kernels->skipWord(p, start + 1, n);
+            size_t declaration = declarationEnd(p, start, end, n);
+            if (declaration) {
+                lexer->position = declaration;
+                continue;
+            }
+            int keyword = keywordToken(p + start, end - start);
+            if (keyword) return operatorToken(lexer, start, end - start, keyword);
+            return valueToken(lexer, value, start, end, IDENTIFIER);
+        }
+
+        case '+': return next == '+' ? operatorToken(lexer, start, 2, PLUSPLUS) : operatorToken(lexer, start, 1, PLUS);
+        case '-': return next == '-' ? operatorToken(lexer, start, 2, MINUSMINUS) : operatorToken(lexer, start, 1, MINUS);
+        case '=': return next == '=' ? operatorToken(lexer, start, 2, EQ) : operatorToken(lexer, start, 1, ASSIGN);
+        case '!': return next == '=' ? operatorToken(lexer, start, 2, NE) : operatorToken(lexer, start, 1, NOT);
+        case '&': return next == '&' ? operatorToken(lexer, start, 2, AND) : operatorToken(lexer, start, 1, BITAND);
+        case '|': return next == '|' ? operatorToken(lexer, start, 2, OR) : operatorToken(lexer, start, 1, BITOR);
+        case '<':
+            if (next == '=') return operatorToken(lexer, start, 2, LE);
+            if (next == '<') return operatorToken(lexer, start, 2, SHL);
+            return operatorToken(lexer, start, 1, LT);
+        case '>':
+            if (next == '=') return operatorToken(lexer, start, 2, GE);
+            if (next == '>') return operatorToken(lexer, start, 2, SHR);
+            return operatorToken(lexer, start, 1, GT);
+        case '*': return operatorToken(lexer, start, 1, TIMES);
+        case '%': return operatorToken(lexer, start, 1, MOD);
+        case '^': return operatorToken(lexer, start, 1, XOR);
+        case ';': return operatorToken(lexer, start, 1, SEMICOLON);
+        case '(': return operatorToken(lexer, start, 1, LPAREN);
+        case ')': return operatorToken(lexer, start, 1, RPAREN);
+        case '{': return operatorToken(lexer, start, 1, LBRACE);
+        case '}': return operatorToken(lexer, start, 1, RBRACE);
+        case ',': return operatorToken(lexer, start, 1, COMMA);
+        case '[': return operatorToken(lexer, start, 1, LBRACKET);
+        case ']': return operatorToken(lexer, start, 1, RBRACKET);
+        default:
+            break;
+        }
+
+        fprintf(stderr, "Error: Unknown character '%c' at line %d\n", c, lexer->lineNumber);
+        lexer->position = start + 1;
+    }
+}
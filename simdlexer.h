@@ -0,0 +1,48 @@
+#ifndef SIMDLEXER_H
+#define SIMDLEXER_H
+
+#include <stddef.h>
+
+// Hand-written alternative to the flex scanner in lexer.l. It returns the same tokens
+// and semantic values, prints the same token trace and counts lines the same way,
+// quirks included: only a newline standing alone bumps the line number, unterminated
+// strings and comments fall back to single-character tokens, and extern, typedef and
+// void lines up to the first ';' are dropped. Whitespace, comments, preprocessor lines,
+// identifiers and numbers are classified 16 bytes at a time with SSE2, or 32 with AVX2
+// where the CPU has it; other targets use a byte loop.
+
+typedef enum ScannerBackend {
+    Scanner_Flex,
+    Scanner_Simd
+} ScannerBackend;
+
+// Build with -DSIM_DEFAULT_SCANNER=Scanner_Simd (make SCANNER=simd) to make it the default
+#ifndef SIM_DEFAULT_SCANNER
+#define SIM_DEFAULT_SCANNER Scanner_Flex
+#endif
+
+extern ScannerBackend scannerBackend;
+
+// "flex" or "simd"; 0 for an unknown name. Select before anything is parsed.
+int selectScanner(const char* name);
+const char* scannerName(void);
+
+// "avx2", "sse2" or "scalar"; 0 when the CPU or the build lacks it. The best one the
+// CPU supports is used unless another is selected.
+int selectSimdKernel(const char* name);
+const char* simdKernelName(void);
+
+typedef struct SimdLexer SimdLexer;
+union YYSTYPE;
+
+SimdLexer* createSimdLexer(void);
+void freeSimdLexer(SimdLexer* lexer);
+// Scans the bytes in place: they must stay unchanged until the next call. The line
+// number carries over, as with yy_scan_bytes.
+void simdLexBytes(SimdLexer* lexer, const char* bytes, size_t length);
+int simdLex(SimdLexer* lexer, union YYSTYPE* value);  // 0 at the end of the bytes
+int simdLexLine(const SimdLexer* lexer);
+void simdLexSetLine(SimdLexer* lexer, int lineNumber);
+const char* simdLexText(SimdLexer* lexer);            // Text of the last token, like yytext
+
+#endif
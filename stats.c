@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+typedef struct StatsBlock {
+    uint64_t counters[STAT_COUNTER_COUNT];
+    uint64_t phaseNs[PHASE_COUNT];
+    uint64_t phaseCalls[PHASE_COUNT];
+    struct StatsBlock* next;
+} StatsBlock;
+
+int statsEnabled = 0;
+
+static __thread StatsBlock* localBlock;
+static StatsBlock* blocks;  // Every thread's block; kept after the thread exits
+static pthread_mutex_t blocksLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t enabledAt;
+
+static const char* phaseNames[PHASE_COUNT] = {
+    "lex", "parse", "canonicalize", "dependences", "collect",
+    "array_pairs", "functions", "dependence_compare", "cost", "compare"
+};
+
+static const char* counterNames[STAT_COUNTER_COUNT] = {
+    "tokens_lexed", "nodes_created", "child_array_growths", "program_pairs",
+    "declaration_pairs", "access_pairs", "function_pairs", "match_entries", "peak_table_capacity",
+    "shared_nodes", "degraded_pairs", "sampled_pairs"
+};
+
+uint64_t statsClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Set before any worker thread starts; the flag is never cleared
+void enableStats(void) {
+    enabledAt = statsClock();
+    statsEnabled = 1;
+}
+
+static StatsBlock* threadBlock(void) {
+    if (localBlock) return localBlock;
+    StatsBlock* block = calloc(1, sizeof(StatsBlock));
+    if (!block) return NULL; // This thread goes uncounted
+    pthread_mutex_lock(&blocksLock);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocksLock);
+    return localBlock = block;
+}
+
+void statsAdd(StatCounter counter, uint64_t amount) {
+    StatsBlock* block = threadBlock();
+    if (block) block->counters[counter] += amount;
+}
+
+void statsMax(StatCounter counter, uint64_t value) {
+    StatsBlock* block = threadBlock();
+    if (block && value > block->counters[counter]) block->counters[counter] = value;
+}
+
+void statsRecordPhase(StatPhase phase, uint64_t start) {
+    StatsBlock* block = threadBlock();
+    if (!block) return;
+    block->phaseNs[phase] += statsClock() - start;
+    block->phaseCalls[phase]++;
+}
+
+int writeStatsJSON(FILE* output) {
+    StatsBlock total;
+    memset(&total, 0, sizeof(StatsBlock));
+    int threads = 0;
+
+    pthread_mutex_lock(&blocksLock);
+    for (StatsBlock* block = blocks; block; block = block->next, threads++) {
+        for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+            if (c == Stat_PeakTableCapacity) {
+                if (block->counters[c] > total.counters[c]) total.counters[c] = block->counters[c];
+            } else {
+                total.counters[c] += block->counters[c];
+            }
+        }
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            total.phaseNs[p] += block->phaseNs[p];
+            total.phaseCalls[p] += block->phaseCalls[p];
+        }
+    }
+    pthread_mutex_unlock(&blocksLock);
+
+    // Phase times are summed over threads, so with workers they can exceed the wall time
+    fprintf(output, "{\n  \"stats\": {\n    \"threads\": %d,\n    \"wall_ns\": %llu,\n    \"phases\": {\n",
+            threads, statsEnabled ? (unsigned long long)(statsClock() - enabledAt) : 0ULL);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        fprintf(output, "      \"%s\": { \"calls\": %llu, \"ns\": %llu }%s\n", phaseNames[p],
+                (unsigned long long)total.phaseCalls[p], (unsigned long long)total.phaseNs[p],
+                p + 1 < PHASE_COUNT ? "," : "");
+    }
+    fprintf(output, "    },\n    \"counters\": {\n");
+    for (int c = 0; c < STAT_COUNTER_COUNT; c++) {
+        fprintf(output, "      \"%s\": %llu%s\n", counterNames[c], (unsigned long long)total.counters[c],
+                c + 1 < STAT_COUNTER_COUNT ? "," : "");
+    }
+    fprintf(output, "    }\n  }\n}\n");
+    return fflush(output) == 0 && !ferror(output);
+}
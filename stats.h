@@ -0,0 +1,67 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Built-in instrumentation: per-phase monotonic timers and event counters. Every thread
+// counts into its own block; the blocks are merged when the report is written. While
+// stats are off (the default) each probe is a single predictable branch on statsEnabled.
+
+typedef enum StatPhase {
+    Phase_Lex,                // Token-only passes (token stream hashing); lexing inside a parse counts as Parse
+    Phase_Parse,
+    Phase_Canonicalize,
+    Phase_Dependences,        // Building the dependence graph
+    Phase_Collect,            // collectNodesOfType, wherever it is called from
+    Phase_ArrayPairs,         // The declaration and access pair loops of compareASTs
+    Phase_Functions,          // Function matching
+    Phase_DependenceCompare,
+    Phase_Cost,               // Estimating the loop cost profile
+    Phase_Compare,            // Whole program comparisons, including the phases above
+    PHASE_COUNT
+} StatPhase;
+
+typedef enum StatCounter {
+    Stat_TokensLexed,
+    Stat_NodesCreated,
+    Stat_ChildGrowths,        // Reallocations of a children array in addASTChild
+    Stat_ProgramPairs,
+    Stat_DeclarationPairs,
+    Stat_AccessPairs,
+    Stat_FunctionPairs,
+    Stat_MatchEntries,
+    Stat_PeakTableCapacity,   // Merged as a maximum, not a sum
+    Stat_SharedNodes,         // AST nodes replaced by hash-consed ones (--share)
+    Stat_DegradedPairs,       // Program comparisons finished by the cheap tiers (budget.h)
+    Stat_SampledPairs,        // Array pairs scored by approximate comparisons (approximate.h)
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+extern int statsEnabled;
+
+void enableStats(void);
+uint64_t statsClock(void);
+void statsAdd(StatCounter counter, uint64_t amount);
+void statsMax(StatCounter counter, uint64_t value);
+void statsRecordPhase(StatPhase phase, uint64_t start);
+// Merges the blocks of all threads; call once the threads have finished. 0 on an I/O error
+int writeStatsJSON(FILE* output);
+
+static inline void statsCount(StatCounter counter, uint64_t amount) {
+    if (__builtin_expect(statsEnabled, 0)) statsAdd(counter, amount);
+}
+
+static inline void statsPeak(StatCounter counter, uint64_t value) {
+    if (__builtin_expect(statsEnabled, 0)) statsMax(counter, value);
+}
+
+static inline uint64_t statsPhaseStart(void) {
+    return __builtin_expect(statsEnabled, 0) ? statsClock() : 0;
+}
+
+static inline void statsPhaseEnd(StatPhase phase, uint64_t start) {
+    if (__builtin_expect(statsEnabled, 0)) statsRecordPhase(phase, start);
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stride.h"
+
+const char* strideClassName(StrideClass strideClass) {
+    switch (strideClass) {
+        case Stride_Invariant: return "invariant";
+        case Stride_Unit: return "unit stride";
+        case Stride_Row: return "row stride";
+        case Stride_Constant: return "constant stride";
+        case Stride_Irregular: return "irregular";
+        default: return "unknown";
+    }
+}
+
+static const char* displayName(ASTNode* node) {
+    return node->sourceName ? node->sourceName : node->name;
+}
+
+static void classifyAccess(LoopNest* nest, AccessInfo* info, AccessLocality* out) {
+    ASTNode* node = info->node;
+    LoopInfo* inner = info->loop >= 0 ? &nest->loops[info->loop] : NULL;
+
+    out->access = node;
+    out->strideClass = Stride_Irregular;
+    out->strideElements = 0;
+
+    // Without a for loop variable and unit step the walk order is unknown
+    if (!inner || !inner->variable || inner->step == 0 || !node->affine) return;
+    for (int d = 0; d < node->indexCount; d++) {
+        if (!node->affine[d].isAffine) return;
+    }
+
+    // A loop variable that never appears in an index has no slot, so nothing moves
+    int slot = inner->slot;
+    int rowCoefficient = 0, columnCoefficient = 0;
+    if (slot >= 0) {
+        rowCoefficient = node->affine[0].coefficients[slot];
+        columnCoefficient = node->indexCount > 1 ? node->affine[1].coefficients[slot] : 0;
+    }
+
+    if (node->linearAffine && node->linearAffine->isAffine) {
+        out->strideElements = slot >= 0 ? (long)node->linearAffine->coefficients[slot] * inner->step : 0;
+    } else if (node->indexCount == 1) {
+        out->strideElements = (long)rowCoefficient * inner->step;
+    } else if (rowCoefficient == 0) {
+        out->strideElements = (long)columnCoefficient * inner->step;
+    }
+
+    if (rowCoefficient == 0 && columnCoefficient == 0) {
+        out->strideClass = Stride_Invariant;
+    } else if (node->indexCount == 2 && rowCoefficient != 0 && columnCoefficient == 0) {
+        out->strideClass = Stride_Row;
+    } else if (out->strideElements == 1 || out->strideElements == -1) {
+        out->strideClass = Stride_Unit;
+    } else if (out->strideElements != 0) {
+        out->strideClass = Stride_Constant;
+    }
+}
+
+static int footprintOf(const AccessLocality* locality) {
+    long bytes;
+    switch (locality->strideClass) {
+        case Stride_Invariant:
+            return 0;
+        case Stride_Unit:
+            return ELEMENT_BYTES;
+        case Stride_Row:
+        case Stride_Constant:
+            bytes = locality->strideElements < 0 ? -locality->strideElements : locality->strideElements;
+            bytes *= ELEMENT_BYTES;
+            return (bytes == 0 || bytes > CACHE_LINE_BYTES) ? CACHE_LINE_BYTES : (int)bytes;
+        default:
+            return CACHE_LINE_BYTES; // Assume every irregular access misses
+    }
+}
+
+// Reads and writes of the same element in one iteration only bring it in once
+static int isRepeatOfEarlier(LoopNest* nest, int index) {
+    ASTNode* node = nest->accesses[index].node;
+    for (int i = 0; i < index; i++) {
+        ASTNode* earlier = nest->accesses[i].node;
+        if (nest->accesses[i].loop != nest->accesses[index].loop || strcmp(earlier->name, node->name) != 0) continue;
+        if (earlier->indexCount != node->indexCount || !earlier->affine || !node->affine) continue;
+
+        int same = 1;
+        for (int d = 0; d < node->indexCount && same; d++) {
+            same = affineFormsEqual(&earlier->affine[d], &node->affine[d]);
+        }
+        if (same) return 1;
+    }
+    return 0;
+}
+
+LocalityProfile* analyzeLocality(ASTNode* root) {
+    DependenceGraph* graph = analyzeDependences(root);
+    if (!graph) return NULL;
+
+    LocalityProfile* profile = calloc(1, sizeof(LocalityProfile));
+    if (!profile) {
+        fprintf(stderr, "Memory allocation failed for locality profile.\n");
+        return NULL;
+    }
+
+    int total = 0;
+    for (int n = 0; n < graph->nestCount; n++) total += graph->nests[n].accessCount;
+
+    profile->accesses = calloc(total > 0 ? total : 1, sizeof(AccessLocality));
+    profile->nestFootprints = calloc(graph->nestCount > 0 ? graph->nestCount : 1, sizeof(int));
+    if (!profile->accesses || !profile->nestFootprints) {
+        fprintf(stderr, "Memory allocation failed for locality profile entries.\n");
+        freeLocalityProfile(profile);
+        return NULL;
+    }
+    profile->nestCount = graph->nestCount;
+
+    for (int n = 0; n < graph->nestCount; n++) {
+        LoopNest* nest = &graph->nests[n];
+        for (int a = 0; a < nest->accessCount; a++) {
+            AccessLocality* locality = &profile->accesses[profile->accessCount++];
+            locality->nest = n;
+            classifyAccess(nest, &nest->accesses[a], locality);
+            locality->footprintBytes = isRepeatOfEarlier(nest, a) ? 0 : footprintOf(locality);
+
+            profile->counts[locality->strideClass]++;
+            profile->nestFootprints[n] += locality->footprintBytes;
+        }
+        profile->footprintBytes += profile->nestFootprints[n];
+    }
+
+    fprintf(stderr, "Log: Classified %d array accesses, footprint %d bytes per iteration.\n",
+            profile->accessCount, profile->footprintBytes);
+    return profile;
+}
+
+void freeLocalityProfile(LocalityProfile* profile) {
+    if (!profile) return;
+    free(profile->accesses);
+    free(profile->nestFootprints);
+    free(profile);
+}
+
+void printLocalityComparison(const char* name1, LocalityProfile* profile1, const char* name2, LocalityProfile* profile2) {
+    if (!profile1 || !profile2) {
+        printf("Locality report unavailable.\n");
+        return;
+    }
+
+    printf("Memory access locality (%s vs %s):\n", name1, name2);
+    for (int c = 0; c < STRIDE_CLASS_COUNT; c++) {
+        printf("  %-16s %4d %4d%s\n", strideClassName((StrideClass)c), profile1->counts[c], profile2->counts[c],
+               profile1->counts[c] != profile2->counts[c] ? "  <- differs" : "");
+    }
+    printf("  %-16s %4d %4d bytes per innermost iteration\n", "footprint", profile1->footprintBytes, profile2->footprintBytes);
+
+    // Access-level differences for nests paired in source order
+    int nests = min(profile1->nestCount, profile2->nestCount);
+    int a1 = 0, a2 = 0;
+    for (int n = 0; n < nests; n++) {
+        int start1 = a1, start2 = a2;
+        while (a1 < profile1->accessCount && profile1->accesses[a1].nest == n) a1++;
+        while (a2 < profile2->accessCount && profile2->accesses[a2].nest == n) a2++;
+
+        int paired = min(a1 - start1, a2 - start2);
+        for (int i = 0; i < paired; i++) {
+            AccessLocality* l1 = &profile1->accesses[start1 + i];
+            AccessLocality* l2 = &profile2->accesses[start2 + i];
+            if (l1->strideClass != l2->strideClass) {
+                printf("  nest %d: %s is %s in %s but %s in %s\n", n + 1, displayName(l1->access),
+                       strideClassName(l1->strideClass), name1, strideClassName(l2->strideClass), name2);
+            }
+        }
+        if (profile1->nestFootprints[n] != profile2->nestFootprints[n]) {
+            printf("  nest %d: footprint %d vs %d bytes per iteration\n", n + 1,
+                   profile1->nestFootprints[n], profile2->nestFootprints[n]);
+        }
+    }
+    if (profile1->nestCount != profile2->nestCount) {
+        printf("  loop nests: %d vs %d\n", profile1->nestCount, profile2->nestCount);
+    }
+}
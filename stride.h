@@ -0,0 +1,42 @@
+#ifndef STRIDE_H
+#define STRIDE_H
+
+#include "ast.h"
+#include "dependence.h"
+
+#define CACHE_LINE_BYTES 64
+#define ELEMENT_BYTES 4    // Every array in the grammar is int
+
+// How an access moves through memory along its innermost enclosing loop
+typedef enum StrideClass {
+    Stride_Invariant,  // Same element on every iteration
+    Stride_Unit,       // Consecutive elements
+    Stride_Row,        // One row per iteration: a column-major walk over a row-major array
+    Stride_Constant,   // Any other fixed distance
+    Stride_Irregular,  // Non-affine or unknown
+    STRIDE_CLASS_COUNT
+} StrideClass;
+
+typedef struct AccessLocality {
+    ASTNode* access;
+    int nest;              // Index of the loop nest in the dependence graph
+    StrideClass strideClass;
+    long strideElements;   // Distance in elements per iteration, when known
+    int footprintBytes;    // Estimated new bytes touched per innermost iteration
+} AccessLocality;
+
+typedef struct LocalityProfile {
+    AccessLocality* accesses;
+    int accessCount;
+    int counts[STRIDE_CLASS_COUNT];
+    int* nestFootprints;   // Bytes per innermost iteration, per nest
+    int nestCount;
+    int footprintBytes;    // Sum over nests
+} LocalityProfile;
+
+LocalityProfile* analyzeLocality(ASTNode* root);
+void freeLocalityProfile(LocalityProfile* profile);
+const char* strideClassName(StrideClass strideClass);
+void printLocalityComparison(const char* name1, LocalityProfile* profile1, const char* name2, LocalityProfile* profile2);
+
+#endif
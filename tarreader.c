@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tarreader.h"
+
+struct TarArchive {
+    char* name;
+    int fd;
+    int ownsFd;
+
+    // Mapped archive
+    const char* mapping;
+    size_t mappedBytes, offset;
+
+    // Streamed archive: bytes of the current header or member
+    char* buffer;
+    size_t capacity;
+
+    char* path;         // Path of the current member
+    char* longName;     // From a GNU 'L' or pax header, for the next member only
+    long long paxSize;  // From a pax header, for the next member only; -1 when unset
+};
+
+static unsigned long long parseNumber(const char* field, size_t length) {
+    // GNU base-256 for sizes that do not fit in octal
+    if ((unsigned char)field[0] & 0x80) {
+        unsigned long long result = (unsigned char)field[0] & 0x7F;
+        for (size_t i = 1; i < length; i++) result = (result << 8) | (unsigned char)field[i];
+        return result;
+    }
+    unsigned long long result = 0;
+    size_t i = 0;
+    while (i < length && field[i] == ' ') i++;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) result = result * 8 + (field[i] - '0');
+    return result;
+}
+
+static int checksumMatches(const unsigned char* header) {
+    unsigned long long stored = parseNumber((const char*)header + 148, 8);
+    unsigned long sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) sum += (i >= 148 && i < 156) ? ' ' : header[i];
+    return sum == stored;
+}
+
+static int isZeroBlock(const char* block) {
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        if (block[i]) return 0;
+    }
+    return 1;
+}
+
+static size_t paddedSize(unsigned long long size) {
+    return (size_t)((size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE);
+}
+
+// Returns the next length bytes of the archive, or NULL at a short read. For a streamed
+// archive the bytes are only valid until the next call.
+static const char* readArchive(TarArchive* archive, size_t length) {
+    if (archive->mapping) {
+        if (archive->mappedBytes - archive->offset < length) return NULL;
+        const char* bytes = archive->mapping + archive->offset;
+        archive->offset += length;
+        return bytes;
+    }
+
+    if (length > archive->capacity) {
+        char* grown = realloc(archive->buffer, length);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed while reading %s.\n", archive->name);
+            return NULL;
+        }
+        archive->buffer = grown;
+        archive->capacity = length;
+    }
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = read(archive->fd, archive->buffer + done, length - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return NULL;
+        done += n;
+    }
+    return archive->buffer;
+}
+
+static int skipArchive(TarArchive* archive, size_t length) {
+    if (archive->mapping) return readArchive(archive, length) != NULL;
+    while (length > 0) {
+        size_t step = length < 65536 ? length : 65536;
+        if (!readArchive(archive, step)) return 0;
+        length -= step;
+    }
+    return 1;
+}
+
+static void replaceString(char** target, const char* text, size_t length) {
+    free(*target);
+    *target = malloc(length + 1);
+    if (*target) {
+        memcpy(*target, text, length);
+        (*target)[length] = '\0';
+    }
+}
+
+// Records are "<length> <key>=<value>\n"; only path and size matter here
+static void parsePaxHeader(TarArchive* archive, const char* data, size_t size) {
+    size_t offset = 0;
+    while (offset < size) {
+        char* end;
+        unsigned long recordLength = strtoul(data + offset, &end, 10);
+        if (recordLength == 0 || recordLength > size - offset || *end != ' ') return;
+        const char* key = end + 1;
+        const char* recordEnd = data + offset + recordLength - 1; // The trailing newline
+        if (key > recordEnd) return; // The length does not even cover its own digits
+        const char* equals = memchr(key, '=', recordEnd - key);
+        if (equals) {
+            const char* value = equals + 1;
+            if ((size_t)(equals - key) == 4 && memcmp(key, "path", 4) == 0) {
+                replaceString(&archive->longName, value, recordEnd - value);
+            } else if ((size_t)(equals - key) == 4 && memcmp(key, "size", 4) == 0) {
+                archive->paxSize = strtoll(value, NULL, 10);
+            }
+        }
+        offset += recordLength;
+    }
+}
+
+TarArchive* openTarArchive(const char* path) {
+    TarArchive* archive = calloc(1, sizeof(TarArchive));
+    if (!archive || !(archive->name = strdup(path))) {
+        fprintf(stderr, "Memory allocation failed for tar archive.\n");
+        free(archive);
+        return NULL;
+    }
+    archive->paxSize = -1;
+
+    if (strcmp(path, "-") == 0) {
+        archive->fd = STDIN_FILENO;
+    } else {
+        archive->fd = open(path, O_RDONLY);
+        archive->ownsFd = 1;
+        if (archive->fd < 0) {
+            perror("File opening error");
+            free(archive->name);
+            free(archive);
+            return NULL;
+        }
+    }
+
+    struct stat info;
+    if (fstat(archive->fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, archive->fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, (size_t)info.st_size, MADV_SEQUENTIAL);
+            archive->mapping = mapping;
+            archive->mappedBytes = (size_t)info.st_size;
+        }
+    }
+    fprintf(stderr, "Log: Reading tar archive %s (%s).\n", path, archive->mapping ? "mapped" : "streamed");
+    return archive;
+}
+
+int nextTarMember(TarArchive* archive, TarMember* member) {
+    for (;;) {
+        const char* header = readArchive(archive, TAR_BLOCK_SIZE);
+        if (!header || isZeroBlock(header)) return 0; // End of archive; a missing trailer is tolerated
+        if (!checksumMatches((const unsigned char*)header)) {
+            fprintf(stderr, "Error: Bad tar header checksum in %s.\n", archive->name);
+            return -1;
+        }
+
+        unsigned long long size = parseNumber(header + 124, 12);
+        char type = header[156];
+
+        // Name: a pending long name wins, else ustar prefix/name
+        char name[256 + 1];
+        if (memcmp(header + 257, "ustar", 5) == 0 && header[345]) {
+            snprintf(name, sizeof(name), "%.155s/%.100s", header + 345, header);
+        } else {
+            snprintf(name, sizeof(name), "%.100s", header);
+        }
+
+        if (type == 'L' || type == 'x' || type == 'g') {
+            if (size > TAR_MAX_MEMBER) return -1;
+            const char* data = readArchive(archive, paddedSize(size));
+            if (!data) return -1;
+            if (type == 'L') replaceString(&archive->longName, data, strnlen(data, (size_t)size));
+            else if (type == 'x') parsePaxHeader(archive, data, (size_t)size);
+            continue;
+        }
+
+        if (archive->paxSize >= 0) size = (unsigned long long)archive->paxSize;
+        const char* path = archive->longName ? archive->longName : name;
+        replaceString(&archive->path, path, strlen(path));
+        free(archive->longName);
+        archive->longName = NULL;
+        archive->paxSize = -1;
+
+        int regular = type == '0' || type == '\0' || type == '7';
+        if (!regular || size > TAR_MAX_MEMBER) {
+            if (regular) fprintf(stderr, "Log: Skipping %s in %s: %llu bytes.\n", archive->path, archive->name, size);
+            if (!skipArchive(archive, paddedSize(size))) return -1;
+            continue;
+        }
+
+        const char* data = readArchive(archive, paddedSize(size));
+        if (!data || !archive->path) return -1;
+        member->path = archive->path;
+        member->data = data;
+        member->size = (size_t)size;
+        member->persistent = archive->mapping != NULL;
+        return 1;
+    }
+}
+
+void closeTarArchive(TarArchive* archive) {
+    if (!archive) return;
+    if (archive->mapping) munmap((void*)archive->mapping, archive->mappedBytes);
+    if (archive->ownsFd) close(archive->fd);
+    free(archive->buffer);
+    free(archive->path);
+    free(archive->longName);
+    free(archive->name);
+    free(archive);
+}
@@ -0,0 +1,27 @@
+#ifndef TARREADER_H
+#define TARREADER_H
+
+#include <stddef.h>
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_MAX_MEMBER (64 * 1024 * 1024)  // Larger members are skipped
+
+// Reads submission archives without extracting them. Understands ustar (with the
+// name prefix), GNU long names and pax extended headers. A regular file is mapped
+// and members point into the mapping; anything else (a pipe, "-" for stdin) is read
+// as a stream, one member at a time.
+typedef struct TarArchive TarArchive;
+
+typedef struct TarMember {
+    const char* path;   // Full member path, valid until the next call
+    const char* data;
+    size_t size;
+    int persistent;     // data stays valid until closeTarArchive (mapped archives)
+} TarMember;
+
+TarArchive* openTarArchive(const char* path);
+// Fills *member with the next regular file: 1 for a member, 0 at the end, -1 on a corrupt archive
+int nextTarMember(TarArchive* archive, TarMember* member);
+void closeTarArchive(TarArchive* archive);
+
+#endif
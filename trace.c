@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trace.h"
+
+#define TRACE_INITIAL_EVENTS 256
+
+typedef struct TraceEvent {
+    const char* name;
+    const char* category;
+    uint64_t start;
+    uint64_t duration;
+    char* first;   // File of a parse span, reference of a compare span
+    char* second;  // Submission of a compare span
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    TraceEvent* events;
+    int count;
+    int capacity;
+    int tid;                 // Small sequential id, in order of each thread's first event
+    const char* threadName;
+    struct TraceBuffer* next;
+} TraceBuffer;
+
+int traceEnabled = 0;
+
+static __thread TraceBuffer* localBuffer;
+static TraceBuffer* buffers;  // Every thread's buffer; kept after the thread exits
+static pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+static int nextTid = 1;
+static uint64_t enabledAt;
+
+// Set before any worker thread starts; the flag is never cleared
+void enableTrace(void) {
+    enabledAt = statsClock();
+    traceEnabled = 1;
+}
+
+static TraceBuffer* threadBuffer(void) {
+    if (localBuffer) return localBuffer;
+    TraceBuffer* buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer) return NULL; // This thread goes untraced
+    pthread_mutex_lock(&buffersLock);
+    buffer->tid = nextTid++;
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffersLock);
+    return localBuffer = buffer;
+}
+
+void traceNameThread(const char* name) {
+    if (!traceEnabled) return;
+    TraceBuffer* buffer = threadBuffer();
+    if (buffer) buffer->threadName = name;
+}
+
+void traceRecordSpan(const char* name, const char* category, uint64_t start, const char* first, const char* second) {
+    uint64_t end = statsClock();
+    TraceBuffer* buffer = threadBuffer();
+    if (!buffer) return;
+
+    if (buffer->count == buffer->capacity) {
+        int capacity = buffer->capacity ? buffer->capacity * 2 : TRACE_INITIAL_EVENTS;
+        TraceEvent* events = realloc(buffer->events, sizeof(TraceEvent) * capacity);
+        if (!events) return; // The span is dropped, the rest of the trace stays valid
+        buffer->events = events;
+        buffer->capacity = capacity;
+    }
+
+    TraceEvent* event = &buffer->events[buffer->count++];
+    event->name = name;
+    event->category = category;
+    event->start = start;
+    event->duration = end - start;
+    event->first = first ? strdup(first) : NULL;
+    event->second = second ? strdup(second) : NULL;
+}
+
+static void writeJSONString(FILE* output, const char* text) {
+    fputc('"', output);
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(output, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(output, "\\u%04x", *c);
+        } else {
+            fputc(*c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+// Microseconds since tracing was enabled, the unit of the trace-event format
+static double traceMicros(uint64_t ns) {
+    return ns / 1000.0;
+}
+
+int writeTraceJSON(FILE* output) {
+    int pid = (int)getpid();
+    int written = 0;
+
+    fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&buffersLock);
+    for (TraceBuffer* buffer = buffers; buffer; buffer = buffer->next) {
+        if (buffer->threadName) {
+            fprintf(output, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                    written++ ? ",\n" : "", pid, buffer->tid);
+            writeJSONString(output, buffer->threadName);
+            fprintf(output, "}}");
+        }
+        for (int i = 0; i < buffer->count; i++) {
+            TraceEvent* event = &buffer->events[i];
+            fprintf(output, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                    written++ ? ",\n" : "", event->name, event->category,
+                    traceMicros(event->start - enabledAt), traceMicros(event->duration), pid, buffer->tid);
+            if (event->first) {
+                fprintf(output, ",\"args\":{\"%s\":", event->second ? "reference" : "file");
+                writeJSONString(output, event->first);
+                if (event->second) {
+                    fprintf(output, ",\"submission\":");
+                    writeJSONString(output, event->second);
+                }
+                fputc('}', output);
+            }
+            fputc('}', output);
+        }
+    }
+    pthread_mutex_unlock(&buffersLock);
+    fprintf(output, "\n]}\n");
+    return fflush(output) == 0 && !ferror(output);
+}
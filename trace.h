@@ -0,0 +1,33 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "stats.h"
+
+// Span tracing in the Chrome trace-event format (load the file in Perfetto or
+// chrome://tracing). Every thread appends to its own buffer without locking; the
+// buffers are only walked when the trace is written, after the workers are done.
+// While tracing is off each probe is a single predictable branch on traceEnabled.
+
+extern int traceEnabled;
+
+void enableTrace(void);
+// Label shown for the calling thread's track, e.g. "parser"; the string must outlive the trace
+void traceNameThread(const char* name);
+// Records a complete span from start to now. name and category must be string literals;
+// first and second are copied and shown as the span's file, or reference and submission.
+void traceRecordSpan(const char* name, const char* category, uint64_t start, const char* first, const char* second);
+// Writes every thread's events; 0 on an I/O error
+int writeTraceJSON(FILE* output);
+
+static inline uint64_t traceSpanStart(void) {
+    return __builtin_expect(traceEnabled, 0) ? statsClock() : 0;
+}
+
+static inline void traceSpanEnd(const char* name, const char* category, uint64_t start,
+                                const char* first, const char* second) {
+    if (__builtin_expect(traceEnabled, 0)) traceRecordSpan(name, category, start, first, second);
+}
+
+#endif